@@ -0,0 +1,217 @@
+/**********************************************************
+ * File: AdaptiveHuffman.cpp
+ *
+ * Implementation of the adaptive Huffman codec from
+ * AdaptiveHuffman.h.
+ */
+
+#include "AdaptiveHuffman.h"
+#include "MemoryDiagnostics.h"
+#include "OutputBuffer.h"
+#include "error.h"
+
+/* Constructor: AdaptiveHuffmanTree
+ * ----------------------------------------------------
+ * Starts with a tree holding only the NYT leaf, whose code is
+ * empty.
+ */
+AdaptiveHuffmanTree::AdaptiveHuffmanTree() : numNodes(0) {
+	for (int ch = 0; ch < NUM_SYMBOLS; ch++) {
+		leaf[ch] = NULL;
+	}
+	nyt = newNode(NOT_A_CHAR);
+	parent[0] = NULL;
+}
+
+/* Member function: root
+ * ----------------------------------------------------
+ * The root always has rank 0.
+ */
+Node* AdaptiveHuffmanTree::root() {
+	return byRank[0];
+}
+
+/* Member function: newNode
+ * ----------------------------------------------------
+ * Returns a leaf of weight zero for character, ranked below every
+ * existing node.
+ */
+Node* AdaptiveHuffmanTree::newNode(ext_char character) {
+	Node* node = &nodes[numNodes];
+	node->character = character;
+	node->zero = node->one = NULL;
+	node->weight = 0;
+	rank[numNodes] = numNodes;
+	byRank[numNodes] = node;
+	numNodes++;
+	return node;
+}
+
+/* Member function: writeCode
+ * ----------------------------------------------------
+ * Writes the path from the root to leaf.  The path is found from
+ * the bottom up, so it is collected first and then written in
+ * 64-bit pieces from the top down.
+ */
+void AdaptiveHuffmanTree::writeCode(obstream& outfile, Node* leaf) {
+	int path[2 * NUM_SYMBOLS];
+	int depth = 0;
+	for (Node* curr = leaf; parent[curr - nodes] != NULL; curr = parent[curr - nodes]) {
+		path[depth++] = (parent[curr - nodes]->one == curr ? 1 : 0);
+	}
+
+	while (depth > 0) {
+		uint64_t bits = 0;
+		int count = 0;
+		while (depth > 0 && count < 64) {
+			bits |= uint64_t(path[--depth]) << count;
+			count++;
+		}
+		outfile.writeBits(bits, count);
+	}
+}
+
+/* Member function: encode
+ * ----------------------------------------------------
+ * Characters already in the tree are sent as their leaf's code;
+ * new ones, and PSEUDO_EOF, as the NYT code and nine raw bits.
+ */
+void AdaptiveHuffmanTree::encode(obstream& outfile, ext_char ch) {
+	if (ch < 0 || ch > PSEUDO_EOF) error("Only bytes and PSEUDO_EOF can be encoded.");
+
+	if (leaf[ch] != NULL) {
+		writeCode(outfile, leaf[ch]);
+	} else {
+		writeCode(outfile, nyt);
+		outfile.writeBits(uint64_t(ch), ADAPTIVE_SYMBOL_BITS);
+	}
+
+	if (ch != PSEUDO_EOF) update(ch);
+}
+
+/* Member function: decode
+ * ----------------------------------------------------
+ * Walks down from the root one bit at a time to a leaf, reading
+ * the nine raw bits if the leaf is NYT.
+ */
+ext_char AdaptiveHuffmanTree::decode(ibstream& infile) {
+	Node* curr = root();
+	while (curr->zero != NULL) {
+		curr = (infile.readBits(1) != 0 ? curr->one : curr->zero);
+	}
+
+	ext_char ch = curr->character;
+	if (curr == nyt) ch = ext_char(infile.readBits(ADAPTIVE_SYMBOL_BITS));
+	if (infile.fail()) error("Encoded data ended before PSEUDO_EOF.");
+	if (ch > PSEUDO_EOF || (curr == nyt && leaf[ch] != NULL)) error("Damaged adaptive data.");
+
+	if (ch != PSEUDO_EOF) update(ch);
+	return ch;
+}
+
+/* Member function: update
+ * ----------------------------------------------------
+ * Adds one to the weight of ch's leaf and every node above it.  A
+ * new character first splits NYT into a new NYT and a leaf for
+ * ch.  Before each node's weight goes up, it trades places with
+ * the highest ranked node of the same weight (unless that is its
+ * parent), which keeps the sibling property.
+ */
+void AdaptiveHuffmanTree::update(ext_char ch) {
+	Node* curr = leaf[ch];
+	if (curr == NULL) {
+		Node* oldNyt = nyt;
+		oldNyt->one = leaf[ch] = newNode(ch);
+		oldNyt->zero = nyt = newNode(NOT_A_CHAR);
+		parent[oldNyt->one - nodes] = oldNyt;
+		parent[oldNyt->zero - nodes] = oldNyt;
+		curr = leaf[ch];
+	}
+
+	while (curr != NULL) {
+		int index = int(curr - nodes);
+		int leaderRank = rank[index];
+		while (leaderRank > 0 && byRank[leaderRank - 1]->weight == curr->weight) {
+			leaderRank--;
+		}
+
+		Node* leader = byRank[leaderRank];
+		if (leader != curr && leader != parent[index]) swapNodes(curr, leader);
+
+		curr->weight++;
+		curr = parent[curr - nodes];
+	}
+}
+
+/* Member function: swapNodes
+ * ----------------------------------------------------
+ * Exchanges the places of two nodes, and so of their subtrees, in
+ * the tree and in the ranking.  Neither may be above the other.
+ */
+void AdaptiveHuffmanTree::swapNodes(Node* one, Node* two) {
+	int oneIndex = int(one - nodes), twoIndex = int(two - nodes);
+	Node* oneParent = parent[oneIndex];
+	Node* twoParent = parent[twoIndex];
+
+	Node*& oneSlot = (oneParent->zero == one ? oneParent->zero : oneParent->one);
+	Node*& twoSlot = (twoParent->zero == two ? twoParent->zero : twoParent->one);
+	oneSlot = two;
+	twoSlot = one;
+	parent[oneIndex] = twoParent;
+	parent[twoIndex] = oneParent;
+
+	int oneRank = rank[oneIndex];
+	rank[oneIndex] = rank[twoIndex];
+	rank[twoIndex] = oneRank;
+	byRank[rank[oneIndex]] = one;
+	byRank[rank[twoIndex]] = two;
+}
+
+/* Function: encodeAdaptive
+ * Usage: encodeAdaptive(infile, outfile);
+ * --------------------------------------------------------
+ * Encodes infile, from its current position to its end, with an
+ * adaptive Huffman code, finishing with PSEUDO_EOF.
+ */
+void encodeAdaptive(istream& infile, obstream& outfile) {
+	MemoryCategoryScope scope(CODING_MEMORY);
+	AdaptiveHuffmanTree tree;
+	streambuf* source = infile.rdbuf();
+	char buffer[4096];
+
+	bool wasBuffering = outfile.isBitBuffering();
+	outfile.setBitBuffering(true);
+	while (true) {
+		streamsize count = source->sgetn(buffer, sizeof buffer);
+		if (count <= 0) break;
+
+		for (streamsize i = 0; i < count; i++) {
+			tree.encode(outfile, (unsigned char)buffer[i]);
+		}
+	}
+
+	tree.encode(outfile, PSEUDO_EOF);
+	outfile.flushBits();
+	outfile.setBitBuffering(wasBuffering);
+}
+
+/* Function: decodeAdaptive
+ * Usage: decodeAdaptive(infile, outfile);
+ * --------------------------------------------------------
+ * Decodes data written by encodeAdaptive.
+ */
+void decodeAdaptive(ibstream& infile, ostream& outfile) {
+	MemoryCategoryScope scope(CODING_MEMORY);
+	AdaptiveHuffmanTree tree;
+
+	bool wasBuffering = infile.isBitBuffering();
+	infile.setBitBuffering(true);
+	OutputBuffer output(outfile);
+	while (true) {
+		ext_char ch = tree.decode(infile);
+		if (ch == PSEUDO_EOF) break;
+		output.put(char(ch));
+	}
+	output.flush();
+	infile.setBitBuffering(wasBuffering);
+}
@@ -0,0 +1,103 @@
+/**********************************************************
+ * File: AdaptiveHuffman.h
+ *
+ * An adaptive Huffman codec using the FGK algorithm.  Encoder
+ * and decoder start from the same empty tree and update it
+ * the same way after every character, so no frequency table
+ * is stored and the input is read only once.  Each character
+ * is written as soon as it is read, which suits short
+ * interactive messages that cannot wait for a whole block.
+ *
+ * A character seen for the first time is written as the code
+ * of the "not yet transmitted" (NYT) leaf followed by its
+ * value in nine bits.  The end of the data is PSEUDO_EOF sent
+ * the same way.
+ */
+
+#ifndef AdaptiveHuffman_Included
+#define AdaptiveHuffman_Included
+
+#include "HuffmanTypes.h"
+#include "HuffmanTables.h"
+#include "bstream.h"
+
+/* Constant: ADAPTIVE_SYMBOL_BITS
+ * The number of bits used to send a character not yet in the tree.
+ */
+const int ADAPTIVE_SYMBOL_BITS = 9;
+
+/* Class: AdaptiveHuffmanTree
+ * The code tree of an adaptive encoder or decoder, which changes
+ * after every character.  The tree keeps the FGK sibling
+ * property: listing the nodes by rank, root first, gives weights
+ * that never increase, with siblings next to each other.
+ *
+ * One tree encodes or decodes one stream; use a fresh tree for
+ * each stream.  The tree is large, so it should not be copied.
+ */
+class AdaptiveHuffmanTree {
+public:
+	AdaptiveHuffmanTree();
+
+	/* Member function: encode
+	 * Usage: tree.encode(outfile, ch);
+	 * ----------------------------------------------------
+	 * Writes the code of ch (a byte value or PSEUDO_EOF) to
+	 * outfile, then updates the tree.
+	 */
+	void encode(obstream& outfile, ext_char ch);
+
+	/* Member function: decode
+	 * Usage: ext_char ch = tree.decode(infile);
+	 * ----------------------------------------------------
+	 * Reads one code from infile, updates the tree, and returns the
+	 * character, which is PSEUDO_EOF at the end of the data.  Raises
+	 * an error if the data ends in the middle of a code.
+	 */
+	ext_char decode(ibstream& infile);
+
+	/* Member function: root
+	 * Usage: Node* root = tree.root();
+	 * ----------------------------------------------------
+	 * Returns the root of the current tree.  The NYT leaf is the one
+	 * whose character is NOT_A_CHAR.
+	 */
+	Node* root();
+
+private:
+	/* Not copyable, since the nodes point at each other. */
+	AdaptiveHuffmanTree(const AdaptiveHuffmanTree&);
+	AdaptiveHuffmanTree& operator=(const AdaptiveHuffmanTree&);
+
+	Node* newNode(ext_char character);
+	void writeCode(obstream& outfile, Node* leaf);
+	void update(ext_char ch);
+	void swapNodes(Node* one, Node* two);
+
+	Node nodes[2 * NUM_SYMBOLS];
+	int numNodes;
+	Node* parent[2 * NUM_SYMBOLS];   /* by node index */
+	int rank[2 * NUM_SYMBOLS];       /* by node index; the root is 0 */
+	Node* byRank[2 * NUM_SYMBOLS];
+	Node* leaf[NUM_SYMBOLS];         /* by character, NULL if unseen */
+	Node* nyt;
+};
+
+/* Function: encodeAdaptive
+ * Usage: encodeAdaptive(infile, outfile);
+ * --------------------------------------------------------
+ * Encodes infile, from its current position to its end, with an
+ * adaptive Huffman code, finishing with PSEUDO_EOF and padding
+ * to a whole byte.
+ */
+void encodeAdaptive(istream& infile, obstream& outfile);
+
+/* Function: decodeAdaptive
+ * Usage: decodeAdaptive(infile, outfile);
+ * --------------------------------------------------------
+ * Decodes data written by encodeAdaptive.  Raises an error if the
+ * data ends before PSEUDO_EOF.
+ */
+void decodeAdaptive(ibstream& infile, ostream& outfile);
+
+#endif
@@ -0,0 +1,225 @@
+/**********************************************************
+ * File: CodePacker.cpp
+ *
+ * Implementation of the CodePacker class from CodePacker.h.
+ */
+
+#include "CodePacker.h"
+#include "error.h"
+#include <cstring>
+
+#if (defined(__GNUC__) || defined(__clang__)) && defined(__x86_64__)
+#include <immintrin.h>
+#define VECTOR_PACKER
+#define VECTOR_TARGET __attribute__((target("avx2")))
+#elif defined(_MSC_VER) && _MSC_VER >= 1700 && defined(_M_X64)
+#include <immintrin.h>
+#include <intrin.h>
+#define VECTOR_PACKER
+#define VECTOR_TARGET
+#endif
+
+#ifdef VECTOR_PACKER
+
+/*
+	Asks the processor, and for the wider registers the system too,
+	whether AVX2 can be used
+*/
+static bool detectVectors() {
+#if defined(_MSC_VER)
+	int info[4];
+	__cpuid(info, 1);
+	bool osSaves = (info[2] & (1 << 27)) != 0 && (info[2] & (1 << 28)) != 0 && (_xgetbv(0) & 6) == 6;
+	__cpuidex(info, 7, 0);
+	return osSaves && (info[1] & (1 << 5)) != 0;
+#else
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2") != 0;
+#endif
+}
+
+/*
+	Adds the n bits of code to the register and stores its whole
+	bytes with one unaligned 8-byte write; bitCount is below 8
+	before and after, and n is at most 4 * MAX_VECTOR_CODE_LENGTH
+*/
+static inline void insertBits(uint64_t code, int n, uint8_t* out, size_t& pos,
+                              uint64_t& bitBuffer, int& bitCount) {
+	bitBuffer |= code << bitCount;
+	bitCount += n;
+	memcpy(out + pos, &bitBuffer, sizeof bitBuffer);
+	pos += size_t(bitCount >> 3);
+	bitBuffer >>= (bitCount & ~7);
+	bitCount &= 7;
+}
+
+/*
+	Packs eight bytes at a time while there is room for the 8-byte
+	stores, and returns the number of bytes written; done is set to
+	the number of input bytes used.  Each gathered entry holds a
+	code in its low 16 bits and its length above, and every 64-bit
+	lane starts out holding two of them.
+*/
+VECTOR_TARGET static size_t vectorPack(const uint32_t* entries, const uint8_t* data, size_t length,
+                                       uint8_t* out, size_t room, uint64_t& bitBuffer, int& bitCount,
+                                       size_t& done) {
+	const __m256i low16 = _mm256_set1_epi64x(0xFFFF);
+	const __m256i low8 = _mm256_set1_epi64x(0xFF);
+	size_t pos = 0;
+	size_t i = 0;
+
+	//eight codes are at most 12 bytes, written as two 8-byte stores
+	for (; i + 8 <= length && pos + 24 <= room; i += 8) {
+		__m256i index = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(data + i)));
+		__m256i entry = _mm256_i32gather_epi32((const int*)entries, index, 4);
+
+		//join the two codes in each 64-bit lane
+		__m256i evenCode = _mm256_and_si256(entry, low16);
+		__m256i evenLength = _mm256_and_si256(_mm256_srli_epi64(entry, 16), low8);
+		__m256i oddCode = _mm256_and_si256(_mm256_srli_epi64(entry, 32), low16);
+		__m256i oddLength = _mm256_srli_epi64(entry, 48);
+		__m256i pair = _mm256_or_si256(evenCode, _mm256_sllv_epi64(oddCode, evenLength));
+		__m256i pairLength = _mm256_add_epi64(evenLength, oddLength);
+
+		//then each pair with the pair above it in its 128-bit half
+		__m256i upper = _mm256_srli_si256(pair, 8);
+		__m256i upperLength = _mm256_srli_si256(pairLength, 8);
+		__m256i quad = _mm256_or_si256(pair, _mm256_sllv_epi64(upper, pairLength));
+		__m256i quadLength = _mm256_add_epi64(pairLength, upperLength);
+
+		__m128i first = _mm256_castsi256_si128(quad);
+		__m128i second = _mm256_extracti128_si256(quad, 1);
+		__m128i firstLength = _mm256_castsi256_si128(quadLength);
+		__m128i secondLength = _mm256_extracti128_si256(quadLength, 1);
+		insertBits(uint64_t(_mm_cvtsi128_si64(first)), int(_mm_cvtsi128_si64(firstLength)),
+		           out, pos, bitBuffer, bitCount);
+		insertBits(uint64_t(_mm_cvtsi128_si64(second)), int(_mm_cvtsi128_si64(secondLength)),
+		           out, pos, bitBuffer, bitCount);
+	}
+	done = i;
+	return pos;
+}
+
+#else
+
+static bool detectVectors() {
+	return false;
+}
+
+#endif
+
+static const bool vectorsAvailable = detectVectors();
+
+/* Constructor: CodePacker
+ * ----------------------------------------------------
+ * Notes the longest code, which decides whether the vector loop
+ * may run, and fills the gather table.
+ */
+CodePacker::CodePacker(const CodeTable& table) : table(table), longest(0), bitBuffer(0), bitCount(0) {
+	for (int ch = 0; ch < NUM_SYMBOLS; ch++) {
+		if (table.length[ch] > 32) error("Code too long for the buffer encoder.");
+		if (table.length[ch] > longest) longest = table.length[ch];
+	}
+	for (int ch = 0; ch < 256; ch++) {
+		entries[ch] = uint32_t(table.bits[ch] & 0xFFFF) | (uint32_t(table.length[ch]) << 16);
+	}
+}
+
+/* Member function: packedSize
+ * ----------------------------------------------------
+ * Every code is at most longest bits, plus the bits held.
+ */
+size_t CodePacker::packedSize(size_t length) const {
+	return (length * size_t(longest) + 7) / 8 + 1;
+}
+
+/* Member function: pack
+ * ----------------------------------------------------
+ * Runs the vector loop as far as it can go, and the scalar loop
+ * for the rest.
+ */
+size_t CodePacker::pack(const uint8_t* data, size_t length, uint8_t* out, size_t room) {
+	size_t written = 0;
+#ifdef VECTOR_PACKER
+	if (vectorsAvailable && longest <= MAX_VECTOR_CODE_LENGTH) {
+		size_t done = 0;
+		written = vectorPack(entries, data, length, out, room, bitBuffer, bitCount, done);
+		data += done;
+		length -= done;
+	}
+#else
+	(void)room;
+#endif
+	return written + packScalar(data, length, out + written);
+}
+
+/* Member function: packScalar
+ * ----------------------------------------------------
+ * One code at a time into the register, four bytes at a time out
+ * of it, as the bit streams do.
+ */
+size_t CodePacker::packScalar(const uint8_t* data, size_t length, uint8_t* out) {
+	size_t pos = 0;
+	for (size_t i = 0; i < length; i++) {
+		bitBuffer |= table.bits[data[i]] << bitCount; //fewer than 32 bits are pending here
+		bitCount += table.length[data[i]];
+
+		if (bitCount >= 32) {
+			out[pos] = uint8_t(bitBuffer);
+			out[pos + 1] = uint8_t(bitBuffer >> 8);
+			out[pos + 2] = uint8_t(bitBuffer >> 16);
+			out[pos + 3] = uint8_t(bitBuffer >> 24);
+			pos += 4;
+			bitBuffer >>= 32;
+			bitCount -= 32;
+		}
+	}
+	while (bitCount >= 8) {
+		out[pos++] = uint8_t(bitBuffer);
+		bitBuffer >>= 8;
+		bitCount -= 8;
+	}
+	return pos;
+}
+
+/* Member function: finish
+ * ----------------------------------------------------
+ * The last partial byte is padded with zeros.
+ */
+size_t CodePacker::finish(uint8_t* out) {
+	bitBuffer |= table.bits[PSEUDO_EOF] << bitCount;
+	bitCount += table.length[PSEUDO_EOF];
+	size_t pos = 0;
+	while (bitCount > 0) {
+		out[pos++] = uint8_t(bitBuffer);
+		bitBuffer >>= 8;
+		bitCount -= 8;
+	}
+	bitBuffer = 0;
+	bitCount = 0;
+	return pos;
+}
+
+/* Member function: pendingBits
+ * ----------------------------------------------------
+ * Returns the register.
+ */
+uint64_t CodePacker::pendingBits() const {
+	return bitBuffer;
+}
+
+/* Member function: pendingCount
+ * ----------------------------------------------------
+ * Returns the number of bits in the register.
+ */
+int CodePacker::pendingCount() const {
+	return bitCount;
+}
+
+/* Member function: usesVectors
+ * ----------------------------------------------------
+ * Returns what was found when the program started.
+ */
+bool CodePacker::usesVectors() {
+	return vectorsAvailable;
+}
@@ -0,0 +1,100 @@
+/**********************************************************
+ * File: CodePacker.h
+ *
+ * The inner loop of the table encoders.  Looking up each
+ * byte's code word and adding it to a bit register is a
+ * chain of dependent shifts, one symbol at a time.  On x86
+ * processors with AVX2, and codes no longer than
+ * MAX_VECTOR_CODE_LENGTH bits, a CodePacker instead loads
+ * eight bytes, gathers their code words and lengths from the
+ * table in one instruction, and joins them pairwise with
+ * per-lane variable shifts into two groups of four, so that
+ * the register takes two insertions per eight symbols instead
+ * of eight.  Other machines, and longer codes, use the scalar
+ * loop; which one runs is decided when the program starts.
+ */
+
+#ifndef CodePacker_Included
+#define CodePacker_Included
+
+#include "HuffmanTables.h"
+
+/* Constant: MAX_VECTOR_CODE_LENGTH
+ * The longest code the vector loop takes, so that four codes
+ * and the bits left over from before fit in 64 bits.
+ */
+const int MAX_VECTOR_CODE_LENGTH = 12;
+
+/* Class: CodePacker
+ * Turns bytes into the bits of their code words, least
+ * significant bit first, a piece at a time.  Between calls it
+ * holds fewer than 8 bits that do not yet make a whole byte.
+ */
+class CodePacker {
+public:
+	/* Constructor: CodePacker
+	 * Usage: CodePacker packer(table);
+	 * ----------------------------------------------------
+	 * Prepares to encode with table, which must have a code for
+	 * every byte that will be packed and for PSEUDO_EOF.  Raises an
+	 * error if any code is longer than 32 bits.
+	 */
+	explicit CodePacker(const CodeTable& table);
+
+	/* Member function: packedSize
+	 * Usage: std::vector<uint8_t> out(packer.packedSize(length));
+	 * ----------------------------------------------------
+	 * Returns enough room for pack to write the codes of length
+	 * bytes in.
+	 */
+	size_t packedSize(size_t length) const;
+
+	/* Member function: pack
+	 * Usage: size_t written = packer.pack(data, length, out, room);
+	 * ----------------------------------------------------
+	 * Adds the codes of the length bytes at data after the bits
+	 * held from before, writes every whole byte of them to out, and
+	 * returns how many that was.  The bytes written never pass the
+	 * room bytes at out, which must be at least as many as those
+	 * written.
+	 */
+	size_t pack(const uint8_t* data, size_t length, uint8_t* out, size_t room);
+
+	/* Member function: finish
+	 * Usage: size_t written = packer.finish(out);
+	 * ----------------------------------------------------
+	 * Adds the code of PSEUDO_EOF, writes what is held to out with
+	 * the last byte padded with zeros, which is at most 5 bytes, and
+	 * returns how many bytes that was.
+	 */
+	size_t finish(uint8_t* out);
+
+	/* Member function: pendingBits
+	 * Member function: pendingCount
+	 * Usage: outfile.writeBits(packer.pendingBits(), packer.pendingCount());
+	 * ----------------------------------------------------
+	 * Return the bits held that make up less than a byte, and how
+	 * many there are, for callers that finish the code themselves.
+	 */
+	uint64_t pendingBits() const;
+	int pendingCount() const;
+
+	/* Member function: usesVectors
+	 * Usage: if (CodePacker::usesVectors()) ...
+	 * ----------------------------------------------------
+	 * Returns whether this processor runs the vector loop.
+	 */
+	static bool usesVectors();
+
+private:
+	size_t packScalar(const uint8_t* data, size_t length, uint8_t* out);
+
+	/* code | length << 16 for every byte value, for the gather. */
+	uint32_t entries[256];
+	const CodeTable& table;
+	int longest;
+	uint64_t bitBuffer;
+	int bitCount;
+};
+
+#endif
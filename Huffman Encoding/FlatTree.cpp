@@ -0,0 +1,156 @@
+/**********************************************************
+ * File: FlatTree.cpp
+ *
+ * Implementation of the FlatTree class from FlatTree.h.
+ */
+
+#include "FlatTree.h"
+#include "OutputBuffer.h"
+#include "error.h"
+
+/* Constructor: FlatTree
+ * ----------------------------------------------------
+ * Creates a tree with no nodes.
+ */
+FlatTree::FlatTree() : root(0), internalCount(0), leafCount(0), maxDepth(0) {
+	/* Empty */
+}
+
+/* Constructor: FlatTree
+ * ----------------------------------------------------
+ * Copies the tree at root.
+ */
+FlatTree::FlatTree(Node* root) : root(0), internalCount(0), leafCount(0), maxDepth(0) {
+	assign(root);
+}
+
+/* Member function: assign
+ * ----------------------------------------------------
+ * Starts over and numbers the nodes in preorder.
+ */
+void FlatTree::assign(Node* rootNode) {
+	internalCount = leafCount = maxDepth = 0;
+	root = 0;
+	if (rootNode != NULL) root = addNode(rootNode, 0);
+}
+
+/* Member function: toNodes
+ * ----------------------------------------------------
+ * Rebuilds the Nodes from the root down.
+ */
+Node* FlatTree::toNodes(NodeArena* arena) const {
+	if (isEmpty()) return NULL;
+	return buildNode(root, arena);
+}
+
+/* Member function: isEmpty
+ * ----------------------------------------------------
+ * Every tree that is not empty has at least one leaf.
+ */
+bool FlatTree::isEmpty() const {
+	return leafCount == 0;
+}
+
+/* Member function: numLeaves
+ * ----------------------------------------------------
+ * Returns the leaf count.
+ */
+int FlatTree::numLeaves() const {
+	return leafCount;
+}
+
+/* Member function: numInternal
+ * ----------------------------------------------------
+ * Returns the internal node count.
+ */
+int FlatTree::numInternal() const {
+	return internalCount;
+}
+
+/* Member function: depth
+ * ----------------------------------------------------
+ * Returns the depth found while copying the tree.
+ */
+int FlatTree::depth() const {
+	return maxDepth;
+}
+
+/* Member function: searchCode
+ * ----------------------------------------------------
+ * Walks the child arrays one character of code at a time.
+ */
+ext_char FlatTree::searchCode(const string& code) const {
+	if (isEmpty()) error("Cannot search an empty tree.");
+	uint16_t ref = root;
+	for (size_t i = 0; i < code.size(); i++) {
+		if (ref & FLAT_LEAF) error("Code runs past a leaf of the tree.");
+		ref = children[ref][code[i] == '0' ? 0 : 1];
+	}
+	if (ref & FLAT_LEAF) return leafSymbols[ref & ~FLAT_LEAF];
+	return NOT_A_CHAR;
+}
+
+/* Member function: decode
+ * ----------------------------------------------------
+ * The same walk as searchCode, with the bits coming from infile.
+ */
+void FlatTree::decode(ibstream& infile, ostream& outfile, uint32_t* checksum) const {
+	if (isEmpty()) error("Cannot decode with an empty tree.");
+	OutputBuffer output(outfile, checksum);
+	while (true) {
+		uint16_t ref = root;
+		while (!(ref & FLAT_LEAF)) {
+			int bit = infile.readBit();
+			if (bit == EOF) error("Encoded data ended before PSEUDO_EOF.");
+			ref = children[ref][bit];
+		}
+
+		ext_char ch = leafSymbols[ref & ~FLAT_LEAF];
+		if (ch == PSEUDO_EOF) break;
+		output.put(char(ch));
+	}
+	output.flush();
+}
+
+/* Member function: addNode
+ * ----------------------------------------------------
+ * Copies node, found depth bits below the root, and everything
+ * below it, and returns its reference.  An internal node takes its
+ * number before its children do, so the root is always node 0.
+ */
+uint16_t FlatTree::addNode(Node* node, int depth) {
+	if (node->character != NOT_A_CHAR) {
+		if (leafCount == NUM_SYMBOLS) error("Tree has too many leaves for a flat tree.");
+		if (depth > maxDepth) maxDepth = depth;
+		leafSymbols[leafCount] = uint16_t(node->character);
+		leafWeights[leafCount] = node->weight;
+		return uint16_t(FLAT_LEAF | leafCount++);
+	}
+
+	if (node->zero == NULL || node->one == NULL) error("Tree has an internal node missing a child.");
+	if (internalCount == MAX_FLAT_INTERNAL) error("Tree has too many leaves for a flat tree.");
+	int index = internalCount++;
+	internalWeights[index] = node->weight;
+	children[index][0] = addNode(node->zero, depth + 1);
+	children[index][1] = addNode(node->one, depth + 1);
+	return uint16_t(index);
+}
+
+/* Member function: buildNode
+ * ----------------------------------------------------
+ * Makes the Node for ref and, for an internal node, its children.
+ */
+Node* FlatTree::buildNode(uint16_t ref, NodeArena* arena) const {
+	Node* node = (arena == NULL ? new Node : arena->allocate());
+	if (ref & FLAT_LEAF) {
+		node->character = leafSymbols[ref & ~FLAT_LEAF];
+		node->weight = leafWeights[ref & ~FLAT_LEAF];
+		node->zero = node->one = NULL;
+	} else {
+		node->character = NOT_A_CHAR;
+		node->weight = internalWeights[ref];
+		node->zero = buildNode(children[ref][0], arena);
+		node->one = buildNode(children[ref][1], arena);
+	}
+	return node;
+}
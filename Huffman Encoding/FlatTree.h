@@ -0,0 +1,138 @@
+/**********************************************************
+ * File: FlatTree.h
+ *
+ * A compact, pointer-free copy of an encoding tree.  A Node
+ * takes 24 to 32 bytes and its children can be anywhere on
+ * the heap, so walking a tree one bit at a time jumps all
+ * over memory.  A FlatTree keeps the same shape in a few
+ * small arrays instead: two 16-bit child references for each
+ * internal node, and a 16-bit symbol for each leaf.  A tree
+ * over all 257 ext_chars takes 1.5 KB of them, which stays
+ * in the first-level cache while it is being walked, and the
+ * weights, which walking never needs, are kept apart.
+ */
+
+#ifndef FlatTree_Included
+#define FlatTree_Included
+
+#include "HuffmanTypes.h"
+#include "HuffmanTables.h"
+#include "NodeArena.h"
+#include "bstream.h"
+#include <string>
+using namespace std;
+
+/* Constant: FLAT_LEAF
+ * The bit that marks a child reference as a leaf.  The rest of a
+ * leaf reference is the index of the leaf; the rest of any other
+ * reference is the index of an internal node.
+ */
+const uint16_t FLAT_LEAF = 0x8000;
+
+/* Constant: MAX_FLAT_INTERNAL
+ * The most internal nodes a FlatTree holds: enough for a tree with
+ * a leaf for every ext_char.
+ */
+const int MAX_FLAT_INTERNAL = NUM_SYMBOLS - 1;
+
+/* Class: FlatTree
+ * An encoding tree with its nodes numbered in preorder, the root
+ * first.  A FlatTree is a plain value: it owns no memory besides
+ * its own arrays and can be copied freely.
+ */
+class FlatTree {
+public:
+	/* Constructor: FlatTree
+	 * Usage: FlatTree tree;
+	 *        FlatTree tree(root);
+	 * ----------------------------------------------------
+	 * Creates an empty tree, or a copy of the tree at root.
+	 */
+	FlatTree();
+	explicit FlatTree(Node* root);
+
+	/* Member function: assign
+	 * Usage: tree.assign(root);
+	 * ----------------------------------------------------
+	 * Replaces the contents with a copy of the tree at root, which
+	 * may be NULL for an empty tree.  Raises an error if the tree has
+	 * an internal node missing a child or more than NUM_SYMBOLS
+	 * leaves.
+	 */
+	void assign(Node* root);
+
+	/* Member function: toNodes
+	 * Usage: Node* root = tree.toNodes();
+	 *        Node* root = tree.toNodes(&arena);
+	 * ----------------------------------------------------
+	 * Builds a Node tree with the same shape, characters and weights,
+	 * from arena if there is one and otherwise from the heap, in
+	 * which case the caller frees it with freeTree.  Returns NULL for
+	 * an empty tree.
+	 */
+	Node* toNodes(NodeArena* arena = NULL) const;
+
+	/* Member function: isEmpty
+	 * Usage: if (tree.isEmpty()) ...
+	 * ----------------------------------------------------
+	 * Returns whether the tree has no nodes at all.
+	 */
+	bool isEmpty() const;
+
+	/* Member function: numLeaves
+	 * Usage: int leaves = tree.numLeaves();
+	 * ----------------------------------------------------
+	 * Returns the number of leaves, and numInternal the number of
+	 * internal nodes.
+	 */
+	int numLeaves() const;
+	int numInternal() const;
+
+	/* Member function: depth
+	 * Usage: int longest = tree.depth();
+	 * ----------------------------------------------------
+	 * Returns the length of the longest code, zero for a tree that is
+	 * a single leaf.
+	 */
+	int depth() const;
+
+	/* Member function: searchCode
+	 * Usage: ext_char ch = tree.searchCode("0110");
+	 * ----------------------------------------------------
+	 * Follows code, a string of '0' and '1' characters, from the root
+	 * and returns the character of the leaf it ends on, or NOT_A_CHAR
+	 * if it ends inside the tree.  Raises an error if code runs past a
+	 * leaf.
+	 */
+	ext_char searchCode(const string& code) const;
+
+	/* Member function: decode
+	 * Usage: tree.decode(infile, outfile);
+	 *        tree.decode(infile, outfile, &crc);
+	 * ----------------------------------------------------
+	 * Decodes bits from infile one at a time, writing each character
+	 * to outfile, until PSEUDO_EOF.  If checksum is given, the
+	 * CRC-32C of the characters is added to it, as OutputBuffer does.
+	 * Raises an error if the bits end first or the tree is empty.
+	 */
+	void decode(ibstream& infile, ostream& outfile, uint32_t* checksum = NULL) const;
+
+private:
+	uint16_t addNode(Node* node, int depth);
+	Node* buildNode(uint16_t ref, NodeArena* arena) const;
+
+	/* Walked while decoding. */
+	uint16_t children[MAX_FLAT_INTERNAL][2];
+	uint16_t leafSymbols[NUM_SYMBOLS];
+	uint16_t root;
+
+	/* Only needed to give the Nodes back. */
+	uint64_t internalWeights[MAX_FLAT_INTERNAL];
+	uint64_t leafWeights[NUM_SYMBOLS];
+
+	int internalCount;
+	int leafCount;
+	int maxDepth;
+};
+
+#endif
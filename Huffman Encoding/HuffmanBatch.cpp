@@ -0,0 +1,292 @@
+/**********************************************************
+ * File: HuffmanBatch.cpp
+ *
+ * Implementation of the batch functions from HuffmanBatch.h.
+ */
+
+#include "HuffmanBatch.h"
+#include "HuffmanEncoding.h"
+#include "HuffmanStats.h"
+#include "MemoryDiagnostics.h"
+#include "WorkPool.h"
+#include "bstream.h"
+#include "error.h"
+#include "filelib.h"
+#include "thread.h"
+
+struct FileJob;
+static void encodeBlockTask(void* data);
+
+/* Type: BlockTask
+ * One block of a large file, encoded as a task of its own.
+ */
+struct BlockTask {
+	FileJob* job;
+	BlockType type;
+	string input;
+	string output;
+};
+
+/* Type: FileJob
+ * One file of the batch as it moves through the pool.  A large
+ * file is read one batch of blocks at a time, one block per thread,
+ * and infile and outfile stay open from one batch to the next.
+ * blocksLeft and the failure fields of file are shared by the block
+ * tasks of the batch, and guarded by the batch lock.
+ */
+struct FileJob {
+	BatchFile* file;
+	WorkPool* pool;
+	Lock* lock;
+	int blockSize;
+	ifbstream* infile;
+	ofbstream* outfile;
+	std::vector<BlockIndexEntry> index;
+	std::vector<BlockTask> blocks;
+	int blocksLeft;
+};
+
+/*
+	Marks the file of job failed with message, keeping the first
+	reason if several tasks of the file fail
+*/
+static void markFailed(FileJob& job, const string& message)
+{
+	synchronized (*job.lock)
+	{
+		if (!job.file->failed)
+		{
+			job.file->failed = true;
+			job.file->message = message;
+		}
+	}
+}
+
+/*
+	Closes the files of a large file job and lets go of its blocks,
+	whether or not it finished
+*/
+static void closeBlockFile(FileJob& job)
+{
+	delete job.infile;
+	delete job.outfile;
+	job.infile = NULL;
+	job.outfile = NULL;
+	job.blocks.clear();
+	job.index.clear();
+}
+
+/*
+	Reads the next batch of blocks of a large file job and hands each
+	block to the pool, or finishes the file if there are none left
+*/
+static void submitBlockBatch(FileJob& job)
+{
+	size_t numBlocks = 0;
+	while (numBlocks < job.blocks.size() && readBlock(*job.infile, job.blockSize, job.blocks[numBlocks].input))
+	{
+		job.file->bytesIn += job.blocks[numBlocks].input.size();
+		numBlocks++;
+	}
+
+	if (numBlocks == 0)
+	{
+		writeBlockIndex(*job.outfile, job.index);
+		job.file->bytesOut = uint64_t(job.outfile->size());
+		job.outfile->close();
+		if (job.outfile->fail()) error("Cannot finish writing " + job.file->output + ".");
+		closeBlockFile(job);
+		return;
+	}
+
+	job.blocksLeft = int(numBlocks);
+	for (size_t i = 0; i < numBlocks; i++)
+	{
+		job.pool->submit(encodeBlockTask, &job.blocks[i]);
+	}
+}
+
+/*
+	Writes the records of a batch once all of its blocks are encoded,
+	in input order, then starts on the next batch
+*/
+static void writeBlockBatch(FileJob& job)
+{
+	for (int i = 0; i < int(job.blocks.size()) && !job.blocks[i].input.empty(); i++)
+	{
+		writeBlockRecord(*job.outfile, job.blocks[i].type, job.blocks[i].input.size(), job.blocks[i].output, job.index);
+		job.blocks[i].input.clear();
+	}
+	submitBlockBatch(job);
+}
+
+/*
+	Task body: encodes one block of a large file, and writes the
+	batch if it was the last block of it to finish
+*/
+static void encodeBlockTask(void* data)
+{
+	MemoryCategoryScope scope(BLOCK_MEMORY);
+	BlockTask& task = *(BlockTask*)data;
+	FileJob& job = *task.job;
+	try
+	{
+		task.type = encodeBlock(HUFFMAN_BLOCK, task.input, task.output);
+	}
+	catch (ErrorException& ex)
+	{
+		markFailed(job, ex.getMessage());
+	}
+
+	bool last = false;
+	synchronized (*job.lock)
+	{
+		last = (--job.blocksLeft == 0);
+	}
+	if (!last) return;
+
+	try
+	{
+		if (job.file->failed)
+		{
+			closeBlockFile(job);
+			return;
+		}
+		writeBlockBatch(job);
+	}
+	catch (ErrorException& ex)
+	{
+		markFailed(job, ex.getMessage());
+		closeBlockFile(job);
+	}
+}
+
+/*
+	Task body: compresses a small file on the spot, or opens a large
+	one and hands its first batch of blocks to the pool
+*/
+static void compressFileTask(void* data)
+{
+	MemoryCategoryScope scope(BLOCK_MEMORY);
+	FileJob& job = *(FileJob*)data;
+	try
+	{
+		job.infile = new ifbstream(job.file->input);
+		if (!job.infile->is_open()) error("Cannot open file " + job.file->input + " for reading.");
+
+		if (uint64_t(job.infile->size()) <= uint64_t(job.blockSize))
+		{
+			job.file->bytesIn = uint64_t(job.infile->size());
+			ofbstream outfile(job.file->output);
+			if (!outfile.is_open()) error("Cannot open file " + job.file->output + " for writing.");
+			compress(*job.infile, outfile);
+			job.file->bytesOut = uint64_t(outfile.size());
+			outfile.close();
+			if (outfile.fail()) error("Cannot finish writing " + job.file->output + ".");
+			closeBlockFile(job);
+			return;
+		}
+
+		//blocks are read as the ones before them are written, so
+		//memory stays at one block per thread for the file
+		job.outfile = new ofbstream(job.file->output);
+		if (!job.outfile->is_open()) error("Cannot open file " + job.file->output + " for writing.");
+		writeContainerVersion(*job.outfile, BLOCK_CONTAINER);
+
+		job.blocks.resize(job.pool->numThreads());
+		for (size_t i = 0; i < job.blocks.size(); i++)
+		{
+			job.blocks[i].job = &job;
+		}
+		submitBlockBatch(job);
+	}
+	catch (ErrorException& ex)
+	{
+		markFailed(job, ex.getMessage());
+		closeBlockFile(job);
+	}
+}
+
+/* Function: compressFiles
+ * Usage: BatchStats totals = compressFiles(files, numThreads, blockSize);
+ * --------------------------------------------------------
+ * Submits one task per file and runs the pool until every file
+ * and every block is done.
+ */
+BatchStats compressFiles(std::vector<BatchFile>& files, int numThreads, int blockSize)
+{
+	MemoryCategoryScope scope(BLOCK_MEMORY);
+	if (blockSize < 1 || blockSize > MAX_BLOCK_SIZE) error("Block size must be between 1 byte and 1 GiB.");
+
+	double start = currentSeconds();
+	WorkPool pool(numThreads);
+	Lock lock;
+	std::vector<FileJob> jobs(files.size());
+	for (size_t i = 0; i < files.size(); i++)
+	{
+		files[i].bytesIn = files[i].bytesOut = 0;
+		files[i].failed = false;
+		files[i].message.clear();
+
+		jobs[i].file = &files[i];
+		jobs[i].pool = &pool;
+		jobs[i].lock = &lock;
+		jobs[i].blockSize = blockSize;
+		jobs[i].infile = NULL;
+		jobs[i].outfile = NULL;
+		jobs[i].blocksLeft = 0;
+		pool.submit(compressFileTask, &jobs[i]);
+	}
+	pool.run();
+	for (size_t i = 0; i < jobs.size(); i++)
+	{
+		closeBlockFile(jobs[i]);
+	}
+
+	BatchStats totals;
+	totals.files = int(files.size());
+	totals.failures = 0;
+	totals.bytesIn = totals.bytesOut = 0;
+	for (size_t i = 0; i < files.size(); i++)
+	{
+		if (files[i].failed) totals.failures++;
+		totals.bytesIn += files[i].bytesIn;
+		totals.bytesOut += files[i].bytesOut;
+	}
+	totals.seconds = currentSeconds() - start;
+	totals.steals = pool.steals();
+	return totals;
+}
+
+/* Function: listBatchFiles
+ * Usage: listBatchFiles(path, names);
+ * --------------------------------------------------------
+ * Walks directories depth first.
+ */
+void listBatchFiles(const string& path, std::vector<string>& names)
+{
+	if (!fileExists(path)) error("No file or directory named " + path + ".");
+	if (!isDirectory(path))
+	{
+		names.push_back(path);
+		return;
+	}
+
+	std::vector<string> entries;
+	listDirectory(path, entries);
+	string separator = getDirectoryPathSeparator();
+	string extension = BATCH_EXTENSION;
+	for (size_t i = 0; i < entries.size(); i++)
+	{
+		string name = path + separator + entries[i];
+		if (isDirectory(name))
+		{
+			listBatchFiles(name, names);
+		}
+		else if (name.size() < extension.size() ||
+		         name.compare(name.size() - extension.size(), extension.size(), extension) != 0)
+		{
+			names.push_back(name);
+		}
+	}
+}
@@ -0,0 +1,84 @@
+/**********************************************************
+ * File: HuffmanBatch.h
+ *
+ * Compressing many files at once.  Every file is a task on a
+ * work-stealing pool (see WorkPool.h).  A small file is
+ * compressed whole by one thread, as compress does it; a file
+ * larger than a block is split into blocks that become tasks
+ * of their own, so that one large file spreads over every
+ * thread and many small files share the threads between them.
+ */
+
+#ifndef HuffmanBatch_Included
+#define HuffmanBatch_Included
+
+#include "HuffmanTypes.h"
+#include "HuffmanBlocks.h"
+#include <string>
+#include <vector>
+using namespace std;
+
+/* Constant: BATCH_EXTENSION
+ * What listBatchFiles leaves out and callers usually add to the
+ * name of each compressed file.
+ */
+const char BATCH_EXTENSION[] = ".huf";
+
+/* Type: BatchFile
+ * One file of a batch.  The caller fills in input and output, the
+ * names of the file to compress and of the file to write; the rest
+ * is filled in by compressFiles.  A file that could not be
+ * compressed is marked failed with the reason in message, and the
+ * other files go on regardless.
+ */
+struct BatchFile {
+	string input;
+	string output;
+	uint64_t bytesIn;
+	uint64_t bytesOut;
+	bool failed;
+	string message;
+};
+
+/* Type: BatchStats
+ * The totals of a whole batch.  seconds is the time from start to
+ * finish, and steals is how many tasks threads took from each other
+ * to stay busy.
+ */
+struct BatchStats {
+	int files;
+	int failures;
+	uint64_t bytesIn;
+	uint64_t bytesOut;
+	double seconds;
+	long steals;
+};
+
+/* Function: compressFiles
+ * Usage: BatchStats totals = compressFiles(files);
+ *        BatchStats totals = compressFiles(files, numThreads, blockSize);
+ * --------------------------------------------------------
+ * Compresses every file of the batch on numThreads threads; zero
+ * means one per processor.  A file of at most blockSize bytes is
+ * written as compress would write it; a larger one is written as
+ * compressBlocks would with that block size, each of its blocks
+ * being encoded as a separate task.  A large file is read one
+ * batch of numThreads blocks at a time, each batch being written
+ * before the next is read, so about numThreads * blockSize bytes
+ * of it are held in memory, as with compressBlocks.
+ */
+BatchStats compressFiles(std::vector<BatchFile>& files, int numThreads = 0,
+                         int blockSize = DEFAULT_BLOCK_SIZE);
+
+/* Function: listBatchFiles
+ * Usage: listBatchFiles(path, names);
+ * --------------------------------------------------------
+ * Adds path to names if it is a file, or every file below it,
+ * in alphabetical order within each directory, if it is a
+ * directory.  Files in a directory whose names end in
+ * BATCH_EXTENSION are left out, since they are most likely
+ * compressed already.  Raises an error if path does not exist.
+ */
+void listBatchFiles(const string& path, std::vector<string>& names);
+
+#endif
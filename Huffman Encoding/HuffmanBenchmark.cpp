@@ -0,0 +1,448 @@
+/**********************************************************
+ * File: HuffmanBenchmark.cpp
+ *
+ * A non-interactive throughput benchmark.  Every file in
+ * test/encodeDecode, plus a generated input of each kind in
+ * HuffmanCorpus.h and tomSawyer repeated to the same size, is
+ * compressed and decompressed repeatedly in memory by each
+ * codec, and the results are printed as comma-separated
+ * values, one line per codec and input, so that runs can be
+ * compared by a script.
+ *
+ * Times are the fastest of several runs, which is the least
+ * disturbed by whatever else the machine is doing.  The heap
+ * columns come from MemoryDiagnostics and need TRACK_HEAP_MEMORY,
+ * which the benchmark project defines; in a build without it
+ * they are left empty.
+ *
+ * The output of one run, saved to a file, is a baseline for
+ * later ones.  With the environment variable HUFFMAN_BASELINE
+ * naming that file, only the codecs and inputs in it are run,
+ * and the benchmark exits with status 1 if either direction of
+ * any of them is more than HUFFMAN_TOLERANCE percent slower
+ * than before (DEFAULT_TOLERANCE unless set).  Inputs smaller
+ * than MIN_CHECKED_BYTES are printed but not checked, since too
+ * little of their time is spent coding to compare fairly.
+ */
+
+#include <iostream>
+#include <string>
+#include <sstream>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include "error.h"
+#include "bstream.h"
+#include "HuffmanEncoding.h"
+#include "HuffmanBlocks.h"
+#include "HuffmanPipeline.h"
+#include "HuffmanPresets.h"
+#include "HuffmanCorpus.h"
+#include "HuffmanContext.h"
+#include "HuffmanStats.h"
+#include "MemoryDiagnostics.h"
+
+/* Constant: MIN_RUNS
+ * Every measurement repeats at least this many times...
+ */
+const int MIN_RUNS = 3;
+
+/* Constant: MIN_SECONDS
+ * ...and keeps repeating until this much time has been spent on it.
+ */
+const double MIN_SECONDS = 0.25;
+
+/* Constant: SYNTHETIC_SIZE
+ * The size of each generated input, unless HUFFMAN_CORPUS_SIZES
+ * lists other sizes, such as 1K,1M,256M (see parseCorpusSize).
+ * All inputs are held in memory at once, so corpora larger than
+ * memory are better written to files by the test harness.
+ */
+const size_t SYNTHETIC_SIZE = 4 << 20;
+
+/* Constant: DEFAULT_TOLERANCE
+ * How many percent slower than its baseline a measurement may be.
+ */
+const double DEFAULT_TOLERANCE = 15;
+
+/* Constant: MIN_CHECKED_BYTES
+ * The smallest input whose speed is checked against the baseline.
+ */
+const size_t MIN_CHECKED_BYTES = 65536;
+
+/* Type: Codec
+ * One way of compressing and decompressing a whole input held in a
+ * string.
+ */
+struct Codec {
+	const char* name;
+	void (*compressData)(const string& input, string& output);
+	void (*decompressData)(const string& input, string& output);
+};
+
+/* Type: Measurement
+ * The results for one codec on one input.
+ */
+struct Measurement {
+	size_t compressedSize;
+	double compressSeconds;     /* fastest single run */
+	double decompressSeconds;
+	long treeNodesPerRun;       /* compress and decompress together */
+	int64_t heapAllocations;    /* every heap block, likewise; needs TRACK_HEAP_MEMORY */
+	int64_t peakHeapBytes;      /* above what was live before the round trip */
+};
+
+/* The codecs under test. */
+void compressStatic(const string& input, string& output) {
+	istringbstream source(input);
+	ostringbstream result;
+	compress(source, result);
+	output = result.str();
+}
+
+void compressAdaptive(const string& input, string& output) {
+	istringbstream source(input);
+	ostringbstream result;
+	compress(source, result, ADAPTIVE_MODE);
+	output = result.str();
+}
+
+void compressSampled(const string& input, string& output) {
+	istringbstream source(input);
+	ostringbstream result;
+	compress(source, result, SAMPLED_MODE);
+	output = result.str();
+}
+
+void compressOrder1Mode(const string& input, string& output) {
+	istringbstream source(input);
+	ostringbstream result;
+	compress(source, result, ORDER1_MODE);
+	output = result.str();
+}
+
+void compressBlocked(const string& input, string& output) {
+	istringbstream source(input);
+	ostringbstream result;
+	compressBlocks(source, result);
+	output = result.str();
+}
+
+void compressPipeline(const string& input, string& output) {
+	istringbstream source(input);
+	ostringbstream result;
+	compressPipelined(source, result);
+	output = result.str();
+}
+
+void compressInterleaved(const string& input, string& output) {
+	istringbstream source(input);
+	ostringbstream result;
+	compress(source, result, INTERLEAVED_MODE);
+	output = result.str();
+}
+
+void decompressAny(const string& input, string& output) {
+	istringbstream source(input);
+	ostringbstream result;
+	decompress(source, result);
+	output = result.str();
+}
+
+void decompressWithFsm(const string& input, string& output) {
+	setDecoderKind(FSM_DECODER);
+	decompressAny(input, output);
+	setDecoderKind(AUTOMATIC_DECODER);
+}
+
+void compressInMemory(const string& input, string& output) {
+	std::vector<uint8_t> result;
+	compressBuffer((const uint8_t*)input.data(), input.size(), result);
+	output.assign(result.begin(), result.end());
+}
+
+void decompressInMemory(const string& input, string& output) {
+	std::vector<uint8_t> result;
+	decompressBuffer((const uint8_t*)input.data(), input.size(), result);
+	output.assign(result.begin(), result.end());
+}
+
+/* One context each way, reset before every message so that only
+ * its memory is reused and never the code of the last run.
+ */
+HuffmanContext benchmarkEncoder;
+HuffmanDecoderContext benchmarkDecoder;
+
+void compressWithContext(const string& input, string& output) {
+	static std::vector<uint8_t> result;
+	benchmarkEncoder.reset();
+	benchmarkEncoder.compress((const uint8_t*)input.data(), input.size(), result);
+	output.assign(result.begin(), result.end());
+}
+
+void decompressWithContext(const string& input, string& output) {
+	static std::vector<uint8_t> result;
+	benchmarkDecoder.reset();
+	benchmarkDecoder.decompress((const uint8_t*)input.data(), input.size(), result);
+	output.assign(result.begin(), result.end());
+}
+
+void compressPresetInMemory(const string& input, string& output) {
+	std::vector<uint8_t> result;
+	compressWithPreset((const uint8_t*)input.data(), input.size(), ENGLISH_TEXT_PRESET, result);
+	output.assign(result.begin(), result.end());
+}
+
+const Codec CODECS[] = {
+	{ "static", compressStatic, decompressAny },
+	{ "fsm", compressStatic, decompressWithFsm },
+	{ "blocks", compressBlocked, decompressAny },
+	{ "pipelined", compressPipeline, decompressAny },
+	{ "interleaved", compressInterleaved, decompressAny },
+	{ "adaptive", compressAdaptive, decompressAny },
+	{ "sampled", compressSampled, decompressAny },
+	{ "order1", compressOrder1Mode, decompressAny },
+	{ "buffer", compressInMemory, decompressInMemory },
+	{ "context", compressWithContext, decompressWithContext },
+	{ "preset", compressPresetInMemory, decompressInMemory }
+};
+const int NUM_CODECS = sizeof CODECS / sizeof CODECS[0];
+
+/* Function: readWholeFile
+ * --------------------------------------------------------
+ * Returns the contents of the named file.
+ */
+string readWholeFile(const string& filename) {
+	ifbstream input(filename);
+	if (!input.is_open()) error("Cannot open file " + filename + " for reading!");
+	ostringstream contents;
+	contents << input.rdbuf();
+	return contents.str();
+}
+
+/* Function: repeatText
+ * --------------------------------------------------------
+ * Returns text repeated until it is size bytes long.
+ */
+string repeatText(const string& text, size_t size) {
+	string result;
+	result.reserve(size);
+	while (result.size() < size) {
+		result.append(text, 0, size - result.size() < text.size() ? size - result.size() : text.size());
+	}
+	return result;
+}
+
+/* Function: sizeName
+ * --------------------------------------------------------
+ * Returns size in the largest binary unit that divides it, such
+ * as 4MiB, for naming inputs.
+ */
+string sizeName(uint64_t size) {
+	const char* units[] = { "B", "KiB", "MiB", "GiB" };
+	int unit = 0;
+	while (unit < 3 && size >= 1024 && size % 1024 == 0) {
+		size /= 1024;
+		unit++;
+	}
+	ostringstream name;
+	name << size << units[unit];
+	return name.str();
+}
+
+/* Function: measure
+ * --------------------------------------------------------
+ * Runs one codec on one input until the times are trustworthy,
+ * checking that every round trip gives back the input.
+ */
+Measurement measure(const Codec& codec, const string& input) {
+	Measurement result;
+	string compressed, decompressed;
+	int runs = 0;
+
+	result.compressSeconds = 0;
+	double spent = 0;
+	while (runs < MIN_RUNS || spent < MIN_SECONDS) {
+		double start = currentSeconds();
+		codec.compressData(input, compressed);
+		double elapsed = currentSeconds() - start;
+		if (runs == 0 || elapsed < result.compressSeconds) result.compressSeconds = elapsed;
+		spent += elapsed;
+		runs++;
+	}
+
+	result.decompressSeconds = 0;
+	spent = 0;
+	for (int i = 0; i < runs || spent < MIN_SECONDS; i++) {
+		double start = currentSeconds();
+		codec.decompressData(compressed, decompressed);
+		double elapsed = currentSeconds() - start;
+		if (i == 0 || elapsed < result.decompressSeconds) result.decompressSeconds = elapsed;
+		spent += elapsed;
+		if (decompressed != input) error(string("Codec ") + codec.name + " did not give back its input.");
+	}
+
+	/* One more round trip, untimed, to count its allocations. */
+	long allocations = numAllocations();
+	MemoryUsage heapBefore = totalMemoryUsage();
+	resetPeakMemory();
+	codec.compressData(input, compressed);
+	codec.decompressData(compressed, decompressed);
+	result.treeNodesPerRun = numAllocations() - allocations;
+	MemoryUsage heapAfter = totalMemoryUsage();
+	result.heapAllocations = heapAfter.allocations - heapBefore.allocations;
+	result.peakHeapBytes = heapAfter.peakBytes - heapBefore.liveBytes;
+	result.compressedSize = compressed.size();
+	return result;
+}
+
+/* Function: report
+ * --------------------------------------------------------
+ * Prints one line of results.  Throughput is in megabytes (10^6
+ * bytes) of original data per second, also given as nanoseconds
+ * per original byte.
+ */
+void report(const Codec& codec, const string& inputName, size_t size, const Measurement& result) {
+	double bytes = double(size > 0 ? size : 1);
+	char line[512];
+	sprintf(line, "%s,%s,%lu,%lu,%.4f,%.2f,%.2f,%.2f,%.2f,%ld,",
+	        codec.name, inputName.c_str(),
+	        (unsigned long)size, (unsigned long)result.compressedSize,
+	        double(result.compressedSize) / bytes,
+	        bytes / 1e6 / result.compressSeconds,
+	        bytes / 1e6 / result.decompressSeconds,
+	        result.compressSeconds * 1e9 / bytes,
+	        result.decompressSeconds * 1e9 / bytes,
+	        result.treeNodesPerRun);
+	cout << line;
+	if (isTrackingHeapMemory()) {
+		sprintf(line, "%ld,%ld", (long)result.heapAllocations, (long)result.peakHeapBytes);
+		cout << line;
+	} else {
+		cout << ",";
+	}
+	cout << endl;
+}
+
+/* Type: Baseline
+ * The speeds, in MB/s, that one codec and input reached before.
+ */
+struct Baseline {
+	double compressSpeed;
+	double decompressSpeed;
+};
+
+/* Function: readBaseline
+ * --------------------------------------------------------
+ * Reads the output of an earlier run into baselines, keyed by
+ * codec and input as they appear at the start of each line.
+ */
+void readBaseline(const string& filename, std::map<string, Baseline>& baselines) {
+	ifstream input(filename.c_str());
+	if (!input.is_open()) error("Cannot open baseline " + filename + " for reading!");
+	string line;
+	getline(input, line); // the column names
+	while (getline(input, line)) {
+		std::vector<string> fields;
+		istringstream row(line);
+		string field;
+		while (getline(row, field, ',')) fields.push_back(field);
+		if (fields.size() < 7) continue;
+
+		Baseline baseline;
+		baseline.compressSpeed = atof(fields[5].c_str());
+		baseline.decompressSpeed = atof(fields[6].c_str());
+		baselines[fields[0] + "," + fields[1]] = baseline;
+	}
+}
+
+/* Function: checkBaseline
+ * --------------------------------------------------------
+ * Reports to cerr each direction of a measurement that is slower
+ * than its baseline by more than tolerance percent, and returns how
+ * many there were.
+ */
+int checkBaseline(const string& key, size_t size, const Measurement& result,
+                  const Baseline& baseline, double tolerance) {
+	double bytes = double(size > 0 ? size : 1);
+	double speeds[] = { bytes / 1e6 / result.compressSeconds, bytes / 1e6 / result.decompressSeconds };
+	double before[] = { baseline.compressSpeed, baseline.decompressSpeed };
+	const char* directions[] = { "compress", "decompress" };
+	int regressions = 0;
+	for (int i = 0; i < 2; i++) {
+		if (speeds[i] < before[i] * (1 - tolerance / 100)) {
+			cerr << "REGRESSION: " << key << " " << directions[i] << " at " << speeds[i]
+			     << " MB/s, baseline " << before[i] << " MB/s" << endl;
+			regressions++;
+		}
+	}
+	return regressions;
+}
+
+/* Runs every codec on every input, or those in the baseline. */
+int main() {
+	std::map<string, Baseline> baselines;
+	const char* baselineFile = getenv("HUFFMAN_BASELINE");
+	if (baselineFile != NULL) readBaseline(baselineFile, baselines);
+	const char* toleranceSetting = getenv("HUFFMAN_TOLERANCE");
+	double tolerance = (toleranceSetting != NULL ? atof(toleranceSetting) : DEFAULT_TOLERANCE);
+
+	std::vector<string> names, inputs;
+	const char* files[] = {
+		"singleChar", "nonRepeated", "alphaOnce", "allRepeated", "fibonacci", "poem",
+		"allCharsOnce", "tomSawyer", "dikdik.jpg", "random"
+	};
+	for (size_t i = 0; i < sizeof files / sizeof files[0]; i++) {
+		names.push_back(files[i]);
+		inputs.push_back(readWholeFile(string("test/encodeDecode/") + files[i]));
+	}
+
+	//every kind of corpus at every size, for scaling curves
+	string sample = readWholeFile("test/encodeDecode/tomSawyer");
+	std::vector<uint64_t> sizes;
+	const char* sizeSetting = getenv("HUFFMAN_CORPUS_SIZES");
+	if (sizeSetting == NULL) {
+		sizes.push_back(SYNTHETIC_SIZE);
+	} else {
+		istringstream list(sizeSetting);
+		string size;
+		while (getline(list, size, ',')) sizes.push_back(parseCorpusSize(size));
+	}
+	for (size_t s = 0; s < sizes.size(); s++) {
+		names.push_back("tomSawyer-" + sizeName(sizes[s]));
+		inputs.push_back(repeatText(sample, size_t(sizes[s])));
+		for (int kind = 0; kind < NUM_CORPUS_KINDS; kind++) {
+			names.push_back(string(corpusName(CorpusKind(kind))) + "-" + sizeName(sizes[s]));
+			inputs.push_back(makeCorpus(CorpusKind(kind), size_t(sizes[s]), 1, sample));
+		}
+	}
+
+	if (!isTrackingHeapMemory()) {
+		cerr << "Built without TRACK_HEAP_MEMORY, so the heap columns are left empty." << endl;
+	}
+	cout << "codec,input,bytes,compressed_bytes,ratio,compress_mb_per_s,decompress_mb_per_s,"
+	     << "compress_ns_per_byte,decompress_ns_per_byte,tree_nodes_per_run,"
+	     << "heap_allocations_per_run,peak_heap_bytes" << endl;
+	int regressions = 0;
+	for (int c = 0; c < NUM_CODECS; c++) {
+		for (size_t i = 0; i < inputs.size(); i++) {
+			string key = string(CODECS[c].name) + "," + names[i];
+			std::map<string, Baseline>::const_iterator baseline = baselines.find(key);
+			if (baselineFile != NULL && baseline == baselines.end()) continue;
+
+			Measurement result = measure(CODECS[c], inputs[i]);
+			report(CODECS[c], names[i], inputs[i].size(), result);
+			if (baselineFile != NULL && inputs[i].size() >= MIN_CHECKED_BYTES) {
+				regressions += checkBaseline(key, inputs[i].size(), result, baseline->second, tolerance);
+			}
+		}
+	}
+
+	if (regressions > 0) {
+		cerr << regressions << " measurements are slower than the baseline." << endl;
+		return 1;
+	}
+	return 0;
+}
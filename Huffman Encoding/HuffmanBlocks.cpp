@@ -0,0 +1,942 @@
+/**********************************************************
+ * File: HuffmanBlocks.cpp
+ *
+ * Implementation of the block functions from HuffmanBlocks.h.
+ */
+
+#include "HuffmanBlocks.h"
+#include "HuffmanHistogram.h"
+#include "HuffmanChecksum.h"
+#include "HuffmanTables.h"
+#include "LittleEndian.h"
+#include "TableCache.h"
+#include "MemoryDiagnostics.h"
+#include "error.h"
+#include "strlib.h"
+#include "thread.h"
+#include <sstream>
+#include <algorithm>
+#include <cstring>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+/* Type: BlockJob
+ * One block handed to a worker thread: the input bytes, and the
+ * encoded bytes or the error message it leaves behind.
+ */
+struct BlockJob {
+	BlockType type;
+	string input;
+	string output;
+	bool failed;
+	string message;
+};
+
+/* The largest number of bytes one run of an RLE_BLOCK stands for:
+ * the two bytes written, and up to 255 more in the count.
+ */
+static const int MAX_RUN_LENGTH = 2 + 255;
+
+/* The number of bytes counted and then checksummed at a time,
+ * small enough to stay in the first-level cache in between.
+ */
+static const size_t CHECKSUM_PIECE_SIZE = 16384;
+
+/*
+	Shortens the runs of input into runs, as an RLE_BLOCK lays them
+	out: each run of two or more equal bytes, up to MAX_RUN_LENGTH,
+	becomes two of them and a count of the rest
+*/
+static void encodeRuns(const string& input, string& runs)
+{
+	runs.clear();
+	runs.reserve(input.size());
+	size_t i = 0;
+	while (i < input.size())
+	{
+		char ch = input[i];
+		size_t run = 1;
+		while (i + run < input.size() && input[i + run] == ch && run < size_t(MAX_RUN_LENGTH)) run++;
+
+		runs += ch;
+		if (run >= 2)
+		{
+			runs += ch;
+			runs += char(run - 2);
+		}
+		i += run;
+	}
+}
+
+/*
+	Expands runs written by encodeRuns into exactly rawSize bytes at
+	output, and raises an error if they do not come to that size
+*/
+static void decodeRuns(const string& runs, char* output, size_t rawSize)
+{
+	size_t written = 0;
+	size_t i = 0;
+	while (i < runs.size())
+	{
+		uint8_t ch = uint8_t(runs[i++]);
+		size_t run = 1;
+		if (i < runs.size() && uint8_t(runs[i]) == ch)
+		{
+			if (i + 1 >= runs.size()) error("Run block is cut off.");
+			run = 2 + uint8_t(runs[i + 1]);
+			i += 2;
+		}
+		if (run > rawSize - written) error("Block decoded to the wrong size.");
+		memset(output + written, ch, run);
+		written += run;
+	}
+	if (written != rawSize) error("Block decoded to the wrong size.");
+}
+
+/*
+	Encodes input, whose histogram is weights, as the data of one
+	block without its checksum, and returns the type written
+*/
+static BlockType encodeBlockData(BlockType type, const string& input, const uint64_t weights[NUM_SYMBOLS],
+                                 string& output)
+{
+	int distinct = 0, dominant = 0;
+	for (int ch = 0; ch < NUM_BYTE_VALUES; ch++)
+	{
+		if (weights[ch] != 0) distinct++;
+		if (weights[ch] > weights[dominant]) dominant = ch;
+	}
+	if (distinct == 1)
+	{
+		output = string(1, char(dominant));
+		return RUN_BLOCK;
+	}
+
+	CodeTable codes;
+	buildCachedCodeTable(weights, codes);
+
+	ostringbstream encoded;
+	writeCodeLengthHeader(encoded, codes.length);
+
+	//each extra stream adds its sizes, a PSEUDO_EOF and up to a byte of padding
+	uint64_t bits = encodedBits(weights, codes.length);
+	uint64_t codedSize = encoded.str().size() + (bits + 7) / 8;
+	if (type == INTERLEAVED_BLOCK)
+	{
+		codedSize += (INTERLEAVED_STREAMS - 1) * (4 + 1 + (codes.length[PSEUDO_EOF] + 7) / 8);
+	}
+
+	//a code takes at least a bit per byte, which runs of padding do not need
+	if (weights[dominant] * 2 >= input.size())
+	{
+		string runs;
+		encodeRuns(input, runs);
+		uint64_t runWeights[NUM_SYMBOLS] = { 0 };
+		countBytes((const unsigned char*)runs.data(), runs.size(), runWeights);
+		runWeights[PSEUDO_EOF] = 1;
+
+		CodeTable runCodes;
+		buildCachedCodeTable(runWeights, runCodes);
+		ostringbstream runEncoded;
+		writeCodeLengthHeader(runEncoded, runCodes.length);
+		uint64_t runSize = runEncoded.str().size() + (encodedBits(runWeights, runCodes.length) + 7) / 8;
+		if (runSize < codedSize && runSize < input.size())
+		{
+			istringstream source(runs);
+			encodeWithTable(source, runCodes, runEncoded);
+			output = runEncoded.str();
+			return RLE_BLOCK;
+		}
+	}
+
+	if (codedSize >= input.size())
+	{
+		output = input;
+		return STORED_BLOCK;
+	}
+
+	if (type == HUFFMAN_BLOCK)
+	{
+		istringstream source(input);
+		encodeWithTable(source, codes, encoded);
+		output = encoded.str();
+		return type;
+	}
+
+	//the longest code bounds what each piece can take
+	int longest = 0;
+	for (int ch = 0; ch < NUM_SYMBOLS; ch++)
+	{
+		longest = max(longest, int(codes.length[ch]));
+	}
+
+	const uint8_t* data = (const uint8_t*)input.data();
+	size_t pieceSize = input.size() / INTERLEAVED_STREAMS;
+	std::vector<uint8_t> streams[INTERLEAVED_STREAMS];
+	for (int i = 0; i < INTERLEAVED_STREAMS; i++)
+	{
+		size_t length = (i == INTERLEAVED_STREAMS - 1 ? input.size() - i * pieceSize : pieceSize);
+		streams[i].resize(((length + 1) * longest + 7) / 8);
+		streams[i].resize(encodeBytes(data + i * pieceSize, length, codes, streams[i], 0));
+	}
+
+	for (int i = 0; i < INTERLEAVED_STREAMS - 1; i++)
+	{
+		writeUint32(encoded, uint32_t(streams[i].size()));
+	}
+	for (int i = 0; i < INTERLEAVED_STREAMS; i++)
+	{
+		if (!streams[i].empty()) encoded.write((const char*)&streams[i][0], streams[i].size());
+	}
+	output = encoded.str();
+	return type;
+}
+
+/* Function: encodeBlock
+ * Usage: BlockType written = encodeBlock(type, input, output);
+ * --------------------------------------------------------
+ * Encodes one block on its own: the code lengths of its bytes,
+ * then the bytes in the canonical code for those lengths, as one
+ * stream or as INTERLEAVED_STREAMS of them.  The histogram picks
+ * the fast paths first: a block of one byte value is a RUN_BLOCK,
+ * and one mostly of one value is also coded as runs, which wins if
+ * it is smaller.  If coding would not be smaller than the block,
+ * the block is stored instead.  No tree nodes are allocated, so
+ * this may run on any thread.
+ *
+ * The checksum is taken a piece at a time as each piece is
+ * counted, while the piece is still in the first-level cache.
+ */
+BlockType encodeBlock(BlockType type, const string& input, string& output)
+{
+	uint64_t weights[NUM_SYMBOLS] = { 0 };
+	const unsigned char* bytes = (const unsigned char*)input.data();
+	uint32_t checksum = 0;
+	for (size_t done = 0; done < input.size(); done += CHECKSUM_PIECE_SIZE)
+	{
+		size_t piece = min(input.size() - done, CHECKSUM_PIECE_SIZE);
+		countBytes(bytes + done, piece, weights);
+		checksum = updateCrc32c(checksum, bytes + done, piece);
+	}
+	weights[PSEUDO_EOF] = 1;
+
+	BlockType written = encodeBlockData(type, input, weights, output);
+	for (int i = 0; i < 4; i++)
+	{
+		output += char((checksum >> (8 * i)) & 0xFF);
+	}
+	return written;
+}
+
+/*
+	Thread body: encodes the block of one job, keeping any error
+	for the thread that started it
+*/
+static void runBlockJob(BlockJob& job)
+{
+	MemoryCategoryScope scope(BLOCK_MEMORY);
+	try
+	{
+		job.type = encodeBlock(job.type, job.input, job.output);
+	}
+	catch (ErrorException& ex)
+	{
+		job.failed = true;
+		job.message = ex.getMessage();
+	}
+}
+
+/* Type: DecodeJob
+ * One block handed to a decoding thread: its sizes, its CRC-32C if
+ * it has one, and compressed bytes, where its rawSize decoded bytes
+ * go, and any error message it leaves behind.
+ */
+struct DecodeJob {
+	BlockType type;
+	BlockIndexEntry entry;
+	bool checked;
+	uint32_t checksum;
+	string input;
+	char* output;
+	bool failed;
+	string message;
+};
+
+/* Type: FixedBuffer
+ * A stream buffer over a fixed stretch of memory.  Writing past
+ * its end fails instead of growing it.
+ */
+class FixedBuffer : public streambuf {
+public:
+	FixedBuffer(char* start, size_t size)
+	{
+		setp(start, start + size);
+	}
+
+	/* Returns the number of bytes written so far. */
+	size_t written() const
+	{
+		return size_t(pptr() - pbase());
+	}
+};
+
+/* Type: BitCursor
+ * A read position in one encoded stream held in memory: the bits
+ * loaded but not yet used, lowest first, and how many zero bits
+ * have been loaded from past the end.
+ */
+struct BitCursor {
+	const uint8_t* next;
+	const uint8_t* end;
+	uint64_t bits;
+	int count;
+	int padBits;
+};
+
+/*
+	Starts a cursor at the beginning of length bytes at data
+*/
+static void startCursor(BitCursor& cursor, const uint8_t* data, size_t length)
+{
+	cursor.next = data;
+	cursor.end = data + length;
+	cursor.bits = 0;
+	cursor.count = 0;
+	cursor.padBits = 0;
+}
+
+/*
+	Loads bytes until the cursor holds at least 57 bits, using zeros
+	past the end of the stream
+*/
+static inline void refillCursor(BitCursor& cursor)
+{
+	while (cursor.count <= 56)
+	{
+		uint64_t byte = 0;
+		if (cursor.next < cursor.end) byte = *cursor.next++;
+		else cursor.padBits += 8;
+		cursor.bits |= byte << cursor.count;
+		cursor.count += 8;
+	}
+}
+
+/*
+	Decodes one symbol at the cursor.  Codes longer than the primary
+	table go down to its second level.  The cursor must hold enough
+	bits for the code.
+*/
+static inline ext_char decodeAtCursor(BitCursor& cursor, const DecodeTable& table)
+{
+	const DecodeEntry* entry = &table.entries[uint32_t(cursor.bits & ((uint64_t(1) << table.lookupBits) - 1))];
+	while (entry->link != 0)
+	{
+		cursor.bits >>= entry->length;
+		cursor.count -= entry->length;
+		entry = &table.entries[table.subtables[entry->symbol] + uint32_t(cursor.bits & ((uint64_t(1) << entry->link) - 1))];
+	}
+	cursor.bits >>= entry->length;
+	cursor.count -= entry->length;
+	return entry->symbol;
+}
+
+/*
+	Decodes the INTERLEAVED_STREAMS streams of an interleaved block
+	into output, which has room for rawSize bytes.  While every
+	stream has bytes left, each refill leaves at least 57 bits per
+	stream, enough for five codes of up to 11 bits, so five symbols
+	are taken from each stream in turn before the next refill.  The
+	last stream's extra bytes, and tables with longer codes, go one
+	symbol at a time.
+*/
+static void decodeInterleaved(const uint8_t* data, size_t length, const DecodeTable& table,
+                              uint32_t rawSize, char* output)
+{
+	const int GROUP = 5;
+	const bool shortCodes = (table.subtables.empty() && table.lookupBits <= 56 / GROUP);
+
+	//stream sizes, then the streams
+	size_t sizes[INTERLEAVED_STREAMS];
+	size_t used = 4 * (INTERLEAVED_STREAMS - 1);
+	if (length < used) error("Interleaved block is cut off.");
+	for (int i = 0; i < INTERLEAVED_STREAMS - 1; i++)
+	{
+		sizes[i] = size_t(data[4 * i]) | (size_t(data[4 * i + 1]) << 8) |
+		           (size_t(data[4 * i + 2]) << 16) | (size_t(data[4 * i + 3]) << 24);
+		if (sizes[i] > length - used) error("Interleaved block is cut off.");
+		used += sizes[i];
+	}
+	sizes[INTERLEAVED_STREAMS - 1] = length - used;
+
+	BitCursor cursors[INTERLEAVED_STREAMS];
+	size_t offset = 4 * (INTERLEAVED_STREAMS - 1);
+	for (int i = 0; i < INTERLEAVED_STREAMS; i++)
+	{
+		startCursor(cursors[i], data + offset, sizes[i]);
+		offset += sizes[i];
+	}
+
+	size_t pieceSize = rawSize / INTERLEAVED_STREAMS;
+	uint8_t* out0 = (uint8_t*)output;
+	uint8_t* out1 = out0 + pieceSize;
+	uint8_t* out2 = out1 + pieceSize;
+	uint8_t* out3 = out2 + pieceSize;
+	BitCursor& c0 = cursors[0];
+	BitCursor& c1 = cursors[1];
+	BitCursor& c2 = cursors[2];
+	BitCursor& c3 = cursors[3];
+	ext_char seen = 0; //every symbol ORed together, to catch PSEUDO_EOF once
+
+	size_t done = 0;
+	if (shortCodes)
+	{
+		const DecodeEntry* entries = &table.entries[0];
+		const uint64_t mask = (uint64_t(1) << table.lookupBits) - 1;
+		for (; done + GROUP <= pieceSize; done += GROUP)
+		{
+			refillCursor(c0);
+			refillCursor(c1);
+			refillCursor(c2);
+			refillCursor(c3);
+			for (int k = 0; k < GROUP; k++)
+			{
+				const DecodeEntry& e0 = entries[c0.bits & mask];
+				const DecodeEntry& e1 = entries[c1.bits & mask];
+				const DecodeEntry& e2 = entries[c2.bits & mask];
+				const DecodeEntry& e3 = entries[c3.bits & mask];
+				c0.bits >>= e0.length; c0.count -= e0.length;
+				c1.bits >>= e1.length; c1.count -= e1.length;
+				c2.bits >>= e2.length; c2.count -= e2.length;
+				c3.bits >>= e3.length; c3.count -= e3.length;
+				seen |= e0.symbol | e1.symbol | e2.symbol | e3.symbol;
+				out0[done + k] = uint8_t(e0.symbol);
+				out1[done + k] = uint8_t(e1.symbol);
+				out2[done + k] = uint8_t(e2.symbol);
+				out3[done + k] = uint8_t(e3.symbol);
+			}
+		}
+	}
+
+	//whatever is left, one symbol at a time, then each stream's PSEUDO_EOF
+	for (int i = 0; i < INTERLEAVED_STREAMS; i++)
+	{
+		size_t pieceLength = (i == INTERLEAVED_STREAMS - 1 ? rawSize - i * pieceSize : pieceSize);
+		uint8_t* out = out0 + i * pieceSize;
+		for (size_t j = done; j < pieceLength; j++)
+		{
+			refillCursor(cursors[i]);
+			ext_char ch = decodeAtCursor(cursors[i], table);
+			seen |= ch;
+			out[j] = uint8_t(ch);
+		}
+
+		refillCursor(cursors[i]);
+		if (decodeAtCursor(cursors[i], table) != PSEUDO_EOF) error("Interleaved stream does not end in PSEUDO_EOF.");
+		if (cursors[i].count < cursors[i].padBits) error("Encoded data ended before PSEUDO_EOF.");
+	}
+	if (seen > 0xFF) error("PSEUDO_EOF in the middle of an interleaved stream.");
+}
+
+/*
+	Decodes the block of one job straight into its part of the
+	output buffer, and returns the CRC-32C of what it wrote.  As with
+	encodeBlock, no tree nodes are involved.  The checksum is taken
+	as the bytes are made where the block is written in order: while
+	stored bytes are copied, from the value of a run, and as the
+	decoder's buffer flushes.  Interleaved and run-length blocks
+	write their bytes out of order or in two steps, so theirs is
+	taken from the finished block, which is then still in cache.
+*/
+static uint32_t decodeBlockData(DecodeJob& job)
+{
+	if (job.type == STORED_BLOCK)
+	{
+		if (job.input.size() != job.entry.rawSize) error("Stored block has the wrong size.");
+		return copyWithCrc32c(0, job.output, (const unsigned char*)job.input.data(), job.input.size());
+	}
+	if (job.type == SKIPPED_BLOCK)
+	{
+		if (job.entry.rawSize != 0) error("Skipped block has data.");
+		return 0;
+	}
+	if (job.type == RUN_BLOCK)
+	{
+		if (job.input.size() != 1) error("Run block is damaged.");
+		memset(job.output, (unsigned char)job.input[0], job.entry.rawSize);
+		return repeatCrc32c(0, (unsigned char)job.input[0], job.entry.rawSize);
+	}
+
+	istringbstream source(job.input);
+	uint8_t lengths[NUM_SYMBOLS];
+	readCodeLengthHeader(source, lengths);
+	DecodeTable table;
+	buildCachedDecodeTable(lengths, table);
+
+	if (job.type == INTERLEAVED_BLOCK)
+	{
+		size_t headerSize = size_t(source.tellg());
+		decodeInterleaved((const uint8_t*)job.input.data() + headerSize, job.input.size() - headerSize,
+		                  table, job.entry.rawSize, job.output);
+		return updateCrc32c(0, (const unsigned char*)job.output, job.entry.rawSize);
+	}
+
+	if (job.type == RLE_BLOCK)
+	{
+		ostringstream runs;
+		decodeSymbols(source, table, runs);
+		decodeRuns(runs.str(), job.output, job.entry.rawSize);
+		return updateCrc32c(0, (const unsigned char*)job.output, job.entry.rawSize);
+	}
+
+	uint32_t checksum = 0;
+	FixedBuffer buffer(job.output, job.entry.rawSize);
+	ostream decoded(&buffer);
+	decodeSymbols(source, table, decoded, &checksum);
+	if (decoded.fail() || buffer.written() != job.entry.rawSize)
+	{
+		error("Block decoded to the wrong size.");
+	}
+	return checksum;
+}
+
+/*
+	Decodes the block of one job and checks it against its checksum
+*/
+static void decodeBlock(DecodeJob& job)
+{
+	uint32_t checksum = decodeBlockData(job);
+	if (job.checked && checksum != job.checksum)
+	{
+		error("Block does not match its checksum; the file is damaged.");
+	}
+}
+
+/*
+	Thread body: decodes the block of one job, keeping any error for
+	the thread that started it
+*/
+static void runDecodeJob(DecodeJob& job)
+{
+	MemoryCategoryScope scope(BLOCK_MEMORY);
+	try
+	{
+		decodeBlock(job);
+	}
+	catch (ErrorException& ex)
+	{
+		job.failed = true;
+		job.message = ex.getMessage();
+	}
+}
+
+/*
+	Reads the next block record of a container into job, and returns
+	false once the end of the blocks is reached
+*/
+static bool readBlockRecord(ibstream& infile, DecodeJob& job)
+{
+	int type = infile.get();
+	if (infile.fail()) error("Block container is cut off.");
+	if (type == END_OF_BLOCKS) return false;
+	job.checked = (type & BLOCK_CHECKSUM_FLAG) != 0;
+	type &= ~BLOCK_CHECKSUM_FLAG;
+	if (type != HUFFMAN_BLOCK && type != INTERLEAVED_BLOCK && type != STORED_BLOCK &&
+	    type != RUN_BLOCK && type != RLE_BLOCK && (type != SKIPPED_BLOCK || job.checked))
+	{
+		error("Unknown block type " + integerToString(type) + ".");
+	}
+	job.type = BlockType(type);
+
+	job.entry.rawSize = readUint32(infile, "Block container");
+	job.entry.compressedSize = readUint32(infile, "Block container");
+	if (job.entry.rawSize > uint32_t(MAX_BLOCK_SIZE)) error("Block is larger than any block size.");
+
+	job.input.resize(job.entry.compressedSize);
+	if (job.entry.compressedSize != 0) infile.read(&job.input[0], job.entry.compressedSize);
+	if (infile.fail()) error("Block container is cut off.");
+
+	//the checksum is not part of what the block decodes from
+	job.checksum = 0;
+	if (job.checked)
+	{
+		if (job.input.size() < 4) error("Block is too short for its checksum.");
+		size_t dataSize = job.input.size() - 4;
+		for (int i = 0; i < 4; i++)
+		{
+			job.checksum |= uint32_t((unsigned char)job.input[dataSize + i]) << (8 * i);
+		}
+		job.input.resize(dataSize);
+	}
+	return true;
+}
+
+/* Function: readBlock
+ * Usage: if (readBlock(infile, blockSize, block)) ...
+ * --------------------------------------------------------
+ * Reads up to blockSize bytes from infile into block, and returns
+ * whether any were read.
+ */
+bool readBlock(istream& infile, int blockSize, string& block)
+{
+	block.resize(blockSize);
+	streamsize count = infile.rdbuf()->sgetn(&block[0], blockSize);
+	if (count < 0) count = 0;
+	block.resize(size_t(count));
+	return count > 0;
+}
+
+/* Function: hardwareThreads
+ * Usage: int threads = hardwareThreads();
+ * --------------------------------------------------------
+ * Returns the number of processors available to this program,
+ * or 1 if that cannot be found out.
+ */
+int hardwareThreads()
+{
+#ifdef _WIN32
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	int count = int(info.dwNumberOfProcessors);
+#else
+	int count = int(sysconf(_SC_NPROCESSORS_ONLN));
+#endif
+	return (count > 0 ? count : 1);
+}
+
+/*
+	Checks the options of compressBlocks and appendBlocks, and
+	returns the number of threads to use
+*/
+static int checkBlockOptions(int blockSize, int numThreads, BlockType blockType)
+{
+	if (blockSize < 1 || blockSize > MAX_BLOCK_SIZE) error("Block size must be between 1 byte and 1 GiB.");
+	if (numThreads < 0) error("Number of threads cannot be negative.");
+	if (blockType != HUFFMAN_BLOCK && blockType != INTERLEAVED_BLOCK) error("Blocks can only be Huffman or interleaved.");
+	return (numThreads == 0 ? hardwareThreads() : numThreads);
+}
+
+/*
+	Reads infile to its end in batches of one block per thread,
+	encodes each batch at once, and writes the records to outfile
+	in input order, adding their sizes to index
+*/
+static void writeBlockBatches(istream& infile, ostream& outfile, int blockSize, int numThreads,
+                              BlockType blockType, std::vector<BlockIndexEntry>& index)
+{
+	std::vector<BlockJob> jobs(numThreads);
+	std::vector<Thread> threads(numThreads);
+	bool moreInput = true;
+	while (moreInput)
+	{
+		//fill a batch of blocks, one per thread
+		int numJobs = 0;
+		while (numJobs < numThreads && readBlock(infile, blockSize, jobs[numJobs].input))
+		{
+			jobs[numJobs].type = blockType;
+			jobs[numJobs].failed = false;
+			numJobs++;
+		}
+		moreInput = (numJobs == numThreads);
+		if (numJobs == 0) break;
+
+		//the first block is encoded here rather than left waiting
+		for (int i = 1; i < numJobs; i++)
+		{
+			threads[i] = fork(runBlockJob, jobs[i]);
+		}
+		runBlockJob(jobs[0]);
+		for (int i = 1; i < numJobs; i++)
+		{
+			join(threads[i]);
+		}
+
+		//write the results out in input order
+		for (int i = 0; i < numJobs; i++)
+		{
+			BlockJob& job = jobs[i];
+			if (job.failed) error(job.message);
+
+			writeBlockRecord(outfile, job.type, job.input.size(), job.output, index);
+		}
+		outfile.flush(); //let a reader downstream start on these blocks
+	}
+}
+
+/* Function: compressBlocks
+ * Usage: compressBlocks(infile, outfile, blockSize, numThreads, blockType);
+ * --------------------------------------------------------
+ * Compresses infile into outfile as a BLOCK_CONTAINER, splitting
+ * it into blocks of blockSize bytes of the given type.  Up to
+ * numThreads blocks are encoded at the same time; zero means one
+ * thread per processor.
+ */
+void compressBlocks(istream& infile, obstream& outfile, int blockSize, int numThreads, BlockType blockType)
+{
+	MemoryCategoryScope scope(BLOCK_MEMORY);
+	numThreads = checkBlockOptions(blockSize, numThreads, blockType);
+
+	writeContainerVersion(outfile, BLOCK_CONTAINER);
+
+	std::vector<BlockIndexEntry> index;
+	writeBlockBatches(infile, outfile, blockSize, numThreads, blockType, index);
+	writeBlockIndex(outfile, index);
+}
+
+/* Function: appendBlocks
+ * Usage: appendBlocks(infile, archive, blockSize, numThreads, blockType);
+ * --------------------------------------------------------
+ * Reads only the trailer of archive: the block count, the index
+ * before it, and the END_OF_BLOCKS record before that, whose place
+ * must be where the records the index describes end.  The new
+ * records go after the trailer, and are followed by a new
+ * END_OF_BLOCKS record and the index of every block, counting the
+ * old trailer as a SKIPPED_BLOCK.  The record header that makes
+ * it one is written last.
+ */
+void appendBlocks(istream& infile, iostream& archive, int blockSize, int numThreads, BlockType blockType)
+{
+	MemoryCategoryScope scope(BLOCK_MEMORY);
+	numThreads = checkBlockOptions(blockSize, numThreads, blockType);
+
+	const streamoff headerSize = sizeof CONTAINER_MAGIC; //the magic, then the version
+	archive.seekg(0, ios::end);
+	streamoff fileSize = streamoff(archive.tellg());
+	char header[sizeof CONTAINER_MAGIC];
+	archive.seekg(0);
+	archive.read(header, sizeof header);
+	if (archive.fail() || fileSize < headerSize + 1 + 4 ||
+	    string(header, sizeof header - 1) != CONTAINER_MAGIC || header[sizeof header - 1] != char(BLOCK_CONTAINER))
+	{
+		error("Only a block container can be appended to.");
+	}
+
+	archive.seekg(-4, ios::end);
+	uint32_t numBlocks = readUint32(archive, "Block container");
+	streamoff endOfBlocks = fileSize - 4 - streamoff(numBlocks) * 8 - 1;
+	if (endOfBlocks < headerSize) error("Block index does not match the blocks.");
+	archive.seekg(endOfBlocks);
+	if (archive.get() != END_OF_BLOCKS) error("Block index does not match the blocks.");
+
+	std::vector<BlockIndexEntry> index(numBlocks);
+	streamoff recordsEnd = headerSize;
+	for (uint32_t i = 0; i < numBlocks; i++)
+	{
+		index[i].rawSize = readUint32(archive, "Block container");
+		index[i].compressedSize = readUint32(archive, "Block container");
+		recordsEnd += 1 + 4 + 4 + streamoff(index[i].compressedSize);
+	}
+	if (archive.fail() || recordsEnd != endOfBlocks) error("Block index does not match the blocks.");
+
+	//the old trailer stays the end of the blocks until the new one is whole
+	const streamoff recordHeaderSize = 1 + 4 + 4;
+	BlockIndexEntry skipped;
+	skipped.rawSize = 0;
+	skipped.compressedSize = uint32_t(fileSize - endOfBlocks - recordHeaderSize);
+	bool keepTrailer = (fileSize - endOfBlocks >= recordHeaderSize);
+	if (keepTrailer) index.push_back(skipped);
+
+	archive.seekp(keepTrailer ? fileSize : endOfBlocks);
+	writeBlockBatches(infile, archive, blockSize, numThreads, blockType, index);
+	writeBlockIndex(archive, index);
+	archive.flush();
+	if (archive.fail()) error("Cannot write to the archive.");
+	if (!keepTrailer) return;
+
+	archive.seekp(endOfBlocks);
+	archive.put(char(SKIPPED_BLOCK));
+	writeUint32(archive, skipped.rawSize);
+	writeUint32(archive, skipped.compressedSize);
+	archive.flush();
+	if (archive.fail()) error("Cannot write to the archive.");
+}
+
+/* Function: appendBlocks
+ * Usage: appendBlocks(infile, archiveName, blockSize, numThreads, blockType);
+ * --------------------------------------------------------
+ * Opens the archive with an fbstream, which neither truncates it
+ * nor moves every write to its end.
+ */
+void appendBlocks(istream& infile, const string& archiveName, int blockSize, int numThreads, BlockType blockType)
+{
+	fbstream archive(archiveName);
+	if (!archive.is_open()) error("Cannot open " + archiveName + " to append to it.");
+	appendBlocks(infile, archive, blockSize, numThreads, blockType);
+}
+
+/* Function: writeBlockRecord
+ * Usage: writeBlockRecord(outfile, type, rawSize, encoded, index);
+ * --------------------------------------------------------
+ * Writes the record of one block and adds its sizes to index.
+ */
+void writeBlockRecord(ostream& outfile, BlockType type, size_t rawSize, const string& encoded,
+                      std::vector<BlockIndexEntry>& index)
+{
+	BlockIndexEntry entry;
+	entry.rawSize = uint32_t(rawSize);
+	entry.compressedSize = uint32_t(encoded.size());
+	index.push_back(entry);
+
+	outfile.put(char(type | BLOCK_CHECKSUM_FLAG));
+	writeUint32(outfile, entry.rawSize);
+	writeUint32(outfile, entry.compressedSize);
+	outfile.write(encoded.data(), encoded.size());
+}
+
+/* Function: writeBlockIndex
+ * Usage: writeBlockIndex(outfile, index);
+ * --------------------------------------------------------
+ * Ends the blocks and writes the block index.
+ */
+void writeBlockIndex(ostream& outfile, const std::vector<BlockIndexEntry>& index)
+{
+	outfile.put(char(END_OF_BLOCKS));
+	for (size_t i = 0; i < index.size(); i++)
+	{
+		writeUint32(outfile, index[i].rawSize);
+		writeUint32(outfile, index[i].compressedSize);
+	}
+	writeUint32(outfile, uint32_t(index.size()));
+}
+
+/* Function: compressStream
+ * Usage: compressStream(infile, outfile, blockSize);
+ * --------------------------------------------------------
+ * Compresses infile into outfile one block at a time on the
+ * calling thread, reading every byte once.
+ */
+void compressStream(istream& infile, obstream& outfile, int blockSize)
+{
+	compressBlocks(infile, outfile, blockSize, 1);
+}
+
+/* Function: decodeBlockContainer
+ * Usage: decodeBlockContainer(infile, outfile, numThreads);
+ * --------------------------------------------------------
+ * Decodes the blocks of a BLOCK_CONTAINER whose magic and version
+ * have already been read, writing the original data to outfile.
+ * Up to numThreads blocks are decoded at the same time; zero
+ * means one thread per processor.
+ */
+void decodeBlockContainer(ibstream& infile, ostream& outfile, int numThreads)
+{
+	MemoryCategoryScope scope(BLOCK_MEMORY);
+	if (numThreads < 0) error("Number of threads cannot be negative.");
+	if (numThreads == 0) numThreads = hardwareThreads();
+
+	std::vector<BlockIndexEntry> blocks;
+	std::vector<DecodeJob> jobs(numThreads);
+	std::vector<Thread> threads(numThreads);
+	string output;
+	bool moreBlocks = true;
+	while (moreBlocks)
+	{
+		//read a batch of blocks, one per thread
+		int numJobs = 0;
+		size_t outputSize = 0;
+		while (numJobs < numThreads && (moreBlocks = readBlockRecord(infile, jobs[numJobs])))
+		{
+			blocks.push_back(jobs[numJobs].entry);
+			outputSize += jobs[numJobs].entry.rawSize;
+			numJobs++;
+		}
+		if (numJobs == 0) break;
+
+		//every block decodes into its own stretch of one buffer
+		output.resize(outputSize);
+		size_t offset = 0;
+		for (int i = 0; i < numJobs; i++)
+		{
+			jobs[i].output = (outputSize == 0 ? NULL : &output[offset]);
+			jobs[i].failed = false;
+			offset += jobs[i].entry.rawSize;
+		}
+
+		for (int i = 1; i < numJobs; i++)
+		{
+			threads[i] = fork(runDecodeJob, jobs[i]);
+		}
+		runDecodeJob(jobs[0]);
+		for (int i = 1; i < numJobs; i++)
+		{
+			join(threads[i]);
+		}
+
+		for (int i = 0; i < numJobs; i++)
+		{
+			if (jobs[i].failed) error(jobs[i].message);
+		}
+		outfile.write(output.data(), output.size());
+	}
+
+	//the index must agree with the blocks just read
+	for (size_t i = 0; i < blocks.size(); i++)
+	{
+		uint32_t rawSize = readUint32(infile, "Block container");
+		uint32_t compressedSize = readUint32(infile, "Block container");
+		if (rawSize != blocks[i].rawSize || compressedSize != blocks[i].compressedSize)
+		{
+			error("Block index does not match the blocks.");
+		}
+	}
+	if (readUint32(infile, "Block container") != blocks.size()) error("Block index does not match the blocks.");
+}
+
+/* Function: decodeBlockRange
+ * Usage: decodeBlockRange(infile, outfile, offset, length);
+ * --------------------------------------------------------
+ * Reads the index from the end of the file, then walks it to find
+ * where each block's record starts, seeking only to the records of
+ * blocks that overlap the range.
+ */
+void decodeBlockRange(ibstream& infile, ostream& outfile, uint64_t offset, uint64_t length)
+{
+	MemoryCategoryScope scope(BLOCK_MEMORY);
+	streamoff recordStart = streamoff(infile.tellg());
+	if (recordStart < 0) error("Cannot seek in the compressed data.");
+
+	infile.seekg(-4, ios::end);
+	uint32_t numBlocks = readUint32(infile, "Block container");
+	streamoff indexStart = streamoff(infile.tellg()) - 4 - streamoff(numBlocks) * 8;
+	if (indexStart <= recordStart) error("Block index does not match the blocks.");
+	infile.seekg(indexStart);
+	std::vector<BlockIndexEntry> blocks(numBlocks);
+	for (uint32_t i = 0; i < numBlocks; i++)
+	{
+		blocks[i].rawSize = readUint32(infile, "Block container");
+		blocks[i].compressedSize = readUint32(infile, "Block container");
+	}
+
+	uint64_t end = (length > ~offset ? ~uint64_t(0) : offset + length);
+	uint64_t blockStart = 0;
+	DecodeJob job;
+	string output;
+	for (uint32_t i = 0; i < numBlocks && blockStart < end; i++)
+	{
+		uint64_t blockEnd = blockStart + blocks[i].rawSize;
+		if (blockEnd > offset)
+		{
+			infile.clear();
+			infile.seekg(recordStart);
+			if (!readBlockRecord(infile, job) ||
+			    job.entry.rawSize != blocks[i].rawSize || job.entry.compressedSize != blocks[i].compressedSize)
+			{
+				error("Block index does not match the blocks.");
+			}
+
+			output.resize(job.entry.rawSize);
+			job.output = (output.empty() ? NULL : &output[0]);
+			decodeBlock(job);
+
+			//only the part of the block inside the range is wanted
+			uint64_t first = (offset > blockStart ? offset - blockStart : 0);
+			uint64_t last = (end < blockEnd ? end - blockStart : blocks[i].rawSize);
+			outfile.write(output.data() + size_t(first), streamsize(last - first));
+		}
+		blockStart = blockEnd;
+		recordStart += 1 + 4 + 4 + streamoff(blocks[i].compressedSize);
+	}
+}
@@ -0,0 +1,262 @@
+/**********************************************************
+ * File: HuffmanBlocks.h
+ *
+ * Block-by-block compression.  The input is split into fixed
+ * size blocks, and each block gets its own code lengths and
+ * is encoded on its own thread.  Because every block is
+ * self-contained, the input is read only once and never has
+ * to be rewound.
+ *
+ * A BLOCK_CONTAINER file holds the magic and version, then
+ * one record per block:
+ *
+ *   1 byte   block type (HUFFMAN_BLOCK, INTERLEAVED_BLOCK,
+ *            STORED_BLOCK, RUN_BLOCK, RLE_BLOCK or
+ *            SKIPPED_BLOCK), with BLOCK_CHECKSUM_FLAG added
+ *            to all but SKIPPED_BLOCK
+ *   4 bytes  size of the block before compression
+ *   4 bytes  size of the compressed data that follows
+ *   ...      code length header and encoded bits
+ *   4 bytes  CRC-32C of the block before compression (see
+ *            HuffmanChecksum.h), counted in the size above
+ *
+ * The decoder checks each block's CRC-32C as soon as the block is
+ * decoded and rejects the file if it differs.  Files written
+ * before blocks had checksums lack the flag and the CRC-32C, and
+ * are decoded unchecked.
+ *
+ * A STORED_BLOCK holds the bytes of the block as they are, in
+ * place of the header and bits, and is written whenever coding
+ * the block would not make it smaller.
+ *
+ * A RUN_BLOCK is a block of one byte value repeated rawSize
+ * times, and holds just that byte.
+ *
+ * An RLE_BLOCK is coded as a HUFFMAN_BLOCK, but what it codes
+ * is the block with its runs shortened: after any two equal
+ * bytes comes one more byte counting how many more times that
+ * byte repeats, from 0 to 255.  The encoder tries this for
+ * blocks whose histogram is mostly one byte value, as padding
+ * and sparse binary data are, and keeps it when it is smaller.
+ *
+ * In an INTERLEAVED_BLOCK the header is followed by the sizes
+ * of the first three of INTERLEAVED_STREAMS encoded streams, 4
+ * bytes each, then the streams themselves.  The block is cut
+ * into that many consecutive pieces, the first ones
+ * rawSize / INTERLEAVED_STREAMS bytes long and the last one
+ * taking the rest, and each piece is coded into its own stream
+ * ending in PSEUDO_EOF.  All streams share the block's code,
+ * and because they are independent, the decoder can follow
+ * them all at once: the lookups for one stream do not have to
+ * wait for the others, so their latencies overlap.
+ *
+ * A SKIPPED_BLOCK has a rawSize of 0, and its data is the rest of
+ * an old END_OF_BLOCKS record and index that appendBlocks has
+ * written past; the decoder passes over it.
+ *
+ * The last block is followed by a record of type END_OF_BLOCKS
+ * with no sizes.
+ * Last comes the block index, which repeats both sizes of
+ * every block in order, then the number of blocks in 4
+ * bytes, so that a reader can find any block from the end
+ * of the file.  All sizes are stored least significant byte
+ * first.
+ */
+
+#ifndef HuffmanBlocks_Included
+#define HuffmanBlocks_Included
+
+#include "HuffmanEncoding.h"
+#include <vector>
+
+/* Constant: DEFAULT_BLOCK_SIZE
+ * The number of input bytes in each block unless told otherwise.
+ */
+const int DEFAULT_BLOCK_SIZE = 1 << 20;
+
+/* Constant: MAX_BLOCK_SIZE
+ * The largest block size allowed, which keeps every size in the
+ * container within 32 bits.
+ */
+const int MAX_BLOCK_SIZE = 1 << 30;
+
+/* Type: BlockType
+ * The first byte of every block record.
+ */
+enum BlockType {
+	END_OF_BLOCKS = 0,
+	HUFFMAN_BLOCK = 1,
+	INTERLEAVED_BLOCK = 2,
+	STORED_BLOCK = 3,
+	RUN_BLOCK = 4,
+	RLE_BLOCK = 5,
+	SKIPPED_BLOCK = 6
+};
+
+/* Constant: BLOCK_CHECKSUM_FLAG
+ * Added to the type byte of a block record whose data ends in the
+ * CRC-32C of the block.
+ */
+const int BLOCK_CHECKSUM_FLAG = 0x80;
+
+/* Constant: INTERLEAVED_STREAMS
+ * The number of encoded streams in an INTERLEAVED_BLOCK.
+ */
+const int INTERLEAVED_STREAMS = 4;
+
+/* Type: BlockIndexEntry
+ * The sizes of one block, as recorded in the block index.
+ */
+struct BlockIndexEntry {
+	uint32_t rawSize;
+	uint32_t compressedSize;
+};
+
+/* Function: hardwareThreads
+ * Usage: int threads = hardwareThreads();
+ * --------------------------------------------------------
+ * Returns the number of processors available to this program,
+ * or 1 if that cannot be found out.
+ */
+int hardwareThreads();
+
+/* Function: compressBlocks
+ * Usage: compressBlocks(infile, outfile);
+ *        compressBlocks(infile, outfile, blockSize, numThreads, blockType);
+ * --------------------------------------------------------
+ * Compresses infile into outfile as a BLOCK_CONTAINER, splitting
+ * it into blocks of blockSize bytes (the last may be shorter).
+ * Up to numThreads blocks are encoded at the same time, so about
+ * numThreads * blockSize bytes of input are held in memory.  A
+ * numThreads of zero means one thread per processor.  infile is
+ * read once from its current position to its end.  Every block
+ * is of the given blockType, HUFFMAN_BLOCK or INTERLEAVED_BLOCK,
+ * except for blocks that are stored because they would not shrink.
+ *
+ * The result can be read back with decompress.
+ */
+void compressBlocks(istream& infile, obstream& outfile,
+                    int blockSize = DEFAULT_BLOCK_SIZE, int numThreads = 0,
+                    BlockType blockType = HUFFMAN_BLOCK);
+
+/* Function: compressStream
+ * Usage: compressStream(infile, outfile);
+ *        compressStream(infile, outfile, blockSize);
+ * --------------------------------------------------------
+ * Compresses infile into outfile one block at a time on the
+ * calling thread, as compressBlocks does with one thread.  Only
+ * one block of input is held in memory, every byte is read once,
+ * and outfile is flushed after each block, so infile can be a
+ * pipe or socket and the output can be consumed as it is made.
+ */
+void compressStream(istream& infile, obstream& outfile,
+                    int blockSize = DEFAULT_BLOCK_SIZE);
+
+/* Function: appendBlocks
+ * Usage: appendBlocks(infile, archive);
+ *        appendBlocks(infile, archive, blockSize, numThreads, blockType);
+ * --------------------------------------------------------
+ * Adds the data of infile to the end of archive, a BLOCK_CONTAINER
+ * opened for both reading and writing, as compressBlocks would
+ * encode it.  The blocks already in archive are neither read nor
+ * rewritten: only the trailer is read, so the cost depends on
+ * infile and not on the size of archive.  archive then
+ * decompresses to its old data followed by that of infile.
+ *
+ * The new blocks and a new trailer are written after the old
+ * trailer, which is left in place until they are all written and
+ * flushed.  Only then are the first 9 bytes of the old trailer
+ * turned into a SKIPPED_BLOCK record over the rest of it, so if
+ * writing fails partway, decompress still reads the archive as
+ * it was.  Each append thus keeps the old index, 8 bytes a block,
+ * as dead data.  An archive with no blocks has too short a
+ * trailer for that, and is written over in place.
+ *
+ * Raises an error if archive is not a BLOCK_CONTAINER or its index
+ * is damaged, before anything is written.
+ */
+void appendBlocks(istream& infile, iostream& archive,
+                  int blockSize = DEFAULT_BLOCK_SIZE, int numThreads = 0,
+                  BlockType blockType = HUFFMAN_BLOCK);
+
+/* Function: appendBlocks
+ * Usage: appendBlocks(infile, "archive.huf");
+ * --------------------------------------------------------
+ * Opens the named archive file and appends infile to it as above.
+ * Raises an error if the file cannot be opened for both reading
+ * and writing.
+ */
+void appendBlocks(istream& infile, const string& archiveName,
+                  int blockSize = DEFAULT_BLOCK_SIZE, int numThreads = 0,
+                  BlockType blockType = HUFFMAN_BLOCK);
+
+/* Function: encodeBlock
+ * Usage: BlockType written = encodeBlock(type, input, output);
+ * --------------------------------------------------------
+ * Encodes input as the data of one block of the given type: its
+ * code length header and encoded bits followed by the CRC-32C of
+ * input, without the record around them.  Returns the type of
+ * block actually written, which is STORED_BLOCK if coding would
+ * not have made input smaller, RUN_BLOCK if input is one byte
+ * value repeated, and RLE_BLOCK if coding its runs was smaller
+ * still.  Every block is coded on its own, so blocks can be
+ * encoded on any threads in any order.
+ */
+BlockType encodeBlock(BlockType type, const string& input, string& output);
+
+/* Function: readBlock
+ * Usage: if (readBlock(infile, blockSize, block)) ...
+ * --------------------------------------------------------
+ * Reads the next block of up to blockSize bytes from infile into
+ * block, which is shorter only at the end of the input.  Returns
+ * whether any bytes were read.
+ */
+bool readBlock(istream& infile, int blockSize, string& block);
+
+/* Function: writeBlockRecord
+ * Usage: writeBlockRecord(outfile, type, rawSize, encoded, index);
+ * --------------------------------------------------------
+ * Writes the record of a block of rawSize bytes whose data,
+ * from encodeBlock, is encoded, and adds its sizes to index.
+ * The container's magic and version must already be written,
+ * and the records must be written in input order.
+ */
+void writeBlockRecord(ostream& outfile, BlockType type, size_t rawSize, const string& encoded,
+                      std::vector<BlockIndexEntry>& index);
+
+/* Function: writeBlockIndex
+ * Usage: writeBlockIndex(outfile, index);
+ * --------------------------------------------------------
+ * Finishes a BLOCK_CONTAINER after its last record: the
+ * END_OF_BLOCKS record, then the block index from index.
+ */
+void writeBlockIndex(ostream& outfile, const std::vector<BlockIndexEntry>& index);
+
+/* Function: decodeBlockContainer
+ * Usage: decodeBlockContainer(infile, outfile);
+ *        decodeBlockContainer(infile, outfile, numThreads);
+ * --------------------------------------------------------
+ * Decodes the blocks of a BLOCK_CONTAINER whose magic and version
+ * have already been read, writing the original data to outfile.
+ * Up to numThreads blocks are decoded at the same time, each into
+ * its own part of an output buffer; zero means one thread per
+ * processor.  Raises an error if the blocks or the index are
+ * damaged.
+ */
+void decodeBlockContainer(ibstream& infile, ostream& outfile, int numThreads = 0);
+
+/* Function: decodeBlockRange
+ * Usage: decodeBlockRange(infile, outfile, offset, length);
+ * --------------------------------------------------------
+ * Decodes only the length bytes of original data that start at
+ * offset from a BLOCK_CONTAINER whose magic and version have
+ * already been read, and writes them to outfile.  The blocks are
+ * found through the block index at the end of the file, so only
+ * the blocks that overlap the range are read and decoded; infile
+ * must therefore be seekable.  A range that runs past the end of
+ * the data is cut short there.  Raises an error if the index is
+ * damaged.
+ */
+void decodeBlockRange(ibstream& infile, ostream& outfile, uint64_t offset, uint64_t length);
+
+#endif
@@ -0,0 +1,253 @@
+/**********************************************************
+ * File: HuffmanChecksum.cpp
+ *
+ * Implementation of the checksum functions from
+ * HuffmanChecksum.h.
+ */
+
+#include "HuffmanChecksum.h"
+#include <cstring>
+
+/* The CRC-32C polynomial, with its bits reversed as the
+ * instructions and tables use it.
+ */
+static const uint32_t CRC32C_POLYNOMIAL = 0x82F63B78;
+
+#if defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+#define HARDWARE_CRC32C_ARM
+#elif (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#include <nmmintrin.h>
+#define HARDWARE_CRC32C_X86
+#define CRC32C_TARGET __attribute__((target("sse4.2")))
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#include <nmmintrin.h>
+#define HARDWARE_CRC32C_X86
+#define CRC32C_TARGET
+#endif
+
+/* Type: Crc32cTables
+ * The tables for eight bytes at a time: table[0] is the usual one
+ * for a byte, and table[k] gives the effect of a byte followed by
+ * k zero bytes.
+ */
+struct Crc32cTables {
+	uint32_t table[8][256];
+
+	Crc32cTables()
+	{
+		for (int n = 0; n < 256; n++)
+		{
+			uint32_t crc = uint32_t(n);
+			for (int bit = 0; bit < 8; bit++)
+			{
+				crc = (crc >> 1) ^ (CRC32C_POLYNOMIAL & (0 - (crc & 1)));
+			}
+			table[0][n] = crc;
+		}
+		for (int n = 0; n < 256; n++)
+		{
+			for (int k = 1; k < 8; k++)
+			{
+				table[k][n] = (table[k - 1][n] >> 8) ^ table[0][table[k - 1][n] & 0xFF];
+			}
+		}
+	}
+};
+
+static const Crc32cTables tables;
+
+/* The bytes copyWithCrc32c and repeatCrc32c take at a time. */
+static const size_t CRC_PIECE_SIZE = 4096;
+
+/*
+	Runs the CRC over length bytes with the tables, crc already
+	inverted
+*/
+static uint32_t softwareCrc32c(uint32_t crc, const unsigned char* data, size_t length)
+{
+	const uint32_t (*t)[256] = tables.table;
+	for (; length >= 8; data += 8, length -= 8)
+	{
+		uint32_t low = crc ^ (uint32_t(data[0]) | (uint32_t(data[1]) << 8) |
+		                      (uint32_t(data[2]) << 16) | (uint32_t(data[3]) << 24));
+		crc = t[7][low & 0xFF] ^ t[6][(low >> 8) & 0xFF] ^ t[5][(low >> 16) & 0xFF] ^ t[4][low >> 24] ^
+		      t[3][data[4]] ^ t[2][data[5]] ^ t[1][data[6]] ^ t[0][data[7]];
+	}
+	for (; length > 0; data++, length--)
+	{
+		crc = (crc >> 8) ^ t[0][(crc ^ *data) & 0xFF];
+	}
+	return crc;
+}
+
+#if defined(HARDWARE_CRC32C_ARM)
+
+/*
+	ARMv8 compilers only define __ARM_FEATURE_CRC32 when the
+	instructions may be used
+*/
+static bool detectHardware()
+{
+	return true;
+}
+
+/*
+	Runs the CRC over length bytes with the crc32c instructions
+*/
+static uint32_t hardwareCrc32c(uint32_t crc, const unsigned char* data, size_t length)
+{
+	for (; length >= 8; data += 8, length -= 8)
+	{
+		uint64_t word;
+		memcpy(&word, data, sizeof word);
+		crc = __crc32cd(crc, word);
+	}
+	for (; length > 0; data++, length--)
+	{
+		crc = __crc32cb(crc, *data);
+	}
+	return crc;
+}
+
+#elif defined(HARDWARE_CRC32C_X86)
+
+/*
+	Asks the processor whether it has SSE4.2, which brought the
+	crc32 instruction
+*/
+static bool detectHardware()
+{
+#if defined(_MSC_VER)
+	int info[4];
+	__cpuid(info, 1);
+	return (info[2] & (1 << 20)) != 0;
+#else
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("sse4.2") != 0;
+#endif
+}
+
+/*
+	Runs the CRC over length bytes with the crc32 instruction, a
+	word at a time
+*/
+CRC32C_TARGET static uint32_t hardwareCrc32c(uint32_t crc, const unsigned char* data, size_t length)
+{
+#if defined(__x86_64__) || defined(_M_X64)
+	uint64_t wide = crc;
+	for (; length >= 8; data += 8, length -= 8)
+	{
+		uint64_t word;
+		memcpy(&word, data, sizeof word);
+		wide = _mm_crc32_u64(wide, word);
+	}
+	crc = uint32_t(wide);
+#else
+	for (; length >= 4; data += 4, length -= 4)
+	{
+		uint32_t word;
+		memcpy(&word, data, sizeof word);
+		crc = _mm_crc32_u32(crc, word);
+	}
+#endif
+	for (; length > 0; data++, length--)
+	{
+		crc = _mm_crc32_u8(crc, *data);
+	}
+	return crc;
+}
+
+#else
+
+/*
+	No instructions are known for this processor
+*/
+static bool detectHardware()
+{
+	return false;
+}
+
+static uint32_t hardwareCrc32c(uint32_t crc, const unsigned char* data, size_t length)
+{
+	return softwareCrc32c(crc, data, length);
+}
+
+#endif
+
+static const bool useHardware = detectHardware();
+
+/* Function: updateCrc32c
+ * Usage: uint32_t crc = updateCrc32c(0, data, length);
+ * --------------------------------------------------------
+ * The register is kept inverted while the bytes go through it, so
+ * the inversion on the way in undoes the one on the way out of the
+ * previous call.
+ */
+uint32_t updateCrc32c(uint32_t crc, const unsigned char* data, size_t length)
+{
+	crc = ~crc;
+	crc = (useHardware ? hardwareCrc32c(crc, data, length) : softwareCrc32c(crc, data, length));
+	return ~crc;
+}
+
+/* Function: updateCrc32cPortable
+ * Usage: uint32_t crc = updateCrc32cPortable(0, data, length);
+ * --------------------------------------------------------
+ * The tables alone, inverted as updateCrc32c does.
+ */
+uint32_t updateCrc32cPortable(uint32_t crc, const unsigned char* data, size_t length)
+{
+	return ~softwareCrc32c(~crc, data, length);
+}
+
+/* Function: copyWithCrc32c
+ * Usage: crc = copyWithCrc32c(crc, destination, source, length);
+ * --------------------------------------------------------
+ * Pieces of CRC_PIECE_SIZE bytes stay in the first level cache
+ * between being checksummed and being copied.
+ */
+uint32_t copyWithCrc32c(uint32_t crc, void* destination, const unsigned char* source, size_t length)
+{
+	unsigned char* out = (unsigned char*)destination;
+	while (length > 0)
+	{
+		size_t piece = (length < CRC_PIECE_SIZE ? length : CRC_PIECE_SIZE);
+		crc = updateCrc32c(crc, source, piece);
+		memcpy(out, source, piece);
+		source += piece;
+		out += piece;
+		length -= piece;
+	}
+	return crc;
+}
+
+/* Function: repeatCrc32c
+ * Usage: crc = repeatCrc32c(crc, value, count);
+ * --------------------------------------------------------
+ * Runs one piece of the value through the CRC as many times as
+ * it takes.
+ */
+uint32_t repeatCrc32c(uint32_t crc, unsigned char value, uint64_t count)
+{
+	unsigned char piece[CRC_PIECE_SIZE];
+	memset(piece, value, sizeof piece);
+	while (count > 0)
+	{
+		size_t length = size_t(count < sizeof piece ? count : sizeof piece);
+		crc = updateCrc32c(crc, piece, length);
+		count -= length;
+	}
+	return crc;
+}
+
+/* Function: hasHardwareCrc32c
+ * Usage: if (hasHardwareCrc32c()) ...
+ * --------------------------------------------------------
+ * Returns what was found when the program started.
+ */
+bool hasHardwareCrc32c()
+{
+	return useHardware;
+}
@@ -0,0 +1,70 @@
+/**********************************************************
+ * File: HuffmanChecksum.h
+ *
+ * CRC-32C checksums of the original data.  A damaged code
+ * usually still decodes to something, so without a checksum a
+ * bad block is only noticed if it happens to lose PSEUDO_EOF.
+ * Blocks carry the CRC-32C of their bytes (see HuffmanBlocks.h),
+ * and so do canonical, stored and run containers (see
+ * CONTAINER_CHECKSUM_FLAG in HuffmanEncoding.h).  The CRC-32C is
+ * computed a piece at a time as the bytes are read, copied or
+ * written out, so checking them never takes a second pass over
+ * the file.
+ *
+ * CRC-32C (Castagnoli) is used rather than the CRC-32 of zip
+ * because processors compute it directly: the crc32 instruction
+ * of SSE4.2 on x86 and the CRC extension of ARMv8.  Where neither
+ * is available, a table-driven version eight bytes at a time
+ * gives the same results.
+ */
+
+#ifndef HuffmanChecksum_Included
+#define HuffmanChecksum_Included
+
+#include "HuffmanTypes.h"
+
+/* Function: updateCrc32c
+ * Usage: uint32_t crc = updateCrc32c(0, data, length);
+ *        crc = updateCrc32c(crc, more, moreLength);
+ * --------------------------------------------------------
+ * Returns the CRC-32C of length bytes at data following the bytes
+ * whose CRC-32C is crc, so that a checksum can be built up a piece
+ * at a time.  The CRC-32C of no bytes is 0.
+ */
+uint32_t updateCrc32c(uint32_t crc, const unsigned char* data, size_t length);
+
+/* Function: updateCrc32cPortable
+ * Usage: uint32_t crc = updateCrc32cPortable(0, data, length);
+ * --------------------------------------------------------
+ * Returns the same as updateCrc32c, always computed with the
+ * tables, so that the processor's instructions can be checked
+ * against it.
+ */
+uint32_t updateCrc32cPortable(uint32_t crc, const unsigned char* data, size_t length);
+
+/* Function: copyWithCrc32c
+ * Usage: crc = copyWithCrc32c(crc, destination, source, length);
+ * --------------------------------------------------------
+ * Copies length bytes from source to destination, as memcpy does,
+ * and returns crc updated with them.  Each piece is checksummed
+ * just before it is copied, while it is in cache.
+ */
+uint32_t copyWithCrc32c(uint32_t crc, void* destination, const unsigned char* source, size_t length);
+
+/* Function: repeatCrc32c
+ * Usage: crc = repeatCrc32c(crc, value, count);
+ * --------------------------------------------------------
+ * Returns crc updated with count bytes that all hold value, as
+ * the data of a run is, without that data having to exist.
+ */
+uint32_t repeatCrc32c(uint32_t crc, unsigned char value, uint64_t count);
+
+/* Function: hasHardwareCrc32c
+ * Usage: if (hasHardwareCrc32c()) ...
+ * --------------------------------------------------------
+ * Returns whether updateCrc32c uses the processor's own CRC-32C
+ * instructions rather than tables.
+ */
+bool hasHardwareCrc32c();
+
+#endif
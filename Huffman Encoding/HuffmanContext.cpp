@@ -0,0 +1,255 @@
+/**********************************************************
+ * File: HuffmanContext.cpp
+ *
+ * Implementation of the contexts and pool from HuffmanContext.h.
+ */
+
+#include "HuffmanContext.h"
+#include "HuffmanHistogram.h"
+#include "TableCache.h"
+#include "MemoryDiagnostics.h"
+#include "error.h"
+#include <cstring>
+
+/* Constructor: HuffmanContext
+ * ----------------------------------------------------
+ * Starts out as if just reset.
+ */
+HuffmanContext::HuffmanContext() {
+	reset();
+}
+
+/* Member function: compress
+ * ----------------------------------------------------
+ * Counts the message, and works out a code and its header only if
+ * the histogram differs from the one the last code was built for.
+ * The arena is reset before each tree, which releases the last
+ * one even if building it raised an error.
+ */
+void HuffmanContext::compress(const uint8_t* data, size_t length, std::vector<uint8_t>& output) {
+	MemoryCategoryScope scope(CODING_MEMORY);
+	memset(weights, 0, sizeof weights);
+	countBytes(data, length, weights);
+	weights[PSEUDO_EOF] = 1;
+	counts.messages++;
+
+	if (haveCode && memcmp(weights, codeWeights, sizeof weights) == 0) {
+		counts.reused++;
+	} else {
+		haveCode = false; //until the new code is whole
+		if (getTableCache() != NULL) {
+			buildCachedCodeTable(weights, codes);
+		} else {
+			arena.reset();
+			buildCodeTable(buildEncodingTree(weights, arena, DEFAULT_MAX_CODE_LENGTH), codes);
+			buildCanonicalCodeTable(codes.length, codes);
+		}
+		headerBytes = writeCodeLengthHeader(codes.length, header);
+		memcpy(codeWeights, weights, sizeof weights);
+		haveCode = true;
+		counts.built++;
+	}
+	writeBufferContainer(data, length, weights, codes, header, headerBytes, output);
+}
+
+/* Member function: reset
+ * ----------------------------------------------------
+ * Clears the flag that says a code is kept, and the counters.
+ */
+void HuffmanContext::reset() {
+	haveCode = false;
+	headerBytes = 0;
+	arena.reset();
+	counts.messages = counts.built = counts.reused = 0;
+}
+
+/* Member function: stats
+ * ----------------------------------------------------
+ * Returns a copy of the counters.
+ */
+ContextStats HuffmanContext::stats() const {
+	return counts;
+}
+
+/* Constructor: HuffmanDecoderContext
+ * ----------------------------------------------------
+ * Starts out as if just reset.
+ */
+HuffmanDecoderContext::HuffmanDecoderContext() {
+	reset();
+}
+
+/* Member function: decompress
+ * ----------------------------------------------------
+ * Reads the header straight from memory, and rebuilds the table
+ * only when the lengths in it are not the ones the table decodes.
+ */
+void HuffmanDecoderContext::decompress(const uint8_t* data, size_t length, std::vector<uint8_t>& output) {
+	MemoryCategoryScope scope(CODING_MEMORY);
+	size_t dataLength = length;
+	int version = 0;
+	bool checked = false;
+	uint32_t stored = 0, checksum = 0;
+	size_t start = readBufferVersion(data, dataLength, version, checked, stored);
+	counts.messages++;
+
+	if (version != CANONICAL_CONTAINER) {
+		decompressBuffer(data, length, output);
+		return;
+	}
+
+	start += readCodeLengthHeader(data + start, dataLength - start, lengths);
+	if (haveTable && memcmp(lengths, tableLengths, sizeof lengths) == 0) {
+		counts.reused++;
+	} else {
+		haveTable = false; //until the new table is whole
+		buildCachedDecodeTable(lengths, table);
+		memcpy(tableLengths, lengths, sizeof lengths);
+		haveTable = true;
+		counts.built++;
+	}
+	decodeBytes(data + start, dataLength - start, table, output, checked ? &checksum : NULL);
+	if (checked) checkChecksum(stored, checksum);
+}
+
+/* Member function: reset
+ * ----------------------------------------------------
+ * Clears the flag that says a table is kept, and the counters.
+ */
+void HuffmanDecoderContext::reset() {
+	haveTable = false;
+	counts.messages = counts.built = counts.reused = 0;
+}
+
+/* Member function: stats
+ * ----------------------------------------------------
+ * Returns a copy of the counters.
+ */
+ContextStats HuffmanDecoderContext::stats() const {
+	return counts;
+}
+
+/* Constructor: HuffmanContextPool
+ * ----------------------------------------------------
+ * Contexts are only made when they are first needed.
+ */
+HuffmanContextPool::HuffmanContextPool() {
+}
+
+/* Destructor: ~HuffmanContextPool
+ * ----------------------------------------------------
+ * Deletes every context made, which must all have been released.
+ */
+HuffmanContextPool::~HuffmanContextPool() {
+	for (size_t i = 0; i < encoders.size(); i++) delete encoders[i];
+	for (size_t i = 0; i < decoders.size(); i++) delete decoders[i];
+}
+
+/* Member function: compress
+ * ----------------------------------------------------
+ * Holds a context only for the one message.
+ */
+void HuffmanContextPool::compress(const uint8_t* data, size_t length, std::vector<uint8_t>& output) {
+	HuffmanContext* context = acquireEncoder();
+	try {
+		context->compress(data, length, output);
+	} catch (...) {
+		release(context);
+		throw;
+	}
+	release(context);
+}
+
+/* Member function: decompress
+ * ----------------------------------------------------
+ * Holds a context only for the one message.
+ */
+void HuffmanContextPool::decompress(const uint8_t* data, size_t length, std::vector<uint8_t>& output) {
+	HuffmanDecoderContext* context = acquireDecoder();
+	try {
+		context->decompress(data, length, output);
+	} catch (...) {
+		release(context);
+		throw;
+	}
+	release(context);
+}
+
+/* Member function: acquireEncoder
+ * ----------------------------------------------------
+ * Takes the context released last, whose memory is most likely
+ * still in the cache, or makes one outside the lock.  Room for it
+ * on the free list is made when it is made, so that releasing it
+ * never allocates.
+ */
+HuffmanContext* HuffmanContextPool::acquireEncoder() {
+	HuffmanContext* context = NULL;
+	synchronized (lock) {
+		if (!freeEncoders.empty()) {
+			context = freeEncoders.back();
+			freeEncoders.pop_back();
+		}
+	}
+	if (context != NULL) return context;
+
+	context = new HuffmanContext;
+	synchronized (lock) {
+		encoders.push_back(context);
+		freeEncoders.reserve(encoders.size());
+	}
+	return context;
+}
+
+/* Member function: acquireDecoder
+ * ----------------------------------------------------
+ * Works as acquireEncoder does.
+ */
+HuffmanDecoderContext* HuffmanContextPool::acquireDecoder() {
+	HuffmanDecoderContext* context = NULL;
+	synchronized (lock) {
+		if (!freeDecoders.empty()) {
+			context = freeDecoders.back();
+			freeDecoders.pop_back();
+		}
+	}
+	if (context != NULL) return context;
+
+	context = new HuffmanDecoderContext;
+	synchronized (lock) {
+		decoders.push_back(context);
+		freeDecoders.reserve(decoders.size());
+	}
+	return context;
+}
+
+/* Member function: release
+ * ----------------------------------------------------
+ * Puts the context back on the free list.
+ */
+void HuffmanContextPool::release(HuffmanContext* context) {
+	synchronized (lock) {
+		freeEncoders.push_back(context);
+	}
+}
+
+/* Member function: release
+ * ----------------------------------------------------
+ * Puts the context back on the free list.
+ */
+void HuffmanContextPool::release(HuffmanDecoderContext* context) {
+	synchronized (lock) {
+		freeDecoders.push_back(context);
+	}
+}
+
+/* Member function: numContexts
+ * ----------------------------------------------------
+ * Counts both lists of contexts made.
+ */
+int HuffmanContextPool::numContexts() {
+	int result = 0;
+	synchronized (lock) {
+		result = int(encoders.size() + decoders.size());
+	}
+	return result;
+}
@@ -0,0 +1,218 @@
+/**********************************************************
+ * File: HuffmanContext.h
+ *
+ * Contexts for coding many small messages, one after another.
+ * compressBuffer and decompressBuffer start every call from
+ * nothing: a histogram, a code worked out with its own
+ * scratch lists, a header, and a decode table that is
+ * allocated and filled in, all for a message that may be a
+ * few hundred bytes.  A HuffmanContext keeps that state from
+ * one message to the next instead: the tree is built in a
+ * NodeArena it owns, the header is written to an array it
+ * owns, and the code and header of the last message are kept,
+ * so a message with the same histogram as the one before it
+ * takes no code building at all.  A HuffmanDecoderContext
+ * keeps its decode table, and builds a new one only when a
+ * message has different code lengths from the last.
+ *
+ * Messages coded with a context are the containers that
+ * compressBuffer writes and decompressBuffer reads, and can be
+ * mixed freely with them.  A context belongs to one thread at
+ * a time; a HuffmanContextPool hands them out to any number.
+ */
+
+#ifndef HuffmanContext_Included
+#define HuffmanContext_Included
+
+#include "HuffmanEncoding.h"
+#include "NodeArena.h"
+#include "thread.h"
+#include <vector>
+using namespace std;
+
+/* Type: ContextStats
+ * What a context has done since it was made or reset: how many
+ * messages it has coded, and for how many of them it had to build
+ * a code or table and how many reused the last one.  Stored
+ * messages need neither.
+ */
+struct ContextStats {
+	long messages;
+	long built;
+	long reused;
+};
+
+/* Class: HuffmanContext
+ * Compresses messages held in memory, keeping its scratch space
+ * and the last code between them.
+ */
+class HuffmanContext {
+public:
+	/* Constructor: HuffmanContext
+	 * Usage: HuffmanContext context;
+	 * ----------------------------------------------------
+	 * Creates a context that has coded nothing yet.
+	 */
+	HuffmanContext();
+
+	/* Member function: compress
+	 * Usage: context.compress(data, length, output);
+	 * ----------------------------------------------------
+	 * Compresses the length bytes at data into output, which is
+	 * replaced, as compressBuffer does.  The code is the same as
+	 * compressBuffer's when a TableCache is installed.  Without one,
+	 * it comes from a Huffman tree built in the context's arena and
+	 * may break ties between equal weights differently, but it codes
+	 * the message into the same number of bits.
+	 */
+	void compress(const uint8_t* data, size_t length, std::vector<uint8_t>& output);
+
+	/* Member function: reset
+	 * Usage: context.reset();
+	 * ----------------------------------------------------
+	 * Forgets the last code and sets the counters back to zero,
+	 * keeping all of the memory.  Messages need no reset between
+	 * them; this is for handing the context to other work.
+	 */
+	void reset();
+
+	/* Member function: stats
+	 * Usage: ContextStats counts = context.stats();
+	 * ----------------------------------------------------
+	 * Returns the counters, where built counts codes worked out.
+	 */
+	ContextStats stats() const;
+
+private:
+	/* Not copyable, like the arena it holds. */
+	HuffmanContext(const HuffmanContext&);
+	HuffmanContext& operator=(const HuffmanContext&);
+
+	uint64_t weights[NUM_SYMBOLS];
+	uint64_t codeWeights[NUM_SYMBOLS];   /* the histogram codes was built for */
+	bool haveCode;
+	CodeTable codes;
+	uint8_t header[MAX_CODE_LENGTH_HEADER_BYTES];
+	size_t headerBytes;
+	NodeArena arena;
+	ContextStats counts;
+};
+
+/* Class: HuffmanDecoderContext
+ * Decompresses messages held in memory, keeping the decode table
+ * of the last code between them.
+ */
+class HuffmanDecoderContext {
+public:
+	/* Constructor: HuffmanDecoderContext
+	 * Usage: HuffmanDecoderContext context;
+	 * ----------------------------------------------------
+	 * Creates a context that has decoded nothing yet.
+	 */
+	HuffmanDecoderContext();
+
+	/* Member function: decompress
+	 * Usage: context.decompress(data, length, output);
+	 * ----------------------------------------------------
+	 * Decompresses the message in the length bytes at data into
+	 * output, which is replaced, as decompressBuffer does, and raises
+	 * the same errors.  Containers other than CANONICAL_CONTAINER,
+	 * STORED_CONTAINER among them, are handed to decompressBuffer,
+	 * since they need no decode table.
+	 */
+	void decompress(const uint8_t* data, size_t length, std::vector<uint8_t>& output);
+
+	/* Member function: reset
+	 * Usage: context.reset();
+	 * ----------------------------------------------------
+	 * Forgets the last decode table and sets the counters back to
+	 * zero, keeping the table's memory for the next one.
+	 */
+	void reset();
+
+	/* Member function: stats
+	 * Usage: ContextStats counts = context.stats();
+	 * ----------------------------------------------------
+	 * Returns the counters, where built counts decode tables.
+	 */
+	ContextStats stats() const;
+
+private:
+	/* Not copyable, to match HuffmanContext. */
+	HuffmanDecoderContext(const HuffmanDecoderContext&);
+	HuffmanDecoderContext& operator=(const HuffmanDecoderContext&);
+
+	uint8_t lengths[NUM_SYMBOLS];
+	uint8_t tableLengths[NUM_SYMBOLS];   /* the lengths table decodes */
+	bool haveTable;
+	DecodeTable table;
+	ContextStats counts;
+};
+
+/* Class: HuffmanContextPool
+ * Contexts shared by any number of threads.  Each call takes a
+ * free context, or makes one if every context is in use, and gives
+ * it back when done, so the pool holds as many contexts as there
+ * were calls at the same time, and after that makes no more.  A
+ * thread's messages may go to different contexts each time, which
+ * only matters to how often the last code is reused.
+ */
+class HuffmanContextPool {
+public:
+	/* Constructor: HuffmanContextPool
+	 * Usage: HuffmanContextPool pool;
+	 * ----------------------------------------------------
+	 * Creates a pool with no contexts in it yet.
+	 */
+	HuffmanContextPool();
+	~HuffmanContextPool();
+
+	/* Member function: compress
+	 * Member function: decompress
+	 * Usage: pool.compress(data, length, output);
+	 *        pool.decompress(data, length, output);
+	 * ----------------------------------------------------
+	 * Code one message, as HuffmanContext::compress and
+	 * HuffmanDecoderContext::decompress do, with a context from the
+	 * pool.  The context goes back to the pool even if an error is
+	 * raised.
+	 */
+	void compress(const uint8_t* data, size_t length, std::vector<uint8_t>& output);
+	void decompress(const uint8_t* data, size_t length, std::vector<uint8_t>& output);
+
+	/* Member function: acquireEncoder
+	 * Member function: acquireDecoder
+	 * Member function: release
+	 * Usage: HuffmanContext* context = pool.acquireEncoder();
+	 *        ...
+	 *        pool.release(context);
+	 * ----------------------------------------------------
+	 * Take a context from the pool, for a caller that codes several
+	 * messages in a row, and give it back.  A context must be given
+	 * back to the pool it came from, and must not be used after.
+	 */
+	HuffmanContext* acquireEncoder();
+	HuffmanDecoderContext* acquireDecoder();
+	void release(HuffmanContext* context);
+	void release(HuffmanDecoderContext* context);
+
+	/* Member function: numContexts
+	 * Usage: int made = pool.numContexts();
+	 * ----------------------------------------------------
+	 * Returns how many contexts of both kinds the pool has made.
+	 */
+	int numContexts();
+
+private:
+	/* Not copyable, since it owns a lock and its contexts. */
+	HuffmanContextPool(const HuffmanContextPool&);
+	HuffmanContextPool& operator=(const HuffmanContextPool&);
+
+	std::vector<HuffmanContext*> encoders;           /* every one made */
+	std::vector<HuffmanContext*> freeEncoders;
+	std::vector<HuffmanDecoderContext*> decoders;    /* every one made */
+	std::vector<HuffmanDecoderContext*> freeDecoders;
+	Lock lock;
+};
+
+#endif
@@ -0,0 +1,181 @@
+/**********************************************************
+ * File: HuffmanCorpus.cpp
+ *
+ * Implementation of the corpus generator from HuffmanCorpus.h.
+ */
+
+#include "HuffmanCorpus.h"
+#include "error.h"
+#include <algorithm>
+#include <cctype>
+
+/* The number of Fibonacci-weighted byte values. */
+static const int FIBONACCI_VALUES = 40;
+
+/* The size of the pieces writeCorpus makes and writes. */
+static const size_t CORPUS_CHUNK_SIZE = 1 << 20;
+
+/* Constructor: CorpusGenerator
+ * ----------------------------------------------------
+ * Builds the cumulative weights of every row the kind needs: one
+ * for most kinds, and one per preceding byte for ENGLISH_CORPUS.
+ */
+CorpusGenerator::CorpusGenerator(CorpusKind kind, uint32_t seed, const string& sample)
+	: numRows(0), previous(0) {
+	//xorshift must not start at zero, and nearby seeds should not start alike
+	state = (uint64_t(seed) << 32 | 0x9E3779B9) * ((uint64_t(0x2545F491) << 32) | 0x4F6CDD1D);
+	if (state == 0) state = 1;
+
+	uint64_t weights[256] = { 0 };
+	switch (kind) {
+	case UNIFORM_CORPUS:
+		for (int v = 0; v < 256; v++) weights[v] = 1;
+		addRow(weights);
+		break;
+	case ZIPF_CORPUS:
+		for (int v = 0; v < 256; v++) weights[v] = (uint64_t(1) << 32) / uint64_t(v + 1);
+		addRow(weights);
+		break;
+	case FIBONACCI_CORPUS: {
+		uint64_t older = 1, newer = 1;
+		for (int v = FIBONACCI_VALUES - 1; v >= 0; v--) {
+			weights[v] = older;
+			uint64_t next = older + newer;
+			older = newer;
+			newer = next;
+		}
+		addRow(weights);
+		break;
+	}
+	case COMPRESSED_CORPUS:
+		for (int v = 0; v < 256; v++) weights[v] = 4096 + 512 / uint64_t(v + 1);
+		addRow(weights);
+		break;
+	case ENGLISH_CORPUS: {
+		if (sample.empty()) error("An English-like corpus needs a sample text.");
+		std::vector<uint64_t> counts(256 * 256, 0);
+		for (size_t i = 0; i < sample.size(); i++) {
+			int before = (i == 0 ? 0 : (unsigned char)sample[i - 1]);
+			counts[256 * before + (unsigned char)sample[i]]++;
+			weights[(unsigned char)sample[i]]++;
+		}
+		//a byte the sample never follows with anything is followed as by any byte
+		for (int c = 0; c < 256; c++) {
+			bool seen = false;
+			for (int v = 0; v < 256 && !seen; v++) seen = (counts[256 * c + v] != 0);
+			addRow(seen ? &counts[256 * c] : weights);
+		}
+		break;
+	}
+	default:
+		error("Unknown corpus kind.");
+	}
+}
+
+/* Member function: generate
+ * ----------------------------------------------------
+ * Picks a point in the total weight of the current row and finds
+ * the byte whose stretch of the cumulative weights holds it.
+ */
+void CorpusGenerator::generate(char* output, size_t length) {
+	for (size_t i = 0; i < length; i++) {
+		const uint64_t* row = &cumulative[256 * (numRows == 1 ? 0 : previous)];
+		uint64_t point = nextRandom() % row[255];
+		int value = int(std::upper_bound(row, row + 256, point) - row);
+		output[i] = char(value);
+		previous = value;
+	}
+}
+
+/* Member function: nextRandom
+ * ----------------------------------------------------
+ * Steps a xorshift64* generator, which is fast, has a period of
+ * 2^64 - 1, and is the same on every platform.
+ */
+uint64_t CorpusGenerator::nextRandom() {
+	state ^= state >> 12;
+	state ^= state << 25;
+	state ^= state >> 27;
+	return state * ((uint64_t(0x2545F491) << 32) | 0x4F6CDD1D);
+}
+
+/* Member function: addRow
+ * ----------------------------------------------------
+ * Appends the running totals of weights as a new row.
+ */
+void CorpusGenerator::addRow(const uint64_t weights[256]) {
+	uint64_t total = 0;
+	for (int v = 0; v < 256; v++) {
+		total += weights[v];
+		cumulative.push_back(total);
+	}
+	numRows++;
+}
+
+/* Function: corpusName
+ * Usage: cout << corpusName(ZIPF_CORPUS);
+ * --------------------------------------------------------
+ * Returns the name of kind.
+ */
+const char* corpusName(CorpusKind kind) {
+	switch (kind) {
+	case UNIFORM_CORPUS:    return "uniform";
+	case ZIPF_CORPUS:       return "zipf";
+	case ENGLISH_CORPUS:    return "english";
+	case FIBONACCI_CORPUS:  return "fibonacci";
+	case COMPRESSED_CORPUS: return "compressed";
+	default:                return "unknown";
+	}
+}
+
+/* Function: makeCorpus
+ * Usage: string data = makeCorpus(kind, size, seed, sample);
+ * --------------------------------------------------------
+ * Generates straight into the string.
+ */
+string makeCorpus(CorpusKind kind, size_t size, uint32_t seed, const string& sample) {
+	CorpusGenerator corpus(kind, seed, sample);
+	string result(size, '\0');
+	if (size > 0) corpus.generate(&result[0], size);
+	return result;
+}
+
+/* Function: writeCorpus
+ * Usage: writeCorpus(kind, size, outfile, seed, sample);
+ * --------------------------------------------------------
+ * Generates and writes one chunk at a time.
+ */
+void writeCorpus(CorpusKind kind, uint64_t size, ostream& outfile, uint32_t seed, const string& sample) {
+	CorpusGenerator corpus(kind, seed, sample);
+	std::vector<char> chunk(CORPUS_CHUNK_SIZE);
+	while (size > 0) {
+		size_t count = size_t(min(size, uint64_t(CORPUS_CHUNK_SIZE)));
+		corpus.generate(&chunk[0], count);
+		outfile.write(&chunk[0], count);
+		if (outfile.fail()) error("Cannot write the corpus.");
+		size -= count;
+	}
+}
+
+/* Function: parseCorpusSize
+ * Usage: uint64_t size = parseCorpusSize("10G");
+ * --------------------------------------------------------
+ * Reads the digits, then the unit, if any.
+ */
+uint64_t parseCorpusSize(const string& text) {
+	uint64_t size = 0;
+	size_t i = 0;
+	for (; i < text.size() && text[i] >= '0' && text[i] <= '9'; i++) {
+		size = size * 10 + uint64_t(text[i] - '0');
+	}
+	if (i == 0 || i + 1 < text.size()) error("Cannot read corpus size " + text + ".");
+
+	if (i < text.size()) {
+		char unit = char(toupper((unsigned char)text[i]));
+		if (unit == 'K') size <<= 10;
+		else if (unit == 'M') size <<= 20;
+		else if (unit == 'G') size <<= 30;
+		else error("Cannot read corpus size " + text + ".");
+	}
+	return size;
+}
@@ -0,0 +1,126 @@
+/**********************************************************
+ * File: HuffmanCorpus.h
+ *
+ * Synthetic inputs for benchmarks.  The files in test/ are
+ * small, the largest a few hundred kilobytes, which is too
+ * little to show cache effects, I/O behaviour or parallel
+ * scaling.  A CorpusGenerator makes an input of any size, from
+ * a kilobyte to tens of gigabytes, with a chosen distribution
+ * of bytes.  The same kind, seed and sample always give the
+ * same bytes, however they are asked for, so a scaling curve
+ * can be run again on exactly the same data.
+ *
+ * The kinds of corpus are
+ *
+ *   UNIFORM_CORPUS:    every byte value equally likely, which no
+ *                      code can shrink.
+ *   ZIPF_CORPUS:       byte value v about 1 / (v + 1) as likely as
+ *                      byte 0, as word and symbol counts tend to be.
+ *   ENGLISH_CORPUS:    each byte drawn from how often it follows
+ *                      the byte before in a sample text, such as
+ *                      tomSawyer, so that order-1 statistics match.
+ *   FIBONACCI_CORPUS:  the first 40 byte values weighted by the
+ *                      Fibonacci numbers, which gives the deepest
+ *                      possible trees and so exercises the code
+ *                      length limit.
+ *   COMPRESSED_CORPUS: nearly uniform with a slight skew, like the
+ *                      output of another compressor, which coding
+ *                      can shrink by a percent or so at most.
+ */
+
+#ifndef HuffmanCorpus_Included
+#define HuffmanCorpus_Included
+
+#include "HuffmanTypes.h"
+#include <ostream>
+#include <string>
+#include <vector>
+using namespace std;
+
+/* Type: CorpusKind
+ * The distributions a corpus can have.
+ */
+enum CorpusKind {
+	UNIFORM_CORPUS,
+	ZIPF_CORPUS,
+	ENGLISH_CORPUS,
+	FIBONACCI_CORPUS,
+	COMPRESSED_CORPUS,
+	NUM_CORPUS_KINDS
+};
+
+/* Function: corpusName
+ * Usage: cout << corpusName(ZIPF_CORPUS);
+ * --------------------------------------------------------
+ * Returns a short lower-case name for kind, such as "zipf".
+ */
+const char* corpusName(CorpusKind kind);
+
+/* Class: CorpusGenerator
+ * Makes the bytes of one corpus, a piece at a time, from the
+ * start.
+ */
+class CorpusGenerator {
+public:
+	/* Constructor: CorpusGenerator
+	 * Usage: CorpusGenerator corpus(kind);
+	 *        CorpusGenerator corpus(kind, seed, sample);
+	 * ----------------------------------------------------
+	 * Prepares to make a corpus of the given kind.  Different seeds
+	 * give different bytes with the same distribution.  sample is
+	 * the text an ENGLISH_CORPUS takes its statistics from, and is
+	 * ignored for the other kinds; raises an error if an
+	 * ENGLISH_CORPUS has no sample.
+	 */
+	CorpusGenerator(CorpusKind kind, uint32_t seed = 1, const string& sample = "");
+
+	/* Member function: generate
+	 * Usage: corpus.generate(buffer, length);
+	 * ----------------------------------------------------
+	 * Writes the next length bytes of the corpus to output.
+	 */
+	void generate(char* output, size_t length);
+
+private:
+	uint64_t nextRandom();
+	void addRow(const uint64_t weights[256]);
+
+	/* cumulative[256 * c + v] is the weight of bytes 0 to v after
+	 * context c; with one row, there is no context.
+	 */
+	std::vector<uint64_t> cumulative;
+	int numRows;
+	uint64_t state;
+	int previous;
+};
+
+/* Function: makeCorpus
+ * Usage: string data = makeCorpus(kind, size);
+ *        string data = makeCorpus(kind, size, seed, sample);
+ * --------------------------------------------------------
+ * Returns the first size bytes of a corpus, for inputs held in
+ * memory.
+ */
+string makeCorpus(CorpusKind kind, size_t size, uint32_t seed = 1, const string& sample = "");
+
+/* Function: writeCorpus
+ * Usage: writeCorpus(kind, size, outfile);
+ *        writeCorpus(kind, size, outfile, seed, sample);
+ * --------------------------------------------------------
+ * Writes the first size bytes of a corpus to outfile a megabyte
+ * at a time, so that a corpus larger than memory can be written
+ * to a file.  Raises an error if writing fails.
+ */
+void writeCorpus(CorpusKind kind, uint64_t size, ostream& outfile,
+                 uint32_t seed = 1, const string& sample = "");
+
+/* Function: parseCorpusSize
+ * Usage: uint64_t size = parseCorpusSize("10G");
+ * --------------------------------------------------------
+ * Returns the number of bytes text stands for: a whole number,
+ * optionally followed by K, M or G for binary kilo-, mega- or
+ * gigabytes.  Raises an error if text is not of that form.
+ */
+uint64_t parseCorpusSize(const string& text);
+
+#endif
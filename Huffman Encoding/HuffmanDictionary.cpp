@@ -0,0 +1,195 @@
+/**********************************************************
+ * File: HuffmanDictionary.cpp
+ *
+ * Implementation of the dictionary functions from
+ * HuffmanDictionary.h.
+ */
+
+#include "HuffmanDictionary.h"
+#include "HuffmanHistogram.h"
+#include "HuffmanTables.h"
+#include "LittleEndian.h"
+#include "MemoryDiagnostics.h"
+#include "error.h"
+#include <cstring>
+#include <algorithm>
+
+/*
+	Fills in every table of dictionary from its code lengths, which
+	must already be in dictionary.codes.length
+*/
+static void buildDictionaryTables(HuffmanDictionary& dictionary)
+{
+	MemoryCategoryScope scope(TABLE_MEMORY);
+	buildCanonicalCodeTable(dictionary.codes.length, dictionary.codes);
+	buildDecodeTable(dictionary.codes, dictionary.decoder);
+
+	dictionary.maxCodeLength = 0;
+	for (int ch = 0; ch < NUM_SYMBOLS; ch++)
+	{
+		dictionary.maxCodeLength = max(dictionary.maxCodeLength, int(dictionary.codes.length[ch]));
+	}
+}
+
+/* Function: trainDictionary
+ * Usage: trainDictionary(samples, id, dictionary);
+ * --------------------------------------------------------
+ * Every byte value starts with a weight of one, so that messages
+ * unlike the samples can still be coded, and PSEUDO_EOF is counted
+ * once per sample.
+ */
+void trainDictionary(const std::vector<string>& samples, uint32_t id,
+                     HuffmanDictionary& dictionary)
+{
+	MemoryCategoryScope scope(FREQUENCY_MEMORY);
+	uint64_t weights[NUM_SYMBOLS];
+	for (int ch = 0; ch < NUM_SYMBOLS; ch++)
+	{
+		weights[ch] = 1;
+	}
+	for (size_t i = 0; i < samples.size(); i++)
+	{
+		countBytes((const unsigned char*)samples[i].data(), samples[i].size(), weights);
+	}
+	weights[PSEUDO_EOF] = max(uint64_t(samples.size()), uint64_t(1));
+
+	dictionary.id = id;
+	buildLimitedCodeLengths(weights, DEFAULT_MAX_CODE_LENGTH, dictionary.codes.length);
+	buildDictionaryTables(dictionary);
+}
+
+/* Function: writeDictionary
+ * Usage: writeDictionary(outfile, dictionary);
+ * --------------------------------------------------------
+ * Writes the magic, the number and the code lengths.
+ */
+void writeDictionary(obstream& outfile, const HuffmanDictionary& dictionary)
+{
+	outfile.write(DICTIONARY_MAGIC, sizeof DICTIONARY_MAGIC - 1);
+	writeUint32(outfile, dictionary.id);
+	writeCodeLengthHeader(outfile, dictionary.codes.length);
+}
+
+/* Function: readDictionary
+ * Usage: readDictionary(infile, dictionary);
+ * --------------------------------------------------------
+ * Reads back what writeDictionary wrote and rebuilds the tables.
+ */
+void readDictionary(ibstream& infile, HuffmanDictionary& dictionary)
+{
+	char magic[sizeof DICTIONARY_MAGIC - 1];
+	infile.read(magic, sizeof magic);
+	if (infile.fail() || string(magic, sizeof magic) != DICTIONARY_MAGIC)
+	{
+		error("Not a dictionary file.");
+	}
+
+	dictionary.id = readUint32(infile, "Dictionary file");
+	readCodeLengthHeader(infile, dictionary.codes.length);
+	for (int ch = 0; ch < NUM_SYMBOLS; ch++)
+	{
+		if (dictionary.codes.length[ch] == 0 || dictionary.codes.length[ch] > DEFAULT_MAX_CODE_LENGTH)
+		{
+			error("Damaged dictionary file.");
+		}
+	}
+	buildDictionaryTables(dictionary);
+}
+
+/* Function: compressWithDictionary
+ * Usage: compressWithDictionary(infile, outfile, dictionary);
+ * --------------------------------------------------------
+ * Writes the container header, then codes infile in one pass.
+ */
+void compressWithDictionary(istream& infile, obstream& outfile,
+                            const HuffmanDictionary& dictionary)
+{
+	MemoryCategoryScope scope(CODING_MEMORY);
+	writeContainerVersion(outfile, DICTIONARY_CONTAINER);
+	writeUint32(outfile, dictionary.id);
+	encodeWithTable(infile, dictionary.codes, outfile);
+}
+
+/* Function: compressWithDictionary
+ * Usage: compressWithDictionary(data, length, dictionary, output);
+ * --------------------------------------------------------
+ * output is sized for the longest codes and cut back after coding,
+ * which saves counting the bytes first.
+ */
+void compressWithDictionary(const uint8_t* data, size_t length,
+                            const HuffmanDictionary& dictionary,
+                            std::vector<uint8_t>& output)
+{
+	MemoryCategoryScope scope(CODING_MEMORY);
+	size_t magicBytes = sizeof CONTAINER_MAGIC - 1;
+	output.resize(DICTIONARY_HEADER_BYTES + ((length + 1) * dictionary.maxCodeLength + 7) / 8);
+	memcpy(&output[0], CONTAINER_MAGIC, magicBytes);
+	output[magicBytes] = uint8_t(DICTIONARY_CONTAINER);
+	for (int i = 0; i < 4; i++)
+	{
+		output[magicBytes + 1 + i] = uint8_t(dictionary.id >> (8 * i));
+	}
+
+	output.resize(encodeBytes(data, length, dictionary.codes, output, DICTIONARY_HEADER_BYTES));
+}
+
+/* Function: decompressWithDictionary
+ * Usage: decompressWithDictionary(infile, outfile, dictionary);
+ * --------------------------------------------------------
+ * Checks the container header, then decodes with the shared table.
+ */
+void decompressWithDictionary(ibstream& infile, ostream& outfile,
+                              const HuffmanDictionary& dictionary)
+{
+	MemoryCategoryScope scope(CODING_MEMORY);
+	if (readContainerVersion(infile) != DICTIONARY_CONTAINER) error("Not a dictionary compressed file.");
+	if (readDictionaryId(infile) != dictionary.id) error("File was compressed with another dictionary.");
+	decodeSymbols(infile, dictionary.decoder, outfile);
+}
+
+/* Function: decompressWithDictionary
+ * Usage: decompressWithDictionary(data, length, dictionary, output);
+ * --------------------------------------------------------
+ * Checks the container header, then decodes straight from memory.
+ */
+void decompressWithDictionary(const uint8_t* data, size_t length,
+                              const HuffmanDictionary& dictionary,
+                              std::vector<uint8_t>& output)
+{
+	MemoryCategoryScope scope(CODING_MEMORY);
+	if (messageDictionaryId(data, length) != dictionary.id) error("File was compressed with another dictionary.");
+	decodeBytes(data + DICTIONARY_HEADER_BYTES, length - DICTIONARY_HEADER_BYTES, dictionary.decoder, output);
+}
+
+/* Function: readDictionaryId
+ * Usage: uint32_t id = readDictionaryId(infile);
+ * --------------------------------------------------------
+ * The number follows the version byte.
+ */
+uint32_t readDictionaryId(ibstream& infile)
+{
+	return readUint32(infile, "Dictionary container");
+}
+
+/* Function: messageDictionaryId
+ * Usage: uint32_t id = messageDictionaryId(data, length);
+ * --------------------------------------------------------
+ * Reads the number from the fixed-size container header.
+ */
+uint32_t messageDictionaryId(const uint8_t* data, size_t length)
+{
+	size_t magicBytes = sizeof CONTAINER_MAGIC - 1;
+	if (length < size_t(DICTIONARY_HEADER_BYTES) ||
+	    memcmp(data, CONTAINER_MAGIC, magicBytes) != 0 ||
+	    data[magicBytes] != DICTIONARY_CONTAINER)
+	{
+		error("Not a dictionary compressed file.");
+	}
+
+	uint32_t id = 0;
+	for (int i = 0; i < 4; i++)
+	{
+		id |= uint32_t(data[magicBytes + 1 + i]) << (8 * i);
+	}
+	return id;
+}
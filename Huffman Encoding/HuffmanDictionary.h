@@ -0,0 +1,143 @@
+/**********************************************************
+ * File: HuffmanDictionary.h
+ *
+ * Shared code tables for many small messages.  A message of
+ * a few hundred bytes is often smaller than its own code
+ * length header, and building a code for it costs more than
+ * coding it.  Instead, a dictionary holds one code, trained
+ * on sample messages, and every message is coded with it;
+ * a message records only the number of its dictionary.
+ *
+ * A dictionary file holds DICTIONARY_MAGIC, the dictionary
+ * number in 4 bytes, least significant byte first, and a code
+ * length header (see writeCodeLengthHeader).
+ *
+ * A message is a DICTIONARY_CONTAINER: the container magic
+ * and version, the dictionary number in 4 bytes, least
+ * significant byte first, then the encoded bits ending in
+ * PSEUDO_EOF.
+ *
+ * Once it is built, a dictionary is only read, so one
+ * dictionary can code messages on any number of threads at
+ * the same time.
+ */
+
+#ifndef HuffmanDictionary_Included
+#define HuffmanDictionary_Included
+
+#include "HuffmanEncoding.h"
+#include <string>
+#include <vector>
+
+/* Constant: DICTIONARY_MAGIC
+ * The four bytes that start every dictionary file.
+ */
+const char DICTIONARY_MAGIC[] = "HUFD";
+
+/* Constant: DICTIONARY_HEADER_BYTES
+ * The size of the container header of every message: magic,
+ * version and dictionary number.
+ */
+const int DICTIONARY_HEADER_BYTES = (sizeof CONTAINER_MAGIC - 1) + 1 + 4;
+
+/* Type: HuffmanDictionary
+ * A trained code and the tables to encode and decode with it.
+ * id is the number written into every message; the other fields
+ * are filled in by trainDictionary and readDictionary.  Every byte
+ * value has a code, whether or not the samples contained it, and
+ * no code is longer than DEFAULT_MAX_CODE_LENGTH bits.
+ */
+struct HuffmanDictionary {
+	uint32_t id;
+	CodeTable codes;
+	DecodeTable decoder;
+	int maxCodeLength;
+};
+
+/* Function: trainDictionary
+ * Usage: trainDictionary(samples, id, dictionary);
+ * --------------------------------------------------------
+ * Builds dictionary, numbered id, with the code that best fits
+ * the given sample messages, each of which is taken to end in
+ * PSEUDO_EOF.  Byte values that never appear in the samples get
+ * the longest codes instead of none.
+ */
+void trainDictionary(const std::vector<string>& samples, uint32_t id,
+                     HuffmanDictionary& dictionary);
+
+/* Function: writeDictionary
+ * Usage: writeDictionary(outfile, dictionary);
+ * --------------------------------------------------------
+ * Writes dictionary to outfile as a dictionary file.
+ */
+void writeDictionary(obstream& outfile, const HuffmanDictionary& dictionary);
+
+/* Function: readDictionary
+ * Usage: readDictionary(infile, dictionary);
+ * --------------------------------------------------------
+ * Reads a dictionary file written by writeDictionary and builds
+ * its tables.  Raises an error if the file is not a dictionary or
+ * is damaged.
+ */
+void readDictionary(ibstream& infile, HuffmanDictionary& dictionary);
+
+/* Function: compressWithDictionary
+ * Usage: compressWithDictionary(infile, outfile, dictionary);
+ * --------------------------------------------------------
+ * Compresses infile, from its current position to its end, into
+ * outfile as a DICTIONARY_CONTAINER coded with dictionary.
+ */
+void compressWithDictionary(istream& infile, obstream& outfile,
+                            const HuffmanDictionary& dictionary);
+
+/* Function: compressWithDictionary
+ * Usage: compressWithDictionary(data, length, dictionary, output);
+ * --------------------------------------------------------
+ * Compresses length bytes starting at data into output, which is
+ * replaced, giving the same bytes as the stream version but coded
+ * straight from memory.
+ */
+void compressWithDictionary(const uint8_t* data, size_t length,
+                            const HuffmanDictionary& dictionary,
+                            std::vector<uint8_t>& output);
+
+/* Function: decompressWithDictionary
+ * Usage: decompressWithDictionary(infile, outfile, dictionary);
+ * --------------------------------------------------------
+ * Decompresses a message written with dictionary into outfile.
+ * Raises an error if infile is not a DICTIONARY_CONTAINER, was
+ * written with another dictionary, or is damaged.
+ */
+void decompressWithDictionary(ibstream& infile, ostream& outfile,
+                              const HuffmanDictionary& dictionary);
+
+/* Function: decompressWithDictionary
+ * Usage: decompressWithDictionary(data, length, dictionary, output);
+ * --------------------------------------------------------
+ * Decompresses the message held in length bytes starting at data
+ * into output, which is replaced, straight from memory.  Raises
+ * the same errors as the stream version.
+ */
+void decompressWithDictionary(const uint8_t* data, size_t length,
+                              const HuffmanDictionary& dictionary,
+                              std::vector<uint8_t>& output);
+
+/* Function: readDictionaryId
+ * Usage: uint32_t id = readDictionaryId(infile);
+ * --------------------------------------------------------
+ * Reads the dictionary number of a DICTIONARY_CONTAINER whose
+ * magic and version have already been read.
+ */
+uint32_t readDictionaryId(ibstream& infile);
+
+/* Function: messageDictionaryId
+ * Usage: uint32_t id = messageDictionaryId(data, length);
+ * --------------------------------------------------------
+ * Returns the dictionary number of the message held in length
+ * bytes starting at data, so that the caller can choose which
+ * dictionary to decompress it with.  Raises an error if the data
+ * is not a DICTIONARY_CONTAINER.
+ */
+uint32_t messageDictionaryId(const uint8_t* data, size_t length);
+
+#endif
@@ -9,8 +9,40 @@
 #include "HuffmanEncoding.h"
 #include "foreach.h"
 #include <string>
+#include <algorithm>
+#include <cstring>
+#include <climits>
+#include <sstream>
 #include "strlib.h"
 #include "map.h"
+#include "HuffmanTables.h"
+#include "FlatTree.h"
+#include "HuffmanHistogram.h"
+#include "HuffmanBlocks.h"
+#include "AdaptiveHuffman.h"
+#include "HuffmanDictionary.h"
+#include "HuffmanPresets.h"
+#include "HuffmanOrder1.h"
+#include "TableCache.h"
+#include "HuffmanStats.h"
+#include "MemoryDiagnostics.h"
+#include "OutputBuffer.h"
+#include "CodePacker.h"
+#include "HuffmanFsm.h"
+#include "HuffmanChecksum.h"
+#include "LittleEndian.h"
+#include "MappedFile.h"
+
+/* A RUN_CONTAINER is 21 bytes with its checksum, and a code takes
+ * at least a bit a byte, so shorter runs are left to the canonical
+ * code.
+ */
+static const uint64_t MIN_RUN_CONTAINER_BYTES = 8 * 21;
+
+/* Files this size or more that are half one byte value are coded
+ * in blocks, which can code its runs.
+ */
+static const uint64_t MIN_RUN_HEAVY_BYTES = 4096;
 
 /* Function: getFrequencyTable
  * Usage: Map<ext_char, int> freq = getFrequencyTable(file);
@@ -27,24 +59,15 @@
  */
 Map<ext_char, int> getFrequencyTable(istream& file) 
 {
-	Map<ext_char, int> freqTable;
-	ext_char currChar;
+	MemoryCategoryScope scope(FREQUENCY_MEMORY);
+	uint64_t counts[NUM_BYTE_VALUES] = { 0 };
+	countBytes(file, counts); //count into plain arrays
 
-	while (true)
+	Map<ext_char, int> freqTable;
+	for (int ch = 0; ch < NUM_BYTE_VALUES; ch++)
 	{
-		currChar = file.get();
-		if (currChar == EOF) break;
-
-		if (freqTable.containsKey(currChar))
-		{
-			//increase stats
-			freqTable[currChar] += 1;
-		}
-		else
-		{
-			//put new character
-			freqTable[currChar] = 1;
-		}
+		if (counts[ch] > uint64_t(INT_MAX)) error("A character appears too often for a frequency table.");
+		if (counts[ch] != 0) freqTable[ch] = int(counts[ch]);
 	}
 
 	freqTable[PSEUDO_EOF] = 1;
@@ -52,6 +75,52 @@ Map<ext_char, int> getFrequencyTable(istream& file)
 	return freqTable;
 }
 
+/* Function: getFrequencyTable
+ * Usage: uint64_t length = getFrequencyTable(file, weights);
+ * --------------------------------------------------------
+ * Counts straight into the array, with no map in between.
+ */
+uint64_t getFrequencyTable(istream& file, uint64_t weights[NUM_SYMBOLS])
+{
+	uint64_t counts[NUM_BYTE_VALUES] = { 0 };
+	uint64_t length = countBytes(file, counts);
+	copy(counts, counts + NUM_BYTE_VALUES, weights);
+	weights[PSEUDO_EOF] = 1;
+	return length;
+}
+
+/* Function: frequenciesToWeights
+ * Usage: frequenciesToWeights(frequencies, weights);
+ * --------------------------------------------------------
+ * Clears the array, then copies every entry of the map.
+ */
+void frequenciesToWeights(Map<ext_char, int>& frequencies, uint64_t weights[NUM_SYMBOLS])
+{
+	fill(weights, weights + NUM_SYMBOLS, uint64_t(0));
+	foreach (ext_char ch in frequencies)
+	{
+		if (frequencies[ch] < 0) error("Frequencies cannot be negative.");
+		weights[ch] = uint64_t(frequencies[ch]);
+	}
+}
+
+/* Function: weightsToFrequencies
+ * Usage: Map<ext_char, int> frequencies = weightsToFrequencies(weights);
+ * --------------------------------------------------------
+ * Adds an entry for every nonzero weight, in ext_char order.
+ */
+Map<ext_char, int> weightsToFrequencies(const uint64_t weights[NUM_SYMBOLS])
+{
+	Map<ext_char, int> frequencies;
+	for (int ch = 0; ch < NUM_SYMBOLS; ch++)
+	{
+		if (weights[ch] == 0) continue;
+		if (weights[ch] > uint64_t(INT_MAX)) error("A character appears too often for a frequency table.");
+		frequencies[ch] = int(weights[ch]);
+	}
+	return frequencies;
+}
+
 /* Function: buildEncodingTree
  * Usage: Node* tree = buildEncodingTree(frequency);
  * --------------------------------------------------------
@@ -62,14 +131,61 @@ Map<ext_char, int> getFrequencyTable(istream& file)
  * This function can assume that there is always at least one
  * entry in the map, since the PSEUDO_EOF character will always
  * be present.
+ *
+ * If maxCodeLength is given, no character's code is longer than
+ * that many bits.  A Huffman tree that already meets the limit is
+ * returned unchanged; otherwise the tree is rebuilt from the
+ * optimal code lengths within the limit.
  */
-Node* buildEncodingTree(Map<ext_char, int>& frequencies) 
+Node* buildEncodingTree(Map<ext_char, int>& frequencies, int maxCodeLength) 
 {
-	PriorityQueue<Node*> pQueue;
-	enqueueNodes(frequencies, pQueue);		//add nodes in queue
-	Node* result = mergeNodes(pQueue);		//merge nodes and build encoding tree
-	
-	return result;
+	MemoryCategoryScope scope(TREE_MEMORY);
+	std::vector<Node*> leaves;
+	collectLeaves(frequencies, leaves, NULL);		//one leaf per character
+	return buildTree(leaves, NULL, maxCodeLength);
+}
+
+/* Function: buildEncodingTree
+ * Usage: Node* tree = buildEncodingTree(frequency, arena);
+ * --------------------------------------------------------
+ * Builds the same encoding tree as above, but takes its nodes
+ * from the given arena instead of the heap.  The tree must not
+ * be passed to freeTree; it is released by resetting the arena.
+ */
+Node* buildEncodingTree(Map<ext_char, int>& frequencies, NodeArena& arena, int maxCodeLength) 
+{
+	MemoryCategoryScope scope(TREE_MEMORY);
+	std::vector<Node*> leaves;
+	collectLeaves(frequencies, leaves, &arena);
+	return buildTree(leaves, &arena, maxCodeLength);
+}
+
+/* Function: buildEncodingTree
+ * Usage: Node* tree = buildEncodingTree(weights, arena);
+ * --------------------------------------------------------
+ * Builds the same encoding tree from 64-bit weights, with a leaf
+ * for every character whose weight is not zero.
+ */
+Node* buildEncodingTree(const uint64_t weights[NUM_SYMBOLS], NodeArena& arena, int maxCodeLength)
+{
+	MemoryCategoryScope scope(TREE_MEMORY);
+	std::vector<Node*> leaves;
+	collectLeaves(weights, leaves, &arena);
+	if (leaves.empty()) error("Cannot build an encoding tree with no characters.");
+	return buildTree(leaves, &arena, maxCodeLength);
+}
+
+/* Function: buildCodeTable
+ * Usage: buildCodeTable(weights, codes, maxCodeLength);
+ * --------------------------------------------------------
+ * Builds the tree in an arena, keeps only its code lengths, and
+ * gives those canonical codes, just as compress does.
+ */
+void buildCodeTable(const uint64_t weights[NUM_SYMBOLS], CodeTable& codes, int maxCodeLength)
+{
+	NodeArena arena; //the tree is only needed for a moment
+	buildCodeTable(buildEncodingTree(weights, arena, maxCodeLength), codes);
+	buildCanonicalCodeTable(codes.length, codes);
 }
 
 /* Function: freeTree
@@ -110,38 +226,22 @@ void freeTree(Node* root)
  *     This means that you should just start writing the bits
  *     without seeking the file anywhere.
  */ 
-void encodeFile(istream& infile, Node* encodingTree, obstream& outfile) 
+void encodeFile(istream& infile, Node* encodingTree, obstream& outfile, uint32_t* checksum) 
 {
-	Map<ext_char, string> encodingMap;
-	ext_char currChar;
-	string code;
-
-	while (true)
-	{
-		currChar = infile.get(); //get character
-
-		if (currChar == EOF) break;
-		
-		if (encodingMap.containsKey(currChar))
-		{
-			/*
-				if program already searched this character then this
-				character must be in encodingMap
-			*/
-			code = encodingMap[currChar];
-		}
-		else
-		{
-			//if program try to search character first time
-			code = searchCharacterInTree(encodingTree, currChar);
-			encodingMap[currChar] = code; //put new character in map
-		}
-
-		writeBits(outfile, code); //write bits in file one by one
-	}
+	MemoryCategoryScope scope(CODING_MEMORY);
+	CodeTable table;
+	buildCodeTable(encodingTree, table); //every code word up front, no searching
+	encodeWithTable(infile, table, outfile, checksum);
+}
 
-	code = searchCharacterInTree(encodingTree, PSEUDO_EOF);
-	writeBits(outfile, code);
+/* Function: encodeFile
+ * Usage: encodeFile(source, codes, output);
+ * --------------------------------------------------------
+ * The table is all the encoder needs.
+ */
+void encodeFile(istream& infile, const CodeTable& codes, obstream& outfile, uint32_t* checksum)
+{
+	encodeWithTable(infile, codes, outfile, checksum);
 }
 
 /* Function: decodeFile
@@ -156,26 +256,38 @@ void encodeFile(istream& infile, Node* encodingTree, obstream& outfile)
  *
  *   - The output file is open and ready for writing.
  */
-void decodeFile(ibstream& infile, Node* encodingTree, ostream& file) 
+void decodeFile(ibstream& infile, Node* encodingTree, ostream& file, uint32_t* checksum) 
 {
-	int bit;
-	string code = "";
-	ext_char character;
-
-	while (true)
+	MemoryCategoryScope scope(CODING_MEMORY);
+	if (getDecoderKind() == TREE_DECODER)
 	{
-		bit = infile.readBit(); //read bit
-
-		code += integerToString(bit); //save this one bit in code
-		character = searchCodeInTree(encodingTree, code); //try to search bit with code
-		if (character == PSEUDO_EOF) break;
-
-		if (character != NOT_A_CHAR)
+		decodeWithTree(infile, encodingTree, file, checksum);
+		return;
+	}
+	if (getDecoderKind() == FSM_DECODER && !infile.isBitBuffering())
+	{
+		//a tree too deep for a code table is not cached
+		FsmDecoder machine;
+		if (treeDepth(encodingTree) <= MAX_TABLE_CODE_LENGTH)
+		{
+			CodeTable codes;
+			buildCodeTable(encodingTree, codes);
+			buildCachedFsmDecoder(codes, machine);
+		}
+		else
 		{
-			file.put(character);
-			code = "";
+			machine = FsmDecoder(encodingTree);
+		}
+		if (machine.isUsable())
+		{
+			machine.decode(infile, file, checksum);
+			return;
 		}
 	}
+
+	DecodeTable table;
+	buildDecodeTable(encodingTree, table); //resolve whole codes per lookup
+	decodeSymbols(infile, table, file, checksum);
 }
 
 /* Function: writeFileHeader
@@ -193,6 +305,7 @@ void decodeFile(ibstream& infile, Node* encodingTree, ostream& file)
  * can properly read the data back.
  */
 void writeFileHeader(obstream& outfile, Map<ext_char, int>& frequencies) {
+	MemoryCategoryScope scope(HEADER_MEMORY);
 	/* The format we will use is the following:
 	 *
 	 * First number: Total number of characters whose frequency is being
@@ -224,6 +337,30 @@ void writeFileHeader(obstream& outfile, Map<ext_char, int>& frequencies) {
 	}
 }
 
+/* Function: writeFileHeader
+ * Usage: writeFileHeader(output, weights);
+ * --------------------------------------------------------
+ * Writes the same format from the array, skipping the bytes that
+ * do not appear.
+ */
+void writeFileHeader(obstream& outfile, const uint64_t weights[NUM_SYMBOLS]) {
+	MemoryCategoryScope scope(HEADER_MEMORY);
+	if (weights[PSEUDO_EOF] == 0) {
+		error("No PSEUDO_EOF defined.");
+	}
+
+	int numValues = 0;
+	for (int ch = 0; ch < NUM_BYTE_VALUES; ch++) {
+		if (weights[ch] != 0) numValues++;
+	}
+	outfile << numValues << ' ';
+
+	for (int ch = 0; ch < NUM_BYTE_VALUES; ch++) {
+		if (weights[ch] == 0) continue;
+		outfile << char(ch) << weights[ch] << ' ';
+	}
+}
+
 /* Function: readFileHeader
  * Usage: Map<ext_char, int> freq = writeFileHeader(input);
  * --------------------------------------------------------
@@ -238,6 +375,7 @@ void writeFileHeader(obstream& outfile, Map<ext_char, int>& frequencies) {
  * can properly write the data.
  */
 Map<ext_char, int> readFileHeader(ibstream& infile) {
+	MemoryCategoryScope scope(HEADER_MEMORY);
 	/* This function inverts the mapping we wrote out in the
 	 * writeFileHeader function before.  If you make any
 	 * changes to that function, be sure to change this one
@@ -273,181 +411,1573 @@ Map<ext_char, int> readFileHeader(ibstream& infile) {
 	return result;
 }
 
-/* Function: compress
- * Usage: compress(infile, outfile);
+/* Function: readFileHeader
+ * Usage: readFileHeader(input, weights);
  * --------------------------------------------------------
- * Main entry point for the Huffman compressor.  Compresses
- * the file whose contents are specified by the input
- * ibstream, then writes the result to outfile.  Your final
- * task in this assignment will be to combine all of the
- * previous functions together to implement this function,
- * which should not require much logic of its own and should
- * primarily be glue code.
+ * Reads the same format into the array.
  */
-void compress(ibstream& infile, obstream& outfile) 
-{
-	Map<ext_char, int> frequencyTable = getFrequencyTable(infile);
-	writeFileHeader(outfile, frequencyTable);
-	Node* rootEncodingTree = buildEncodingTree(frequencyTable);
-	infile.rewind();
-	encodeFile(infile, rootEncodingTree, outfile);
-	freeTree(rootEncodingTree);
-}
+void readFileHeader(ibstream& infile, uint64_t weights[NUM_SYMBOLS]) {
+	MemoryCategoryScope scope(HEADER_MEMORY);
+	fill(weights, weights + NUM_SYMBOLS, uint64_t(0));
 
-/* Function: decompress
- * Usage: decompress(infile, outfile);
- * --------------------------------------------------------
- * Main entry point for the Huffman decompressor.
- * Decompresses the file whose contents are specified by the
- * input ibstream, then writes the decompressed version of
- * the file to the stream specified by outfile.  Your final
- * task in this assignment will be to combine all of the
- * previous functions together to implement this function,
- * which should not require much logic of its own and should
- * primarily be glue code.
- */
-void decompress(ibstream& infile, ostream& outfile) 
-{
-	Map<ext_char, int> frequencyTable = readFileHeader(infile); 
-	Node* rootEncodingTree = buildEncodingTree(frequencyTable);
-	decodeFile(infile, rootEncodingTree, outfile);
-	freeTree(rootEncodingTree);
-}
+	int numValues;
+	infile >> numValues;
+	infile.get();
+
+	for (int i = 0; i < numValues; i++) {
+		ext_char ch = infile.get();
+		uint64_t frequency;
+		infile >> frequency;
+		infile.get();
+		if (ch >= 0 && ch < NUM_BYTE_VALUES) weights[ch] = frequency;
+	}
 
+	weights[PSEUDO_EOF] = 1;
+}
 
-		/*	Private functions ipleentation	*/
+/* Type: MemoryBitWriter
+ * Writes bits to a byte array in the order obstream does, least
+ * significant first, for headers that are built in memory.
+ */
+struct MemoryBitWriter {
+	uint8_t* out;
+	size_t pos;
+	uint64_t bitBuffer;
+	int bitCount;
 
-/*
-	This function creates Nodes with correct parameters and 
-	adds them in priority queue
-*/
-void enqueueNodes(Map<ext_char, int>& frequencies, PriorityQueue<Node*>& pQueue)
-{
-	Node* node;
+	void writeBits(uint64_t code, int nbits)
+	{
+		bitBuffer |= code << bitCount; //fields are at most 9 bits, so they always fit
+		bitCount += nbits;
+		while (bitCount >= 8)
+		{
+			out[pos++] = uint8_t(bitBuffer);
+			bitBuffer >>= 8;
+			bitCount -= 8;
+		}
+	}
 
-	foreach(ext_char currChar in frequencies)
+	void flushBits()
 	{
-		node = new Node;
-		node->zero = NULL;
-		node->one = NULL;
-		node->character = currChar;
-		node->weight = frequencies[currChar];
-		pQueue.enqueue(node, node->weight);
+		if (bitCount > 0) out[pos++] = uint8_t(bitBuffer);
+		bitBuffer = 0;
+		bitCount = 0;
 	}
-}
+};
 
-/*	
-	This function merges Nodes, builds encoding tree and 
-	returns root of tree
-*/
-Node* mergeNodes(PriorityQueue<Node*>& pQueue)
-{
-	Node* node;
+/* Type: MemoryBitReader
+ * Reads bits back from a byte array as ibstream does, failing
+ * instead of reading past its end.
+ */
+struct MemoryBitReader {
+	const uint8_t* data;
+	size_t length;
+	size_t pos;
+	uint64_t bitBuffer;
+	int bitCount;
+	bool failed;
 
-	while (true)
+	uint64_t readBits(int nbits)
 	{
-		if (pQueue.size() == 1) break;
-
-		node = new Node;
-		node->character = NOT_A_CHAR;
-		node->zero = pQueue.dequeue();
-		node->one = pQueue.dequeue();
-		node->weight = node->zero->weight + node->one->weight;
-		pQueue.enqueue(node, node->weight);
+		while (bitCount < nbits)
+		{
+			if (pos == length)
+			{
+				failed = true;
+				return 0;
+			}
+			bitBuffer |= uint64_t(data[pos++]) << bitCount;
+			bitCount += 8;
+		}
+		uint64_t result = bitBuffer & ((uint64_t(1) << nbits) - 1);
+		bitBuffer >>= nbits;
+		bitCount -= nbits;
+		return result;
 	}
 
-	Node* result = pQueue.dequeue();
-	
-	return result;
-}
+	bool fail() const
+	{
+		return failed;
+	}
+};
 
 /*
-	this functions searches character in tree and 
-	returns relevant code of character
+	Writes the fields of a code length header to anything with
+	writeBits, obstream or MemoryBitWriter, ending on a partial byte
 */
-string searchCharacterInTree(Node* root, ext_char character)
-{	
-	if (root->character != NOT_A_CHAR) return "";
+template <typename BitSink>
+static void writeLengthFields(BitSink& sink, const uint8_t lengths[NUM_SYMBOLS])
+{
+	int numCoded = 0;
+	int longest = lengths[PSEUDO_EOF];
+	for (int ch = 0; ch < PSEUDO_EOF; ch++)
+	{
+		if (lengths[ch] != 0) numCoded++;
+		if (lengths[ch] > longest) longest = lengths[ch];
+	}
 
-	string result = "";
+	if (lengths[PSEUDO_EOF] == 0 && numCoded != 0) error("No PSEUDO_EOF defined.");
 
-	result += "0";
-	result += searchCharacterInTree(root->zero, character);
-	if (isCorrectCode(root, result, character)) return result;
-	result = "";
-	
-	result += "1";
-	result += searchCharacterInTree(root->one, character);
-	if (isCorrectCode(root, result, character)) return result;
+	//bits needed to store the longest length
+	int lengthBits = 1;
+	while ((1 << lengthBits) <= longest) lengthBits++;
+
+	//pick whichever layout is smaller
+	bool dense = (PSEUDO_EOF * lengthBits < 9 + numCoded * (8 + lengthBits));
 
-	return "";
-}    
+	sink.writeBits(lengthBits - 1, 3);
+	sink.writeBits(dense ? 1 : 0, 1);
+	if (dense)
+	{
+		for (int ch = 0; ch < PSEUDO_EOF; ch++)
+		{
+			sink.writeBits(lengths[ch], lengthBits);
+		}
+	}
+	else
+	{
+		sink.writeBits(numCoded, 9);
+		for (int ch = 0; ch < PSEUDO_EOF; ch++)
+		{
+			if (lengths[ch] == 0) continue;
+			sink.writeBits(ch, 8);
+			sink.writeBits(lengths[ch], lengthBits);
+		}
+	}
+	sink.writeBits(lengths[PSEUDO_EOF], lengthBits);
+}
 
 /*
-	Tis function checks code, if code is correct sequence of bits from 
-	root then functions returns true if not returns false
+	Reads the fields of a code length header back from anything with
+	readBits and fail, ibstream or MemoryBitReader
 */
-bool isCorrectCode(Node* fromRoot, string code, ext_char character)
+template <typename BitSource>
+static void readLengthFields(BitSource& source, uint8_t lengths[NUM_SYMBOLS])
 {
-	Node* currNode = fromRoot;
+	for (int ch = 0; ch < NUM_SYMBOLS; ch++)
+	{
+		lengths[ch] = 0;
+	}
 
-	for (int i = 0; i < code.size(); i++)
+	int lengthBits = int(source.readBits(3)) + 1;
+	bool dense = (source.readBits(1) == 1);
+	if (dense)
 	{
-		if (code[i] == '0')
+		for (int ch = 0; ch < PSEUDO_EOF; ch++)
 		{
-			currNode = currNode->zero;
+			lengths[ch] = uint8_t(source.readBits(lengthBits));
 		}
-		else
+	}
+	else
+	{
+		int numCoded = int(source.readBits(9));
+		int previous = -1;
+		for (int i = 0; i < numCoded && !source.fail(); i++)
 		{
-			currNode = currNode->one;
+			int ch = int(source.readBits(8));
+			if (ch <= previous) error("Damaged code length header.");
+			lengths[ch] = uint8_t(source.readBits(lengthBits));
+			if (lengths[ch] == 0) error("Damaged code length header.");
+			previous = ch;
 		}
 	}
+	lengths[PSEUDO_EOF] = uint8_t(source.readBits(lengthBits));
 
-	if (currNode->character == character) return true;
-	
-	return false;
+	if (source.fail()) error("Code length header is cut off.");
 }
 
 /*
-	This functions writes some bits in file
+	Checks the lengths of a header just read: they must form a
+	complete code, and PSEUDO_EOF may only go without a code when
+	it is alone
 */
-void writeBits(obstream& outfile, string code)
+static void checkCodeLengths(const uint8_t lengths[NUM_SYMBOLS])
 {
-	int bit;
+	if (!isCompleteCode(lengths)) error("Damaged code length header.");
 
-	for (int i = 0; i < code.size(); i++)
+	if (lengths[PSEUDO_EOF] == 0)
 	{
-		if (code[i] == '0')
-		{
-			bit = 0;
-		}
-		else
+		for (int ch = 0; ch < PSEUDO_EOF; ch++)
 		{
-			bit = 1;
+			if (lengths[ch] != 0) error("No PSEUDO_EOF defined.");
 		}
-
-		outfile.writeBit(bit);
 	}
 }
 
+/* Function: writeCodeLengthHeader
+ * Usage: writeCodeLengthHeader(output, lengths);
+ * --------------------------------------------------------
+ * Writes the code length of every ext_char (zero for those
+ * without a code) in a compact binary form.  The first three
+ * bits give how many bits each length takes, less one.  A flag
+ * bit then chooses between a sparse layout, which lists the
+ * number of coded bytes in nine bits followed by each byte and
+ * its length in ascending order, and a dense layout, which has
+ * one length for each of the 256 byte values.  Both end with
+ * the length for PSEUDO_EOF.  The header is padded to a whole
+ * byte.  Raises an error if PSEUDO_EOF has no code.
+ */
+void writeCodeLengthHeader(obstream& outfile, const uint8_t lengths[NUM_SYMBOLS])
+{
+	MemoryCategoryScope scope(HEADER_MEMORY);
+	bool wasBuffering = outfile.isBitBuffering();
+	outfile.setBitBuffering(true);
+	writeLengthFields(outfile, lengths);
+	outfile.flushBits();
+	outfile.setBitBuffering(wasBuffering);
+}
+
+/* Function: writeCodeLengthHeader
+ * Usage: size_t bytes = writeCodeLengthHeader(lengths, header);
+ * --------------------------------------------------------
+ * Writes the same bits as the stream version into header.
+ */
+size_t writeCodeLengthHeader(const uint8_t lengths[NUM_SYMBOLS], uint8_t header[MAX_CODE_LENGTH_HEADER_BYTES])
+{
+	MemoryBitWriter sink = { header, 0, 0, 0 };
+	writeLengthFields(sink, lengths);
+	sink.flushBits();
+	return sink.pos;
+}
+
+/* Function: readCodeLengthHeader
+ * Usage: readCodeLengthHeader(input, lengths);
+ * --------------------------------------------------------
+ * Reads back a header written by writeCodeLengthHeader into
+ * lengths.  Raises an error if the header is damaged or the
+ * lengths do not form a complete prefix code.
+ */
+void readCodeLengthHeader(ibstream& infile, uint8_t lengths[NUM_SYMBOLS])
+{
+	MemoryCategoryScope scope(HEADER_MEMORY);
+	bool wasBuffering = infile.isBitBuffering();
+	infile.setBitBuffering(true);
+	readLengthFields(infile, lengths);
+	infile.setBitBuffering(wasBuffering);
+	checkCodeLengths(lengths);
+}
+
+/* Function: readCodeLengthHeader
+ * Usage: size_t bytes = readCodeLengthHeader(data, length, lengths);
+ * --------------------------------------------------------
+ * Reads the header at the front of data with the checks of the
+ * stream version, skipping to the end of its last byte as the
+ * stream version also does.
+ */
+size_t readCodeLengthHeader(const uint8_t* data, size_t length, uint8_t lengths[NUM_SYMBOLS])
+{
+	MemoryBitReader source = { data, length, 0, 0, 0, false };
+	readLengthFields(source, lengths);
+	checkCodeLengths(lengths);
+	return source.pos;
+}
+
 /*
-	this function searches code in tree and returns relevant character
+	This function chooses the container compress writes in STATIC_MODE
+	for rawBytes bytes of the given weights, and sets dominant to the
+	most frequent byte value.  One byte value over and over is just
+	that value and a count, in a RUN_CONTAINER.  A code takes a bit per
+	byte at least, so large inputs that are half one byte value go to
+	blocks, which code runs.  Anything else gets one code, in a
+	CANONICAL_CONTAINER, unless isWorthCoding says that the code does
+	not pay for its header, which needs the code itself and so is left
+	to the caller: then the bytes go in a STORED_CONTAINER.
 */
-ext_char searchCodeInTree(Node* root, string code)
+static ContainerVersion chooseStaticContainer(const uint64_t weights[NUM_SYMBOLS], uint64_t rawBytes, int& dominant)
+{
+	int distinct = 0;
+	dominant = 0;
+	for (int ch = 0; ch < NUM_BYTE_VALUES; ch++)
+	{
+		if (weights[ch] != 0) distinct++;
+		if (weights[ch] > weights[dominant]) dominant = ch;
+	}
+	if (distinct == 1 && rawBytes >= MIN_RUN_CONTAINER_BYTES) return RUN_CONTAINER;
+	if (rawBytes >= MIN_RUN_HEAVY_BYTES && weights[dominant] * 2 >= rawBytes) return BLOCK_CONTAINER;
+	return CANONICAL_CONTAINER;
+}
+
+/* Function: compress
+ * Usage: compress(infile, outfile);
+ * --------------------------------------------------------
+ * Main entry point for the Huffman compressor.  Compresses
+ * the file whose contents are specified by the input
+ * ibstream, then writes the result to outfile.  Your final
+ * task in this assignment will be to combine all of the
+ * previous functions together to implement this function,
+ * which should not require much logic of its own and should
+ * primarily be glue code.
+ *
+ * Input that cannot be rewound is written as a BLOCK_CONTAINER,
+ * ADAPTIVE_MODE writes an ADAPTIVE_CONTAINER, and INTERLEAVED_MODE
+ * a BLOCK_CONTAINER of INTERLEAVED_BLOCKs.  In STATIC_MODE, a file
+ * of one byte value over and over is written as a RUN_CONTAINER,
+ * and a file at least half one byte value as a BLOCK_CONTAINER,
+ * whose blocks can code runs.
+ */
+void compress(ibstream& infile, obstream& outfile, CompressionMode mode, CodingStats* stats) 
 {
-	Node* currNode = root;
+	streamoff inStart = 0, outStart = 0;
+	double mark = 0;
+	if (stats != NULL)
+	{
+		*stats = CodingStats();
+		inStart = readPosition(infile);
+		outStart = writePosition(outfile);
+		mark = currentSeconds();
+	}
 
-	for (int i = 0; i < code.size(); i++)
+	if (mode == ADAPTIVE_MODE)
+	{
+		writeContainerVersion(outfile, ADAPTIVE_CONTAINER);
+		encodeAdaptive(infile, outfile);
+		endPhase(stats, CODING_PHASE, mark);
+		if (stats != NULL) stats->headerBytes = (sizeof CONTAINER_MAGIC - 1) + 1; //magic and version
+	}
+	else if (mode == INTERLEAVED_MODE)
+	{
+		compressBlocks(infile, outfile, DEFAULT_BLOCK_SIZE, 0, INTERLEAVED_BLOCK);
+		endPhase(stats, CODING_PHASE, mark);
+		if (stats != NULL) stats->headerBytes = (sizeof CONTAINER_MAGIC - 1) + 1;
+	}
+	//pipes and sockets cannot be read twice, so code them block by block
+	else if (infile.tellg() == streampos(-1))
+	{
+		compressStream(infile, outfile);
+		endPhase(stats, CODING_PHASE, mark);
+		if (stats != NULL) stats->headerBytes = (sizeof CONTAINER_MAGIC - 1) + 1;
+	}
+	else if (mode == ORDER1_MODE)
+	{
+		compressOrder1(infile, outfile);
+		endPhase(stats, CODING_PHASE, mark);
+		if (stats != NULL) stats->headerBytes = (sizeof CONTAINER_MAGIC - 1) + 1;
+	}
+	else
 	{
-		if (code[i] == '0')
+		uint64_t weights[NUM_SYMBOLS] = { 0 };
+		uint64_t rawBytes = 0;
+		if (mode == SAMPLED_MODE)
+		{
+			//bytes between the samples still need codes, so none is left at zero
+			rawBytes = sampleBytes(infile, weights);
+			for (int ch = 0; ch < PSEUDO_EOF; ch++)
+			{
+				if (weights[ch] == 0) weights[ch] = 1;
+			}
+			weights[PSEUDO_EOF] = 1;
+		}
+		else
+		{
+			//64-bit counts, so no file is too large for its histogram
+			MemoryCategoryScope histogramScope(FREQUENCY_MEMORY);
+			rawBytes = countBytes(infile, weights);
+			weights[PSEUDO_EOF] = 1;
+		}
+		endPhase(stats, HISTOGRAM_PHASE, mark);
+
+		//a sample cannot promise a run, so sampled input always gets a code
+		int dominant = 0;
+		ContainerVersion container = (mode == STATIC_MODE ? chooseStaticContainer(weights, rawBytes, dominant)
+		                                                  : CANONICAL_CONTAINER);
+		if (container == RUN_CONTAINER)
+		{
+			writeContainerVersion(outfile, RUN_CONTAINER, true);
+			outfile.put(char(dominant));
+			writeStoredLength(outfile, rawBytes);
+			if (stats != NULL) stats->headerBytes = uint64_t(writePosition(outfile) - outStart);
+			writeUint32(outfile, repeatCrc32c(0, (unsigned char)dominant, rawBytes));
+			endPhase(stats, CODING_PHASE, mark);
+		}
+		else if (container == BLOCK_CONTAINER)
 		{
-			currNode = currNode->zero;
+			infile.rewind();
+			compressBlocks(infile, outfile);
+			endPhase(stats, CODING_PHASE, mark);
+			if (stats != NULL) stats->headerBytes = (sizeof CONTAINER_MAGIC - 1) + 1;
 		}
 		else
 		{
-			currNode = currNode->one;
+			//an input shaped like an earlier one can reuse its code
+			TableCache* cache = getTableCache();
+			CodeTable codes;
+			long treeNodes = 0;
+			if (cache == NULL || !cache->findCodes(weights, codes))
+			{
+				NodeArena arena; //the tree is only needed for a moment
+				Node* rootEncodingTree = buildEncodingTree(weights, arena, DEFAULT_MAX_CODE_LENGTH);
+
+				//only the code lengths are kept, the codes themselves are canonical
+				buildCodeTable(rootEncodingTree, codes);
+				treeNodes = arena.size();
+				arena.reset();
+				buildCanonicalCodeTable(codes.length, codes);
+				if (cache != NULL) cache->addCodes(weights, codes);
+			}
+			endPhase(stats, CODE_PHASE, mark);
+
+			//data that would not shrink, such as media, is stored as it is
+			ostringbstream header;
+			writeCodeLengthHeader(header, codes.length);
+			string headerBytes = header.str();
+			bool coded = isWorthCoding(rawBytes, headerBytes.size(), encodedBits(weights, codes.length));
+
+			if (coded)
+			{
+				writeContainerVersion(outfile, CANONICAL_CONTAINER, true);
+				outfile.write(headerBytes.data(), headerBytes.size());
+			}
+			else
+			{
+				writeContainerVersion(outfile, STORED_CONTAINER, true);
+				writeStoredLength(outfile, rawBytes);
+			}
+			if (stats != NULL)
+			{
+				stats->headerBytes = uint64_t(writePosition(outfile) - outStart);
+			}
+			endPhase(stats, HEADER_PHASE, mark);
+
+			//the checksum is taken as the input goes by for the second time
+			infile.rewind();
+			uint32_t checksum = 0;
+			if (coded) encodeWithTable(infile, codes, outfile, &checksum);
+			else copyStored(infile, outfile, rawBytes, &checksum);
+			writeUint32(outfile, checksum);
+			endPhase(stats, CODING_PHASE, mark);
+
+			if (stats != NULL)
+			{
+				stats->treeNodes = treeNodes;
+			}
+			if (stats != NULL && coded)
+			{
+				stats->symbolsCoded = rawBytes + 1;
+				for (int ch = 0; ch < NUM_SYMBOLS; ch++)
+				{
+					stats->maxCodeLength = max(stats->maxCodeLength, int(codes.length[ch]));
+				}
+			}
 		}
 	}
 
-	return currNode->character;
-}
\ No newline at end of file
+	if (stats != NULL)
+	{
+		finishStats(*stats, readPosition(infile) - inStart, writePosition(outfile) - outStart);
+		if (mode == ADAPTIVE_MODE) stats->symbolsCoded = stats->bytesIn + 1;
+	}
+}
+
+/* Function: estimateCompressedSize
+ * Usage: SizeEstimate estimate = estimateCompressedSize(frequencies);
+ * --------------------------------------------------------
+ * Copies the map into an array of weights.
+ */
+SizeEstimate estimateCompressedSize(Map<ext_char, int>& frequencies)
+{
+	uint64_t weights[NUM_SYMBOLS];
+	frequenciesToWeights(frequencies, weights);
+	return estimateCompressedSize(weights);
+}
+
+/* Function: estimateCompressedSize
+ * Usage: SizeEstimate estimate = estimateCompressedSize(weights);
+ * --------------------------------------------------------
+ * Chooses the container with chooseStaticContainer and
+ * isWorthCoding, as compress does in STATIC_MODE, and adds up the
+ * bits of whichever one it picks.
+ */
+SizeEstimate estimateCompressedSize(const uint64_t weights[NUM_SYMBOLS])
+{
+	uint64_t counts[NUM_SYMBOLS];
+	copy(weights, weights + NUM_SYMBOLS, counts);
+	counts[PSEUDO_EOF] = 1;
+
+	SizeEstimate estimate;
+	estimate.rawBytes = 0;
+	estimate.exact = true;
+	for (int ch = 0; ch < NUM_BYTE_VALUES; ch++)
+	{
+		estimate.rawBytes += counts[ch];
+	}
+	int dominant = 0;
+	estimate.container = chooseStaticContainer(counts, estimate.rawBytes, dominant);
+
+	//the version, and the checksum that ends the container
+	const uint64_t versionBits = 8 * ((sizeof CONTAINER_MAGIC - 1) + 1) + 8 * 4;
+	if (estimate.container == RUN_CONTAINER)
+	{
+		estimate.headerBits = versionBits + 8 * (1 + 8); //the value and its count
+		estimate.payloadBits = 0;
+	}
+	else
+	{
+		CodeTable codes;
+		buildCodeTable(counts, codes);
+		ostringbstream header;
+		writeCodeLengthHeader(header, codes.length);
+		size_t headerBytes = header.str().size();
+		uint64_t bits = encodedBits(counts, codes.length);
+
+		//blocks are sized as one code would be, since the counts alone cannot size them
+		bool coded = isWorthCoding(estimate.rawBytes, headerBytes, bits);
+		if (estimate.container == BLOCK_CONTAINER) estimate.exact = false;
+		else estimate.container = (coded ? CANONICAL_CONTAINER : STORED_CONTAINER);
+
+		if (coded)
+		{
+			estimate.headerBits = versionBits + 8 * uint64_t(headerBytes);
+			estimate.payloadBits = bits;
+		}
+		else
+		{
+			estimate.headerBits = versionBits + 8 * 8; //the stored length
+			estimate.payloadBits = 8 * estimate.rawBytes;
+		}
+	}
+	estimate.totalBits = estimate.headerBits + estimate.payloadBits;
+	estimate.totalBytes = (estimate.totalBits + 7) / 8;
+	return estimate;
+}
+
+/* Function: estimateCompressedSize
+ * Usage: SizeEstimate estimate = estimateCompressedSize(file, sampleEvery);
+ * --------------------------------------------------------
+ * Samples the counts and estimates from those.
+ */
+SizeEstimate estimateCompressedSize(istream& file, int sampleEvery)
+{
+	uint64_t counts[NUM_BYTE_VALUES] = { 0 };
+	uint64_t rawBytes = sampleBytes(file, counts, sampleEvery);
+
+	uint64_t weights[NUM_SYMBOLS] = { 0 };
+	copy(counts, counts + NUM_BYTE_VALUES, weights);
+	SizeEstimate estimate = estimateCompressedSize(weights);
+	estimate.exact = estimate.exact && rawBytes <= uint64_t(SAMPLE_BLOCK_SIZE);
+
+	//the scaled counts need not add up to the length, but a stored copy is exact
+	estimate.rawBytes = rawBytes;
+	if (estimate.container == STORED_CONTAINER)
+	{
+		estimate.payloadBits = 8 * rawBytes;
+		estimate.totalBits = estimate.headerBits + estimate.payloadBits;
+		estimate.totalBytes = (estimate.totalBits + 7) / 8;
+	}
+	return estimate;
+}
+
+/* Function: decompress
+ * Usage: decompress(infile, outfile);
+ * --------------------------------------------------------
+ * Main entry point for the Huffman decompressor.
+ * Decompresses the file whose contents are specified by the
+ * input ibstream, then writes the decompressed version of
+ * the file to the stream specified by outfile.  Your final
+ * task in this assignment will be to combine all of the
+ * previous functions together to implement this function,
+ * which should not require much logic of its own and should
+ * primarily be glue code.
+ */
+void decompress(ibstream& infile, ostream& outfile, CodingStats* stats) 
+{
+	streamoff inStart = 0, outStart = 0;
+	double mark = 0;
+	if (stats != NULL)
+	{
+		*stats = CodingStats();
+		inStart = readPosition(infile);
+		outStart = writePosition(outfile);
+		mark = currentSeconds();
+	}
+
+	bool checked = false;
+	ContainerVersion version = readContainerVersion(infile, checked);
+	uint32_t checksum = 0;
+	if (stats != NULL) stats->headerBytes = uint64_t(readPosition(infile) - inStart);
+	if (version == BLOCK_CONTAINER)
+	{
+		decodeBlockContainer(infile, outfile);
+		endPhase(stats, CODING_PHASE, mark);
+	}
+	else if (version == ADAPTIVE_CONTAINER)
+	{
+		decodeAdaptive(infile, outfile);
+		endPhase(stats, CODING_PHASE, mark);
+	}
+	else if (version == STORED_CONTAINER)
+	{
+		uint64_t length = readStoredLength(infile);
+		if (stats != NULL) stats->headerBytes = uint64_t(readPosition(infile) - inStart);
+		endPhase(stats, HEADER_PHASE, mark);
+		copyStored(infile, outfile, length, &checksum);
+		if (checked) checkChecksum(readUint32(infile, "Stored data"), checksum);
+		endPhase(stats, CODING_PHASE, mark);
+	}
+	else if (version == RUN_CONTAINER)
+	{
+		int value = infile.get();
+		uint64_t length = readStoredLength(infile);
+		if (value == EOF) error("Run container is cut off.");
+		if (stats != NULL) stats->headerBytes = uint64_t(readPosition(infile) - inStart);
+		uint32_t stored = (checked ? readUint32(infile, "Run container") : 0);
+		endPhase(stats, HEADER_PHASE, mark);
+		const std::vector<char> run(size_t(min<uint64_t>(length, OUTPUT_BUFFER_SIZE)), char(value));
+		while (length > 0)
+		{
+			streamsize count = streamsize(min<uint64_t>(length, run.size()));
+			if (checked) checksum = updateCrc32c(checksum, (const unsigned char*)&run[0], size_t(count));
+			outfile.write(&run[0], count);
+			length -= uint64_t(count);
+		}
+		if (checked) checkChecksum(stored, checksum);
+		endPhase(stats, CODING_PHASE, mark);
+	}
+	else if (version == ORDER1_CONTAINER)
+	{
+		decodeOrder1Container(infile, outfile);
+		endPhase(stats, CODING_PHASE, mark);
+	}
+	else if (version == PRESET_CONTAINER)
+	{
+		//every preset is built in, so only its number is in the file
+		decodePresetContainer(infile, outfile);
+		endPhase(stats, CODING_PHASE, mark);
+	}
+	else if (version == DICTIONARY_CONTAINER)
+	{
+		//the code is not in the file, only the number of its dictionary
+		ostringstream message;
+		message << "This file needs dictionary " << readDictionaryId(infile) << " to decompress.";
+		error(message.str());
+	}
+	else if (version == LEGACY_CONTAINER)
+	{
+		uint64_t weights[NUM_SYMBOLS];
+		readFileHeader(infile, weights); //no map, the tree is the same
+		if (stats != NULL) stats->headerBytes = uint64_t(readPosition(infile) - inStart);
+		endPhase(stats, HEADER_PHASE, mark);
+		NodeArena arena;
+		Node* rootEncodingTree = buildEncodingTree(weights, arena);
+		endPhase(stats, CODE_PHASE, mark);
+		decodeFile(infile, rootEncodingTree, outfile);
+		endPhase(stats, CODING_PHASE, mark);
+
+		if (stats != NULL)
+		{
+			stats->treeNodes = arena.size();
+			stats->maxCodeLength = treeDepth(rootEncodingTree);
+		}
+	}
+	else
+	{
+		//tables come straight from the lengths, no tree needed; a
+		//seekable container's checkpoint index after the bits is not
+		uint8_t lengths[NUM_SYMBOLS];
+		readCodeLengthHeader(infile, lengths);
+		endPhase(stats, HEADER_PHASE, mark);
+
+		if (stats != NULL)
+		{
+			stats->headerBytes = uint64_t(readPosition(infile) - inStart);
+			for (int ch = 0; ch < NUM_SYMBOLS; ch++)
+			{
+				stats->maxCodeLength = max(stats->maxCodeLength, int(lengths[ch]));
+			}
+		}
+
+		bool decoded = false;
+		if (getDecoderKind() == FSM_DECODER && !infile.isBitBuffering())
+		{
+			CodeTable codes;
+			buildCanonicalCodeTable(lengths, codes);
+			FsmDecoder machine;
+			buildCachedFsmDecoder(codes, machine);
+			endPhase(stats, CODE_PHASE, mark);
+			if (machine.isUsable())
+			{
+				machine.decode(infile, outfile, &checksum);
+				decoded = true;
+			}
+		}
+		if (!decoded)
+		{
+			DecodeTable table;
+			buildCachedDecodeTable(lengths, table);
+			endPhase(stats, CODE_PHASE, mark);
+			decodeSymbols(infile, table, outfile, &checksum);
+		}
+		if (checked) checkChecksum(readUint32(infile, "Encoded data"), checksum);
+		endPhase(stats, CODING_PHASE, mark);
+	}
+
+	if (stats != NULL)
+	{
+		finishStats(*stats, readPosition(infile) - inStart, writePosition(outfile) - outStart);
+		if (version != BLOCK_CONTAINER && version != STORED_CONTAINER && version != RUN_CONTAINER) stats->symbolsCoded = stats->bytesOut + 1;
+	}
+}
+
+/* The decoder chosen by setDecoderKind. */
+static DecoderKind gDecoderKind = AUTOMATIC_DECODER;
+
+/* Function: setDecoderKind
+ * Usage: setDecoderKind(TREE_DECODER);
+ * --------------------------------------------------------
+ * Chooses the decoder used from now on.
+ */
+void setDecoderKind(DecoderKind kind)
+{
+	gDecoderKind = kind;
+}
+
+/* Function: getDecoderKind
+ * Usage: DecoderKind kind = getDecoderKind();
+ * --------------------------------------------------------
+ * Returns the decoder chosen by setDecoderKind.
+ */
+DecoderKind getDecoderKind()
+{
+	return gDecoderKind;
+}
+
+/* Function: compressBuffer
+ * Usage: compressBuffer(data, length, output);
+ * --------------------------------------------------------
+ * Compresses length bytes starting at data into output, which
+ * is replaced.  The result is a CANONICAL_CONTAINER, coded
+ * straight from memory.
+ */
+void compressBuffer(const uint8_t* data, size_t length, std::vector<uint8_t>& output)
+{
+	MemoryCategoryScope scope(CODING_MEMORY);
+	uint64_t weights[NUM_SYMBOLS] = { 0 };
+	countBytes(data, length, weights);
+	weights[PSEUDO_EOF] = 1;
+
+	CodeTable codes;
+	buildCachedCodeTable(weights, codes);
+
+	uint8_t header[MAX_CODE_LENGTH_HEADER_BYTES];
+	size_t headerBytes = writeCodeLengthHeader(codes.length, header);
+	writeBufferContainer(data, length, weights, codes, header, headerBytes, output);
+}
+
+/* Function: decompressBuffer
+ * Usage: decompressBuffer(data, length, output);
+ * --------------------------------------------------------
+ * Decompresses the compressed file held in length bytes starting
+ * at data into output, which is replaced.  Containers other than
+ * CANONICAL_CONTAINER go through decompress.
+ */
+void decompressBuffer(const uint8_t* data, size_t length, std::vector<uint8_t>& output)
+{
+	MemoryCategoryScope scope(CODING_MEMORY);
+	size_t dataLength = length;
+	int version = 0;
+	bool checked = false;
+	uint32_t stored = 0, checksum = 0;
+	size_t start = readBufferVersion(data, dataLength, version, checked, stored);
+
+	if (version == STORED_CONTAINER)
+	{
+		//stored bytes are copied out as they are
+		if (dataLength < start + 8) error("Stored data is cut off.");
+		uint64_t storedLength = 0;
+		for (int i = 0; i < 8; i++)
+		{
+			storedLength |= uint64_t(data[start + i]) << (8 * i);
+		}
+		start += 8;
+		if (storedLength > dataLength - start) error("Stored data is cut off.");
+		output.resize(size_t(storedLength));
+		checksum = copyWithCrc32c(0, output.empty() ? NULL : &output[0], data + start, size_t(storedLength));
+		if (checked) checkChecksum(stored, checksum);
+		return;
+	}
+	if (version == PRESET_CONTAINER)
+	{
+		decompressWithPreset(data, length, output);
+		return;
+	}
+	if (version != CANONICAL_CONTAINER)
+	{
+		istringbstream source(string((const char*)data, length));
+		ostringstream result;
+		decompress(source, result);
+		string bytes = result.str();
+		output.assign(bytes.begin(), bytes.end());
+		return;
+	}
+
+	uint8_t lengths[NUM_SYMBOLS];
+	start += readCodeLengthHeader(data + start, dataLength - start, lengths);
+
+	DecodeTable table;
+	buildCachedDecodeTable(lengths, table);
+	decodeBytes(data + start, dataLength - start, table, output, checked ? &checksum : NULL);
+	if (checked) checkChecksum(stored, checksum);
+}
+
+
+		/*	Private functions ipleentation	*/
+
+/*
+	This function returns a new Node from the arena, or from the heap
+	if there is no arena
+*/
+Node* newNode(NodeArena* arena)
+{
+	if (arena == NULL) return new Node;
+	return arena->allocate();
+}
+
+/*
+	This function builds the encoding tree for buildEncodingTree from
+	its leaves, with nodes from the arena if there is one.  The leaves
+	must be the last nodes taken from the arena, so that a tree too
+	deep can give back its own nodes and no one else's.
+*/
+Node* buildTree(std::vector<Node*>& leaves, NodeArena* arena, int maxCodeLength)
+{
+	int mark = (arena == NULL ? 0 : arena->size() - int(leaves.size())); //where this tree's nodes start
+	Node* result = mergeLeaves(leaves, arena);		//merge nodes and build encoding tree
+	
+	if (maxCodeLength == NO_LENGTH_LIMIT || treeDepth(result) <= maxCodeLength) return result;
+
+	//too deep, so work out the best lengths within the limit instead
+	uint64_t weights[NUM_SYMBOLS] = { 0 };
+	uint64_t limitWeights[NUM_SYMBOLS] = { 0 };
+	for (size_t i = 0; i < leaves.size(); i++)
+	{
+		weights[leaves[i]->character] = leaves[i]->weight;
+		limitWeights[leaves[i]->character] = (leaves[i]->weight > 0 ? leaves[i]->weight : 1); //every character still gets a code
+	}
+
+	CodeTable codes;
+	buildLimitedCodeLengths(limitWeights, maxCodeLength, codes.length);
+	buildCanonicalCodeTable(codes.length, codes);
+
+	if (arena == NULL) freeTree(result);
+	else arena->releaseAfter(mark);
+	return buildTreeFromCodes(codes, weights, arena);
+}
+
+/*
+	This function creates a leaf Node for every character, in
+	ext_char order
+*/
+void collectLeaves(Map<ext_char, int>& frequencies, std::vector<Node*>& leaves, NodeArena* arena)
+{
+	Node* node;
+
+	foreach(ext_char currChar in frequencies)
+	{
+		node = newNode(arena);
+		node->zero = NULL;
+		node->one = NULL;
+		node->character = currChar;
+		node->weight = frequencies[currChar];
+		leaves.push_back(node);
+	}
+}
+
+/*
+	This function creates a leaf Node for every character of nonzero
+	weight, in ext_char order
+*/
+void collectLeaves(const uint64_t weights[NUM_SYMBOLS], std::vector<Node*>& leaves, NodeArena* arena)
+{
+	for (int ch = 0; ch < NUM_SYMBOLS; ch++)
+	{
+		if (weights[ch] == 0) continue;
+		Node* node = newNode(arena);
+		node->zero = NULL;
+		node->one = NULL;
+		node->character = ch;
+		node->weight = weights[ch];
+		leaves.push_back(node);
+	}
+}
+
+/*
+	Orders Nodes by weight alone, so a stable sort keeps equal weights
+	in ext_char order
+*/
+static bool isLighter(Node* one, Node* two)
+{
+	return one->weight < two->weight;
+}
+
+/*	
+	This function merges Nodes, builds encoding tree and 
+	returns root of tree.  The leaves are sorted once; merged nodes
+	come out in order of weight by themselves, so they wait in a
+	second queue and the two lightest nodes are always at the front
+	of one queue or the other.
+*/
+Node* mergeLeaves(std::vector<Node*>& leaves, NodeArena* arena)
+{
+	std::stable_sort(leaves.begin(), leaves.end(), isLighter);
+
+	std::vector<Node*> merged;
+	merged.reserve(leaves.size());
+	size_t nextLeaf = 0, nextMerged = 0;
+
+	while ((leaves.size() - nextLeaf) + (merged.size() - nextMerged) > 1)
+	{
+		Node* node = newNode(arena);
+		node->character = NOT_A_CHAR;
+		node->zero = takeLightest(leaves, nextLeaf, merged, nextMerged);
+		node->one = takeLightest(leaves, nextLeaf, merged, nextMerged);
+		node->weight = node->zero->weight + node->one->weight;
+		merged.push_back(node);
+	}
+
+	if (nextLeaf < leaves.size()) return leaves[nextLeaf];
+	return merged[nextMerged];
+}
+
+/*
+	This function removes and returns the lightest node at the front
+	of either queue.  On ties it takes the leaf, which is what the
+	priority queue this replaces did (leaves were enqueued first), so
+	trees for files in the legacy format come out the same.
+*/
+Node* takeLightest(std::vector<Node*>& leaves, size_t& nextLeaf,
+                   std::vector<Node*>& merged, size_t& nextMerged)
+{
+	if (nextMerged == merged.size() ||
+	    (nextLeaf < leaves.size() && leaves[nextLeaf]->weight <= merged[nextMerged]->weight))
+	{
+		return leaves[nextLeaf++];
+	}
+	return merged[nextMerged++];
+}
+
+/*
+	this function returns the length of the longest path from root to a
+	leaf, which a FlatTree finds while copying the tree
+*/
+int treeDepth(Node* root)
+{
+	return FlatTree(root).depth();
+}
+
+/*
+	This function builds the encoding tree whose codes are exactly those
+	in the code table, for every character with a code, taking each
+	leaf's weight from weights
+*/
+Node* buildTreeFromCodes(CodeTable& codes, const uint64_t weights[NUM_SYMBOLS], NodeArena* arena)
+{
+	Node* root = newNode(arena);
+	root->character = NOT_A_CHAR;
+	root->zero = root->one = NULL;
+	root->weight = 0;
+
+	for (int ch = 0; ch < NUM_SYMBOLS; ch++)
+	{
+		if (codes.length[ch] == 0) continue;
+		Node* curr = root;
+		curr->weight += weights[ch];
+		for (int i = 0; i < codes.length[ch]; i++) //walk down the code, adding nodes as needed
+		{
+			Node*& next = ((codes.bits[ch] >> i) & 1) ? curr->one : curr->zero;
+			if (next == NULL)
+			{
+				next = newNode(arena);
+				next->character = NOT_A_CHAR;
+				next->zero = next->one = NULL;
+				next->weight = 0;
+			}
+			curr = next;
+			curr->weight += weights[ch];
+		}
+		curr->character = ch;
+	}
+
+	return root;
+}
+
+/*
+	This function packs count bytes from data with packer, adds them to
+	checksum if it is not NULL, and writes the packed bytes to the bit
+	buffer of outfile.  packed must have room for the code of count
+	bytes.
+*/
+static void packToStream(CodePacker& packer, const uint8_t* data, size_t count,
+                         std::vector<uint8_t>& packed, obstream& outfile, uint32_t* checksum)
+{
+	if (checksum != NULL) *checksum = updateCrc32c(*checksum, data, count);
+
+	size_t written = packer.pack(data, count, &packed[0], packed.size());
+	size_t i = 0;
+	for (; i + 8 <= written; i += 8) outfile.writeBits(loadLittleEndian64(&packed[i]), 64);
+	for (; i < written; i++) outfile.writeBits(packed[i], 8);
+}
+
+/*
+	This function encodes the input with a code table.  A CodePacker
+	turns the input into bytes of code a block at a time, and those go
+	to the bit buffer of outfile eight at a time, followed by the code
+	of PSEUDO_EOF.  A memory-mapped input is packed straight from the
+	mapping and left at its end; any other is read in blocks.  If
+	checksum is not NULL, the CRC-32C of the input is taken block by
+	block as it goes by.
+*/
+void encodeWithTable(istream& infile, const CodeTable& table, obstream& outfile, uint32_t* checksum)
+{
+	MemoryCategoryScope scope(CODING_MEMORY);
+	streambuf* source = infile.rdbuf();
+	char buffer[4096];
+	CodePacker packer(table);
+	std::vector<uint8_t> packed(packer.packedSize(sizeof buffer));
+
+	bool wasBuffering = outfile.isBitBuffering();
+	outfile.setBitBuffering(true); //collect bits in a register, not per bit
+	mapbuf* mapping = dynamic_cast<mapbuf*>(source);
+	streampos position = (mapping != NULL ? infile.tellg() : streampos(-1));
+	if (position != streampos(-1))
+	{
+		size_t start = size_t(streamoff(position));
+		size_t length = (start < mapping->length() ? mapping->length() - start : 0);
+		const uint8_t* data = (const uint8_t*)mapping->data() + start;
+		for (size_t done = 0; done < length; done += sizeof buffer)
+		{
+			packToStream(packer, data + done, min(length - done, sizeof buffer), packed, outfile, checksum);
+		}
+		infile.seekg(0, ios::end);
+		infile.setstate(ios::eofbit | ios::failbit);
+	}
+	else
+	{
+		while (true)
+		{
+			streamsize count = source->sgetn(buffer, sizeof buffer); //read a block
+			if (count <= 0) break;
+			packToStream(packer, (const uint8_t*)buffer, size_t(count), packed, outfile, checksum);
+		}
+	}
+
+	outfile.writeBits(packer.pendingBits(), packer.pendingCount());
+	outfile.writeBits(table.bits[PSEUDO_EOF], table.length[PSEUDO_EOF]);
+	outfile.flushBits();
+	outfile.setBitBuffering(wasBuffering);
+}
+
+/*
+	This function stores a checksum in the 4 bytes at out, least
+	significant first, as writeUint32 writes it to a stream
+*/
+static void storeChecksum(uint32_t checksum, uint8_t* out)
+{
+	for (int i = 0; i < 4; i++) out[i] = uint8_t(checksum >> (8 * i));
+}
+
+/*
+	This function replaces output with the container compressBuffer
+	writes for length bytes from data: a CANONICAL_CONTAINER coded
+	with codes, whose header bytes are given, or a STORED_CONTAINER if
+	that would not be smaller, each followed by the CRC-32C of data.
+	weights is the histogram of data.
+*/
+void writeBufferContainer(const uint8_t* data, size_t length, const uint64_t weights[NUM_SYMBOLS],
+                          const CodeTable& codes, const uint8_t* header, size_t headerBytes,
+                          std::vector<uint8_t>& output)
+{
+	//the histogram gives the exact size of the encoded bits
+	uint64_t totalBits = encodedBits(weights, codes.length);
+	size_t versionBytes = (sizeof CONTAINER_MAGIC - 1) + 1;
+	if (!isWorthCoding(length, headerBytes, totalBits))
+	{
+		output.resize(versionBytes + 8 + length + 4);
+		memcpy(&output[0], CONTAINER_MAGIC, versionBytes - 1);
+		output[versionBytes - 1] = uint8_t(STORED_CONTAINER | CONTAINER_CHECKSUM_FLAG);
+		for (int i = 0; i < 8; i++)
+		{
+			output[versionBytes + i] = uint8_t(uint64_t(length) >> (8 * i));
+		}
+		uint32_t checksum = copyWithCrc32c(0, &output[versionBytes + 8], data, length);
+		storeChecksum(checksum, &output[versionBytes + 8 + length]);
+		return;
+	}
+	size_t end = versionBytes + headerBytes + size_t((totalBits + 7) / 8);
+	output.resize(end + 4);
+	memcpy(&output[0], CONTAINER_MAGIC, versionBytes - 1);
+	output[versionBytes - 1] = uint8_t(CANONICAL_CONTAINER | CONTAINER_CHECKSUM_FLAG);
+	memcpy(&output[versionBytes], header, headerBytes);
+
+	uint32_t checksum = 0;
+	if (encodeBytes(data, length, codes, output, versionBytes + headerBytes, &checksum) != end)
+	{
+		error("Encoded size does not match the histogram.");
+	}
+	storeChecksum(checksum, &output[end]); //over any bytes the packer ran into
+}
+
+/*
+	This function encodes length bytes from data, followed by PSEUDO_EOF,
+	into output starting at index start, and returns the index just past
+	the last byte written.  output must already be large enough; any
+	room beyond that lets the packer use its vector loop further.  If
+	checksum is not NULL, the CRC-32C of data is taken piece by piece
+	just before each piece is packed, while it is still in the cache.
+*/
+size_t encodeBytes(const uint8_t* data, size_t length, const CodeTable& table,
+                   std::vector<uint8_t>& output, size_t start, uint32_t* checksum)
+{
+	CodePacker packer(table);
+	uint8_t* out = (output.empty() ? NULL : &output[0]);
+	size_t pos = start;
+	if (checksum == NULL)
+	{
+		pos += packer.pack(data, length, out + pos, output.size() - pos);
+		return pos + packer.finish(out + pos);
+	}
+
+	size_t done = 0;
+	do
+	{
+		size_t count = min(length - done, size_t(OUTPUT_BUFFER_SIZE));
+		*checksum = updateCrc32c(*checksum, data + done, count);
+		pos += packer.pack(data + done, count, out + pos, output.size() - pos);
+		done += count;
+	} while (done < length);
+	return pos + packer.finish(out + pos);
+}
+
+/*
+	This function decodes the bits in length bytes from data with the
+	decode table until PSEUDO_EOF, replacing the contents of output.
+	If checksum is not NULL, the CRC-32C of the output is taken every
+	OUTPUT_BUFFER_SIZE bytes, while those bytes are still in the cache.
+*/
+void decodeBytes(const uint8_t* data, size_t length, const DecodeTable& table,
+                 std::vector<uint8_t>& output, uint32_t* checksum)
+{
+	const DecodeEntry* entries = &table.entries[0];
+	const int lookupBits = table.lookupBits;
+	const uint64_t lookupMask = (uint64_t(1) << lookupBits) - 1;
+
+	output.resize(length * 2 + 64); //a guess, grown as needed
+	size_t written = 0;
+	size_t pos = 0;
+	uint64_t bitBuffer = 0;
+	int bitCount = 0;
+	int padBits = 0; //zero bits added past the end of the data
+	size_t summed = 0; //bytes of output already in the checksum
+
+	while (true)
+	{
+		//keep at least 57 bits ready, enough for any two-level code
+		while (bitCount <= 56)
+		{
+			uint64_t byte = 0;
+			if (pos < length) byte = data[pos];
+			else padBits += 8;
+			pos++;
+			bitBuffer |= byte << bitCount;
+			bitCount += 8;
+		}
+
+		const DecodeEntry* entry = &entries[bitBuffer & lookupMask];
+		while (entry->link != 0)
+		{
+			//code is longer than the primary table, go one level down
+			bitBuffer >>= entry->length;
+			bitCount -= entry->length;
+			entry = &entries[table.subtables[entry->symbol] + uint32_t(bitBuffer & ((uint64_t(1) << entry->link) - 1))];
+		}
+		bitBuffer >>= entry->length;
+		bitCount -= entry->length;
+
+		if (bitCount < padBits) error("Encoded data ended before PSEUDO_EOF.");
+		if (entry->symbol == PSEUDO_EOF) break;
+
+		if (written == output.size()) output.resize(output.size() * 2);
+		output[written++] = uint8_t(entry->symbol);
+		if (checksum != NULL && written - summed == OUTPUT_BUFFER_SIZE)
+		{
+			*checksum = updateCrc32c(*checksum, &output[summed], OUTPUT_BUFFER_SIZE);
+			summed = written;
+		}
+	}
+
+	if (checksum != NULL && written > summed) *checksum = updateCrc32c(*checksum, &output[summed], written - summed);
+	output.resize(written);
+}
+
+/*
+	This function records the byte counts of a finished compress or
+	decompress, given how far each stream moved; a stream that could
+	not tell its position gives a negative distance, recorded as zero
+*/
+void finishStats(CodingStats& stats, streamoff bytesIn, streamoff bytesOut)
+{
+	stats.bytesIn = (bytesIn > 0 ? uint64_t(bytesIn) : 0);
+	stats.bytesOut = (bytesOut > 0 ? uint64_t(bytesOut) : 0);
+}
+
+/*
+	This function tells whether coding rawBytes bytes is worth it,
+	given the size of the code length header and of the encoded bits:
+	the coded container must come out smaller than the stored one
+*/
+bool isWorthCoding(uint64_t rawBytes, size_t headerBytes, uint64_t encodedBits)
+{
+	return uint64_t(headerBytes) + (encodedBits + 7) / 8 < 8 + rawBytes;
+}
+
+/*
+	This function writes the length of a STORED_CONTAINER in eight
+	bytes, least significant first
+*/
+void writeStoredLength(obstream& outfile, uint64_t length)
+{
+	for (int i = 0; i < 8; i++)
+	{
+		outfile.put(char(length & 0xFF));
+		length >>= 8;
+	}
+}
+
+/*
+	This function reads the length written by writeStoredLength
+*/
+uint64_t readStoredLength(ibstream& infile)
+{
+	uint64_t length = 0;
+	for (int i = 0; i < 8; i++)
+	{
+		length |= uint64_t((unsigned char)infile.get()) << (8 * i);
+	}
+	if (infile.fail()) error("Stored data is cut off.");
+	return length;
+}
+
+/*
+	This function copies exactly length bytes from infile to outfile
+	in large blocks, straight between the stream buffers, taking the
+	CRC-32C of each block as it goes by if checksum is not NULL
+*/
+void copyStored(istream& infile, ostream& outfile, uint64_t length, uint32_t* checksum)
+{
+	MemoryCategoryScope scope(CODING_MEMORY);
+	streambuf* source = infile.rdbuf();
+	std::vector<char> buffer(1 << 16);
+	while (length > 0)
+	{
+		streamsize wanted = streamsize(min(length, uint64_t(buffer.size())));
+		streamsize count = source->sgetn(&buffer[0], wanted);
+		if (count <= 0) error("Stored data is cut off.");
+		if (checksum != NULL) *checksum = updateCrc32c(*checksum, (const unsigned char*)&buffer[0], size_t(count));
+		outfile.write(&buffer[0], count);
+		length -= uint64_t(count);
+	}
+}
+
+/*
+	This function writes the magic bytes and version that start
+	every container newer than LEGACY_CONTAINER, with
+	CONTAINER_CHECKSUM_FLAG added if checksummed
+*/
+void writeContainerVersion(obstream& outfile, ContainerVersion version, bool checksummed)
+{
+	outfile.write(CONTAINER_MAGIC, sizeof CONTAINER_MAGIC - 1);
+	outfile.put(char(checksummed ? version | CONTAINER_CHECKSUM_FLAG : version));
+}
+
+/*
+	This function reads the magic bytes and version of a container
+	that cannot have a checksum.  Legacy files have no magic; for
+	those nothing is consumed.
+*/
+ContainerVersion readContainerVersion(ibstream& infile)
+{
+	bool checksummed = false;
+	ContainerVersion version = readContainerVersion(infile, checksummed);
+	if (checksummed) error("Unsupported container version " + integerToString(version | CONTAINER_CHECKSUM_FLAG) + ".");
+	return version;
+}
+
+/*
+	This function tells whether a container of the given version may
+	end in a checksum
+*/
+static bool canHaveChecksum(int version)
+{
+	return version == CANONICAL_CONTAINER || version == STORED_CONTAINER || version == RUN_CONTAINER;
+}
+
+/*
+	This function reads the magic bytes and version of a container,
+	and sets checksummed to whether CONTAINER_CHECKSUM_FLAG was added.
+	Legacy files have no magic; for those nothing is consumed.
+*/
+ContainerVersion readContainerVersion(ibstream& infile, bool& checksummed)
+{
+	checksummed = false;
+	if (infile.peek() != CONTAINER_MAGIC[0]) return LEGACY_CONTAINER;
+
+	char magic[sizeof CONTAINER_MAGIC - 1];
+	infile.read(magic, sizeof magic);
+	int version = infile.get();
+	if (infile.fail() || string(magic, sizeof magic) != CONTAINER_MAGIC)
+	{
+		error("Not a compressed file.");
+	}
+	if ((version & CONTAINER_CHECKSUM_FLAG) != 0 && canHaveChecksum(version & ~CONTAINER_CHECKSUM_FLAG))
+	{
+		checksummed = true;
+		version &= ~CONTAINER_CHECKSUM_FLAG;
+	}
+	if (version < CANONICAL_CONTAINER || version > RUN_CONTAINER) error("Unsupported container version " + integerToString(version) + ".");
+
+	return ContainerVersion(version);
+}
+
+/*
+	This function reads the version of a container held in length bytes
+	at data, as readContainerVersion does, and returns the index just
+	past it; version is 0 if there is no magic.  If the container ends
+	in a checksum, checked is set, the checksum is taken off the end
+	into checksum, and length is cut to the bytes before it.
+*/
+size_t readBufferVersion(const uint8_t* data, size_t& length, int& version, bool& checked, uint32_t& checksum)
+{
+	size_t magicBytes = sizeof CONTAINER_MAGIC - 1;
+	version = 0;
+	checked = false;
+	checksum = 0;
+	if (length <= magicBytes || memcmp(data, CONTAINER_MAGIC, magicBytes) != 0) return 0;
+
+	version = data[magicBytes];
+	if ((version & CONTAINER_CHECKSUM_FLAG) != 0 && canHaveChecksum(version & ~CONTAINER_CHECKSUM_FLAG))
+	{
+		if (length < magicBytes + 1 + 4) error("Encoded data is cut off.");
+		version &= ~CONTAINER_CHECKSUM_FLAG;
+		checked = true;
+		length -= 4;
+		for (int i = 0; i < 4; i++) checksum |= uint32_t(data[length + i]) << (8 * i);
+	}
+	return magicBytes + 1;
+}
+
+/*
+	This function raises an error if the checksum stored with a
+	container is not the one computed from the data decoded
+*/
+void checkChecksum(uint32_t stored, uint32_t computed)
+{
+	if (stored != computed) error("Data does not match its checksum; the file is damaged.");
+}
+
+/*
+	this function searches code in tree and returns relevant character,
+	or NOT_A_CHAR if code ends inside the tree, through a FlatTree copy
+	as decodeWithTree does; a code that runs past a leaf is an error
+*/
+ext_char searchCodeInTree(Node* root, string code)
+{
+	return FlatTree(root).searchCode(code);
+}
+
+/*
+	This function decodes bits with a decode table.  It peeks
+	lookupBits bits at a time from the bit buffer of infile and
+	consumes only the length of the code found, and collects the
+	bytes in an OutputBuffer.  Once PSEUDO_EOF is decoded, the bytes
+	read ahead are handed back to the stream.  The buffer takes the
+	CRC-32C of the bytes into checksum as it flushes them, if
+	checksum is not NULL.
+*/
+void decodeWithTable(ibstream& infile, const DecodeTable& table, ostream& file, uint32_t* checksum)
+{
+	MemoryCategoryScope scope(CODING_MEMORY);
+	const DecodeEntry* entries = &table.entries[0];
+	const int lookupBits = table.lookupBits;
+
+	bool wasBuffering = infile.isBitBuffering();
+	infile.setBitBuffering(true); //read ahead into a 64-bit register
+	OutputBuffer output(file, checksum);
+
+	while (true)
+	{
+		const DecodeEntry* entry = &entries[uint32_t(infile.peekBits(lookupBits))];
+		while (entry->link != 0)
+		{
+			//code is longer than the primary table, go one level down
+			infile.skipBits(entry->length);
+			entry = &entries[table.subtables[entry->symbol] + uint32_t(infile.peekBits(entry->link))];
+		}
+		infile.skipBits(entry->length);
+
+		if (infile.fail()) error("Encoded data ended before PSEUDO_EOF.");
+		if (entry->symbol == PSEUDO_EOF) break;
+
+		output.put(char(entry->symbol));
+	}
+
+	output.flush();
+	infile.setBitBuffering(wasBuffering);
+}
+
+/*
+	This function is the reference decoder: it walks the encoding tree
+	one bit at a time from the root to a leaf for each character, as
+	searchCodeInTree does for a single code.  The walk goes through a
+	FlatTree copy, whose few small arrays stay in cache, rather than
+	from Node to Node across the heap
+*/
+void decodeWithTree(ibstream& infile, Node* encodingTree, ostream& file, uint32_t* checksum)
+{
+	FlatTree tree(encodingTree);
+	tree.decode(infile, file, checksum);
+}
+
+/*
+	This function tells whether decodeFast can decode with table from
+	infile: every code must be found in the primary table, which must
+	leave room for at least one code per refill (and not be the empty
+	code of a lone PSEUDO_EOF), and infile must not be holding bits of
+	its own
+*/
+bool canDecodeFast(ibstream& infile, const DecodeTable& table)
+{
+	return table.subtables.empty() && table.lookupBits >= 1 && table.lookupBits <= 56 &&
+	       !infile.isBitBuffering();
+}
+
+/*
+	This function decodes with the decode table in a 64-bit register
+	refilled from a chunk of the input instead of through the stream.
+	While at least eight bytes of the chunk are left, a refill is a
+	single unaligned load that tops the register up to 56 or more bits,
+	enough for 56 / lookupBits codes, which are then looked up with no
+	further checks but for PSEUDO_EOF.  The last few bytes of the input
+	go through a tail loop that pads with zeros and checks every code.
+	Decoded bytes go out through an OutputBuffer, which takes their
+	CRC-32C into checksum if it is not NULL.  Once PSEUDO_EOF is
+	decoded, the bytes read ahead are handed back.
+*/
+void decodeFast(ibstream& infile, const DecodeTable& table, ostream& file, uint32_t* checksum)
+{
+	MemoryCategoryScope scope(CODING_MEMORY);
+	const int CHUNK_SIZE = 1 << 16;
+	const DecodeEntry* entries = &table.entries[0];
+	const uint64_t mask = (uint64_t(1) << table.lookupBits) - 1;
+	const int codesPerRefill = 56 / table.lookupBits;
+
+	streambuf* source = infile.rdbuf();
+	std::vector<unsigned char> chunk(CHUNK_SIZE);
+	size_t length = 0; //bytes in chunk
+	size_t next = 0;   //first byte of chunk not yet in the register
+	bool moreInput = true;
+
+	uint64_t bits = 0;
+	int count = 0;
+	int padBits = 0; //zero bits added past the end of the input
+	OutputBuffer output(file, checksum);
+
+	while (true)
+	{
+		//keep at least eight bytes ahead while the input lasts
+		if (length - next < 8 && moreInput)
+		{
+			memmove(&chunk[0], &chunk[next], length - next);
+			length -= next;
+			next = 0;
+			streamsize got = source->sgetn((char*)&chunk[length], streamsize(CHUNK_SIZE - length));
+			if (got > 0) length += size_t(got);
+			else moreInput = false;
+			continue;
+		}
+
+		if (length - next >= 8)
+		{
+			//hot path: one load, then several codes without checks
+			bits |= loadLittleEndian64(&chunk[next]) << count;
+			next += (63 - count) >> 3;
+			count |= 56;
+
+			for (int i = 0; i < codesPerRefill; i++)
+			{
+				const DecodeEntry& entry = entries[bits & mask];
+				bits >>= entry.length;
+				count -= entry.length;
+				if (entry.symbol == PSEUDO_EOF) goto finished;
+				output.put(char(entry.symbol));
+			}
+		}
+		else
+		{
+			//tail: byte by byte, zeros past the end, every code checked
+			while (count <= 56)
+			{
+				uint64_t byte = 0;
+				if (next < length) byte = chunk[next++];
+				else padBits += 8;
+				bits |= byte << count;
+				count += 8;
+			}
+
+			const DecodeEntry& entry = entries[bits & mask];
+			bits >>= entry.length;
+			count -= entry.length;
+			if (count < padBits) error("Encoded data ended before PSEUDO_EOF.");
+			if (entry.symbol == PSEUDO_EOF) break;
+			output.put(char(entry.symbol));
+		}
+	}
+finished:
+	output.flush();
+
+	//hand back the whole bytes not used, as setBitBuffering(false) does
+	size_t unused = (length - next) + size_t((count - padBits) / 8);
+	for (; unused > 0; unused--)
+	{
+		if (source->sungetc() == EOF)
+		{
+			infile.seekg(-streamoff(unused), ios::cur);
+			break;
+		}
+	}
+}
+
+/*
+	This function decodes with whichever of decodeFast and
+	decodeWithTable setDecoderKind calls for and can be used
+*/
+void decodeSymbols(ibstream& infile, const DecodeTable& table, ostream& file, uint32_t* checksum)
+{
+	DecoderKind kind = getDecoderKind();
+	if ((kind == AUTOMATIC_DECODER || kind == FAST_DECODER || kind == FSM_DECODER) && canDecodeFast(infile, table))
+	{
+		decodeFast(infile, table, file, checksum);
+	}
+	else
+	{
+		decodeWithTable(infile, table, file, checksum);
+	}
+}
+
+/*
+	This function returns the eight bytes at bytes as a number, the
+	first byte lowest, whatever their alignment.  On x86 that is a
+	plain load.
+*/
+uint64_t loadLittleEndian64(const unsigned char* bytes)
+{
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+	uint64_t value;
+	memcpy(&value, bytes, sizeof value);
+	return value;
+#else
+	uint64_t value = 0;
+	for (int i = 7; i >= 0; i--)
+	{
+		value = (value << 8) | bytes[i];
+	}
+	return value;
+#endif
+}
@@ -14,8 +14,18 @@
 #include "map.h"
 #include "bstream.h"
 #include "pqueue.h"
+#include "HuffmanTables.h"
+#include "NodeArena.h"
+#include "HuffmanStats.h"
+#include "HuffmanHistogram.h"
 
 
+/* Constant: DEFAULT_MAX_CODE_LENGTH
+ * The longest code compress gives any character.  It matches the
+ * decoder's lookup width, so every code decodes in one lookup.
+ */
+const int DEFAULT_MAX_CODE_LENGTH = DEFAULT_DECODE_BITS;
+
 /* Function: getFrequencyTable
  * Usage: Map<ext_char, int> freq = getFrequencyTable(file);
  * --------------------------------------------------------
@@ -28,9 +38,42 @@
  * character to be 1, which ensures that any future encoding
  * tree built from these frequencies will have an encoding for
  * the PSEUDO_EOF character.
+ *
+ * Raises an error if a character appears more often than an int
+ * can count; such files are counted with countBytes (see
+ * HuffmanHistogram.h) and take the buildEncodingTree below that
+ * reads 64-bit weights.
  */
 Map<ext_char, int> getFrequencyTable(istream& file);
 
+/* Function: getFrequencyTable
+ * Usage: uint64_t length = getFrequencyTable(file, weights);
+ * --------------------------------------------------------
+ * Counts the same frequencies into an array indexed by ext_char,
+ * which is replaced, with PSEUDO_EOF at 1 and every character
+ * that does not appear at zero.  Nothing is allocated, and no
+ * count is too large.  Returns the number of bytes read.
+ */
+uint64_t getFrequencyTable(istream& file, uint64_t weights[NUM_SYMBOLS]);
+
+/* Function: frequenciesToWeights
+ * Usage: frequenciesToWeights(frequencies, weights);
+ * --------------------------------------------------------
+ * Copies a frequency map into an array indexed by ext_char, which
+ * is replaced; characters not in the map get zero.  Raises an
+ * error if a frequency is negative.
+ */
+void frequenciesToWeights(Map<ext_char, int>& frequencies, uint64_t weights[NUM_SYMBOLS]);
+
+/* Function: weightsToFrequencies
+ * Usage: Map<ext_char, int> frequencies = weightsToFrequencies(weights);
+ * --------------------------------------------------------
+ * Returns a frequency map with an entry for every character of
+ * nonzero weight.  Raises an error if a weight is too large for an
+ * int.
+ */
+Map<ext_char, int> weightsToFrequencies(const uint64_t weights[NUM_SYMBOLS]);
+
 /* Function: buildEncodingTree
  * Usage: Node* tree = buildEncodingTree(frequency);
  * --------------------------------------------------------
@@ -41,8 +84,49 @@ Map<ext_char, int> getFrequencyTable(istream& file);
  * This function can assume that there is always at least one
  * entry in the map, since the PSEUDO_EOF character will always
  * be present.
+ *
+ * If maxCodeLength is given, no character's code is longer than
+ * that many bits.  A Huffman tree that already meets the limit is
+ * returned unchanged; otherwise the tree is rebuilt from the
+ * optimal code lengths within the limit.  Raises an error if
+ * there are too many characters for the limit.
+ */
+Node* buildEncodingTree(Map<ext_char, int>& frequencies,
+                        int maxCodeLength = NO_LENGTH_LIMIT);
+
+/* Function: buildEncodingTree
+ * Usage: Node* tree = buildEncodingTree(frequency, arena);
+ * --------------------------------------------------------
+ * Builds the same encoding tree as above, but takes its nodes
+ * from the given arena instead of the heap.  The tree must not
+ * be passed to freeTree; it is released by resetting the arena.
+ */
+Node* buildEncodingTree(Map<ext_char, int>& frequencies, NodeArena& arena,
+                        int maxCodeLength = NO_LENGTH_LIMIT);
+
+/* Function: buildEncodingTree
+ * Usage: Node* tree = buildEncodingTree(weights, arena);
+ * --------------------------------------------------------
+ * Builds the same encoding tree as above from an array of 64-bit
+ * weights indexed by ext_char, in which characters of weight zero
+ * are left out, so that no count from a file of any size is cut
+ * short.  At least one weight must be nonzero.
+ */
+Node* buildEncodingTree(const uint64_t weights[NUM_SYMBOLS], NodeArena& arena,
+                        int maxCodeLength = NO_LENGTH_LIMIT);
+
+/* Function: buildCodeTable
+ * Usage: buildCodeTable(weights, codes);
+ *        buildCodeTable(weights, codes, maxCodeLength);
+ * --------------------------------------------------------
+ * Fills codes with the canonical code that compress would use for
+ * the given weights, indexed by ext_char, with no code longer than
+ * maxCodeLength bits.  The tree it takes comes from an arena on
+ * the stack and is gone when it returns.  At least one weight must
+ * be nonzero.
  */
-Node* buildEncodingTree(Map<ext_char, int>& frequencies);
+void buildCodeTable(const uint64_t weights[NUM_SYMBOLS], CodeTable& codes,
+                    int maxCodeLength = DEFAULT_MAX_CODE_LENGTH);
 
 /* Function: freeTree
  * Usage: freeTree(encodingTree);
@@ -69,8 +153,23 @@ void freeTree(Node* root);
  *     to it, and the file cursor is at the end of the file.
  *     This means that you should just start writing the bits
  *     without seeking the file anywhere.
+ *
+ * If checksum is not NULL, the CRC-32C of the bytes encoded (see
+ * HuffmanChecksum.h) is added to it, as they are read, for the
+ * caller to store wherever its format keeps it; the bits written
+ * are the same either way.
+ */
+void encodeFile(istream& infile, Node* encodingTree, obstream& outfile, uint32_t* checksum = NULL);
+
+/* Function: encodeFile
+ * Usage: encodeFile(source, codes, output);
+ *        encodeFile(source, codes, output, &crc);
+ * --------------------------------------------------------
+ * Encodes the file as above with a code table instead of a tree,
+ * so that no tree needs to be kept, and ends with the code of
+ * PSEUDO_EOF.  Raises an error if a code is longer than 32 bits.
  */
-void encodeFile(istream& infile, Node* encodingTree, obstream& outfile);
+void encodeFile(istream& infile, const CodeTable& codes, obstream& outfile, uint32_t* checksum = NULL);
 
 /* Function: decodeFile
  * Usage: decodeFile(encodedFile, encodingTree, resultFile);
@@ -83,8 +182,12 @@ void encodeFile(istream& infile, Node* encodingTree, obstream& outfile);
  *     this encoding table.
  *
  *   - The output file is open and ready for writing.
+ *
+ * If checksum is not NULL, the CRC-32C of the bytes decoded is
+ * added to it as they are written out, so that the caller can
+ * compare it with the one encodeFile gave.
  */
-void decodeFile(ibstream& infile, Node* encodingTree, ostream& file);
+void decodeFile(ibstream& infile, Node* encodingTree, ostream& file, uint32_t* checksum = NULL);
 
 /* Function: writeFileHeader
  * Usage: writeFileHeader(output, frequencies);
@@ -102,6 +205,15 @@ void decodeFile(ibstream& infile, Node* encodingTree, ostream& file);
  */
 void writeFileHeader(obstream& outfile, Map<ext_char, int>& frequencies);
 
+/* Function: writeFileHeader
+ * Usage: writeFileHeader(output, weights);
+ * --------------------------------------------------------
+ * Writes the same table from an array indexed by ext_char, with an
+ * entry for every byte of nonzero weight.  Raises an error if
+ * PSEUDO_EOF has no weight.
+ */
+void writeFileHeader(obstream& outfile, const uint64_t weights[NUM_SYMBOLS]);
+
 /* Function: readFileHeader
  * Usage: Map<ext_char, int> freq = writeFileHeader(input);
  * --------------------------------------------------------
@@ -117,6 +229,156 @@ void writeFileHeader(obstream& outfile, Map<ext_char, int>& frequencies);
  */
 Map<ext_char, int> readFileHeader(ibstream& infile);
 
+/* Function: readFileHeader
+ * Usage: readFileHeader(input, weights);
+ * --------------------------------------------------------
+ * Reads the same table into an array indexed by ext_char, which
+ * is replaced, with PSEUDO_EOF at 1.
+ */
+void readFileHeader(ibstream& infile, uint64_t weights[NUM_SYMBOLS]);
+
+/* Constant: CONTAINER_MAGIC
+ * The three bytes that start every file written by compress,
+ * followed by one byte holding the container version.  Files
+ * written before versions existed start with the decimal count
+ * of writeFileHeader instead, and are version 1.
+ */
+const char CONTAINER_MAGIC[] = "HUF";
+
+/* Type: ContainerVersion
+ * The layouts a compressed file can have.
+ *
+ *   LEGACY_CONTAINER:    writeFileHeader's textual frequency
+ *                        table, then the encoded bits.
+ *   CANONICAL_CONTAINER: magic and version, a code length header
+ *                        (see writeCodeLengthHeader), then the
+ *                        bits encoded with the canonical code for
+ *                        those lengths.
+ *   BLOCK_CONTAINER:     magic and version, then independently
+ *                        coded blocks and a block index (see
+ *                        HuffmanBlocks.h).
+ *   ADAPTIVE_CONTAINER:  magic and version, then the data in an
+ *                        adaptive Huffman code (see
+ *                        AdaptiveHuffman.h).
+ *   DICTIONARY_CONTAINER: magic and version, then the number of a
+ *                        shared dictionary, and the bits encoded
+ *                        with its code (see HuffmanDictionary.h).
+ *   STORED_CONTAINER:    magic and version, the number of bytes in
+ *                        8 bytes, least significant first, then the
+ *                        bytes themselves, not coded at all.
+ *   PRESET_CONTAINER:    magic and version, then the number of a
+ *                        built-in code, and the bits encoded with
+ *                        it (see HuffmanPresets.h).
+ *   SEEKABLE_CONTAINER:  as CANONICAL_CONTAINER, followed by an
+ *                        index of checkpoints into the bits (see
+ *                        HuffmanSeek.h).
+ *   ORDER1_CONTAINER:    magic and version, a map from each previous
+ *                        byte to one of several code tables, the
+ *                        tables, then the bits (see HuffmanOrder1.h).
+ *   RUN_CONTAINER:       magic and version, the one byte value the
+ *                        data is made of, then how many times it
+ *                        repeats in 8 bytes, least significant first.
+ *
+ * The version byte of a CANONICAL_CONTAINER, STORED_CONTAINER or
+ * RUN_CONTAINER may have CONTAINER_CHECKSUM_FLAG added.
+ */
+enum ContainerVersion {
+	LEGACY_CONTAINER = 1,
+	CANONICAL_CONTAINER = 2,
+	BLOCK_CONTAINER = 3,
+	ADAPTIVE_CONTAINER = 4,
+	DICTIONARY_CONTAINER = 5,
+	STORED_CONTAINER = 6,
+	PRESET_CONTAINER = 7,
+	SEEKABLE_CONTAINER = 8,
+	ORDER1_CONTAINER = 9,
+	RUN_CONTAINER = 10
+};
+
+/* Constant: CONTAINER_CHECKSUM_FLAG
+ * Added to the version byte of a container whose layout above is
+ * followed by the CRC-32C of the original data (see
+ * HuffmanChecksum.h) in 4 bytes, least significant first.  compress
+ * adds it to every canonical, stored and run container, and the
+ * decoder rejects the file if the data it decodes does not match.
+ * Files written before these containers had checksums lack the
+ * flag and are decoded unchecked.
+ */
+const int CONTAINER_CHECKSUM_FLAG = 0x80;
+
+/* Type: CompressionMode
+ * How compress codes its input.
+ *
+ *   STATIC_MODE:   one code for the whole file, built from its
+ *                  frequencies in a first pass.
+ *   ADAPTIVE_MODE: a code that adapts as the file is read, written
+ *                  in a single pass with no header.
+ *   INTERLEAVED_MODE: a block container whose blocks are each split
+ *                  into several streams that decode side by side
+ *                  (see HuffmanBlocks.h).
+ *   SAMPLED_MODE:  as STATIC_MODE, but the frequencies are estimated
+ *                  from a sample of the file (see sampleBytes), so
+ *                  a huge file is read little more than once.
+ *   ORDER1_MODE:   a code for each value of the byte before, with
+ *                  rare contexts sharing one (see HuffmanOrder1.h).
+ */
+enum CompressionMode {
+	STATIC_MODE,
+	ADAPTIVE_MODE,
+	INTERLEAVED_MODE,
+	SAMPLED_MODE,
+	ORDER1_MODE
+};
+
+/* Constant: MAX_CODE_LENGTH_HEADER_BYTES
+ * The most bytes writeCodeLengthHeader can write: the dense layout
+ * with seven bits for each of the 257 lengths, plus four bits in
+ * front.  The sparse layout is only used when it is smaller.
+ */
+const int MAX_CODE_LENGTH_HEADER_BYTES = (4 + NUM_SYMBOLS * 7 + 7) / 8;
+
+/* Function: writeCodeLengthHeader
+ * Usage: writeCodeLengthHeader(output, lengths);
+ * --------------------------------------------------------
+ * Writes the code length of every ext_char (zero for those
+ * without a code) in a compact binary form.  The first three
+ * bits give how many bits each length takes, less one.  A flag
+ * bit then chooses between a sparse layout, which lists the
+ * number of coded bytes in nine bits followed by each byte and
+ * its length in ascending order, and a dense layout, which has
+ * one length for each of the 256 byte values.  Both end with
+ * the length for PSEUDO_EOF.  The header is padded to a whole
+ * byte.  Raises an error if PSEUDO_EOF has no code.
+ */
+void writeCodeLengthHeader(obstream& outfile, const uint8_t lengths[NUM_SYMBOLS]);
+
+/* Function: writeCodeLengthHeader
+ * Usage: size_t bytes = writeCodeLengthHeader(lengths, header);
+ * --------------------------------------------------------
+ * Writes the same header into the array header, which must have
+ * room for MAX_CODE_LENGTH_HEADER_BYTES, and returns how many
+ * bytes it took.
+ */
+size_t writeCodeLengthHeader(const uint8_t lengths[NUM_SYMBOLS], uint8_t header[MAX_CODE_LENGTH_HEADER_BYTES]);
+
+/* Function: readCodeLengthHeader
+ * Usage: readCodeLengthHeader(input, lengths);
+ * --------------------------------------------------------
+ * Reads back a header written by writeCodeLengthHeader into
+ * lengths.  Raises an error if the header is damaged or the
+ * lengths do not form a complete prefix code.
+ */
+void readCodeLengthHeader(ibstream& infile, uint8_t lengths[NUM_SYMBOLS]);
+
+/* Function: readCodeLengthHeader
+ * Usage: size_t bytes = readCodeLengthHeader(data, length, lengths);
+ * --------------------------------------------------------
+ * Reads a header from the front of the length bytes at data, and
+ * returns how many bytes it took.  Raises the same errors as the
+ * stream version, including when the header runs past length.
+ */
+size_t readCodeLengthHeader(const uint8_t* data, size_t length, uint8_t lengths[NUM_SYMBOLS]);
+
 /* Function: compress
  * Usage: compress(infile, outfile);
  * --------------------------------------------------------
@@ -127,8 +389,95 @@ Map<ext_char, int> readFileHeader(ibstream& infile);
  * previous functions together to implement this function,
  * which should not require much logic of its own and should
  * primarily be glue code.
+ *
+ * The output is a CANONICAL_CONTAINER file whose codes are at
+ * most DEFAULT_MAX_CODE_LENGTH bits long, unless the histogram
+ * shows that it would be no smaller than the input itself, as for
+ * data that is already compressed; then the input is copied into
+ * a STORED_CONTAINER instead.  Input that cannot be
+ * rewound, such as a pipe, is read once and written as a
+ * BLOCK_CONTAINER instead (see compressStream).
+ *
+ * Degenerate data takes a shortcut in STATIC_MODE.  A file that is
+ * one byte value repeated, such as a zero-filled image, becomes a
+ * RUN_CONTAINER of a few bytes whatever its size; a file of a few
+ * kilobytes or more that is at least half one value, such as padded
+ * records, becomes a BLOCK_CONTAINER whose blocks code the runs of
+ * that value (see RUN_BLOCK and RLE_BLOCK), since a canonical code
+ * cannot take less than a bit for each byte.
+ *
+ * In ADAPTIVE_MODE the output is an ADAPTIVE_CONTAINER, and each
+ * character's bits are ready as soon as it is read.  In
+ * INTERLEAVED_MODE it is a BLOCK_CONTAINER of INTERLEAVED_BLOCKs,
+ * which trades a few bytes per block for faster decoding.
+ * SAMPLED_MODE writes the same containers as STATIC_MODE, from an
+ * estimate of the frequencies in which every byte value has a
+ * count of at least one, so that bytes the sample missed can
+ * still be coded; the estimate costs some compression, most of
+ * all on files whose contents change along the way.
+ *
+ * With a TableCache installed (see TableCache.h), an input shaped
+ * like an earlier one is coded with the earlier one's code.
+ *
+ * If stats is not NULL, it is filled in with what the call did
+ * (see CodingStats).
+ */
+void compress(ibstream& infile, obstream& outfile, CompressionMode mode = STATIC_MODE,
+              CodingStats* stats = NULL);
+
+/* Type: SizeEstimate
+ * What compress in STATIC_MODE would write for some frequencies,
+ * found from the code lengths alone.
+ *
+ *   container:   the ContainerVersion it would write.
+ *   rawBytes:    the number of input bytes the frequencies count.
+ *   headerBits:  the magic, the version, and the code length header
+ *                or the stored length.
+ *   payloadBits: the codes of every byte and PSEUDO_EOF, or the
+ *                stored bytes, before padding to a whole byte.
+ *   totalBits:   headerBits plus payloadBits.
+ *   totalBytes:  the size of the whole compressed file.
+ *   exact:       whether the sizes are exactly what compress would
+ *                write.  They are not when the frequencies come from
+ *                a sample, nor for a BLOCK_CONTAINER of runs, where
+ *                they give what one code for the file would take.
  */
-void compress(ibstream& infile, obstream& outfile);
+struct SizeEstimate {
+	ContainerVersion container;
+	uint64_t rawBytes;
+	uint64_t headerBits;
+	uint64_t payloadBits;
+	uint64_t totalBits;
+	uint64_t totalBytes;
+	bool exact;
+};
+
+/* Function: estimateCompressedSize
+ * Usage: SizeEstimate estimate = estimateCompressedSize(frequencies);
+ *        SizeEstimate estimate = estimateCompressedSize(weights);
+ * --------------------------------------------------------
+ * Returns how large compress would make a file with the given
+ * frequencies, indexed by ext_char, without coding anything: the
+ * code is built and its lengths are multiplied out, which takes
+ * microseconds next to the counting pass.  PSEUDO_EOF is counted
+ * once whatever its frequency.  With a TableCache installed,
+ * compress may reuse a slightly different code than the one built
+ * here.  Raises an error if a frequency is negative.
+ */
+SizeEstimate estimateCompressedSize(Map<ext_char, int>& frequencies);
+SizeEstimate estimateCompressedSize(const uint64_t weights[NUM_SYMBOLS]);
+
+/* Function: estimateCompressedSize
+ * Usage: SizeEstimate estimate = estimateCompressedSize(file);
+ *        SizeEstimate estimate = estimateCompressedSize(file, sampleEvery);
+ * --------------------------------------------------------
+ * Returns the estimate for the rest of a seekable stream from
+ * frequencies sampled by sampleBytes, which reads about one block
+ * in every sampleEvery.  The estimate is exact only for streams of
+ * a single block, which are counted whole.  The stream is left as
+ * sampleBytes leaves it.
+ */
+SizeEstimate estimateCompressedSize(istream& file, int sampleEvery = DEFAULT_SAMPLE_EVERY);
 
 /* Function: decompress
  * Usage: decompress(infile, outfile);
@@ -141,17 +490,121 @@ void compress(ibstream& infile, obstream& outfile);
  * previous functions together to implement this function,
  * which should not require much logic of its own and should
  * primarily be glue code.
+ *
+ * Files of every ContainerVersion can be decompressed, except that
+ * a DICTIONARY_CONTAINER needs its dictionary and raises an error
+ * here (see decompressWithDictionary).  If stats is not NULL, it is
+ * filled in as by compress.
+ */
+void decompress(ibstream& infile, ostream& outfile, CodingStats* stats = NULL);
+
+/* Type: DecoderKind
+ * The ways the decoder can turn bits back into characters.
+ *
+ *   AUTOMATIC_DECODER: the fastest one that can handle the code.
+ *   TREE_DECODER:      walks the encoding tree one bit at a time,
+ *                      as searchCodeInTree does.  The reference,
+ *                      used only where a tree exists (decodeFile);
+ *                      elsewhere it means TABLE_DECODER.
+ *   TABLE_DECODER:     looks up whole codes in a DecodeTable through
+ *                      the bit buffer of the input stream.
+ *   FAST_DECODER:      looks up several codes at a time from a
+ *                      64-bit register refilled seven bytes at
+ *                      once.  Needs every code to fit the primary
+ *                      table and the stream's bit buffering to be
+ *                      off; otherwise TABLE_DECODER is used.
+ *   FSM_DECODER:       steps a state machine a byte of input at a
+ *                      time, putting out every character the byte
+ *                      finishes (see HuffmanFsm.h).  Used by
+ *                      decodeFile and for CANONICAL_CONTAINERs when
+ *                      the stream's bit buffering is off and the
+ *                      table fits DEFAULT_FSM_MEMORY_LIMIT;
+ *                      otherwise it means AUTOMATIC_DECODER.
+ *
+ * All of them give the same output and the same errors.
+ */
+enum DecoderKind {
+	AUTOMATIC_DECODER,
+	TREE_DECODER,
+	TABLE_DECODER,
+	FAST_DECODER,
+	FSM_DECODER
+};
+
+/* Function: setDecoderKind
+ * Usage: setDecoderKind(TREE_DECODER);
+ * --------------------------------------------------------
+ * Chooses the decoder used from now on by decodeFile, decompress
+ * and the block decoders.  The default is AUTOMATIC_DECODER.  Set
+ * it before starting threads that decode.
+ */
+void setDecoderKind(DecoderKind kind);
+
+/* Function: getDecoderKind
+ * Usage: DecoderKind kind = getDecoderKind();
+ * --------------------------------------------------------
+ * Returns the decoder chosen by setDecoderKind.
+ */
+DecoderKind getDecoderKind();
+
+/* Function: compressBuffer
+ * Usage: compressBuffer(data, length, output);
+ * --------------------------------------------------------
+ * Compresses length bytes starting at data into output, which
+ * is replaced.  The result is a CANONICAL_CONTAINER or a
+ * STORED_CONTAINER, just as compress would write, but no streams
+ * are involved: the bytes are coded straight from memory, and
+ * output is sized from the histogram before coding starts.
+ */
+void compressBuffer(const uint8_t* data, size_t length, std::vector<uint8_t>& output);
+
+/* Function: decompressBuffer
+ * Usage: decompressBuffer(data, length, output);
+ * --------------------------------------------------------
+ * Decompresses the compressed file held in length bytes starting
+ * at data into output, which is replaced.  A CANONICAL_CONTAINER
+ * or STORED_CONTAINER is decoded straight from memory; any other
+ * ContainerVersion is handed to decompress.  Raises an error if
+ * the data is damaged.
  */
-void decompress(ibstream& infile, ostream& outfile);
+void decompressBuffer(const uint8_t* data, size_t length, std::vector<uint8_t>& output);
 
 
 		/*	Private Functions decleration	*/		
 
-void enqueueNodes(Map<ext_char, int>& frequencies, PriorityQueue<Node*>& pQueue);
-Node* mergeNodes(PriorityQueue<Node*>& pQueue);
-string searchCharacterInTree(Node* root, ext_char character);
-bool isCorrectCode(Node* fromRoot, string code, ext_char character);
-void writeBits(obstream& outfile, string code);
+Node* newNode(NodeArena* arena);
+Node* buildTree(std::vector<Node*>& leaves, NodeArena* arena, int maxCodeLength);
+void collectLeaves(Map<ext_char, int>& frequencies, std::vector<Node*>& leaves, NodeArena* arena);
+void collectLeaves(const uint64_t weights[NUM_SYMBOLS], std::vector<Node*>& leaves, NodeArena* arena);
+Node* mergeLeaves(std::vector<Node*>& leaves, NodeArena* arena);
+Node* takeLightest(std::vector<Node*>& leaves, size_t& nextLeaf,
+                   std::vector<Node*>& merged, size_t& nextMerged);
 ext_char searchCodeInTree(Node* root, string code);
+int treeDepth(Node* root);
+Node* buildTreeFromCodes(CodeTable& codes, const uint64_t weights[NUM_SYMBOLS], NodeArena* arena);
+void encodeWithTable(istream& infile, const CodeTable& table, obstream& outfile, uint32_t* checksum = NULL);
+void writeBufferContainer(const uint8_t* data, size_t length, const uint64_t weights[NUM_SYMBOLS],
+                          const CodeTable& codes, const uint8_t* header, size_t headerBytes,
+                          std::vector<uint8_t>& output);
+size_t encodeBytes(const uint8_t* data, size_t length, const CodeTable& table,
+                   std::vector<uint8_t>& output, size_t start, uint32_t* checksum = NULL);
+void decodeBytes(const uint8_t* data, size_t length, const DecodeTable& table,
+                 std::vector<uint8_t>& output, uint32_t* checksum = NULL);
+void decodeWithTable(ibstream& infile, const DecodeTable& table, ostream& file, uint32_t* checksum = NULL);
+void decodeWithTree(ibstream& infile, Node* encodingTree, ostream& file, uint32_t* checksum = NULL);
+bool canDecodeFast(ibstream& infile, const DecodeTable& table);
+void decodeFast(ibstream& infile, const DecodeTable& table, ostream& file, uint32_t* checksum = NULL);
+void decodeSymbols(ibstream& infile, const DecodeTable& table, ostream& file, uint32_t* checksum = NULL);
+uint64_t loadLittleEndian64(const unsigned char* bytes);
+void writeContainerVersion(obstream& outfile, ContainerVersion version, bool checksummed = false);
+ContainerVersion readContainerVersion(ibstream& infile);
+ContainerVersion readContainerVersion(ibstream& infile, bool& checksummed);
+size_t readBufferVersion(const uint8_t* data, size_t& length, int& version, bool& checked, uint32_t& checksum);
+void checkChecksum(uint32_t stored, uint32_t computed);
+void finishStats(CodingStats& stats, streamoff bytesIn, streamoff bytesOut);
+bool isWorthCoding(uint64_t rawBytes, size_t headerBytes, uint64_t encodedBits);
+void writeStoredLength(obstream& outfile, uint64_t length);
+uint64_t readStoredLength(ibstream& infile);
+void copyStored(istream& infile, ostream& outfile, uint64_t length, uint32_t* checksum = NULL);
 
 #endif
@@ -12,11 +12,36 @@
 #include <sstream>
 #include <iomanip>
 #include <limits>
+#include <cstdlib>
+#include <fstream>
+#include <algorithm>
+#include <cstring>
 //#include "console.h"
 #include "simpio.h"
 #include "strlib.h"
+#include "error.h"
 #include "bstream.h"
 #include "HuffmanEncoding.h"
+#include "HuffmanBlocks.h"
+#include "HuffmanChecksum.h"
+#include "LittleEndian.h"
+#include "HuffmanBatch.h"
+#include "HuffmanPipeline.h"
+#include "HuffmanDictionary.h"
+#include "HuffmanPresets.h"
+#include "HuffmanSeek.h"
+#include "HuffmanHistogram.h"
+#include "HuffmanOrder1.h"
+#include "WorkPool.h"
+#include "FlatTree.h"
+#include "OutputBuffer.h"
+#include "TableCache.h"
+#include "MappedFile.h"
+#include "HuffmanVerify.h"
+#include "HuffmanCorpus.h"
+#include "CodePacker.h"
+#include "HuffmanFsm.h"
+#include "HuffmanContext.h"
 #include "ReferenceHuffmanEncoding.h"
 #include "MemoryDiagnostics.h"
 using namespace std;
@@ -32,12 +57,26 @@ enum MenuEntry {
 	MANUAL_ENCODING_TESTS,
 	AUTOMATIC_ENCODING_TESTS,
 	AUTOMATIC_COMPLETE_TESTS,
+	AUTOMATIC_BITSTREAM_TESTS,
+	AUTOMATIC_FEATURE_TESTS,
 	COMPRESS,
 	DECOMPRESS,
 	COMPARE,
+	BATCH_COMPRESS,
+	VERIFY,
+	GENERATE_CORPUS,
+	APPEND,
 	QUIT,
 };
 
+/* Variable: interactive
+ * Whether a person is at the console.  In a batch run, nothing
+ * waits for ENTER, and failures are counted in failureCount so that
+ * the exit status can report them.
+ */
+bool interactive = true;
+int failureCount = 0;
+
 /* Macro: checkCondition
  * ------------------------------------------------------------
  * A utility macro that makes it easier to diagnose and report
@@ -62,7 +101,8 @@ void doAssertCondition(bool expr, string reason, string expression, int lineNumb
 		cout << "! FAIL: " << reason << endl;
 		cout << "  Test failed on line " << lineNumber << " of HuffmanEncodingTest.cpp" << endl;
 		cout << "  Specific expression: " << expression << endl;
-		getLine("  Press ENTER to continue...");
+		failureCount++;
+		if (interactive) getLine("  Press ENTER to continue...");
 	}
 }
 
@@ -95,7 +135,7 @@ void beginTest(string testName) {
  */
 void endTest(string testName) {
 	cout << "=================== END: " << testName << "===================" << endl;
-	getLine("Press ENTER to continue...");
+	if (interactive) getLine("Press ENTER to continue...");
 }
 
 /* Function: logInfo
@@ -213,6 +253,20 @@ void validateFrequencyTable(ibstream& stream, int length) {
 		assertCondition(referenceTable[key] == table[key], representationOf(key) + " should be "
 		                + integerToString(referenceTable[key]) + " but is " + integerToString(table[key]));
 	}
+
+	/* The array form counts the same, and converts to and from the map. */
+	stream.rewind();
+	uint64_t weights[NUM_SYMBOLS];
+	uint64_t converted[NUM_SYMBOLS];
+	checkCondition(getFrequencyTable(stream, weights) == uint64_t(length),
+	               "The array frequency table counts every byte.");
+	frequenciesToWeights(table, converted);
+	Map<ext_char, int> back = weightsToFrequencies(weights);
+	uint64_t roundTrip[NUM_SYMBOLS];
+	frequenciesToWeights(back, roundTrip);
+	checkCondition(equal(weights, weights + NUM_SYMBOLS, converted) && back.size() == table.size() &&
+	               equal(weights, weights + NUM_SYMBOLS, roundTrip),
+	               "The array frequency table matches the map.");
 }
 
 /* Function: validateFrequencyTableString
@@ -225,6 +279,23 @@ void validateFrequencyTableString(string input, string message) {
 	validateFrequencyTable(stream, input.length());
 }
 
+/* Type: NestedCount
+ * A block to count from inside a pool's task, and what came out.
+ */
+struct NestedCount {
+	const string* data;
+	uint64_t counts[NUM_BYTE_VALUES];
+};
+
+/* Function: countInTask
+ * --------------------------------------------------------
+ * Pool task that counts its block on one thread per processor.
+ */
+void countInTask(void* data) {
+	NestedCount* job = (NestedCount*)data;
+	countBytesParallel((const unsigned char*)job->data->data(), job->data->size(), job->counts);
+}
+
 /* Function: testGetFrequencyTable
  * --------------------------------------------------------
  * Test code for getFrequencyTable	If you are failing these
@@ -248,6 +319,108 @@ void testGetFrequencyTable() {
 		ifbstream stream("test/input/random_10k.test");
 		validateFrequencyTable(stream, 10000);
 	}
+
+	/* Sampling reads only part of the stream but scales up to all of it. */
+	{
+		logInfo("Testing sampled counts on the same file.");
+		ifbstream stream("test/input/random_10k.test");
+		uint64_t exact[NUM_BYTE_VALUES] = { 0 };
+		uint64_t everyBlock[NUM_BYTE_VALUES] = { 0 };
+		uint64_t sampled[NUM_BYTE_VALUES] = { 0 };
+		countBytes(stream, exact);
+		stream.rewind();
+		checkCondition(sampleBytes(stream, everyBlock, 1, 100) == 10000, "Sampling every block finds the whole length.");
+		stream.rewind();
+		checkCondition(sampleBytes(stream, sampled, 10, 100) == 10000, "Sampling one block in ten finds the whole length.");
+
+		bool same = true;
+		uint64_t total = 0;
+		for (int ch = 0; ch < NUM_BYTE_VALUES; ch++) {
+			if (everyBlock[ch] != exact[ch]) same = false;
+			total += sampled[ch];
+		}
+		checkCondition(same, "Sampling every block counts exactly.");
+		checkCondition(total > 9000 && total < 11000, "A sample scales up to about the whole length.");
+	}
+
+	/* Counting on several threads gives the same counts, from memory, a stream or a
+	 * mapping, starting wherever the stream was left.
+	 */
+	{
+		logInfo("Testing parallel counts on a few megabytes.");
+		string data = makeCorpus(ZIPF_CORPUS, 3 * MIN_PARALLEL_COUNT_BYTES + 123);
+		const unsigned char* bytes = (const unsigned char*)data.data();
+		uint64_t exact[NUM_BYTE_VALUES] = { 0 };
+		uint64_t rest[NUM_BYTE_VALUES] = { 0 };
+		countBytes(bytes, data.size(), exact);
+		countBytes(bytes + 5, data.size() - 5, rest);
+
+		int threads[] = { 0, 1, 2, 3 };
+		for (int t = 0; t < 4; t++) {
+			uint64_t parallel[NUM_BYTE_VALUES] = { 0 };
+			countBytesParallel(bytes, data.size(), parallel, threads[t]);
+			checkCondition(equal(parallel, parallel + NUM_BYTE_VALUES, exact),
+			               "Counting on " + integerToString(threads[t]) + " threads gives the same counts.");
+		}
+
+		istringbstream stream(data);
+		char skipped[5];
+		stream.read(skipped, sizeof skipped);
+		uint64_t streamed[NUM_BYTE_VALUES] = { 0 };
+		checkCondition(countBytesParallel(stream, streamed, 3) == data.size() - 5 &&
+		               equal(streamed, streamed + NUM_BYTE_VALUES, rest) && stream.eof(),
+		               "A stream counted in parallel gives the same counts.");
+
+		{
+			ofstream file("test/input/parallel.tmp", ios::binary);
+			file << data;
+		}
+		imapbstream mapped("test/input/parallel.tmp");
+		assertCondition(mapped.is_open(), "Cannot map file test/input/parallel.tmp for reading!");
+		mapped.read(skipped, sizeof skipped);
+		uint64_t inPlace[NUM_BYTE_VALUES] = { 0 };
+		checkCondition(countBytesParallel(mapped, inPlace) == data.size() - 5 &&
+		               equal(inPlace, inPlace + NUM_BYTE_VALUES, rest) && mapped.eof(),
+		               "A mapping counted in place gives the same counts.");
+		mapped.close();
+		remove("test/input/parallel.tmp");
+
+		WorkPool pool(3);
+		bool allSame = true;
+		for (int run = 0; run < 3; run++) {
+			uint64_t kept[NUM_BYTE_VALUES] = { 0 };
+			uint64_t keptStream[NUM_BYTE_VALUES] = { 0 };
+			countBytesParallel(bytes, data.size(), kept, pool);
+			istringbstream again(data);
+			countBytesParallel(again, keptStream, pool);
+			if (!equal(kept, kept + NUM_BYTE_VALUES, exact) || !equal(keptStream, keptStream + NUM_BYTE_VALUES, exact)) {
+				allSame = false;
+			}
+		}
+		checkCondition(allSame, "A pool kept by the caller counts the same every time.");
+
+		NestedCount nested;
+		nested.data = &data;
+		memset(nested.counts, 0, sizeof nested.counts);
+		pool.submit(countInTask, &nested);
+		pool.run();
+		checkCondition(equal(nested.counts, nested.counts + NUM_BYTE_VALUES, exact),
+		               "Counting from inside a pool's task gives the same counts.");
+	}
+
+	/* A byte that only appears between the samples must still be coded. */
+	{
+		logInfo("Testing sampled mode on a byte the sample misses.");
+		string text(4 * SAMPLE_BLOCK_SIZE * DEFAULT_SAMPLE_EVERY, 'a');
+		text[SAMPLE_BLOCK_SIZE + 17] = 'Z';
+		istringbstream input(text);
+		ostringbstream compressed;
+		compress(input, compressed, SAMPLED_MODE);
+		istringbstream compressedData(compressed.str());
+		ostringbstream decompressed;
+		decompress(compressedData, decompressed);
+		checkCondition(decompressed.str() == text, "Sampled mode codes bytes it never saw.");
+	}
 	
 	endTest("getFrequencyTable Tests");
 }
@@ -303,6 +476,33 @@ int treeCost(Node* root, int depth = 0) {
 	return treeCost(root->zero, depth + 1) + treeCost(root->one, depth + 1);
 }
 
+/* Function: buildPriorityQueueTree
+ * --------------------------------------------------------
+ * Builds an encoding tree the way the original priority queue
+ * version of buildEncodingTree did.  Files in the legacy format
+ * only store frequencies, so the tree built to decode them must
+ * match this one exactly.
+ */
+Node* buildPriorityQueueTree(Map<ext_char, int>& frequencies) {
+	PriorityQueue<Node*> pQueue;
+	foreach (ext_char ch in frequencies) {
+		Node* leaf = new Node;
+		leaf->zero = leaf->one = NULL;
+		leaf->character = ch;
+		leaf->weight = frequencies[ch];
+		pQueue.enqueue(leaf, leaf->weight);
+	}
+	while (pQueue.size() > 1) {
+		Node* node = new Node;
+		node->character = NOT_A_CHAR;
+		node->zero = pQueue.dequeue();
+		node->one = pQueue.dequeue();
+		node->weight = node->zero->weight + node->one->weight;
+		pQueue.enqueue(node, node->weight);
+	}
+	return pQueue.dequeue();
+}
+
 /* Function: recCheckTreeCorrectness
  * --------------------------------------------------------
  * Recursively checks the structure of an encoding tree to
@@ -339,7 +539,7 @@ void recCheckTreeCorrectness(Node* root, Map<ext_char, int>& frequencies) {
 																		
 	/* If this is a leaf, the frequency should match what's expected. */
 	assertCondition(root->character == NOT_A_CHAR || 
-	                frequencies[root->character] == root->weight,
+	                uint64_t(frequencies[root->character]) == root->weight,
 	                "Weight in the tree should match weight in the table.");
 									
 	/* Mutate the map by removing this character from it.	 This helps us detect
@@ -554,6 +754,167 @@ void testBuildEncodingTree() {
 		checkCondition(recCheckTreesEqual(third, first),  "Encoding trees should be the same.");
 	}
 
+	/* Ties are everywhere in these inputs, and each must be broken the way the
+	 * priority queue used to break it.
+	 */
+	{
+		Vector<string> inputs;
+		inputs += "0123AABBCCDD", "ABBCCCDDDDDEEEEEEEEFFFFFFFFFFFFF", "AAAABBBBCCCCDDDD";
+		foreach (string text in inputs) {
+			istringstream stream(text);
+			Map<ext_char, int> frequencies = referenceGetFrequencyTable(stream);
+			Node* expected = buildPriorityQueueTree(frequencies);
+			Node* theirs = buildEncodingTree(frequencies);
+			checkCondition(recCheckTreesEqual(expected, theirs), "Tree matches the priority queue tree for " + text);
+			freeTree(expected);
+			freeTree(theirs);
+		}
+	}
+
+	/* Trees built in an arena must match heap trees, and the arena must report
+	 * its nodes to the allocation counters.
+	 */
+	{
+		long disparity = numAllocations() - numDeallocations();
+
+		ifbstream stream("test/input/random_10k.test");
+		Map<ext_char, int> frequencies = referenceGetFrequencyTable(stream);
+		Node* heapTree = buildEncodingTree(frequencies);
+
+		NodeArena arena;
+		for (int round = 0; round < 2; round++) {
+			Node* arenaTree = buildEncodingTree(frequencies, arena);
+			checkCondition(recCheckTreesEqual(heapTree, arenaTree), "Arena tree matches the heap tree.");
+			checkCondition(numAllocations() - numDeallocations() > disparity, "Arena nodes are counted as allocated.");
+			arena.reset();
+		}
+		freeTree(heapTree);
+
+		checkCondition(numAllocations() - numDeallocations() == disparity,
+		               "Resetting the arena counts its nodes as freed.");
+	}
+
+	/* Fibonacci weights make the Huffman tree as deep as possible.  With a length
+	 * limit, the tree must stay within the limit but still hold every letter.
+	 */
+	{
+		string text;
+		int previous = 1, current = 1;
+		for (char ch = 'a'; ch <= 't'; ch++) {
+			text += string(current, ch);
+			int next = previous + current;
+			previous = current;
+			current = next;
+		}
+		istringstream stream(text);
+		Map<ext_char, int> frequencies = referenceGetFrequencyTable(stream);
+		Node* unlimited = buildEncodingTree(frequencies);
+		Node* limited = buildEncodingTree(frequencies, 8);
+
+		checkCondition(treeDepth(unlimited) > 8, "Unlimited tree is deeper than the limit.");
+		checkCondition(treeDepth(limited) <= 8, "Limited tree respects the limit.");
+		checkCondition(treeCost(limited) >= treeCost(unlimited), "Limited tree costs no less than the Huffman tree.");
+
+		Node* loose = buildEncodingTree(frequencies, treeDepth(unlimited));
+		checkCondition(recCheckTreesEqual(loose, unlimited), "Trees within the limit are left alone.");
+
+		freeTree(unlimited);
+		freeTree(loose);
+
+		/* Limiting a tree in an arena gives back only its own nodes. */
+		NodeArena arena;
+		Map<ext_char, int> fewFrequencies;
+		fewFrequencies['x'] = 3;
+		fewFrequencies['y'] = 1;
+		fewFrequencies[PSEUDO_EOF] = 1;
+		Node* fewHeap = buildEncodingTree(fewFrequencies);
+		Node* fewTree = buildEncodingTree(fewFrequencies, arena);
+		int fewNodes = arena.size();
+		Node* limitedInArena = buildEncodingTree(frequencies, arena, 8);
+		checkCondition(recCheckTreesEqual(fewTree, fewHeap) && recCheckTreesEqual(limitedInArena, limited) &&
+		               arena.size() == fewNodes + 2 * int(frequencies.size()) - 1,
+		               "Limiting a tree leaves the other trees in its arena alone.");
+		freeTree(fewHeap);
+
+		recCheckTreeCorrectness(limited, frequencies);
+		checkCondition(frequencies.isEmpty(), "All letters accounted for.");
+		freeTree(limited);
+	}
+
+	/* A flat copy of a tree must hold the same codes and give back the same tree. */
+	{
+		logInfo("Testing flat trees built from test/encodeDecode/tomSawyer");
+		ifbstream source("test/encodeDecode/tomSawyer");
+		Map<ext_char, int> frequencies = getFrequencyTable(source);
+		Node* tree = buildEncodingTree(frequencies);
+		FlatTree flat(tree);
+		CodeTable codes;
+		buildCodeTable(tree, codes);
+		int longest = *max_element(codes.length, codes.length + NUM_SYMBOLS);
+		checkCondition(flat.numLeaves() == frequencies.size() && flat.numInternal() == frequencies.size() - 1 &&
+		               flat.depth() == longest,
+		               "Flat tree has every node of the tree.");
+
+		Node* copy = flat.toNodes();
+		checkCondition(recCheckTreesEqual(tree, copy), "Flat tree converts back to the same tree.");
+		freeTree(copy);
+
+		bool allFound = true;
+		foreach (ext_char ch in frequencies) {
+			string code;
+			for (int bit = 0; bit < codes.length[ch]; bit++) {
+				code += ((codes.bits[ch] >> bit) & 1) ? '1' : '0';
+			}
+			if (flat.searchCode(code) != ch || searchCodeInTree(tree, code) != ch) allFound = false;
+		}
+		checkCondition(allFound, "Flat tree finds the code of every character.");
+		checkCondition(treeDepth(tree) == flat.depth() && searchCodeInTree(tree, "") == NOT_A_CHAR,
+		               "Tree search and depth go through the flat tree.");
+		checkCondition(flat.searchCode("") == NOT_A_CHAR, "Flat tree search can end inside the tree.");
+		freeTree(tree);
+
+		NodeArena arena;
+		Node single;
+		single.character = PSEUDO_EOF;
+		single.weight = 1;
+		single.zero = single.one = NULL;
+		FlatTree leaf(&single);
+		checkCondition(leaf.numLeaves() == 1 && leaf.depth() == 0 &&
+		               leaf.toNodes(&arena)->character == PSEUDO_EOF && FlatTree().isEmpty(),
+		               "Flat trees of one leaf and of nothing.");
+	}
+
+	/* 64-bit weights build the same trees, and counts past 2^31 keep their size. */
+	{
+		logInfo("Testing buildEncodingTree on 64-bit weights");
+		ifbstream source("test/encodeDecode/tomSawyer");
+		Map<ext_char, int> frequencies = getFrequencyTable(source);
+		uint64_t weights[NUM_SYMBOLS] = { 0 };
+		foreach (ext_char ch in frequencies) {
+			weights[ch] = frequencies[ch];
+		}
+		NodeArena arena, wideArena;
+		checkCondition(recCheckTreesEqual(buildEncodingTree(frequencies, arena), buildEncodingTree(weights, wideArena)),
+		               "64-bit weights build the same tree as a frequency table.");
+
+		uint64_t huge[NUM_SYMBOLS] = { 0 };
+		huge['a'] = uint64_t(5) << 32;
+		huge['b'] = uint64_t(3) << 32;
+		huge['c'] = uint64_t(1) << 31;
+		huge[PSEUDO_EOF] = 1;
+		wideArena.reset();
+		Node* tree = buildEncodingTree(huge, wideArena);
+		checkCondition(tree->weight == huge['a'] + huge['b'] + huge['c'] + 1 && tree->one->weight == huge['a'],
+		               "Weights past 2^31 add up without overflowing.");
+		for (int ch = 0; ch < PSEUDO_EOF; ch++) {
+			if (ch != 'a') huge[ch] = 1;
+		}
+		wideArena.reset();
+		tree = buildEncodingTree(huge, wideArena, DEFAULT_MAX_CODE_LENGTH);
+		checkCondition(treeDepth(tree) <= DEFAULT_MAX_CODE_LENGTH && tree->weight == huge['a'] + PSEUDO_EOF,
+		               "Length limits hold for 64-bit weights.");
+	}
+
 	endTest("buildEncodingTree tests");
 }
 
@@ -680,10 +1041,180 @@ void testEncoding() {
 			               "Encoding then decoding should get back the original file.");
 		}
 	}
-	
+
+	/* Fibonacci weights give a maximally skewed tree, so the rarest characters
+	 * get codes longer than the decoder's lookup table is wide.
+	 */
+	{
+		logInfo("Testing encoding and decoding with codes longer than the decode table.");
+		string text;
+		int previous = 1, current = 1;
+		for (char ch = 'a'; ch <= 't'; ch++) {
+			text += string(current, ch);
+			int next = previous + current;
+			previous = current;
+			current = next;
+		}
+
+		istringbstream input(text);
+		Map<ext_char, int> frequency = getFrequencyTable(input);
+		input.rewind();
+		Node* encodingTree = buildEncodingTree(frequency);
+
+		ostringbstream compressed;
+		encodeFile(input, encodingTree, compressed);
+
+		istringbstream toDecompress(compressed.str());
+		ostringbstream decompressed;
+		decodeFile(toDecompress, encodingTree, decompressed);
+		checkCondition(text == decompressed.str(),
+		               "Encoding then decoding a deep tree should get back the original text.");
+		freeTree(encodingTree);
+	}
+
+	/* Decoded bytes are held back only until a chunk fills or the buffer is flushed,
+	 * and a buffer that is never flushed, as when decoding fails, writes no more.
+	 */
+	{
+		ostringstream target;
+		string expected;
+		{
+			OutputBuffer output(target);
+			for (int i = 0; i < OUTPUT_BUFFER_SIZE + 5; i++) {
+				output.put(char('a' + i % 26));
+				expected += char('a' + i % 26);
+			}
+			checkCondition(target.str().size() == size_t(OUTPUT_BUFFER_SIZE), "A full output buffer is written out.");
+			output.flush();
+			checkCondition(target.str() == expected, "Flushing writes out the rest in order.");
+			output.put('!');
+			expected += '!';
+		}
+		checkCondition(target.str() == expected.substr(0, expected.size() - 1),
+		               "Destroying an output buffer drops what it did not flush.");
+	}
+
 	endTest("encodeFile / decodeFile Tests");
 }
 
+/* Class: PipeBuffer
+ * --------------------------------------------------------
+ * A stream buffer that serves a string but, like a pipe,
+ * cannot seek.
+ */
+class PipeBuffer: public streambuf {
+public:
+	PipeBuffer(const string& data) : data(data) {
+		char* start = const_cast<char*>(this->data.data());
+		setg(start, start, start + this->data.size());
+	}
+
+private:
+	string data;
+};
+
+/* Function: countPipelineCallback
+ * --------------------------------------------------------
+ * Pipeline callback that counts how often it is called.
+ */
+void countPipelineCallback(void* data, PipelinedCompression&) {
+	(*(int*)data)++;
+}
+
+/* Type: PoolJob
+ * The messages one thread codes through a shared context pool, and
+ * whether every one of them came back.
+ */
+struct PoolJob {
+	HuffmanContextPool* pool;
+	const std::vector<string>* messages;
+	bool allMatch;
+};
+
+/* Function: runPoolJob
+ * --------------------------------------------------------
+ * Thread body that compresses and decompresses each message
+ * through the pool.
+ */
+void runPoolJob(PoolJob& job) {
+	std::vector<uint8_t> packed, unpacked;
+	for (size_t i = 0; i < job.messages->size(); i++) {
+		const string& message = (*job.messages)[i];
+		job.pool->compress((const uint8_t*)message.data(), message.size(), packed);
+		job.pool->decompress(&packed[0], packed.size(), unpacked);
+		if (string(unpacked.begin(), unpacked.end()) != message) job.allMatch = false;
+	}
+}
+
+/* Function: containerOf
+ * --------------------------------------------------------
+ * Returns the version of a compressed file, without the flag that
+ * says it ends in a checksum.
+ */
+ContainerVersion containerOf(const string& compressed) {
+	return ContainerVersion((unsigned char)compressed[3] & ~CONTAINER_CHECKSUM_FLAG);
+}
+
+/* Function: testFileNames
+ * --------------------------------------------------------
+ * Returns the names of the files in test/encodeDecode that
+ * the tests of the complete stack run on.
+ */
+Vector<string> testFileNames() {
+	Vector<string> files;
+	files += "singleChar", "nonRepeated", "alphaOnce", "allRepeated", "fibonacci", "poem", "allCharsOnce", "tomSawyer", "dikdik.jpg", "random";
+	return files;
+}
+
+/* Function: readTestFile
+ * --------------------------------------------------------
+ * Returns the contents of the named file in test/encodeDecode.
+ */
+string readTestFile(const string& file) {
+	ifbstream input("test/encodeDecode/" + file);
+	assertCondition(input.is_open(), ("Cannot open file test/encodeDecode/" + file + " for reading!"));
+	ostringstream data;
+	data << input.rdbuf();
+	return data.str();
+}
+
+/* Function: compressString
+ * --------------------------------------------------------
+ * Returns what compress writes for data.
+ */
+string compressString(const string& data) {
+	istringbstream input(data);
+	ostringbstream result;
+	compress(input, result);
+	return result.str();
+}
+
+/* Type: TestFile
+ * A test file's name, its contents, and what compress writes for
+ * them.
+ */
+struct TestFile {
+	string name;
+	string original;
+	string compressed;
+};
+
+/* Function: loadTestFiles
+ * --------------------------------------------------------
+ * Reads and compresses every file named by testFileNames into
+ * files.
+ */
+void loadTestFiles(std::vector<TestFile>& files) {
+	Vector<string> names = testFileNames();
+	foreach (string name in names) {
+		TestFile file;
+		file.name = name;
+		file.original = readTestFile(name);
+		file.compressed = compressString(file.original);
+		files.push_back(file);
+	}
+}
+
 /* Function: testCompleteStack
  * --------------------------------------------------------
  * This test will run your compress and decompress functions
@@ -694,9 +1225,8 @@ void testEncoding() {
 void testCompleteStack() {
 	beginTest("Complete Stack Tests");
 	
-	/* Construct a list of files to run your compression/decompression functions on. */
-	Vector<string> files;
-	files += "singleChar", "nonRepeated", "alphaOnce", "allRepeated", "fibonacci", "poem", "allCharsOnce", "tomSawyer", "dikdik.jpg", "random";
+	/* The files to run your compression/decompression functions on. */
+	Vector<string> files = testFileNames();
 	
 	foreach (string file in files) {
 		logInfo("Testing compress and decompress on file test/encodeDecode/" + file);
@@ -704,124 +1234,1682 @@ void testCompleteStack() {
 		/* Take a snapshot of total memory usage. */
 		long difference = numAllocations() - numDeallocations();
 	
-		/* Open the file to compress. */
-		ifbstream input("test/encodeDecode/" + file);
-		assertCondition(input.is_open(), ("Cannot open file test/encodeDecode/" + file + " for reading!"));
-	
-		/* Read the file into memory. */
-		ostringstream originalData;
-		originalData << input.rdbuf();
-		input.rewind();
-	
-		/* Compress the file into an ostringbstream so that we hold it in RAM. */
-		ostringbstream result;
-		compress(input, result);
+		/* Read the file into memory and compress it there. */
+		string original = readTestFile(file);
+		string compressed = compressString(original);
 		
 		/* Decompress the input from memory. */
-		istringbstream compressedData(result.str());
+		istringbstream compressedData(compressed);
 		ostringbstream decompressedData;
 		decompress(compressedData, decompressedData);
 		
 		/* Confirm that it matches. */
-		checkCondition(originalData.str() == decompressedData.str(),
+		checkCondition(original == decompressedData.str(),
 		               "Compressed/decompressed data matches.");
-									 
+
 		checkCondition(numAllocations() - numDeallocations() == difference,
 		               "No tree nodes leaked.");
 	}
+
+	/* An empty file has only PSEUDO_EOF, whose code is empty. */
+	istringbstream empty("");
+	ostringbstream emptyResult;
+	compress(empty, emptyResult);
+	istringbstream emptyCompressed(emptyResult.str());
+	ostringbstream emptyDecompressed;
+	decompress(emptyCompressed, emptyDecompressed);
+	checkCondition(emptyDecompressed.str().empty(), "Empty file round-trips.");
 	
 	endTest("Complete Stack Tests");
 }
 
-/* Function: printBits
+/* Function: checkCodingStats
  * --------------------------------------------------------
- * Given a string, prints the bits of that string one at a
- * time.
+ * Checks that the stats compress and decompress collect
+ * describe what they did, without changing what they write.
  */
-void printBits(string str, int maxBits) {
-	/* Wrap your string in an istringbstream so we can do bit-by-bit
-	 * I/O.
-	 */
-	istringbstream stream(str);
-	for (int i = 0; i < maxBits; i++) {
-		int bit = stream.readBit();
-		if (bit == EOF) break;
-		cout << bit;
-	}
-	cout << endl;
+void checkCodingStats(const TestFile& test) {
+	const string& original = test.original;
+	const string& compressed = test.compressed;
+
+	istringbstream statsInput(original);
+	ostringbstream statsResult;
+	CodingStats compressStats;
+	compress(statsInput, statsResult, STATIC_MODE, &compressStats);
+	checkCondition(statsResult.str() == compressed, "Collecting stats does not change the output.");
+	bool stored = (containerOf(compressed) == STORED_CONTAINER);
+	checkCondition(compressStats.bytesIn == original.size() &&
+	               compressStats.bytesOut == compressed.size() &&
+	               compressStats.symbolsCoded == (stored ? 0 : original.size() + 1),
+	               "Compress stats count the bytes and symbols.");
+	checkCondition(compressStats.headerBytes > 0 && compressStats.headerBytes <= compressStats.bytesOut &&
+	               compressStats.maxCodeLength <= DEFAULT_MAX_CODE_LENGTH && compressStats.treeNodes > 0,
+	               "Compress stats describe the header and tree.");
+
+	istringbstream statsData(compressed);
+	ostringbstream statsDecompressed;
+	CodingStats decompressStats;
+	decompress(statsData, statsDecompressed, &decompressStats);
+	checkCondition(decompressStats.bytesIn == compressStats.bytesOut &&
+	               decompressStats.bytesOut == compressStats.bytesIn &&
+	               decompressStats.headerBytes == compressStats.headerBytes &&
+	               decompressStats.maxCodeLength == compressStats.maxCodeLength,
+	               "Decompress stats mirror compress stats.");
 }
 
-/* Function: manualEncodeDecode
+/* Function: checkStoredContainers
  * --------------------------------------------------------
- * Function to let you manually test running encode and
- * decode on a given string.
+ * Checks that data coding cannot shrink is stored, so nothing
+ * grows by more than the stored header and checksum, and that
+ * text is always coded.
  */
-void manualEncodeDecode() {
-	beginTest("Manual encodeFile / decodeFile Tests");
-	
-	cout << "Enter text for us to encode and then decode" << endl;
-	while (true) {
-		string text = getLine("Text (enter to stop test): ");
-		if (text == "") break;
-		
-		/* Build an istringstream holding the data. */
-		istringbstream source(text);
+void checkStoredContainers(const TestFile& test) {
+	const string& file = test.name;
+	const string& original = test.original;
+	const string& compressed = test.compressed;
 
-		/* Construct the encoding tree for the text. */
-		Map<ext_char, int> frequencies = getFrequencyTable(source);
-		Node* tree = buildEncodingTree(frequencies);
-		ostringbstream compressed;
-		
-		/* Encode the text. */
-		source.rewind();
-		encodeFile(source, tree, compressed);
-		
-		/* Print out the compressed representation. */
-		cout << "Compressed representation: " << endl;
-		printBits(compressed.str(), treeCost(tree));
-		
-		/* No need to generate new map/tree because we know we'd read same map that we wrote,
-		 * meaning we'd also get the same tree (assuming tree function is deterministic.)
-		 */
-		istringbstream compressedIn(compressed.str());
-		ostringstream unpacked;
-		decodeFile(compressedIn, tree, unpacked);
-		checkCondition(unpacked.str() == text, "Result of compressing and decompressing should be the original input.");
-		
-		/* Clean up memory. */
-		freeTree(tree);
+	bool stored = (containerOf(compressed) == STORED_CONTAINER);
+	checkCondition(compressed.size() <= original.size() + 16,
+	               "Compressed output is never much larger than the input.");
+	checkCondition(!stored || (file != "tomSawyer" && file != "poem" && file != "fibonacci"),
+	               "Compressible files are coded, not stored.");
+}
+
+/* Function: checkLegacyFormat
+ * --------------------------------------------------------
+ * Checks that files in the old textual format still decompress,
+ * and that the headers that replaced it are no larger and agree
+ * with compress.
+ */
+void checkLegacyFormat(const TestFile& test) {
+	const string& original = test.original;
+	const string& compressed = test.compressed;
+
+	istringbstream legacyInput(original);
+	ostringbstream legacy;
+	Map<ext_char, int> frequencies = getFrequencyTable(legacyInput);
+	writeFileHeader(legacy, frequencies);
+	Node* tree = buildEncodingTree(frequencies);
+	legacyInput.rewind();
+	int legacyHeaderSize = legacy.size();
+	encodeFile(legacyInput, tree, legacy);
+
+	/* The binary length table is never larger than the textual one. */
+	CodeTable codes;
+	buildCodeTable(tree, codes);
+	ostringbstream header;
+	writeCodeLengthHeader(header, codes.length);
+	checkCondition(header.size() <= legacyHeaderSize,
+	               "Code length header is no larger than the legacy header.");
+
+	/* The array forms write the same legacy header and read it back, and a code
+	 * table built from weights gives the same output as compress.
+	 */
+	uint64_t weights[NUM_SYMBOLS];
+	frequenciesToWeights(frequencies, weights);
+	ostringbstream denseLegacy;
+	writeFileHeader(denseLegacy, weights);
+	istringbstream denseLegacyData(denseLegacy.str());
+	uint64_t readWeights[NUM_SYMBOLS];
+	readFileHeader(denseLegacyData, readWeights);
+	checkCondition(denseLegacy.str() == legacy.str().substr(0, legacyHeaderSize) &&
+	               equal(weights, weights + NUM_SYMBOLS, readWeights),
+	               "The array legacy header matches the map one.");
+
+	CodeTable denseCodes;
+	buildCodeTable(weights, denseCodes);
+	ostringbstream dense;
+	writeContainerVersion(dense, CANONICAL_CONTAINER, true);
+	writeCodeLengthHeader(dense, denseCodes.length);
+	istringbstream denseInput(original);
+	uint32_t denseChecksum = 0;
+	encodeFile(denseInput, denseCodes, dense, &denseChecksum);
+	writeUint32(dense, denseChecksum);
+	if (containerOf(compressed) == CANONICAL_CONTAINER) {
+		checkCondition(dense.str() == compressed, "Encoding from weights alone matches compress.");
 	}
+	freeTree(tree);
+
+	istringbstream legacyData(legacy.str());
+	ostringbstream legacyDecompressed;
+	decompress(legacyData, legacyDecompressed);
+	checkCondition(original == legacyDecompressed.str(),
+	               "Legacy format still decompresses.");
 }
 
-/* Function: openFile
+/* Function: checkDecoders
  * --------------------------------------------------------
- * Prompts the user for the name of a file to open, opening
- * the indicated stream object to that file.
+ * Checks that every kind of decoder gives back the same data
+ * from both formats and leaves the stream just past it, and that
+ * the state machine keeps to its memory limit.
  */
-template <typename FileStream>
-void openFile(FileStream& file, string prompt = "") {
-	while (true) {
-		string filename = getLine(prompt);
-		file.open(filename.c_str());
-		
-		if (file.is_open()) return;
-		
-		cout << "Sorry, I couldn't open that file." << endl;
-		file.clear();
+void checkDecoders(const TestFile& test) {
+	const string& original = test.original;
+	const string& compressed = test.compressed;
+
+	/* The same file in the old textual format. */
+	istringbstream legacyInput(original);
+	ostringbstream legacy;
+	Map<ext_char, int> frequencies = getFrequencyTable(legacyInput);
+	writeFileHeader(legacy, frequencies);
+	Node* tree = buildEncodingTree(frequencies);
+	legacyInput.rewind();
+	encodeFile(legacyInput, tree, legacy);
+	freeTree(tree);
+
+	DecoderKind kinds[] = { TREE_DECODER, TABLE_DECODER, FAST_DECODER, FSM_DECODER };
+	for (int k = 0; k < 4; k++) {
+		setDecoderKind(kinds[k]);
+		istringbstream kindData(compressed + "XYZ");
+		ostringbstream kindDecompressed;
+		decompress(kindData, kindDecompressed);
+		istringbstream kindLegacy(legacy.str());
+		ostringbstream kindLegacyDecompressed;
+		decompress(kindLegacy, kindLegacyDecompressed);
+		checkCondition(original == kindDecompressed.str() &&
+		               original == kindLegacyDecompressed.str(),
+		               "Decoder " + integerToString(kinds[k]) + " decompresses both formats.");
+		checkCondition(kindData.get() == 'X', "Decoder " + integerToString(kinds[k]) + " stops after PSEUDO_EOF.");
+	}
+	setDecoderKind(AUTOMATIC_DECODER);
+
+	/* The state machine steps a nibble at a time when a byte table passes its
+	 * limit, decodes the same, and is not built past its limit at all.
+	 */
+	if (containerOf(compressed) == CANONICAL_CONTAINER) {
+		istringbstream lengthData(compressed);
+		bool lengthChecked = false;
+		readContainerVersion(lengthData, lengthChecked);
+		uint8_t fsmLengths[NUM_SYMBOLS];
+		readCodeLengthHeader(lengthData, fsmLengths);
+		FsmDecoder wide(fsmLengths);
+		size_t nibbleBytes = wide.numStates() * 16 * sizeof(FsmEntry);
+		FsmDecoder narrow(fsmLengths, nibbleBytes);
+		FsmDecoder none(fsmLengths, nibbleBytes - 1);
+		checkCondition(wide.isUsable() && wide.stepBits() == 8 && wide.memoryBytes() <= DEFAULT_FSM_MEMORY_LIMIT &&
+		               narrow.stepBits() == 4 && narrow.memoryBytes() < wide.memoryBytes() / 8 &&
+		               !none.isUsable(),
+		               "The state machine keeps to its memory limit.");
+
+		ostringbstream narrowDecoded;
+		narrow.decode(lengthData, narrowDecoded);
+		checkCondition(narrowDecoded.str() == original, "A nibble state machine decodes the same.");
+
+		istringbstream cutData(compressed.substr(0, compressed.size() - 5)); //into the bits, not the checksum
+		ostringbstream cutDecoded;
+		bool raised = false;
+		setDecoderKind(FSM_DECODER);
+		try {
+			decompress(cutData, cutDecoded);
+		} catch (ErrorException&) {
+			raised = true;
+		}
+		setDecoderKind(AUTOMATIC_DECODER);
+		checkCondition(raised, "The state machine notices data that ends early.");
 	}
 }
 
-/* Function: runCompress
+/* Function: checkBlockContainers
  * --------------------------------------------------------
- * Harness to run your compress function on actual files.
+ * Checks that block containers, plain and interleaved, decode
+ * on one thread or several, and that a block that fails its
+ * checksum is rejected.
  */
-void runCompress() {
-	/* Open a file for reading. */
-	ifbstream infile;
-	openFile(infile, "File to compress: ");
+void checkBlockContainers(const TestFile& test) {
+	const string& original = test.original;
 
-	/* Open a file for writing. */
-	ofbstream outfile;
+	/* Small blocks spread over a few threads must give back the same data. */
+	istringbstream blockInput(original);
+	ostringbstream blocks;
+	compressBlocks(blockInput, blocks, 4096, 3);
+	istringbstream blockData(blocks.str());
+	ostringbstream blockDecompressed;
+	decompress(blockData, blockDecompressed);
+	checkCondition(original == blockDecompressed.str(),
+	               "Block container decompresses.");
+	checkCondition(blocks.str().size() <= original.size() + 21 * (original.size() / 4096 + 1) + 9,
+	               "Blocks that would grow are stored.");
+
+	/* A block that decodes to the wrong bytes fails its checksum.  The byte
+	 * changed is in the middle of the first block's data, not its checksum.
+	 */
+	string damaged = blocks.str();
+	size_t recordStart = sizeof CONTAINER_MAGIC;
+	uint32_t firstSize = 0;
+	for (int i = 0; i < 4; i++) {
+		firstSize |= uint32_t((unsigned char)damaged[recordStart + 5 + i]) << (8 * i);
+	}
+	damaged[recordStart + 9 + (firstSize - 4) / 2] ^= 0xFF; //every bit, not just padding
+	bool rejected = false;
+	try {
+		istringbstream damagedData(damaged);
+		ostringbstream damagedDecompressed;
+		decompress(damagedData, damagedDecompressed);
+	} catch (ErrorException&) {
+		rejected = true;
+	}
+	checkCondition(rejected, "A block that does not match its checksum is rejected.");
+
+	/* Decode the same blocks on several threads, skipping the magic and version. */
+	istringbstream threadedData(blocks.str());
+	threadedData.ignore(4);
+	ostringbstream threadedDecompressed;
+	decodeBlockContainer(threadedData, threadedDecompressed, 3);
+	checkCondition(original == threadedDecompressed.str(),
+	               "Block container decompresses on several threads.");
+
+	/* Interleaved blocks, small and full size, must decode the same way. */
+	istringbstream interleavedInput(original);
+	ostringbstream interleaved;
+	compressBlocks(interleavedInput, interleaved, 4096, 3, INTERLEAVED_BLOCK);
+	istringbstream interleavedData(interleaved.str());
+	ostringbstream interleavedDecompressed;
+	decompress(interleavedData, interleavedDecompressed);
+	checkCondition(original == interleavedDecompressed.str(),
+	               "Interleaved blocks decompress.");
+}
+
+/* Function: checkEmptyBlocks
+ * --------------------------------------------------------
+ * Checks that an empty file round-trips through blocks.
+ */
+void checkEmptyBlocks() {
+	istringbstream emptyBlockInput("");
+	ostringbstream emptyBlocks;
+	compressBlocks(emptyBlockInput, emptyBlocks);
+	istringbstream emptyBlockData(emptyBlocks.str());
+	ostringbstream emptyBlockDecompressed;
+	decompress(emptyBlockData, emptyBlockDecompressed);
+	checkCondition(emptyBlockDecompressed.str().empty(), "Empty file round-trips through blocks.");
+}
+
+/* Function: checkChecksums
+ * --------------------------------------------------------
+ * Checks that a whole file that does not match its checksum is
+ * rejected, and that CRC-32C comes out the same every way it is
+ * computed.
+ */
+void checkChecksums(const TestFile& test) {
+	const string& original = test.original;
+	const string& compressed = test.compressed;
+
+	istringbstream statsInput(original);
+	ostringbstream statsResult;
+	CodingStats compressStats;
+	compress(statsInput, statsResult, STATIC_MODE, &compressStats);
+
+	/* The whole-file containers end in a checksum too, which catches a changed
+	 * byte of the data, stream or memory; without the flag they decode as before.
+	 */
+	string changed = compressed;
+	changed[changed.size() - 4 - (changed.size() - 4 - compressStats.headerBytes) / 2] ^= 0xFF;
+	bool changedRejected = false, bufferRejected = false;
+	try {
+		istringbstream changedData(changed);
+		ostringbstream changedDecompressed;
+		decompress(changedData, changedDecompressed);
+	} catch (ErrorException&) {
+		changedRejected = true;
+	}
+	try {
+		std::vector<uint8_t> changedOutput;
+		decompressBuffer((const uint8_t*)changed.data(), changed.size(), changedOutput);
+	} catch (ErrorException&) {
+		bufferRejected = true;
+	}
+	checkCondition(changedRejected && bufferRejected, "A file that does not match its checksum is rejected.");
+
+	string unchecked = compressed.substr(0, compressed.size() - 4);
+	unchecked[3] = char(containerOf(unchecked));
+	istringbstream uncheckedData(unchecked);
+	ostringbstream uncheckedDecompressed;
+	decompress(uncheckedData, uncheckedDecompressed);
+	std::vector<uint8_t> uncheckedOutput;
+	decompressBuffer((const uint8_t*)unchecked.data(), unchecked.size(), uncheckedOutput);
+	checkCondition(uncheckedDecompressed.str() == original &&
+	               string(uncheckedOutput.begin(), uncheckedOutput.end()) == original,
+	               "A file written without a checksum still decompresses.");
+}
+
+/* Function: checkCrc32c
+ * --------------------------------------------------------
+ * Checks that CRC-32C matches its published check value, and that
+ * the processor and the tables agree on it.
+ */
+void checkCrc32c() {
+	const unsigned char* digits = (const unsigned char*)"123456789";
+	checkCondition(updateCrc32c(0, digits, 9) == 0xE3069283, "CRC-32C of 123456789 is E3069283.");
+	checkCondition(updateCrc32c(updateCrc32c(0, digits, 4), digits + 4, 5) == 0xE3069283,
+	               "CRC-32C can be taken a piece at a time.");
+	checkCondition(updateCrc32c(0, digits, 0) == 0, "CRC-32C of no bytes is zero.");
+	checkCondition(updateCrc32cPortable(0, digits, 9) == 0xE3069283, "The table CRC-32C of 123456789 is E3069283.");
+
+	/* The processor's instructions, where there are any, and the tables agree on
+	 * every length and alignment, and so do the helpers built on them.
+	 */
+	string crcData = makeCorpus(ZIPF_CORPUS, 20000, 3);
+	const unsigned char* crcBytes = (const unsigned char*)crcData.data();
+	bool crcAgrees = true;
+	for (size_t offset = 0; offset < 8; offset++) {
+		for (size_t length = 0; length < 300; length += 1 + length / 8) {
+			if (updateCrc32c(7, crcBytes + offset, length) != updateCrc32cPortable(7, crcBytes + offset, length)) crcAgrees = false;
+		}
+		size_t rest = crcData.size() - offset;
+		if (updateCrc32c(0, crcBytes + offset, rest) != updateCrc32cPortable(0, crcBytes + offset, rest)) crcAgrees = false;
+	}
+	checkCondition(crcAgrees, string("Hardware and table CRC-32C agree") +
+	                              (hasHardwareCrc32c() ? "." : " (no hardware CRC-32C here)."));
+	std::vector<unsigned char> crcCopy(crcData.size());
+	string crcRun(10000, 'q');
+	checkCondition(copyWithCrc32c(0, &crcCopy[0], crcBytes, crcData.size()) == updateCrc32c(0, crcBytes, crcData.size()) &&
+	               string(crcCopy.begin(), crcCopy.end()) == crcData &&
+	               repeatCrc32c(0, 'q', crcRun.size()) == updateCrc32c(0, (const unsigned char*)crcRun.data(), crcRun.size()),
+	               "Copying and repeating take the same CRC-32C.");
+}
+
+/* Function: checkPipelines
+ * --------------------------------------------------------
+ * Checks that a pipeline writes the same container as
+ * compressBlocks, and that one started in the background reports
+ * back through its callback or raises its error when waited for.
+ */
+void checkPipelines(const TestFile& test) {
+	const string& original = test.original;
+
+	istringbstream blockInput(original);
+	ostringbstream blocks;
+	compressBlocks(blockInput, blocks, 4096, 3);
+
+	istringbstream pipelineInput(original);
+	ostringbstream pipelined;
+	compressPipelined(pipelineInput, pipelined, 4096, 2, 3);
+	checkCondition(pipelined.str() == blocks.str(), "Pipelined compression matches compressBlocks.");
+}
+
+/* Function: checkBackgroundPipeline
+ * --------------------------------------------------------
+ * Checks that a pipeline started in the background reports back
+ * through its callback, and that one that fails raises the error
+ * when waited for.
+ */
+void checkBackgroundPipeline() {
+	logInfo("Testing background pipelined compression of test/encodeDecode/tomSawyer");
+	ifbstream original("test/encodeDecode/tomSawyer");
+	ostringbstream compressed;
+	int calls = 0;
+	PipelinedCompression compression(original, compressed, 4096, 2, 1, countPipelineCallback, &calls);
+	compression.wait();
+	checkCondition(calls == 1 && compression.isDone() && !compression.failed(),
+	               "The callback runs once when the pipeline is done.");
+	checkCondition(compression.bytesRead() == uint64_t(original.size()) &&
+	               compression.bytesWritten() == compressed.str().size(),
+	               "The pipeline counts what it read and wrote.");
+
+	istringbstream compressedData(compressed.str());
+	ostringbstream decompressed;
+	decompress(compressedData, decompressed);
+	original.rewind();
+	ostringstream originalData;
+	originalData << original.rdbuf();
+	checkCondition(decompressed.str() == originalData.str(), "Background pipeline output decompresses.");
+
+	original.rewind();
+	ofbstream closed;
+	bool raised = false;
+	try {
+		compressPipelined(original, closed, 4096, 2);
+	} catch (ErrorException&) {
+		raised = true;
+	}
+	checkCondition(raised, "A failed pipeline raises its error.");
+}
+
+/* Function: checkRanges
+ * --------------------------------------------------------
+ * Checks that ranges come out the same from checkpoints, blocks,
+ * or a plain decode.
+ */
+void checkRanges(const TestFile& test) {
+	const string& original = test.original;
+	const string& compressed = test.compressed;
+
+	istringbstream blockInput(original);
+	ostringbstream blocks;
+	compressBlocks(blockInput, blocks, 4096, 3);
+
+	istringbstream seekableInput(original);
+	ostringbstream seekable;
+	compressSeekable(seekableInput, seekable, 1000);
+	istringbstream seekableData(seekable.str());
+	ostringbstream seekableDecompressed;
+	decompress(seekableData, seekableDecompressed);
+	checkCondition(original == seekableDecompressed.str(),
+	               "Seekable container decompresses from the start.");
+
+	uint64_t windows[][2] = { { 0, 10 }, { 999, 2 }, { 1500, 5000 }, { original.size() / 2, 1 },
+	                          { original.size() - 3, 100 }, { original.size() + 5, 10 }, { 17, 0 } };
+	string containers[] = { seekable.str(), blocks.str(), compressed };
+	bool rangesMatch = true;
+	for (int c = 0; c < 3; c++) {
+		for (size_t w = 0; w < sizeof windows / sizeof windows[0]; w++) {
+			istringbstream rangeData(containers[c]);
+			ostringstream range;
+			decompressRange(rangeData, range, windows[w][0], windows[w][1]);
+			string expected = (windows[w][0] < original.size() ? original.substr(size_t(windows[w][0]), size_t(windows[w][1])) : "");
+			if (range.str() != expected) rangesMatch = false;
+		}
+	}
+	checkCondition(rangesMatch, "Ranges decompress from seekable, block and plain containers.");
+}
+
+/* Function: checkEmptyRanges
+ * --------------------------------------------------------
+ * Checks that an empty file has no ranges.
+ */
+void checkEmptyRanges() {
+	istringbstream emptySeekableInput("");
+	ostringbstream emptySeekable;
+	compressSeekable(emptySeekableInput, emptySeekable);
+	istringbstream emptySeekableData(emptySeekable.str());
+	ostringstream emptyRange;
+	decompressRange(emptySeekableData, emptyRange, 0, 10);
+	checkCondition(emptyRange.str().empty(), "Empty file has no ranges.");
+}
+
+/* Function: checkAppend
+ * --------------------------------------------------------
+ * Checks that appending leaves the old blocks and trailer where
+ * they were, and only turns the start of the trailer into a
+ * skipped record once the new one is written; until then the
+ * archive reads as it was.
+ */
+void checkAppend(const TestFile& test) {
+	const string& original = test.original;
+	const string& compressed = test.compressed;
+
+	istringbstream blockInput(original);
+	ostringbstream blocks;
+	compressBlocks(blockInput, blocks, 4096, 3);
+
+	size_t split = (original.size() / 2) & ~size_t(4095);
+	istringbstream firstPart(original.substr(0, split));
+	ostringbstream firstBlocks;
+	compressBlocks(firstPart, firstBlocks, 4096, 3);
+	stringstream archive(firstBlocks.str());
+	istringstream secondPart(original.substr(split));
+	appendBlocks(secondPart, archive, 4096, 2);
+	istringbstream archiveData(archive.str());
+	ostringbstream archiveDecompressed;
+	decompress(archiveData, archiveDecompressed);
+	checkCondition(archiveDecompressed.str() == original, "Appended blocks decompress to both parts.");
+
+	const string& before = firstBlocks.str();
+	uint32_t firstCount = 0;
+	for (int i = 0; i < 4; i++) {
+		firstCount |= uint32_t((unsigned char)before[before.size() - 4 + i]) << (8 * i);
+	}
+	if (firstCount == 0) {
+		checkCondition(archive.str() == blocks.str(), "Appending to no blocks matches compressing everything at once.");
+	} else {
+		size_t oldEnd = before.size() - 4 - 8 * firstCount - 1;
+		string unswitched = archive.str();
+		unswitched.replace(oldEnd, 9, before, oldEnd, 9);
+		istringbstream unswitchedData(unswitched);
+		ostringbstream unswitchedDecompressed;
+		decompress(unswitchedData, unswitchedDecompressed);
+		checkCondition(unswitched.compare(0, before.size(), before) == 0 &&
+		               archive.str()[oldEnd] == char(SKIPPED_BLOCK) &&
+		               unswitchedDecompressed.str() == original.substr(0, split),
+		               "Appending rewrites nothing of the old archive until the new trailer is written.");
+	}
+
+	/* Pieces that are not whole blocks, appended to a file one by one, all come back. */
+	{
+		istringbstream nothing("");
+		ofbstream file("test/input/append.tmp");
+		compressBlocks(nothing, file, 4096, 1);
+	}
+	size_t cuts[] = { 0, min(original.size(), size_t(1000)), min(original.size(), size_t(6000)), original.size() };
+	for (int i = 0; i < 3; i++) {
+		istringstream piece(original.substr(cuts[i], cuts[i + 1] - cuts[i]));
+		appendBlocks(piece, "test/input/append.tmp", 4096);
+	}
+	ifbstream appended("test/input/append.tmp");
+	ostringbstream appendedDecompressed;
+	decompress(appended, appendedDecompressed);
+	checkCondition(appendedDecompressed.str() == original, "An archive appended to three times decompresses.");
+	ifbstream appendedRange("test/input/append.tmp");
+	ostringstream acrossPieces;
+	decompressRange(appendedRange, acrossPieces, 900, 5200);
+	checkCondition(acrossPieces.str() == (original.size() > 900 ? original.substr(900, 5200) : ""), "Ranges decompress across appended pieces.");
+	remove("test/input/append.tmp");
+
+	/* Only block containers can be appended to, and others are left alone. */
+	stringstream plainArchive(compressed);
+	istringstream more("more");
+	bool refused = false;
+	try {
+		appendBlocks(more, plainArchive);
+	} catch (ErrorException&) {
+		refused = true;
+	}
+	checkCondition(refused && plainArchive.str() == compressed, "Appending to a container without blocks is refused.");
+}
+
+/* Function: checkModes
+ * --------------------------------------------------------
+ * Checks that the interleaved, sampled and adaptive modes, and
+ * input that cannot be rewound, give back the same data.
+ */
+void checkModes(const TestFile& test) {
+	const string& original = test.original;
+
+	istringbstream interleavedModeInput(original);
+	ostringbstream interleavedMode;
+	compress(interleavedModeInput, interleavedMode, INTERLEAVED_MODE);
+	istringbstream interleavedModeData(interleavedMode.str());
+	ostringbstream interleavedModeDecompressed;
+	decompress(interleavedModeData, interleavedModeDecompressed);
+	checkCondition(original == interleavedModeDecompressed.str(),
+	               "Interleaved mode compresses and decompresses.");
+
+	/* Sampled frequencies give the same data back, whatever the sample missed. */
+	istringbstream sampledInput(original);
+	ostringbstream sampled;
+	compress(sampledInput, sampled, SAMPLED_MODE);
+	istringbstream sampledData(sampled.str());
+	ostringbstream sampledDecompressed;
+	decompress(sampledData, sampledDecompressed);
+	checkCondition(original == sampledDecompressed.str(),
+	               "Sampled mode compresses and decompresses.");
+
+	/* The adaptive codec goes through the same entry points. */
+	istringbstream adaptiveInput(original);
+	ostringbstream adaptive;
+	compress(adaptiveInput, adaptive, ADAPTIVE_MODE);
+	istringbstream adaptiveData(adaptive.str());
+	ostringbstream adaptiveDecompressed;
+	decompress(adaptiveData, adaptiveDecompressed);
+	checkCondition(original == adaptiveDecompressed.str(),
+	               "Adaptive mode compresses and decompresses.");
+
+	/* Input that cannot be rewound must still compress, in a single pass. */
+	PipeBuffer pipeBuffer(original);
+	ibstream pipe;
+	pipe.rdbuf(&pipeBuffer);
+	ostringbstream piped;
+	compress(pipe, piped);
+	istringbstream pipedData(piped.str());
+	ostringbstream pipedDecompressed;
+	decompress(pipedData, pipedDecompressed);
+	checkCondition(original == pipedDecompressed.str(),
+	               "Input that cannot seek compresses and decompresses.");
+}
+
+/* Function: checkOrder1
+ * --------------------------------------------------------
+ * Checks that order-1 codes give the same data back, that text
+ * shrinks further with them, and that they keep to their table
+ * limit.
+ */
+void checkOrder1(const TestFile& test) {
+	const string& file = test.name;
+	const string& original = test.original;
+	const string& compressed = test.compressed;
+
+	istringbstream order1Input(original);
+	ostringbstream order1;
+	compress(order1Input, order1, ORDER1_MODE);
+	istringbstream order1Data(order1.str());
+	ostringbstream order1Decompressed;
+	decompress(order1Data, order1Decompressed);
+	checkCondition(original == order1Decompressed.str(),
+	               "Order-1 mode compresses and decompresses.");
+	checkCondition(order1.str().size() <= original.size() + 16,
+	               "Order-1 mode stores what it cannot shrink.");
+	if (file == "tomSawyer") {
+		checkCondition(order1.str().size() < compressed.size() * 9 / 10,
+		               "Order-1 mode beats a single code on text.");
+	}
+}
+
+/* Function: checkOrder1TableLimit
+ * --------------------------------------------------------
+ * Checks that data where every context wants its own code still
+ * gets no more than MAX_ORDER1_TABLES, and that a container
+ * claiming more is rejected.
+ */
+void checkOrder1TableLimit() {
+	logInfo("Testing the order-1 table limit");
+	string contexts;
+	uint32_t state = 12345;
+	int previous = 0;
+	for (int i = 0; i < 200000; i++) {
+		state = state * 1103515245 + 12345;
+		previous = (previous * 37 + int(state >> 29)) & 0xFF;
+		contexts += char(previous);
+	}
+	istringbstream contextsInput(contexts);
+	ostringbstream order1;
+	compress(contextsInput, order1, ORDER1_MODE);
+	istringbstream order1Data(order1.str());
+	ostringbstream order1Decompressed;
+	decompress(order1Data, order1Decompressed);
+	checkCondition(containerOf(order1.str()) == ORDER1_CONTAINER &&
+	               int(uint8_t(order1.str()[4])) + 1 <= MAX_ORDER1_TABLES &&
+	               order1Decompressed.str() == contexts,
+	               "Order-1 mode keeps to the table limit.");
+
+	string tooMany = order1.str().substr(0, 4) + string(1, char(0xFF)) + string(64, char(0xFF));
+	bool rejected = false;
+	try {
+		istringbstream tooManyData(tooMany);
+		ostringbstream tooManyDecompressed;
+		decompress(tooManyData, tooManyDecompressed);
+	} catch (ErrorException&) {
+		rejected = true;
+	}
+	checkCondition(rejected, "An order-1 container with too many tables is rejected.");
+}
+
+/* Function: checkSizeEstimates
+ * --------------------------------------------------------
+ * Checks that the estimate from the frequency table is exactly
+ * what compress writes, and that a sample is close.
+ */
+void checkSizeEstimates(const TestFile& test) {
+	const string& original = test.original;
+	const string& compressed = test.compressed;
+
+	istringbstream estimateInput(original);
+	Map<ext_char, int> estimateFrequencies = getFrequencyTable(estimateInput);
+	SizeEstimate estimate = estimateCompressedSize(estimateFrequencies);
+	if (estimate.exact) {
+		checkCondition(estimate.totalBytes == compressed.size() &&
+		               estimate.container == containerOf(compressed) &&
+		               estimate.rawBytes == original.size(),
+		               "The size estimate matches the compressed file.");
+	}
+	istringbstream sampledEstimateInput(original);
+	SizeEstimate sampledEstimate = estimateCompressedSize(sampledEstimateInput, 4);
+	checkCondition(sampledEstimate.rawBytes == original.size() &&
+	               sampledEstimate.totalBytes <= estimate.totalBytes + estimate.totalBytes / 4 + 16 &&
+	               estimate.totalBytes <= sampledEstimate.totalBytes + sampledEstimate.totalBytes / 4 + 16,
+	               "A sampled size estimate is close to the exact one.");
+}
+
+/* Function: checkVerification
+ * --------------------------------------------------------
+ * Checks that verification finds a round trip that matches, and
+ * the first byte of one that does not.
+ */
+void checkVerification(const TestFile& test) {
+	const string& file = test.name;
+	const string& original = test.original;
+	const string& compressed = test.compressed;
+
+	VerifyResult verified = verifyRoundTrip("test/encodeDecode/" + file);
+	checkCondition(verified.matches && verified.bytesIn == original.size() &&
+	               verified.bytesOut == compressed.size(),
+	               "The file verifies after a round trip.");
+	if (!original.empty()) {
+		string altered = original;
+		altered[original.size() / 2] ^= 0x01;
+		istringbstream archive(compressed);
+		VerifyResult mismatched = verifyArchive(archive, (const unsigned char*)altered.data(), altered.size());
+		checkCondition(!mismatched.matches && mismatched.mismatchOffset == original.size() / 2,
+		               "Verification finds where the data differs.");
+		istringbstream longerArchive(compressed);
+		altered = original + "!";
+		VerifyResult shorter = verifyArchive(longerArchive, (const unsigned char*)altered.data(), altered.size());
+		checkCondition(!shorter.matches && shorter.mismatchOffset == original.size(),
+		               "Verification finds an original longer than the archive.");
+	}
+}
+
+/* Function: checkBufferFunctions
+ * --------------------------------------------------------
+ * Checks that the buffer functions agree with the stream
+ * functions both ways.
+ */
+void checkBufferFunctions(const TestFile& test) {
+	const string& original = test.original;
+	const string& compressed = test.compressed;
+
+	std::vector<uint8_t> packed, unpacked;
+	compressBuffer((const uint8_t*)original.data(), original.size(), packed);
+	checkCondition(string(packed.begin(), packed.end()) == compressed,
+	               "compressBuffer writes the same bytes as compress.");
+	decompressBuffer(packed.empty() ? NULL : &packed[0], packed.size(), unpacked);
+	checkCondition(string(unpacked.begin(), unpacked.end()) == original,
+	               "compressBuffer output decompresses from memory.");
+	istringbstream adaptiveInput(original);
+	ostringbstream adaptive;
+	compress(adaptiveInput, adaptive, ADAPTIVE_MODE);
+	string streamed = adaptive.str();
+	decompressBuffer((const uint8_t*)streamed.data(), streamed.size(), unpacked);
+	checkCondition(string(unpacked.begin(), unpacked.end()) == original,
+	               "decompressBuffer reads other containers too.");
+}
+
+/* Function: checkEmptyBuffer
+ * --------------------------------------------------------
+ * Checks that an empty buffer round-trips.
+ */
+void checkEmptyBuffer() {
+	std::vector<uint8_t> emptyPacked, emptyUnpacked(1);
+	compressBuffer(NULL, 0, emptyPacked);
+	decompressBuffer(&emptyPacked[0], emptyPacked.size(), emptyUnpacked);
+	checkCondition(emptyUnpacked.empty(), "Empty buffer round-trips.");
+}
+
+/* Type: FileFeature
+ * A feature checked on every test file: its test banner, what the
+ * log says is being tested, the check run on each file, and any
+ * checks of it that need no file, run after the files (or NULL).
+ */
+struct FileFeature {
+	const char* title;
+	const char* what;
+	void (*check)(const TestFile& test);
+	void (*finish)();
+};
+
+/* Constant: FILE_FEATURES
+ * The features checked file by file, in the order they are run.
+ */
+const FileFeature FILE_FEATURES[] = {
+	{ "Coding Stats Tests", "coding stats", checkCodingStats, NULL },
+	{ "Stored Container Tests", "stored containers", checkStoredContainers, NULL },
+	{ "Legacy Format Tests", "the legacy format", checkLegacyFormat, NULL },
+	{ "Decoder Tests", "every decoder", checkDecoders, NULL },
+	{ "Block Container Tests", "block containers", checkBlockContainers, checkEmptyBlocks },
+	{ "Checksum Tests", "file checksums", checkChecksums, checkCrc32c },
+	{ "Pipeline Tests", "the pipeline", checkPipelines, checkBackgroundPipeline },
+	{ "Range Tests", "ranges", checkRanges, checkEmptyRanges },
+	{ "Append Tests", "appending", checkAppend, NULL },
+	{ "Compression Mode Tests", "the compression modes", checkModes, NULL },
+	{ "Order-1 Tests", "order-1 codes", checkOrder1, checkOrder1TableLimit },
+	{ "Size Estimate Tests", "size estimates", checkSizeEstimates, NULL },
+	{ "Verification Tests", "verification", checkVerification, NULL },
+	{ "Buffer Function Tests", "the buffer functions", checkBufferFunctions, checkEmptyBuffer },
+};
+
+/* Function: testFileFeatures
+ * --------------------------------------------------------
+ * Runs every check in FILE_FEATURES on the test files, each
+ * feature under its own banner.
+ */
+void testFileFeatures(const std::vector<TestFile>& files) {
+	for (size_t f = 0; f < sizeof FILE_FEATURES / sizeof FILE_FEATURES[0]; f++) {
+		const FileFeature& feature = FILE_FEATURES[f];
+		beginTest(feature.title);
+		for (size_t i = 0; i < files.size(); i++) {
+			logInfo(string("Testing ") + feature.what + " on file test/encodeDecode/" + files[i].name);
+			feature.check(files[i]);
+		}
+		if (feature.finish != NULL) feature.finish();
+		endTest(feature.title);
+	}
+}
+
+/* Function: testDictionaries
+ * --------------------------------------------------------
+ * Checks that short messages coded with a shared dictionary carry
+ * only its number, and come back the same through streams and
+ * buffers alike.
+ */
+void testDictionaries() {
+	beginTest("Dictionary Tests");
+	
+	logInfo("Testing dictionary compression on the lines of test/encodeDecode/tomSawyer");
+	ifbstream text("test/encodeDecode/tomSawyer");
+	assertCondition(text.is_open(), "Cannot open file test/encodeDecode/tomSawyer for reading!");
+	std::vector<string> lines;
+	string line;
+	while (getline(text, line)) {
+		lines.push_back(line + "\n");
+	}
+	std::vector<string> samples(lines.begin(), lines.begin() + lines.size() / 2);
+	HuffmanDictionary dictionary;
+	trainDictionary(samples, 42, dictionary);
+
+	ostringbstream dictionaryFile;
+	writeDictionary(dictionaryFile, dictionary);
+	istringbstream dictionaryData(dictionaryFile.str());
+	HuffmanDictionary loaded;
+	readDictionary(dictionaryData, loaded);
+	checkCondition(loaded.id == 42 &&
+	               memcmp(loaded.codes.length, dictionary.codes.length, NUM_SYMBOLS) == 0,
+	               "Dictionary file reads back the same code.");
+
+	/* Code the lines the dictionary was not trained on, plus bytes it never saw. */
+	lines.push_back(string("\0\x01\xff\x80", 4));
+	bool allMatch = true, buffersMatch = true, idsMatch = true;
+	size_t dictionaryBytes = 0, ownBytes = 0;
+	for (size_t i = lines.size() / 2; i < lines.size(); i++) {
+		istringbstream message(lines[i]);
+		ostringbstream packed;
+		compressWithDictionary(message, packed, dictionary);
+		istringbstream packedData(packed.str());
+		ostringbstream unpacked;
+		decompressWithDictionary(packedData, unpacked, loaded);
+		if (unpacked.str() != lines[i]) allMatch = false;
+
+		std::vector<uint8_t> packedBuffer, unpackedBuffer;
+		compressWithDictionary((const uint8_t*)lines[i].data(), lines[i].size(), loaded, packedBuffer);
+		if (string(packedBuffer.begin(), packedBuffer.end()) != packed.str()) buffersMatch = false;
+		decompressWithDictionary(&packedBuffer[0], packedBuffer.size(), dictionary, unpackedBuffer);
+		if (string(unpackedBuffer.begin(), unpackedBuffer.end()) != lines[i]) buffersMatch = false;
+		if (messageDictionaryId(&packedBuffer[0], packedBuffer.size()) != 42) idsMatch = false;
+
+		istringbstream own(lines[i]);
+		ostringbstream ownPacked;
+		compress(own, ownPacked);
+		dictionaryBytes += packed.size();
+		ownBytes += ownPacked.size();
+	}
+	checkCondition(allMatch, "Dictionary messages decompress through streams.");
+	checkCondition(buffersMatch, "Dictionary buffers match the streams and decompress.");
+	checkCondition(idsMatch, "Dictionary messages record the dictionary number.");
+	checkCondition(dictionaryBytes < ownBytes,
+	               "Dictionary messages are smaller than self-contained ones.");
+	
+	endTest("Dictionary Tests");
+}
+
+/* Function: testPresets
+ * --------------------------------------------------------
+ * Checks that a preset is always complete and needs nothing but
+ * its number to decode, and that its own buffer loops write and
+ * read the same bits as the streams.
+ */
+void testPresets() {
+	beginTest("Preset Tests");
+	
+	logInfo("Testing the English text preset on test/encodeDecode");
+	const HuffmanDictionary& preset = presetDictionary(ENGLISH_TEXT_PRESET);
+	checkCondition(isCompleteCode(preset.codes.length) && preset.maxCodeLength <= DEFAULT_MAX_CODE_LENGTH &&
+	               preset.id == ENGLISH_TEXT_PRESET && isPreset(ENGLISH_TEXT_PRESET) && !isPreset(0),
+	               "The preset is a complete, limited code.");
+
+	string files[] = { "tomSawyer", "poem", "fibonacci", "allCharsOnce", "dikdik.jpg", "singleChar" };
+	bool streamsMatch = true, buffersMatch = true;
+	for (size_t i = 0; i < sizeof files / sizeof files[0]; i++) {
+		ifbstream original("test/encodeDecode/" + files[i]);
+		ostringstream originalData;
+		originalData << original.rdbuf();
+		original.rewind();
+		string data = originalData.str();
+		/* Every split of the buffer loops' groups must be covered. */
+		for (size_t cut = 0; cut < 6 && cut <= data.size(); cut++) {
+			string input = data.substr(cut);
+			istringbstream source(input);
+			ostringbstream packed;
+			compressWithPreset(source, packed, ENGLISH_TEXT_PRESET);
+			istringbstream packedData(packed.str());
+			ostringbstream unpacked;
+			decompress(packedData, unpacked);
+			if (unpacked.str() != input) streamsMatch = false;
+
+			std::vector<uint8_t> packedBuffer, unpackedBuffer, anyBuffer;
+			compressWithPreset((const uint8_t*)input.data(), input.size(), ENGLISH_TEXT_PRESET, packedBuffer);
+			if (string(packedBuffer.begin(), packedBuffer.end()) != packed.str()) buffersMatch = false;
+			decompressWithPreset(&packedBuffer[0], packedBuffer.size(), unpackedBuffer);
+			decompressBuffer(&packedBuffer[0], packedBuffer.size(), anyBuffer);
+			if (string(unpackedBuffer.begin(), unpackedBuffer.end()) != input || anyBuffer != unpackedBuffer) {
+				buffersMatch = false;
+			}
+		}
+	}
+	checkCondition(streamsMatch, "Preset messages decompress through decompress.");
+	checkCondition(buffersMatch, "Preset buffers match the streams and decompress.");
+
+	/* The preset is what its comment says it was built from. */
+	uint64_t trainingWeights[NUM_SYMBOLS] = { 0 };
+	string trainingFiles[] = { "tomSawyer", "poem" };
+	for (int i = 0; i < 2; i++) {
+		ifbstream training("test/encodeDecode/" + trainingFiles[i]);
+		assertCondition(training.is_open(), "Cannot open file test/encodeDecode/" + trainingFiles[i] + " for reading!");
+		countBytes(training, trainingWeights);
+	}
+	for (int ch = 0; ch < NUM_SYMBOLS; ch++) {
+		if (trainingWeights[ch] == 0) trainingWeights[ch] = 1;
+	}
+	uint8_t trainedLengths[NUM_SYMBOLS];
+	buildLimitedCodeLengths(trainingWeights, DEFAULT_MAX_CODE_LENGTH, trainedLengths);
+	checkCondition(memcmp(trainedLengths, preset.codes.length, NUM_SYMBOLS) == 0,
+	               "The preset is rebuilt from the text it was trained on.");
+
+	/* English the preset never saw is still smaller with it than with its own code. */
+	string unseen = "The committee met again on Thursday morning to go over the plans for the new "
+	                "library.  Most of the members agreed that the old building could be kept, but "
+	                "nobody was sure how the repairs would be paid for, and the meeting ended late.\n";
+	istringbstream ownSource(unseen), presetSource(unseen);
+	ostringbstream ownUnseen, presetUnseen;
+	compress(ownSource, ownUnseen);
+	compressWithPreset(presetSource, presetUnseen, ENGLISH_TEXT_PRESET);
+	checkCondition(presetUnseen.str().size() < ownUnseen.str().size(),
+	               "A short English text is smaller with the preset than with its own code.");
+
+	string unknown = string(CONTAINER_MAGIC) + char(PRESET_CONTAINER) + char(99);
+	bool raised = false;
+	try {
+		std::vector<uint8_t> output;
+		decompressBuffer((const uint8_t*)unknown.data(), unknown.size(), output);
+	} catch (ErrorException&) {
+		raised = true;
+	}
+	checkCondition(raised, "An unknown preset is an error.");
+	
+	endTest("Preset Tests");
+}
+
+/* Function: testTableCache
+ * --------------------------------------------------------
+ * Checks that with a table cache installed, inputs of the same
+ * shape reuse one code and its decode table, and everything still
+ * decompresses.
+ */
+void testTableCache() {
+	beginTest("Table Cache Tests");
+	
+	logInfo("Testing the table cache on test/encodeDecode/tomSawyer");
+	TableCache cache;
+	setTableCache(&cache);
+	ifbstream textFile("test/encodeDecode/tomSawyer");
+	assertCondition(textFile.is_open(), "Cannot open file test/encodeDecode/tomSawyer for reading!");
+	ostringstream textData;
+	textData << textFile.rdbuf();
+	string text = textData.str();
+	string changed = text;
+	changed[changed.size() / 2] = (changed[changed.size() / 2] == 'e' ? 't' : 'e');
+
+	string inputs[] = { text, text, changed };
+	bool allMatch = true;
+	string firstCompressed;
+	for (int i = 0; i < 3; i++) {
+		istringbstream source(inputs[i]);
+		ostringbstream compressed;
+		compress(source, compressed);
+		if (i == 0) firstCompressed = compressed.str();
+		istringbstream compressedData(compressed.str());
+		ostringbstream decompressed;
+		decompress(compressedData, decompressed);
+		if (decompressed.str() != inputs[i]) allMatch = false;
+	}
+	TableCacheStats counts = cache.stats();
+	checkCondition(allMatch, "Files decompress with the table cache installed.");
+	checkCondition(counts.misses == 2 && counts.hits == 4 && counts.entries == 2,
+	               "Repeat and near-repeat inputs hit the table cache.");
+
+	/* The state machine is built for the first file only. */
+	setDecoderKind(FSM_DECODER);
+	bool machinesMatch = true;
+	for (int i = 0; i < 2; i++) {
+		istringbstream compressedData(firstCompressed);
+		ostringbstream decompressed;
+		decompress(compressedData, decompressed);
+		if (decompressed.str() != text) machinesMatch = false;
+	}
+	setDecoderKind(AUTOMATIC_DECODER);
+	TableCacheStats machineCounts = cache.stats();
+	checkCondition(machinesMatch && machineCounts.misses == counts.misses + 1 &&
+	               machineCounts.hits == counts.hits + 1 && machineCounts.entries == 3,
+	               "State machines are kept in the table cache.");
+
+	setTableCache(NULL);
+	istringbstream uncachedSource(text);
+	ostringbstream uncached;
+	compress(uncachedSource, uncached);
+	checkCondition(uncached.str() == firstCompressed, "A cold cache gives the same output as none.");
+
+	TableCache tiny(1);
+	CodeTable codes = CodeTable();
+	uint64_t weights[NUM_SYMBOLS] = { 0 };
+	weights[PSEUDO_EOF] = 1;
+	tiny.addCodes(weights, codes);
+	checkCondition(!tiny.findCodes(weights, codes) && tiny.stats().entries == 0 &&
+	               tiny.stats().evictions == 1 && tiny.stats().bytes == 0,
+	               "The table cache stays within its capacity.");
+	
+	endTest("Table Cache Tests");
+}
+
+/* Function: testContexts
+ * --------------------------------------------------------
+ * Checks that small messages coded with a context, which keeps
+ * its tables between them, come back through the contexts and the
+ * buffer functions alike.
+ */
+void testContexts() {
+	beginTest("Coding Context Tests");
+	
+	logInfo("Testing coding contexts on messages from test/encodeDecode/tomSawyer");
+	ifbstream textFile("test/encodeDecode/tomSawyer");
+	assertCondition(textFile.is_open(), "Cannot open file test/encodeDecode/tomSawyer for reading!");
+	ostringstream textData;
+	textData << textFile.rdbuf();
+	string text = textData.str();
+
+	std::vector<string> messages;
+	for (size_t start = 0, i = 0; start < text.size() && i < 200; start += 97, i++) {
+		messages.push_back(text.substr(start, (i * 37) % 500));
+	}
+	for (int i = 0; i < 3; i++) {
+		messages.push_back(messages[5]); //repeats after the first reuse the code and table
+	}
+	messages.push_back(string(300, 'z'));
+	messages.push_back(text.substr(0, 2));
+
+	HuffmanContext encoder;
+	HuffmanDecoderContext decoder;
+	std::vector<uint8_t> packed, unpacked, viaBuffer;
+	bool contextsMatch = true, buffersRead = true, headersMatch = true;
+	for (size_t i = 0; i < messages.size(); i++) {
+		const uint8_t* bytes = (const uint8_t*)messages[i].data();
+		encoder.compress(bytes, messages[i].size(), packed);
+		decoder.decompress(&packed[0], packed.size(), unpacked);
+		if (string(unpacked.begin(), unpacked.end()) != messages[i]) contextsMatch = false;
+		decompressBuffer(&packed[0], packed.size(), viaBuffer);
+		if (viaBuffer != unpacked) buffersRead = false;
+
+		//the header written to memory is the one written to a stream
+		uint64_t weights[NUM_SYMBOLS] = { 0 };
+		countBytes(bytes, messages[i].size(), weights);
+		weights[PSEUDO_EOF] = 1;
+		CodeTable codes;
+		buildCodeTable(weights, codes);
+		uint8_t header[MAX_CODE_LENGTH_HEADER_BYTES], lengths[NUM_SYMBOLS];
+		size_t headerBytes = writeCodeLengthHeader(codes.length, header);
+		ostringbstream streamHeader;
+		writeCodeLengthHeader(streamHeader, codes.length);
+		if (streamHeader.str() != string((const char*)header, headerBytes) ||
+		    readCodeLengthHeader(header, headerBytes, lengths) != headerBytes ||
+		    memcmp(lengths, codes.length, sizeof lengths) != 0) {
+			headersMatch = false;
+		}
+	}
+	checkCondition(contextsMatch, "Messages round-trip through the contexts.");
+	checkCondition(buffersRead, "decompressBuffer reads what a context writes.");
+	checkCondition(headersMatch, "Code length headers are the same in memory and in a stream.");
+
+	ContextStats encoded = encoder.stats(), decoded = decoder.stats();
+	checkCondition(encoded.messages == long(messages.size()) && encoded.reused >= 2 &&
+	               decoded.messages == long(messages.size()) && decoded.reused >= 2,
+	               "Repeated messages reuse the code and the decode table.");
+	encoder.reset();
+	decoder.reset();
+	checkCondition(encoder.stats().messages == 0 && decoder.stats().built == 0, "A reset context starts over.");
+
+	bool cutRaised = false;
+	try {
+		encoder.compress((const uint8_t*)text.data(), 1000, packed);
+		decoder.decompress(&packed[0], 6, unpacked);
+	} catch (ErrorException&) {
+		cutRaised = true;
+	}
+	checkCondition(cutRaised, "A context notices a header that is cut off.");
+
+	TableCache cache;
+	setTableCache(&cache);
+	bool cachedSame = true;
+	for (size_t i = 0; i < messages.size(); i++) {
+		encoder.compress((const uint8_t*)messages[i].data(), messages[i].size(), packed);
+		compressBuffer((const uint8_t*)messages[i].data(), messages[i].size(), viaBuffer);
+		if (packed != viaBuffer) cachedSame = false;
+	}
+	setTableCache(NULL);
+	checkCondition(cachedSame, "With a table cache, a context writes what compressBuffer does.");
+
+	HuffmanContextPool pool;
+	PoolJob jobs[3];
+	Thread threads[3];
+	for (int i = 0; i < 3; i++) {
+		jobs[i].pool = &pool;
+		jobs[i].messages = &messages;
+		jobs[i].allMatch = true;
+		threads[i] = fork(runPoolJob, jobs[i]);
+	}
+	for (int i = 0; i < 3; i++) join(threads[i]);
+	checkCondition(jobs[0].allMatch && jobs[1].allMatch && jobs[2].allMatch && pool.numContexts() <= 6,
+	               "Threads sharing a context pool code every message.");
+	
+	endTest("Coding Context Tests");
+}
+
+/* Function: testBatchCompression
+ * --------------------------------------------------------
+ * Checks that a batch writes every file just as compress or
+ * compressBlocks would, whether the file is coded whole or spread
+ * over the pool block by block, and that a file that cannot be
+ * read does not stop the others.
+ */
+void testBatchCompression() {
+	beginTest("Batch Compression Tests");
+	
+	logInfo("Testing batch compression of test/encodeDecode");
+	std::vector<string> names;
+	listBatchFiles("test/encodeDecode", names);
+	names.push_back("test/encodeDecode/no such file");
+	std::vector<BatchFile> batch(names.size());
+	for (size_t i = 0; i < names.size(); i++) {
+		batch[i].input = names[i];
+		batch[i].output = names[i] + ".batch" + BATCH_EXTENSION;
+	}
+	BatchStats totals = compressFiles(batch, 3, 4096);
+	checkCondition(totals.files == int(names.size()) && totals.failures == 1 && batch.back().failed,
+	               "Batch reports the file it could not read.");
+
+	bool allMatch = true, allDecompress = true;
+	uint64_t bytesIn = 0, bytesOut = 0;
+	for (size_t i = 0; i + 1 < batch.size(); i++) {
+		ifbstream original(batch[i].input);
+		ostringbstream expected;
+		if (original.size() <= 4096) compress(original, expected);
+		else compressBlocks(original, expected, 4096, 1);
+
+		ifbstream written(batch[i].output);
+		ostringstream writtenData;
+		writtenData << written.rdbuf();
+		if (batch[i].failed || writtenData.str() != expected.str()) allMatch = false;
+		bytesIn += batch[i].bytesIn;
+		bytesOut += batch[i].bytesOut;
+
+		istringbstream compressedData(writtenData.str());
+		ostringbstream decompressed;
+		decompress(compressedData, decompressed);
+		original.rewind();
+		ostringstream originalData;
+		originalData << original.rdbuf();
+		if (decompressed.str() != originalData.str()) allDecompress = false;
+		written.close();
+		remove(batch[i].output.c_str());
+	}
+	checkCondition(allMatch, "Batch writes the same files as compress and compressBlocks.");
+	checkCondition(allDecompress, "Batch output decompresses.");
+	checkCondition(totals.bytesIn == bytesIn && totals.bytesOut == bytesOut && bytesOut > 0,
+	               "Batch totals add up the files.");
+	
+	endTest("Batch Compression Tests");
+}
+
+/* Function: testMappedFiles
+ * --------------------------------------------------------
+ * Checks that memory-mapped streams read and write the same bytes
+ * as file streams.  The output mapping starts out small so that it
+ * has to grow, and must be cut back to size when it is closed.
+ */
+void testMappedFiles() {
+	beginTest("Memory-Mapped File Tests");
+	
+	logInfo("Testing compress and decompress through memory-mapped files");
+	ifbstream original("test/encodeDecode/tomSawyer");
+	ostringbstream expected;
+	compress(original, expected);
+
+	imapbstream mappedInput("test/encodeDecode/tomSawyer");
+	assertCondition(mappedInput.is_open(), "Cannot map file test/encodeDecode/tomSawyer for reading!");
+	omapbstream mappedOutput("test/encodeDecode/tomSawyer.mapped.huf", 100);
+	compress(mappedInput, mappedOutput);
+	mappedOutput.close();
+	checkCondition(!mappedOutput.fail(), "Mapped output closes cleanly.");
+
+	imapbstream mappedCompressed("test/encodeDecode/tomSawyer.mapped.huf");
+	checkCondition(mappedCompressed.length() == expected.str().size(),
+	               "Mapped output is cut back to the bytes written.");
+	checkCondition(string((const char*)mappedCompressed.data(), mappedCompressed.length()) == expected.str(),
+	               "Mapped output matches file stream output.");
+
+	ostringbstream decompressed;
+	decompress(mappedCompressed, decompressed);
+	mappedInput.rewind();
+	checkCondition(string((const char*)mappedInput.data(), mappedInput.length()) == decompressed.str(),
+	               "Mapped input decompresses to the original.");
+
+	/* A mapping is coded from its read position on, as a stream would be. */
+	string tail = decompressed.str().substr(1000);
+	uint64_t tailWeights[NUM_SYMBOLS] = { 0 };
+	countBytes((const unsigned char*)tail.data(), tail.size(), tailWeights);
+	tailWeights[PSEUDO_EOF] = 1;
+	CodeTable tailCodes;
+	buildLimitedCodeLengths(tailWeights, DEFAULT_MAX_CODE_LENGTH, tailCodes.length);
+	buildCanonicalCodeTable(tailCodes.length, tailCodes);
+	istringstream tailStream(tail);
+	ostringbstream fromStream, fromMapping;
+	uint32_t streamChecksum = 0, mappingChecksum = 0;
+	encodeFile(tailStream, tailCodes, fromStream, &streamChecksum);
+	mappedInput.clear();
+	mappedInput.seekg(1000);
+	encodeFile(mappedInput, tailCodes, fromMapping, &mappingChecksum);
+	checkCondition(fromMapping.str() == fromStream.str() && mappingChecksum == streamChecksum &&
+	               mappedInput.eof(),
+	               "A mapping is coded in place from its read position.");
+	mappedCompressed.close();
+	remove("test/encodeDecode/tomSawyer.mapped.huf");
+
+	/* A mapping that cannot grow that far fails the seek, and once it is lost,
+	 * later seeks and writes fail too rather than trying to grow from nothing.
+	 */
+	omapbstream lost("test/input/lost.mapped.tmp", 100);
+	assertCondition(lost.is_open(), "Cannot map file test/input/lost.mapped.tmp for writing!");
+	lost.seekp(streamoff(1) << 62);
+	bool farSeekFailed = lost.fail();
+	lost.clear();
+	lost.seekp(10);
+	lost.put('x');
+	bool laterFailed = lost.fail() || lost.bad();
+	lost.close();
+	remove("test/input/lost.mapped.tmp");
+	checkCondition(farSeekFailed && (sizeof(size_t) < 8 || laterFailed),
+	               "A mapping that fails to grow stays failed.");
+	
+	endTest("Memory-Mapped File Tests");
+}
+
+/* Function: testMemoryAccounting
+ * --------------------------------------------------------
+ * Checks that every codec allocation is charged to a category and
+ * handed back, including those made by worker threads.  Only a
+ * build that counts the heap can tell.
+ */
+void testMemoryAccounting() {
+	beginTest("Memory Accounting Tests");
+	
+	if (!isTrackingHeapMemory()) {
+		logInfo("Skipping memory accounting: built without TRACK_HEAP_MEMORY");
+	} else {
+		logInfo("Testing memory accounting on test/encodeDecode/tomSawyer");
+		MemoryUsage before[NUM_MEMORY_CATEGORIES];
+		for (int i = 0; i < NUM_MEMORY_CATEGORIES; i++) {
+			before[i] = memoryUsage(MemoryCategory(i));
+		}
+		MemoryUsage threadBefore = threadMemoryUsage();
+
+		/* Output buffers grow while coding, so they are charged to it; free them first. */
+		{
+			ifbstream original("test/encodeDecode/tomSawyer");
+			ostringbstream compressed;
+			compress(original, compressed);
+			istringbstream compressedData(compressed.str());
+			ostringbstream text;
+			decompress(compressedData, text);
+			istringbstream blockInput(text.str());
+			ostringbstream blocks;
+			compressBlocks(blockInput, blocks, 4096, 3);
+			istringbstream blockData(blocks.str());
+			ostringbstream decompressed;
+			decompress(blockData, decompressed);
+			checkCondition(decompressed.str() == text.str(), "Round trip under accounting gives back the data.");
+
+			/* compress counts into a plain array, so the frequency table is built here. */
+			istringbstream tableInput(text.str());
+			Map<ext_char, int> frequencies = getFrequencyTable(tableInput);
+			checkCondition(frequencies.size() > 1, "Frequency table under accounting is filled in.");
+		}
+
+		bool allReturned = true, allCounted = true;
+		for (int i = FREQUENCY_MEMORY; i < NUM_MEMORY_CATEGORIES; i++) {
+			MemoryUsage after = memoryUsage(MemoryCategory(i));
+			if (after.liveBytes != before[i].liveBytes) allReturned = false;
+			if (after.allocations == before[i].allocations || after.peakBytes < after.liveBytes) allCounted = false;
+		}
+		checkCondition(allCounted, "Every codec category saw allocations.");
+		checkCondition(allReturned, "Every codec category freed what it allocated.");
+		checkCondition(threadMemoryUsage().allocations > threadBefore.allocations,
+		               "The calling thread's allocations are counted.");
+	}
+	
+	endTest("Memory Accounting Tests");
+}
+
+/* Function: testRunContainers
+ * --------------------------------------------------------
+ * Checks that runs of one value take a shortcut, since a code
+ * takes at least a bit a byte, and still come back the same.
+ */
+void testRunContainers() {
+	beginTest("Run Container Tests");
+	
+	string zeros(100000, '\0');
+	istringbstream zeroInput(zeros);
+	ostringbstream zeroResult;
+	compress(zeroInput, zeroResult);
+	istringbstream zeroCompressed(zeroResult.str());
+	ostringbstream zeroDecompressed;
+	decompress(zeroCompressed, zeroDecompressed);
+	checkCondition(zeroDecompressed.str() == zeros, "One repeated byte round-trips.");
+	checkCondition(zeroResult.str().size() < 24, "One repeated byte takes a few bytes.");
+	uint64_t zeroWeights[NUM_SYMBOLS] = { 0 };
+	zeroWeights[0] = zeros.size();
+	SizeEstimate zeroEstimate = estimateCompressedSize(zeroWeights);
+	checkCondition(zeroEstimate.exact && zeroEstimate.container == RUN_CONTAINER &&
+	               zeroEstimate.totalBytes == zeroResult.str().size(), "The size estimate knows run containers.");
+
+	string padded;
+	for (int record = 0; record < 2000; record++) {
+		padded += "record " + integerToString(record);
+		padded.resize(64 * (record + 1), '\0');
+	}
+	istringbstream paddedInput(padded);
+	ostringbstream paddedResult;
+	compress(paddedInput, paddedResult);
+	istringbstream paddedCompressed(paddedResult.str());
+	ostringbstream paddedDecompressed;
+	decompress(paddedCompressed, paddedDecompressed);
+	checkCondition(paddedDecompressed.str() == padded, "Padded records round-trip.");
+	checkCondition(paddedResult.str().size() < padded.size() / 8, "Padded records take less than a bit a byte.");
+	istringbstream paddedEstimateInput(padded);
+	Map<ext_char, int> paddedFrequencies = getFrequencyTable(paddedEstimateInput);
+	SizeEstimate paddedEstimate = estimateCompressedSize(paddedFrequencies);
+	checkCondition(!paddedEstimate.exact && paddedEstimate.container == BLOCK_CONTAINER,
+	               "The size estimate says when runs go to blocks.");
+
+	istringbstream zeroBlockInput(zeros);
+	ostringbstream zeroBlocks;
+	compressBlocks(zeroBlockInput, zeroBlocks, 4096, 2);
+	istringbstream zeroBlockData(zeroBlocks.str());
+	ostringbstream zeroBlockDecompressed;
+	decompress(zeroBlockData, zeroBlockDecompressed);
+	checkCondition(zeroBlockDecompressed.str() == zeros, "Run blocks round-trip.");
+	checkCondition(zeroBlocks.str().size() < 25 * (zeros.size() / 4096 + 1) + 9, "Run blocks hold one byte each.");
+	istringbstream zeroRangeData(zeroBlocks.str());
+	ostringstream zeroRange;
+	decompressRange(zeroRangeData, zeroRange, 4000, 200);
+	checkCondition(zeroRange.str() == string(200, '\0'), "Ranges decompress across run blocks.");
+	
+	endTest("Run Container Tests");
+}
+
+/* Function: testCorpora
+ * --------------------------------------------------------
+ * Checks that corpora come out the same however they are cut up,
+ * and compress as their kind should.
+ */
+void testCorpora() {
+	beginTest("Corpus Tests");
+	
+	string sample = readTestFile("tomSawyer");
+	for (int kind = 0; kind < NUM_CORPUS_KINDS; kind++) {
+		string whole = makeCorpus(CorpusKind(kind), 100000, 7, sample);
+		CorpusGenerator pieces(CorpusKind(kind), 7, sample);
+		string cut(whole.size(), '\0');
+		pieces.generate(&cut[0], 12345);
+		pieces.generate(&cut[12345], cut.size() - 12345);
+		checkCondition(cut == whole && makeCorpus(CorpusKind(kind), 100000, 8, sample) != whole,
+		               string("A ") + corpusName(CorpusKind(kind)) + " corpus depends only on its seed.");
+
+		istringbstream corpusInput(whole);
+		ostringbstream corpusCompressed;
+		compress(corpusInput, corpusCompressed);
+		istringbstream corpusData(corpusCompressed.str());
+		ostringbstream corpusDecompressed;
+		decompress(corpusData, corpusDecompressed);
+		double ratio = double(corpusCompressed.str().size()) / whole.size();
+		bool expected = (kind == UNIFORM_CORPUS || kind == COMPRESSED_CORPUS ? ratio > 0.98 : ratio < 0.8);
+		checkCondition(corpusDecompressed.str() == whole && expected,
+		               string("A ") + corpusName(CorpusKind(kind)) + " corpus compresses as expected.");
+	}
+	checkCondition(parseCorpusSize("10G") == (uint64_t(10) << 30) && parseCorpusSize("1k") == 1024 &&
+	               parseCorpusSize("123") == 123, "Corpus sizes take units.");
+	
+	endTest("Corpus Tests");
+}
+
+/* Function: testCodePacker
+ * --------------------------------------------------------
+ * Checks that the packer gives the same bits as one code at a
+ * time, in any pieces, with codes short enough for its vector loop
+ * and with codes too long for it.
+ */
+void testCodePacker() {
+	beginTest("Code Packer Tests");
+	
+	string sample = readTestFile("tomSawyer");
+	CorpusKind packKinds[] = { ENGLISH_CORPUS, FIBONACCI_CORPUS };
+	for (int k = 0; k < 2; k++) {
+		string corpus = makeCorpus(packKinds[k], 50000, 3, sample);
+		const uint8_t* bytes = (const uint8_t*)corpus.data();
+		uint64_t counts[NUM_BYTE_VALUES] = { 0 };
+		countBytes(bytes, corpus.size(), counts);
+		uint64_t weights[NUM_SYMBOLS] = { 0 };
+		for (int ch = 0; ch < NUM_BYTE_VALUES; ch++) weights[ch] = counts[ch];
+		weights[PSEUDO_EOF] = 1;
+		NodeArena arena;
+		CodeTable codes = CodeTable();
+		buildCodeTable(buildEncodingTree(weights, arena, k == 0 ? MAX_VECTOR_CODE_LENGTH : 24), codes);
+
+		std::vector<uint8_t> expected;
+		uint64_t pending = 0;
+		int pendingCount = 0;
+		for (size_t i = 0; i <= corpus.size(); i++) {
+			ext_char ch = (i < corpus.size() ? bytes[i] : PSEUDO_EOF);
+			for (int b = 0; b < codes.length[ch]; b++) {
+				pending |= ((codes.bits[ch] >> b) & 1) << pendingCount;
+				if (++pendingCount == 8) {
+					expected.push_back(uint8_t(pending));
+					pending = 0;
+					pendingCount = 0;
+				}
+			}
+		}
+		if (pendingCount > 0) expected.push_back(uint8_t(pending));
+
+		CodePacker packer(codes);
+		std::vector<uint8_t> packed(packer.packedSize(corpus.size()) + 8);
+		size_t pos = 0;
+		bool underByte = true;
+		size_t pieces[] = { 1, 7, 8, 9, 100, 4096, 12345 };
+		for (size_t done = 0, p = 0; done < corpus.size(); p++) {
+			size_t count = min(pieces[p % 7], corpus.size() - done);
+			pos += packer.pack(bytes + done, count, &packed[pos], packed.size() - pos);
+			underByte = underByte && packer.pendingCount() < 8;
+			done += count;
+		}
+		pos += packer.finish(&packed[pos]);
+		packed.resize(pos);
+
+		std::vector<uint8_t> whole(packer.packedSize(corpus.size()) + 8);
+		whole.resize(encodeBytes(bytes, corpus.size(), codes, whole, 0));
+		checkCondition(packed == expected && whole == expected && underByte,
+		               string("The packer encodes a ") + corpusName(packKinds[k]) + " corpus bit for bit.");
+	}
+	
+	endTest("Code Packer Tests");
+}
+
+/* Function: testFeatures
+ * --------------------------------------------------------
+ * Runs the tests of everything built on top of the complete
+ * stack, one feature at a time.  The test files are read and
+ * compressed once, and shared by every feature checked on them.
+ */
+void testFeatures() {
+	std::vector<TestFile> files;
+	loadTestFiles(files);
+	testFileFeatures(files);
+	testDictionaries();
+	testPresets();
+	testTableCache();
+	testContexts();
+	testBatchCompression();
+	testMappedFiles();
+	testMemoryAccounting();
+	testRunContainers();
+	testCorpora();
+	testCodePacker();
+}
+
+/* Function: testBitStreams
+ * --------------------------------------------------------
+ * Checks that the buffered bit stream operations write and
+ * read exactly the same bits as writeBit and readBit.
+ */
+void testBitStreams() {
+	beginTest("Buffered Bit Stream Tests");
+
+	/* A mix of code lengths, including empty and 64-bit codes. */
+	Vector<int> lengths;
+	lengths += 3, 1, 0, 13, 7, 32, 5, 64, 2, 33, 11, 17, 57, 9;
+
+	ostringbstream unbuffered;
+	ostringbstream buffered;
+	buffered.setBitBuffering(true);
+
+	uint64_t pattern = 0x9E3779B97F4A7C15ULL;
+	for (int round = 0; round < 40; round++) {
+		foreach (int length in lengths) {
+			pattern = pattern * 6364136223846793005ULL + 1442695040888963407ULL;
+			unbuffered.writeBits(pattern, length);
+			buffered.writeBits(pattern, length);
+		}
+	}
+
+	checkCondition(buffered.size() == unbuffered.size(),
+	               "Buffered and unbuffered streams should report the same size.");
+	checkCondition(buffered.str() == unbuffered.str(),
+	               "Buffered writeBits should produce the same bytes as writeBit.");
+
+	/* After flushBits, output written with << must follow the bits. */
+	buffered.flushBits();
+	buffered << "tail";
+	buffered.writeBit(1);
+	unbuffered << "tail";
+	unbuffered.writeBit(1);
+	checkCondition(buffered.str() == unbuffered.str(),
+	               "Flushed bits followed by << should match unbuffered output.");
+
+	/* Read the bits back with readBits and with readBit and compare. */
+	{
+		istringbstream bitwise(unbuffered.str());
+		istringbstream bulk(unbuffered.str());
+		bulk.setBitBuffering(true);
+
+		bool allMatch = true;
+		for (int round = 0; round < 40; round++) {
+			foreach (int length in lengths) {
+				if (length > MAX_PEEK_BITS) length = MAX_PEEK_BITS;
+				if (bulk.peekBits(length) != bitwise.readBits(length)) allMatch = false;
+				bulk.skipBits(length);
+			}
+		}
+		checkCondition(allMatch, "peekBits/skipBits should read the same bits as readBit.");
+
+		/* Turning buffering off should give back the bytes read ahead. */
+		bulk.setBitBuffering(false);
+		checkCondition(!bulk.fail(), "Reading within the stream should not fail.");
+
+		string expected = unbuffered.str();
+		size_t tailStart = expected.find("tail");
+		istringbstream afterBits(expected);
+		afterBits.setBitBuffering(true);
+		for (size_t i = 0; i < tailStart; i++) afterBits.skipBits(8);
+		afterBits.setBitBuffering(false);
+		string tail(4, ' ');
+		afterBits.read(&tail[0], 4);
+		checkCondition(tail == "tail", "Bytes after the bits should be readable once buffering is off.");
+
+		/* Skipping past the end should be reported. */
+		istringbstream shortStream("ab");
+		shortStream.setBitBuffering(true);
+		shortStream.skipBits(16);
+		checkCondition(!shortStream.fail(), "Skipping exactly to the end should not fail.");
+		shortStream.skipBits(1);
+		checkCondition(shortStream.fail(), "Skipping past the end should put the stream in a fail state.");
+	}
+
+	endTest("Buffered Bit Stream Tests");
+}
+
+/* Function: printBits
+ * --------------------------------------------------------
+ * Given a string, prints the bits of that string one at a
+ * time.
+ */
+void printBits(string str, int maxBits) {
+	/* Wrap your string in an istringbstream so we can do bit-by-bit
+	 * I/O.
+	 */
+	istringbstream stream(str);
+	for (int i = 0; i < maxBits; i++) {
+		int bit = stream.readBit();
+		if (bit == EOF) break;
+		cout << bit;
+	}
+	cout << endl;
+}
+
+/* Function: manualEncodeDecode
+ * --------------------------------------------------------
+ * Function to let you manually test running encode and
+ * decode on a given string.
+ */
+void manualEncodeDecode() {
+	beginTest("Manual encodeFile / decodeFile Tests");
+	
+	cout << "Enter text for us to encode and then decode" << endl;
+	while (true) {
+		string text = getLine("Text (enter to stop test): ");
+		if (text == "") break;
+		
+		/* Build an istringstream holding the data. */
+		istringbstream source(text);
+
+		/* Construct the encoding tree for the text. */
+		Map<ext_char, int> frequencies = getFrequencyTable(source);
+		Node* tree = buildEncodingTree(frequencies);
+		ostringbstream compressed;
+		
+		/* Encode the text. */
+		source.rewind();
+		encodeFile(source, tree, compressed);
+		
+		/* Print out the compressed representation. */
+		cout << "Compressed representation: " << endl;
+		printBits(compressed.str(), treeCost(tree));
+		
+		/* No need to generate new map/tree because we know we'd read same map that we wrote,
+		 * meaning we'd also get the same tree (assuming tree function is deterministic.)
+		 */
+		istringbstream compressedIn(compressed.str());
+		ostringstream unpacked;
+		decodeFile(compressedIn, tree, unpacked);
+		checkCondition(unpacked.str() == text, "Result of compressing and decompressing should be the original input.");
+		
+		/* Clean up memory. */
+		freeTree(tree);
+	}
+}
+
+/* Function: openFile
+ * --------------------------------------------------------
+ * Prompts the user for the name of a file to open, opening
+ * the indicated stream object to that file.
+ */
+template <typename FileStream>
+void openFile(FileStream& file, string prompt = "") {
+	while (true) {
+		string filename = getLine(prompt);
+		file.open(filename.c_str());
+		
+		if (file.is_open()) return;
+		
+		cout << "Sorry, I couldn't open that file." << endl;
+		file.clear();
+	}
+}
+
+/* Function: runCompress
+ * --------------------------------------------------------
+ * Harness to run your compress function on actual files.
+ */
+void runCompress() {
+	/* Open a file for reading. */
+	ifbstream infile;
+	openFile(infile, "File to compress: ");
+
+	/* Open a file for writing. */
+	ofbstream outfile;
 	openFile(outfile, "Filename for compressed output: ");
 		
 	/* Compress the file. */
@@ -853,41 +2941,65 @@ void runDecompress() {
 	getLine("Press ENTER to continue...");
 }
 
+/* Function: runBatchCompress
+ * --------------------------------------------------------
+ * Harness code to compress a file, or every file in a directory,
+ * on all processors at once.  Each file is written next to the
+ * original with BATCH_EXTENSION added.
+ */
+void runBatchCompress() {
+	string path = getLine("File or directory to compress: ");
+	std::vector<string> names;
+	listBatchFiles(path, names);
+	std::vector<BatchFile> batch(names.size());
+	for (size_t i = 0; i < names.size(); i++) {
+		batch[i].input = names[i];
+		batch[i].output = names[i] + BATCH_EXTENSION;
+	}
+
+	cout << "Compressing " << names.size() << " files... " << flush;
+	BatchStats totals = compressFiles(batch);
+	cout << "done!" << endl << endl;
+
+	for (size_t i = 0; i < batch.size(); i++) {
+		if (batch[i].failed) cout << batch[i].input << ": " << batch[i].message << endl;
+	}
+	cout << "Files compressed:   " << totals.files - totals.failures << " of " << totals.files << endl;
+	cout << "Original size:      " << totals.bytesIn << "B" << endl;
+	cout << "Compressed size:    " << totals.bytesOut << "B" << endl;
+	cout << "Compression ratio:  " << double(totals.bytesOut) / max(totals.bytesIn, uint64_t(1)) << endl;
+	cout << "Time:               " << totals.seconds << "s" << endl;
+	cout << "Throughput:         " << totals.bytesIn / 1e6 / max(totals.seconds, 1e-9) << "MB/s" << endl;
+	cout << "Tasks stolen:       " << totals.steals << endl << endl;
+	getLine("Press ENTER to continue...");
+}
+
 /* Function: compareFiles
  * --------------------------------------------------------
  * Compares two files byte-by-byte to determine whether or
  * not they are equivalent to one another.
  */
 void compareFiles() {
-	/* Get the two files to compare. */
-	ifstream one, two;
+	/* Get the two files to compare.  They are mapped rather than
+	 * read, so comparing costs no more than touching their pages.
+	 */
+	imapbstream one, two;
 	openFile(one, "First file to compare:  ");
 	openFile(two, "Second file to compare: ");
 	
-	/* Read the contents of the files into a stringstream for
-	 * comparison.
-	 */
-	ostringstream oneContents, twoContents;
-	oneContents << one.rdbuf();
-	twoContents << two.rdbuf();
-	
-	const string oneString = oneContents.str(), twoString = twoContents.str();
-	
 	/* Check lengths are the same. */
-	if (oneString.length() != twoString.length()) {
+	if (one.length() != two.length()) {
 		cout << "Files differ!" << endl;
-		cout << "File one has length " << oneString.length() << "." << endl;
-		cout << "File two has length " << twoString.length() << "." << endl;
+		cout << "File one has length " << one.length() << "." << endl;
+		cout << "File two has length " << two.length() << "." << endl;
 	} else {
 		/* Compare the two sequences to find a mismatch. */
-		pair<string::const_iterator, string::const_iterator> diff =
-			mismatch(oneString.begin(), oneString.end(), twoString.begin());
-		if (diff.first != oneString.end()) {
+		size_t offset = findMismatch(one.data(), two.data(), one.length());
+		if (offset != one.length()) {
 			cout << "Files differ!" << endl;
-			ptrdiff_t offset = diff.first - oneString.begin();
 			cout << "Bytes differ at offset " << offset << "." << endl;
-			cout << "File one has value " << representationOf(*diff.first) << endl;
-			cout << "File two has value " << representationOf(*diff.second) << endl;
+			cout << "File one has value " << representationOf(one.data()[offset]) << endl;
+			cout << "File two has value " << representationOf(two.data()[offset]) << endl;
 		} else {
 			/* Files match! */
 			cout << "Files match!" << endl;
@@ -896,6 +3008,96 @@ void compareFiles() {
 	getLine("Press ENTER to continue...");
 }
 
+/* Function: runVerify
+ * --------------------------------------------------------
+ * Harness code to check that a file comes back unchanged from
+ * compress and decompress, without writing anything to disk.
+ */
+void runVerify() {
+	string filename;
+	while (true) {
+		filename = getLine("File to verify: ");
+		ifbstream probe(filename.c_str());
+		if (probe.is_open()) break;
+
+		cout << "Sorry, I couldn't open that file." << endl;
+	}
+
+	cout << "Verifying... " << flush;
+	VerifyResult result;
+	try {
+		result = verifyRoundTrip(filename);
+	} catch (ErrorException& e) {
+		cout << "failed: " << e.getMessage() << endl << endl;
+		getLine("Press ENTER to continue...");
+		return;
+	}
+	cout << "done!" << endl << endl;
+
+	if (result.matches) {
+		cout << "Round trip matches!" << endl;
+	} else {
+		cout << result.message << endl;
+		cout << "First difference at offset " << result.mismatchOffset << "." << endl;
+	}
+	cout << "Original file size:   " << result.bytesIn << "B" << endl;
+	cout << "Compressed size:      " << result.bytesOut << "B" << endl;
+	cout << "Compression speed:    " << result.bytesIn / 1e6 / max(result.compressSeconds, 1e-9) << "MB/s" << endl;
+	cout << "Decompression speed:  " << result.bytesIn / 1e6 / max(result.decompressSeconds, 1e-9) << "MB/s" << endl << endl;
+	getLine("Press ENTER to continue...");
+}
+
+/* Function: runGenerateCorpus
+ * --------------------------------------------------------
+ * Harness code to write a synthetic corpus of any size to a file,
+ * for benchmarks too large to hold in memory.  English-like data
+ * takes its statistics from tomSawyer.
+ */
+void runGenerateCorpus() {
+	CorpusKind kind = NUM_CORPUS_KINDS;
+	while (kind == NUM_CORPUS_KINDS) {
+		string name = getLine("Kind (uniform, zipf, english, fibonacci, compressed): ");
+		for (int k = 0; k < NUM_CORPUS_KINDS; k++) {
+			if (name == corpusName(CorpusKind(k))) kind = CorpusKind(k);
+		}
+	}
+	uint64_t size = parseCorpusSize(getLine("Size, such as 64K, 100M or 10G: "));
+
+	ofbstream outfile;
+	openFile(outfile, "Filename for the corpus: ");
+
+	ifbstream source("test/encodeDecode/tomSawyer");
+	ostringstream sample;
+	sample << source.rdbuf();
+
+	cout << "Generating... " << flush;
+	double start = currentSeconds();
+	writeCorpus(kind, size, outfile, 1, sample.str());
+	outfile.close();
+	cout << "done in " << currentSeconds() - start << "s!" << endl << endl;
+	getLine("Press ENTER to continue...");
+}
+
+/* Function: runAppend
+ * --------------------------------------------------------
+ * Harness code to add a file to the end of an archive written by
+ * compressBlocks, without recompressing what it already holds.
+ */
+void runAppend() {
+	ifbstream infile;
+	openFile(infile, "File to append: ");
+	string archiveName = getLine("Block archive to append it to: ");
+
+	cout << "Appending... " << flush;
+	try {
+		appendBlocks(infile, archiveName);
+		cout << "done!" << endl << endl;
+	} catch (ErrorException& ex) {
+		cout << ex.getMessage() << endl << endl;
+	}
+	getLine("Press ENTER to continue...");
+}
+
 /* Function: displayMenu
  * --------------------------------------------------------
  * Displays the main menu of options.
@@ -910,9 +3112,15 @@ void displayMenu() {
 	cout << setw(2) << MANUAL_ENCODING_TESTS << ": Manually test encodeFile/decodeFile" << endl;
 	cout << setw(2) << AUTOMATIC_ENCODING_TESTS << ": Automatically test encodeFile/decodeFile" << endl;
 	cout << setw(2) << AUTOMATIC_COMPLETE_TESTS << ": Automatically test compress/decompress" << endl;
+	cout << setw(2) << AUTOMATIC_BITSTREAM_TESTS << ": Automatically test buffered bit streams" << endl;
+	cout << setw(2) << AUTOMATIC_FEATURE_TESTS << ": Automatically test everything built on compress/decompress" << endl;
 	cout << setw(2) << COMPRESS << ": Compress a file" << endl;
 	cout << setw(2) << DECOMPRESS << ": Decompress a compressed file" << endl;
 	cout << setw(2) << COMPARE << ": Compare two files for equality" << endl;
+	cout << setw(2) << BATCH_COMPRESS << ": Compress a directory of files" << endl;
+	cout << setw(2) << VERIFY << ": Verify that a file round-trips" << endl;
+	cout << setw(2) << GENERATE_CORPUS << ": Generate a synthetic corpus file" << endl;
+	cout << setw(2) << APPEND << ": Append a file to a block archive" << endl;
 	cout << setw(2) << QUIT << ": Quit" << endl;
 }
 
@@ -937,11 +3145,40 @@ void testEnvironment() {
   }
 }
 
-/* Displays the menu and drives the testing code. */
+/* Function: runAllTests
+ * --------------------------------------------------------
+ * Runs every automatic test group in turn without stopping, and
+ * returns the exit status for the whole run: 0 if every check
+ * passed, 1 otherwise.
+ */
+int runAllTests() {
+	interactive = false;
+	testGetFrequencyTable();
+	testBuildEncodingTree();
+	testEncoding();
+	testCompleteStack();
+	testBitStreams();
+	testFeatures();
+
+	if (failureCount == 0) {
+		cout << "All tests passed." << endl;
+		return 0;
+	}
+	cout << failureCount << " checks failed." << endl;
+	return 1;
+}
+
+/* Displays the menu and drives the testing code.  With the
+ * environment variable HUFFMAN_TEST_BATCH set, it runs every
+ * automatic test instead, for scripts and builds; the library's
+ * main takes the command line, so an option could not get here.
+ */
 int main() {
   testEnvironment();
   testReferenceSolutionConfiguration();
 
+	if (getenv("HUFFMAN_TEST_BATCH") != NULL) return runAllTests();
+
 	while (true) {
 		displayMenu();
 		
@@ -973,9 +3210,27 @@ int main() {
 			case AUTOMATIC_COMPLETE_TESTS:
 				testCompleteStack();
 				break;
+			case AUTOMATIC_BITSTREAM_TESTS:
+				testBitStreams();
+				break;
+			case AUTOMATIC_FEATURE_TESTS:
+				testFeatures();
+				break;
+			case BATCH_COMPRESS:
+				runBatchCompress();
+				break;
 			case COMPARE:
 				compareFiles();
 				break;
+			case VERIFY:
+				runVerify();
+				break;
+			case GENERATE_CORPUS:
+				runGenerateCorpus();
+				break;
+			case APPEND:
+				runAppend();
+				break;
 			case QUIT:
 				return 0;
 			default:
@@ -0,0 +1,254 @@
+/**********************************************************
+ * File: HuffmanFsm.cpp
+ *
+ * Implementation of the FsmDecoder class from HuffmanFsm.h.
+ */
+
+#include "HuffmanFsm.h"
+#include "HuffmanChecksum.h"
+#include "MemoryDiagnostics.h"
+#include "OutputBuffer.h"
+#include "error.h"
+#include <cstring>
+
+/* The child of a trie node that has none; leaves are -1 to -257. */
+static const int FSM_MISSING = -(NUM_SYMBOLS + 1);
+
+/* The size of the pieces of input read at a time. */
+static const int FSM_CHUNK_SIZE = 1 << 16;
+
+/* Constructor: FsmDecoder
+ * ----------------------------------------------------
+ * No trie and no step size.
+ */
+FsmDecoder::FsmDecoder() : bitless(false), steps(0) {
+	/* Empty */
+}
+
+/* Constructor: FsmDecoder
+ * ----------------------------------------------------
+ * Copies the tree into the trie, then builds the table.
+ */
+FsmDecoder::FsmDecoder(Node* encodingTree, size_t memoryLimit) : bitless(false), steps(0) {
+	MemoryCategoryScope scope(TABLE_MEMORY);
+	if (encodingTree == NULL) error("Cannot build a state machine for an empty tree.");
+	addTree(encodingTree, -1, 0);
+	buildTable(memoryLimit);
+}
+
+/* Constructor: FsmDecoder
+ * ----------------------------------------------------
+ * Adds every canonical code to the trie, then builds the table.
+ */
+FsmDecoder::FsmDecoder(const uint8_t lengths[NUM_SYMBOLS], size_t memoryLimit) : bitless(false), steps(0) {
+	MemoryCategoryScope scope(TABLE_MEMORY);
+	CodeTable codes;
+	buildCanonicalCodeTable(lengths, codes);
+	addCodes(codes);
+	buildTable(memoryLimit);
+}
+
+/* Constructor: FsmDecoder
+ * ----------------------------------------------------
+ * Adds the code words as they are, then builds the table.
+ */
+FsmDecoder::FsmDecoder(const CodeTable& codes, size_t memoryLimit) : bitless(false), steps(0) {
+	MemoryCategoryScope scope(TABLE_MEMORY);
+	addCodes(codes);
+	buildTable(memoryLimit);
+}
+
+/* Member function: isUsable
+ * ----------------------------------------------------
+ * A machine was built if it has a step size.
+ */
+bool FsmDecoder::isUsable() const {
+	return steps != 0;
+}
+
+/* Member function: stepBits
+ * ----------------------------------------------------
+ * Returns the step size.
+ */
+int FsmDecoder::stepBits() const {
+	return steps;
+}
+
+/* Member function: numStates
+ * ----------------------------------------------------
+ * Every internal node has two children in the trie.
+ */
+int FsmDecoder::numStates() const {
+	return int(children.size() / 2);
+}
+
+/* Member function: memoryBytes
+ * ----------------------------------------------------
+ * Counts the table, which is nearly all of it.
+ */
+size_t FsmDecoder::memoryBytes() const {
+	return entries.size() * sizeof(FsmEntry) + children.size() * sizeof(int);
+}
+
+/* Member function: decode
+ * ----------------------------------------------------
+ * One lookup per step.  Every entry copies all eight of its
+ * symbol slots, which is one store, and the output moves on by
+ * however many of them count says are real.
+ */
+void FsmDecoder::decode(ibstream& infile, ostream& outfile, uint32_t* checksum) const {
+	MemoryCategoryScope scope(CODING_MEMORY);
+	if (!isUsable()) error("This code has no state machine.");
+	if (infile.isBitBuffering()) error("The state machine decoder reads whole bytes.");
+
+	streambuf* source = infile.rdbuf();
+	std::vector<unsigned char> chunk(FSM_CHUNK_SIZE);
+	std::vector<char> pending(OUTPUT_BUFFER_SIZE + 2 * sizeof(entries[0].symbols)); //room for two steps past full
+	const FsmEntry* table = &entries[0];
+	size_t used = 0;
+	int state = 0;
+	uint8_t end = 0;
+	size_t unused = 0;
+
+	while (end == 0) {
+		streamsize got = source->sgetn((char*)&chunk[0], FSM_CHUNK_SIZE);
+		if (got <= 0) error("Encoded data ended before PSEUDO_EOF.");
+
+		size_t i = 0;
+		for (; i < size_t(got) && end == 0; i++) {
+			const FsmEntry* entry = &table[(state << steps) | (chunk[i] & ((1 << steps) - 1))];
+			memcpy(&pending[used], entry->symbols, sizeof entry->symbols);
+			used += entry->count;
+			state = entry->next;
+			end = entry->end;
+			if (steps == 4 && end == 0) {
+				entry = &table[(state << 4) | (chunk[i] >> 4)];
+				memcpy(&pending[used], entry->symbols, sizeof entry->symbols);
+				used += entry->count;
+				state = entry->next;
+				end = entry->end;
+			}
+
+			if (used >= OUTPUT_BUFFER_SIZE) {
+				if (checksum != NULL) *checksum = updateCrc32c(*checksum, (const unsigned char*)&pending[0], used);
+				outfile.write(&pending[0], used);
+				used = 0;
+			}
+		}
+		unused = size_t(got) - i;
+	}
+	if (checksum != NULL) *checksum = updateCrc32c(*checksum, (const unsigned char*)&pending[0], used);
+	outfile.write(&pending[0], used);
+	if (end == FSM_INVALID) error("Encoded data does not follow the code.");
+
+	//hand back the whole bytes not used, as decodeFast does
+	for (; unused > 0; unused--) {
+		if (source->sungetc() == EOF) {
+			infile.seekg(-streamoff(unused), ios::cur);
+			break;
+		}
+	}
+}
+
+/* Member function: addTree
+ * ----------------------------------------------------
+ * Numbers the internal nodes in preorder, the root as state zero,
+ * and links each to its parent; a tree that is just a leaf needs
+ * no bits.
+ */
+void FsmDecoder::addTree(Node* node, int parent, int bit) {
+	if (node->zero == NULL && node->one == NULL) {
+		if (parent < 0) bitless = true;
+		else children[2 * parent + bit] = -1 - node->character;
+		return;
+	}
+
+	int index = int(children.size() / 2);
+	if (index >= NUM_SYMBOLS - 1) error("Encoding tree has too many nodes for a state machine.");
+	children.push_back(FSM_MISSING);
+	children.push_back(FSM_MISSING);
+	if (parent >= 0) children[2 * parent + bit] = index;
+	if (node->zero != NULL) addTree(node->zero, index, 0);
+	if (node->one != NULL) addTree(node->one, index, 1);
+}
+
+/* Member function: addCode
+ * ----------------------------------------------------
+ * Follows the bits of the code from the root, first bit first,
+ * making the internal nodes on the way.
+ */
+void FsmDecoder::addCode(ext_char ch, uint64_t bits, int length) {
+	if (children.empty()) {
+		children.push_back(FSM_MISSING);
+		children.push_back(FSM_MISSING);
+	}
+	int node = 0;
+	for (int j = 0; j < length; j++) {
+		int& slot = children[2 * node + int((bits >> j) & 1)];
+		if (j == length - 1) {
+			if (slot != FSM_MISSING) error("Code lengths do not form a prefix code.");
+			slot = -1 - ch;
+		} else if (slot == FSM_MISSING) {
+			int index = int(children.size() / 2);
+			if (index >= NUM_SYMBOLS - 1) error("Code lengths do not form a prefix code.");
+			slot = index;
+			node = index; //slot is not used again, the push may move it
+			children.push_back(FSM_MISSING);
+			children.push_back(FSM_MISSING);
+		} else if (slot < 0) {
+			error("Code lengths do not form a prefix code.");
+		} else {
+			node = slot;
+		}
+	}
+}
+
+/* Member function: addCodes
+ * ----------------------------------------------------
+ * Adds every code of the table to the trie; a table with no code
+ * of any bits is the lone PSEUDO_EOF.
+ */
+void FsmDecoder::addCodes(const CodeTable& codes) {
+	for (int ch = 0; ch < NUM_SYMBOLS; ch++) {
+		if (codes.length[ch] == 0) continue;
+		addCode(ch, codes.bits[ch], codes.length[ch]);
+	}
+	if (children.empty()) bitless = true; //a lone code of no bits
+}
+
+/* Member function: buildTable
+ * ----------------------------------------------------
+ * Takes a byte step if its table fits the limit, then a nibble
+ * step, and fills in every step by walking its bits through the
+ * trie, going back to the root after each character.
+ */
+void FsmDecoder::buildTable(size_t memoryLimit) {
+	if (bitless || children.empty()) return;
+	size_t states = children.size() / 2;
+	if ((states << 8) * sizeof(FsmEntry) <= memoryLimit) steps = 8;
+	else if ((states << 4) * sizeof(FsmEntry) <= memoryLimit) steps = 4;
+	else return;
+
+	entries.resize(states << steps);
+	for (size_t state = 0; state < states; state++) {
+		for (int value = 0; value < (1 << steps); value++) {
+			FsmEntry& entry = entries[(state << steps) | size_t(value)];
+			memset(&entry, 0, sizeof entry);
+			int node = int(state);
+			for (int j = 0; j < steps && entry.end == 0; j++) {
+				int child = children[2 * node + ((value >> j) & 1)];
+				if (child == FSM_MISSING) {
+					entry.end = FSM_INVALID;
+				} else if (child >= 0) {
+					node = child;
+				} else if (-1 - child == PSEUDO_EOF) {
+					entry.end = FSM_END;
+				} else {
+					entry.symbols[entry.count++] = uint8_t(-1 - child);
+					node = 0;
+				}
+			}
+			entry.next = uint16_t(node);
+		}
+	}
+}
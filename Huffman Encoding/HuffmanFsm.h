@@ -0,0 +1,149 @@
+/**********************************************************
+ * File: HuffmanFsm.h
+ *
+ * A decoder that reads a whole byte of input per step.  The
+ * internal nodes of the encoding tree are the states of a
+ * finite-state machine: being at a node means the bits read
+ * since the last character are the path to it.  For every
+ * state and every value of the next byte, the table holds the
+ * characters those eight bits finish and the node they end
+ * on, so the decoder does one lookup per input byte and no
+ * work on single bits at all.  With short codes, as text has,
+ * each lookup gives two or three characters.
+ *
+ * A tree over all 257 ext_chars has 256 states, and a byte
+ * table for it takes 768 KB.  When that is more than the
+ * memory allowed, the machine steps a nibble at a time
+ * instead, with a table a sixteenth the size; when even that
+ * is too much, the decoder cannot be used.
+ *
+ * Building a byte table walks every state through every byte,
+ * which costs more than decoding a small input does.  A
+ * TableCache keeps machines by their code, so inputs coded
+ * alike build theirs once (see TableCache.h).
+ */
+
+#ifndef HuffmanFsm_Included
+#define HuffmanFsm_Included
+
+#include "HuffmanTypes.h"
+#include "HuffmanTables.h"
+#include "bstream.h"
+#include <vector>
+using namespace std;
+
+/* Constant: DEFAULT_FSM_MEMORY_LIMIT
+ * The most table memory an FsmDecoder takes unless told otherwise,
+ * which is enough for a byte table over any tree.
+ */
+const size_t DEFAULT_FSM_MEMORY_LIMIT = 1 << 20;
+
+/* Constant: FSM_END
+ * Constant: FSM_INVALID
+ * The values of FsmEntry::end for a step that reaches PSEUDO_EOF,
+ * and for one whose bits follow no code.
+ */
+const uint8_t FSM_END = 1;
+const uint8_t FSM_INVALID = 2;
+
+/* Type: FsmEntry
+ * What one step of the machine does: puts out the first count
+ * characters of symbols and moves to state next.  If end is not
+ * zero, decoding stops after those characters, at PSEUDO_EOF or
+ * at bits that follow no code.
+ */
+struct FsmEntry {
+	uint8_t symbols[8];
+	uint8_t count;
+	uint8_t end;
+	uint16_t next;
+};
+
+/* Class: FsmDecoder
+ * The state machine for one code, built once and used for any
+ * number of inputs.
+ */
+class FsmDecoder {
+public:
+	/* Constructor: FsmDecoder
+	 * Usage: FsmDecoder decoder;
+	 * ----------------------------------------------------
+	 * Creates a machine that is not usable, for one to be copied into.
+	 */
+	FsmDecoder();
+
+	/* Constructor: FsmDecoder
+	 * Usage: FsmDecoder decoder(encodingTree);
+	 *        FsmDecoder decoder(lengths, memoryLimit);
+	 *        FsmDecoder decoder(codes, memoryLimit);
+	 * ----------------------------------------------------
+	 * Builds the machine for the code of an encoding tree, for the
+	 * canonical code with the given lengths, indexed by ext_char, or
+	 * for the code words of a code table, taking no more than
+	 * memoryLimit bytes of tables.  Raises an error if the lengths or
+	 * code words do not form a prefix code.
+	 */
+	explicit FsmDecoder(Node* encodingTree, size_t memoryLimit = DEFAULT_FSM_MEMORY_LIMIT);
+	explicit FsmDecoder(const uint8_t lengths[NUM_SYMBOLS], size_t memoryLimit = DEFAULT_FSM_MEMORY_LIMIT);
+	explicit FsmDecoder(const CodeTable& codes, size_t memoryLimit = DEFAULT_FSM_MEMORY_LIMIT);
+
+	/* Member function: isUsable
+	 * Usage: if (decoder.isUsable()) ...
+	 * ----------------------------------------------------
+	 * Returns whether the machine was built: not when even a nibble
+	 * table passes the memory limit, nor for a code that needs no
+	 * bits at all, as the lone PSEUDO_EOF of an empty file does.
+	 */
+	bool isUsable() const;
+
+	/* Member function: stepBits
+	 * Usage: int bits = decoder.stepBits();
+	 * ----------------------------------------------------
+	 * Returns how many bits one step reads: 8, 4, or 0 if the machine
+	 * is not usable.
+	 */
+	int stepBits() const;
+
+	/* Member function: numStates
+	 * Usage: int states = decoder.numStates();
+	 * ----------------------------------------------------
+	 * Returns the number of states, one per internal node of the tree.
+	 */
+	int numStates() const;
+
+	/* Member function: memoryBytes
+	 * Usage: size_t bytes = decoder.memoryBytes();
+	 * ----------------------------------------------------
+	 * Returns the memory the table takes.
+	 */
+	size_t memoryBytes() const;
+
+	/* Member function: decode
+	 * Usage: decoder.decode(infile, outfile);
+	 *        decoder.decode(infile, outfile, &crc);
+	 * ----------------------------------------------------
+	 * Decodes whole bytes of infile until PSEUDO_EOF, writing each
+	 * character to outfile, and hands back the bytes read past it.
+	 * The code must start on a byte boundary.  If checksum is given,
+	 * the CRC-32C of the characters is added to it.  Raises an error
+	 * if the machine is not usable, if infile is buffering bits of
+	 * its own, or if the input ends first.
+	 */
+	void decode(ibstream& infile, ostream& outfile, uint32_t* checksum = NULL) const;
+
+private:
+	void addTree(Node* node, int parent, int bit);
+	void addCode(ext_char ch, uint64_t bits, int length);
+	void addCodes(const CodeTable& codes);
+	void buildTable(size_t memoryLimit);
+
+	/* The trie: a child is an internal node if it is at least zero,
+	 * -1 - ch for a leaf of ch, or FSM_MISSING if there is none.
+	 */
+	std::vector<int> children;
+	bool bitless;
+	int steps;
+	std::vector<FsmEntry> entries;
+};
+
+#endif
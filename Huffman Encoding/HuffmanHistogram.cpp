@@ -0,0 +1,379 @@
+/**********************************************************
+ * File: HuffmanHistogram.cpp
+ *
+ * Implementation of the byte counting functions from
+ * HuffmanHistogram.h.
+ */
+
+#include "HuffmanHistogram.h"
+#include "MappedFile.h"
+#include "WorkPool.h"
+#include "error.h"
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+/* Size of the blocks read from a stream while counting. */
+static const int COUNT_BLOCK_SIZE = 32768;
+
+/* Size of the piece of a stream each thread counts at a time. */
+static const size_t PARALLEL_PIECE_SIZE = 1 << 20;
+
+/* The pool every count on one thread per processor shares, made
+ * on first use and kept, and whether a count is using it.  A count
+ * that finds it in use runs on its own thread instead of waiting.
+ */
+static Lock sharedPoolLock;
+static WorkPool* sharedPool = NULL;
+static bool sharedPoolBusy = false;
+
+/* Type: CountJob
+ * One thread's range of bytes and its private counts, so that no
+ * two threads ever write the same counter.
+ */
+struct CountJob {
+	const unsigned char* data;
+	size_t length;
+	uint64_t counts[NUM_BYTE_VALUES];
+};
+
+/*
+	A WorkPool task that counts one range
+*/
+static void countRangeTask(void* data)
+{
+	CountJob* job = static_cast<CountJob*>(data);
+	countBytes(job->data, job->length, job->counts);
+}
+
+/*
+	Takes the shared pool for the caller, or returns NULL if another
+	count has it
+*/
+static WorkPool* acquireSharedPool()
+{
+	WorkPool* pool = NULL;
+	synchronized (sharedPoolLock)
+	{
+		if (!sharedPoolBusy)
+		{
+			if (sharedPool == NULL) sharedPool = new WorkPool;
+			sharedPoolBusy = true;
+			pool = sharedPool;
+		}
+	}
+	return pool;
+}
+
+/*
+	Gives the shared pool back
+*/
+static void releaseSharedPool()
+{
+	synchronized (sharedPoolLock)
+	{
+		sharedPoolBusy = false;
+	}
+}
+
+/*
+	This function counts length bytes from data in equal ranges on the
+	threads of pool, then adds every range's counts to counts
+*/
+static void countInPool(WorkPool& pool, const unsigned char* data, size_t length,
+                        uint64_t counts[NUM_BYTE_VALUES])
+{
+	size_t numRanges = size_t(pool.numThreads());
+	if (numRanges > length / (MIN_PARALLEL_COUNT_BYTES / 2)) numRanges = length / (MIN_PARALLEL_COUNT_BYTES / 2);
+	if (numRanges <= 1)
+	{
+		countBytes(data, length, counts);
+		return;
+	}
+
+	std::vector<CountJob> jobs(numRanges);
+	size_t rangeSize = (length + numRanges - 1) / numRanges;
+	for (size_t i = 0; i < numRanges; i++)
+	{
+		size_t start = i * rangeSize;
+		jobs[i].data = data + start;
+		jobs[i].length = (start < length ? min(rangeSize, length - start) : 0);
+		memset(jobs[i].counts, 0, sizeof jobs[i].counts);
+		pool.submit(countRangeTask, &jobs[i]);
+	}
+	pool.run();
+
+	for (size_t i = 0; i < numRanges; i++)
+	{
+		for (int ch = 0; ch < NUM_BYTE_VALUES; ch++) counts[ch] += jobs[i].counts[ch];
+	}
+}
+
+/* Function: countBytes
+ * Usage: countBytes(data, length, counts);
+ * --------------------------------------------------------
+ * Adds the number of times each byte value appears in the given
+ * memory block to counts, which is indexed by byte value.
+ */
+void countBytes(const unsigned char* data, size_t length,
+                uint64_t counts[NUM_BYTE_VALUES])
+{
+	/*
+		Runs of the same byte would make every increment wait for the
+		previous store to the same counter.  Four tables, one per byte
+		of each 32-bit word, keep neighbouring increments independent;
+		they are summed at the end.
+	*/
+	uint64_t tables[4][NUM_BYTE_VALUES];
+	memset(tables, 0, sizeof tables);
+
+	size_t i = 0;
+	for (; i + 4 <= length; i += 4)
+	{
+		uint32_t word;
+		memcpy(&word, data + i, sizeof word);
+
+		tables[0][word & 0xFF]++;
+		tables[1][(word >> 8) & 0xFF]++;
+		tables[2][(word >> 16) & 0xFF]++;
+		tables[3][word >> 24]++;
+	}
+	for (; i < length; i++)
+	{
+		tables[0][data[i]]++;
+	}
+
+	for (int ch = 0; ch < NUM_BYTE_VALUES; ch++)
+	{
+		counts[ch] += tables[0][ch] + tables[1][ch] + tables[2][ch] + tables[3][ch];
+	}
+}
+
+/*
+	Counts a mapped stream from its read position to its end in place,
+	on pool if there is one or else on numThreads threads, or returns
+	false, having done nothing, if file is not mapped
+*/
+static bool countMapping(istream& file, uint64_t counts[NUM_BYTE_VALUES], int numThreads, WorkPool* pool,
+                         uint64_t& total)
+{
+	mapbuf* mapping = dynamic_cast<mapbuf*>(file.rdbuf());
+	if (mapping == NULL) return false;
+	streampos position = mapping->pubseekoff(0, ios::cur, ios::in);
+	if (position == streampos(-1)) return false;
+
+	size_t start = size_t(streamoff(position));
+	size_t length = (start < mapping->length() ? mapping->length() - start : 0);
+	const unsigned char* data = (const unsigned char*)mapping->data() + start;
+	if (pool != NULL) countBytesParallel(data, length, counts, *pool);
+	else countBytesParallel(data, length, counts, numThreads);
+	mapping->pubseekoff(0, ios::end, ios::in);
+	file.setstate(ios::eofbit | ios::failbit);
+	total = length;
+	return true;
+}
+
+/* Function: countBytes
+ * Usage: countBytes(file, counts);
+ * --------------------------------------------------------
+ * Reads the given stream to its end in large blocks and adds the
+ * number of times each byte value appears to counts.  Afterwards
+ * the stream is in the same state as after get() reaches the end
+ * of the file.  Returns the number of bytes read.  A mapping is
+ * counted without copying.
+ */
+uint64_t countBytes(istream& file, uint64_t counts[NUM_BYTE_VALUES])
+{
+	uint64_t total = 0;
+	if (countMapping(file, counts, 1, NULL, total)) return total;
+
+	streambuf* source = file.rdbuf();
+	char block[COUNT_BLOCK_SIZE];
+
+	while (source != NULL)
+	{
+		streamsize count = source->sgetn(block, sizeof block);
+		if (count <= 0) break;
+
+		countBytes((const unsigned char*) block, size_t(count), counts);
+		total += count;
+	}
+
+	file.setstate(ios::eofbit | ios::failbit);
+	return total;
+}
+
+/* Function: countBytesParallel
+ * Usage: countBytesParallel(data, length, counts, numThreads);
+ * --------------------------------------------------------
+ * Small blocks, and blocks counted from inside a pool's task, are
+ * counted on the calling thread alone.  One thread per processor
+ * means the shared pool, if no other count holds it.
+ */
+void countBytesParallel(const unsigned char* data, size_t length,
+                        uint64_t counts[NUM_BYTE_VALUES], int numThreads)
+{
+	if (length < MIN_PARALLEL_COUNT_BYTES || numThreads == 1 || WorkPool::isRunningTask())
+	{
+		countBytes(data, length, counts);
+		return;
+	}
+	if (numThreads != 0)
+	{
+		WorkPool pool(numThreads);
+		countInPool(pool, data, length, counts);
+		return;
+	}
+
+	WorkPool* pool = acquireSharedPool();
+	if (pool == NULL)
+	{
+		countBytes(data, length, counts);
+		return;
+	}
+	try
+	{
+		countInPool(*pool, data, length, counts);
+	}
+	catch (...)
+	{
+		releaseSharedPool();
+		throw;
+	}
+	releaseSharedPool();
+}
+
+/* Function: countBytesParallel
+ * Usage: countBytesParallel(data, length, counts, pool);
+ * --------------------------------------------------------
+ * Small blocks are counted on the calling thread alone.
+ */
+void countBytesParallel(const unsigned char* data, size_t length,
+                        uint64_t counts[NUM_BYTE_VALUES], WorkPool& pool)
+{
+	if (length < MIN_PARALLEL_COUNT_BYTES || pool.numThreads() == 1)
+	{
+		countBytes(data, length, counts);
+		return;
+	}
+	countInPool(pool, data, length, counts);
+}
+
+/*
+	Counts the rest of a stream that is not mapped, a batch of one
+	piece per thread of pool at a time
+*/
+static uint64_t countStreamInPool(istream& file, uint64_t counts[NUM_BYTE_VALUES], WorkPool& pool)
+{
+	streambuf* source = file.rdbuf();
+	size_t batchSize = PARALLEL_PIECE_SIZE * size_t(pool.numThreads());
+	std::vector<unsigned char> batch(PARALLEL_PIECE_SIZE); //grown once the stream turns out large
+	uint64_t total = 0;
+	while (source != NULL)
+	{
+		streamsize count = source->sgetn((char*)&batch[0], streamsize(batch.size()));
+		if (count <= 0) break;
+
+		countBytesParallel(&batch[0], size_t(count), counts, pool);
+		total += count;
+		if (size_t(count) == batch.size() && batch.size() < batchSize) batch.resize(batchSize);
+	}
+
+	file.setstate(ios::eofbit | ios::failbit);
+	return total;
+}
+
+/* Function: countBytesParallel
+ * Usage: countBytesParallel(file, counts, numThreads);
+ * --------------------------------------------------------
+ * A mapping is counted from the read position to its end without
+ * copying.  Other streams fill one buffer with a piece for every
+ * thread, count them together, and go on until the stream ends,
+ * all on one pool.
+ */
+uint64_t countBytesParallel(istream& file, uint64_t counts[NUM_BYTE_VALUES], int numThreads)
+{
+	uint64_t total = 0;
+	if (countMapping(file, counts, numThreads, NULL, total)) return total;
+	if (numThreads == 1 || WorkPool::isRunningTask()) return countBytes(file, counts);
+	if (numThreads != 0)
+	{
+		WorkPool pool(numThreads);
+		return countStreamInPool(file, counts, pool);
+	}
+
+	WorkPool* pool = acquireSharedPool();
+	if (pool == NULL) return countBytes(file, counts);
+	try
+	{
+		total = countStreamInPool(file, counts, *pool);
+	}
+	catch (...)
+	{
+		releaseSharedPool();
+		throw;
+	}
+	releaseSharedPool();
+	return total;
+}
+
+/* Function: countBytesParallel
+ * Usage: countBytesParallel(file, counts, pool);
+ * --------------------------------------------------------
+ * Works as the version above does, on the caller's pool.
+ */
+uint64_t countBytesParallel(istream& file, uint64_t counts[NUM_BYTE_VALUES], WorkPool& pool)
+{
+	uint64_t total = 0;
+	if (countMapping(file, counts, 0, &pool, total)) return total;
+	return countStreamInPool(file, counts, pool);
+}
+
+/* Function: sampleBytes
+ * Usage: uint64_t length = sampleBytes(file, counts, sampleEvery, blockSize);
+ * --------------------------------------------------------
+ * Seeks from one sampled block to the next through the stream
+ * buffer, then scales the sample by the share of the stream it
+ * covered, rounding up so that no sampled byte value ends up at
+ * zero.
+ */
+uint64_t sampleBytes(istream& file, uint64_t counts[NUM_BYTE_VALUES],
+                     int sampleEvery, int blockSize)
+{
+	if (sampleEvery < 1) error("Sampling must read at least one block in every sampleEvery.");
+	if (blockSize < 1) error("Sample blocks must hold at least one byte.");
+
+	streambuf* source = file.rdbuf();
+	if (source == NULL) error("Cannot sample a stream without a buffer.");
+	streampos start = source->pubseekoff(0, ios::cur, ios::in);
+	streampos end = source->pubseekoff(0, ios::end, ios::in);
+	if (start == streampos(-1) || end == streampos(-1)) error("Cannot sample a stream that cannot seek.");
+	uint64_t length = uint64_t(streamoff(end) - streamoff(start));
+
+	uint64_t sample[NUM_BYTE_VALUES] = { 0 };
+	uint64_t sampled = 0;
+	uint64_t stride = uint64_t(sampleEvery) * uint64_t(blockSize);
+	std::vector<char> block(blockSize);
+	for (uint64_t offset = 0; offset < length; offset += stride)
+	{
+		if (source->pubseekpos(start + streamoff(offset), ios::in) == streampos(-1)) break;
+		streamsize count = source->sgetn(&block[0], blockSize);
+		if (count <= 0) break;
+
+		countBytes((const unsigned char*) &block[0], size_t(count), sample);
+		sampled += count;
+	}
+
+	//the share of the stream the sample covered decides the scale
+	double scale = (sampled == 0) ? 0.0 : double(length) / double(sampled);
+	for (int ch = 0; ch < NUM_BYTE_VALUES; ch++)
+	{
+		if (sample[ch] == 0) continue;
+		uint64_t estimate = (sampled == length) ? sample[ch] : uint64_t(double(sample[ch]) * scale + 0.5);
+		counts[ch] += (estimate == 0) ? 1 : estimate;
+	}
+
+	source->pubseekoff(0, ios::end, ios::in);
+	file.setstate(ios::eofbit | ios::failbit);
+	return length;
+}
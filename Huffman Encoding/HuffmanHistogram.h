@@ -0,0 +1,121 @@
+/**********************************************************
+ * File: HuffmanHistogram.h
+ *
+ * Fast byte counting.  getFrequencyTable is built on top of
+ * these functions, which count into plain arrays instead of
+ * a Map so that counting runs at the speed of reading.  Large
+ * inputs can be counted on several threads, each counting its
+ * own range into a private table, with the tables added up at
+ * the end.
+ */
+
+#ifndef HuffmanHistogram_Included
+#define HuffmanHistogram_Included
+
+#include "HuffmanTypes.h"
+#include "WorkPool.h"
+#include <istream>
+using namespace std;
+
+/* Constant: NUM_BYTE_VALUES
+ * The number of distinct byte values, and so the size of a byte
+ * count array.
+ */
+const int NUM_BYTE_VALUES = 256;
+
+/* Function: countBytes
+ * Usage: countBytes(data, length, counts);
+ * --------------------------------------------------------
+ * Adds the number of times each byte value appears in the given
+ * memory block to counts, which is indexed by byte value.
+ */
+void countBytes(const unsigned char* data, size_t length,
+                uint64_t counts[NUM_BYTE_VALUES]);
+
+/* Function: countBytes
+ * Usage: countBytes(file, counts);
+ * --------------------------------------------------------
+ * Reads the given stream to its end in large blocks and adds the
+ * number of times each byte value appears to counts.  Afterwards
+ * the stream is in the same state as after get() reaches the end
+ * of the file.  Returns the number of bytes read.  A memory-mapped
+ * stream (see MappedFile.h) is counted in place.
+ */
+uint64_t countBytes(istream& file, uint64_t counts[NUM_BYTE_VALUES]);
+
+/* Constant: MIN_PARALLEL_COUNT_BYTES
+ * The least input countBytesParallel hands to more than one
+ * thread; below it, waking threads costs more than it saves.
+ */
+const size_t MIN_PARALLEL_COUNT_BYTES = 1 << 20;
+
+/* Function: countBytesParallel
+ * Usage: countBytesParallel(data, length, counts);
+ *        countBytesParallel(data, length, counts, numThreads);
+ *        countBytesParallel(data, length, counts, pool);
+ * --------------------------------------------------------
+ * Adds the same counts as countBytes, but splits the block into
+ * one range per thread and counts the ranges at the same time on
+ * numThreads threads, or on the threads of the caller's pool, which
+ * must not be running.  A numThreads of zero means one thread per
+ * processor, on a pool that every such call shares and that keeps
+ * its threads from one call to the next.  Blocks shorter than
+ * MIN_PARALLEL_COUNT_BYTES are counted on the calling thread, as
+ * countBytes does, and so are blocks counted while the shared pool
+ * is busy with another count and, unless a pool is passed in,
+ * blocks counted from inside a task of any WorkPool.
+ *
+ * compress and getFrequencyTable count on one thread; these are
+ * for callers that know their input is large.
+ */
+void countBytesParallel(const unsigned char* data, size_t length,
+                        uint64_t counts[NUM_BYTE_VALUES], int numThreads = 0);
+void countBytesParallel(const unsigned char* data, size_t length,
+                        uint64_t counts[NUM_BYTE_VALUES], WorkPool& pool);
+
+/* Function: countBytesParallel
+ * Usage: countBytesParallel(file, counts);
+ *        countBytesParallel(file, counts, numThreads);
+ *        countBytesParallel(file, counts, pool);
+ * --------------------------------------------------------
+ * Adds the same counts as countBytes for the rest of the stream,
+ * and leaves the stream in the same state.  A memory-mapped stream
+ * is counted in place; any other is read a megabyte per thread at
+ * a time, and each batch counted in parallel on the one pool.  The
+ * threads are chosen as above.  Returns the number of bytes read.
+ */
+uint64_t countBytesParallel(istream& file, uint64_t counts[NUM_BYTE_VALUES], int numThreads = 0);
+uint64_t countBytesParallel(istream& file, uint64_t counts[NUM_BYTE_VALUES], WorkPool& pool);
+
+/* Constant: DEFAULT_SAMPLE_EVERY
+ * How many blocks sampleBytes moves on for each block it reads by
+ * default, so that one byte in a hundred is read.
+ */
+const int DEFAULT_SAMPLE_EVERY = 100;
+
+/* Constant: SAMPLE_BLOCK_SIZE
+ * The size of the blocks sampleBytes reads by default.  Blocks this
+ * large keep the seeks between them cheap next to the reading.
+ */
+const int SAMPLE_BLOCK_SIZE = 65536;
+
+/* Function: sampleBytes
+ * Usage: uint64_t length = sampleBytes(file, counts);
+ *        uint64_t length = sampleBytes(file, counts, sampleEvery, blockSize);
+ * --------------------------------------------------------
+ * Estimates the counts of a seekable stream from the current
+ * position to its end without reading all of it: the stream is
+ * cut into blocks of blockSize bytes, only the first of every
+ * sampleEvery blocks is counted, and those counts are scaled up
+ * to the length of the whole stream and added to counts.  A byte
+ * value that was sampled gets an estimate of at least one, but
+ * one that only appears between the samples gets none.  The
+ * stream is left as countBytes leaves it.  Returns the exact
+ * number of bytes from the starting position to the end; a stream
+ * that is no longer than one block is simply counted.
+ */
+uint64_t sampleBytes(istream& file, uint64_t counts[NUM_BYTE_VALUES],
+                     int sampleEvery = DEFAULT_SAMPLE_EVERY,
+                     int blockSize = SAMPLE_BLOCK_SIZE);
+
+#endif
@@ -0,0 +1,381 @@
+/**********************************************************
+ * File: HuffmanOrder1.cpp
+ *
+ * Implementation of the order-1 context coding functions from
+ * HuffmanOrder1.h.
+ */
+
+#include "HuffmanOrder1.h"
+#include "HuffmanTables.h"
+#include "LittleEndian.h"
+#include "TableCache.h"
+#include "MemoryDiagnostics.h"
+#include "OutputBuffer.h"
+#include "error.h"
+#include <vector>
+#include <algorithm>
+
+/* The number of contexts: one for each value of the previous byte. */
+static const int NUM_CONTEXTS = 256;
+
+/* Size of the chunks the input is read in. */
+static const int ORDER1_CHUNK_SIZE = 65536;
+
+/* Type: ContextMap
+ * Which contexts occur, the table each one codes with, and the
+ * canonical code of every table.
+ */
+struct ContextMap {
+	bool used[NUM_CONTEXTS];
+	int table[NUM_CONTEXTS];
+	std::vector<CodeTable> tables;
+};
+
+/* Each decoder entry packs its symbol into the low SYMBOL_BITS bits
+ * and the length of its code above them, in 16 bits, so that the
+ * tables of every context take half the room of DecodeEntries.
+ */
+static const int SYMBOL_BITS = 9;
+static const uint16_t SYMBOL_MASK = (1 << SYMBOL_BITS) - 1;
+
+/* Type: ContextSlot
+ * What the decoder needs of the table of one context: its packed
+ * entries and the mask for its lookup width.
+ */
+struct ContextSlot {
+	const uint16_t* entries;
+	uint32_t mask;
+};
+
+/*
+	Counts every byte of infile under the byte before it, into counts,
+	which holds NUM_SYMBOLS weights for each context, and returns the
+	number of bytes.  Every context that occurs - context 0, where
+	coding starts, and every byte value in the file - is marked in
+	used and given a weight of one for PSEUDO_EOF
+*/
+static uint64_t countContexts(ibstream& infile, std::vector<uint64_t>& counts, bool used[NUM_CONTEXTS])
+{
+	MemoryCategoryScope scope(FREQUENCY_MEMORY);
+	counts.assign(NUM_CONTEXTS * NUM_SYMBOLS, 0);
+	uint64_t* rows = &counts[0];
+
+	streambuf* source = infile.rdbuf();
+	std::vector<char> buffer(ORDER1_CHUNK_SIZE);
+	uint64_t total = 0;
+	int previous = 0;
+	while (true)
+	{
+		streamsize count = source->sgetn(&buffer[0], ORDER1_CHUNK_SIZE);
+		if (count <= 0) break;
+
+		for (streamsize i = 0; i < count; i++)
+		{
+			int ch = (unsigned char)buffer[i];
+			rows[previous * NUM_SYMBOLS + ch]++;
+			previous = ch;
+		}
+		total += uint64_t(count);
+	}
+
+	for (int context = 0; context < NUM_CONTEXTS; context++)
+	{
+		used[context] = (context == 0);
+	}
+	for (int context = 0; context < NUM_CONTEXTS; context++)
+	{
+		for (int ch = 0; ch < NUM_CONTEXTS; ch++)
+		{
+			if (rows[context * NUM_SYMBOLS + ch] != 0) used[ch] = true;
+		}
+	}
+	for (int context = 0; context < NUM_CONTEXTS; context++)
+	{
+		if (used[context]) rows[context * NUM_SYMBOLS + PSEUDO_EOF] = 1;
+	}
+	return total;
+}
+
+/*
+	Returns how many bytes writeCodeLengthHeader takes for lengths
+*/
+static size_t codeLengthHeaderSize(const uint8_t lengths[NUM_SYMBOLS])
+{
+	ostringbstream header;
+	writeCodeLengthHeader(header, lengths);
+	return header.str().size();
+}
+
+/*
+	Decides which contexts get a table of their own and fills in map.
+	A context gets one if its bytes coded with it, plus its code length
+	header, take fewer bits than coding them with the code of every
+	context together; the rest share a code built from their bytes
+	alone, which is table 0.  If more contexts would have their own
+	than MAX_ORDER1_TABLES allows, those that save the fewest bits
+	share instead.  The own tables follow in context order.  Returns
+	the number of bits the data will take.
+*/
+static uint64_t chooseTables(const std::vector<uint64_t>& counts, ContextMap& map)
+{
+	MemoryCategoryScope scope(TABLE_MEMORY);
+	const uint64_t* rows = &counts[0];
+
+	uint64_t shared[NUM_SYMBOLS] = { 0 };
+	for (int context = 0; context < NUM_CONTEXTS; context++)
+	{
+		if (!map.used[context]) continue;
+		for (int ch = 0; ch < NUM_SYMBOLS; ch++)
+		{
+			shared[ch] += rows[context * NUM_SYMBOLS + ch];
+		}
+	}
+	uint8_t sharedLengths[NUM_SYMBOLS];
+	buildLimitedCodeLengths(shared, DEFAULT_MAX_CODE_LENGTH, sharedLengths);
+
+	//first pass: own table or the code of the whole file
+	std::vector<CodeTable> own(NUM_CONTEXTS);
+	bool hasOwn[NUM_CONTEXTS];
+	bool anyShared = false;
+	std::vector<std::pair<uint64_t, int> > savings; //bits saved, and by which context
+	for (int context = 0; context < NUM_CONTEXTS; context++)
+	{
+		hasOwn[context] = false;
+		if (!map.used[context]) continue;
+
+		const uint64_t* row = rows + context * NUM_SYMBOLS;
+		buildLimitedCodeLengths(row, DEFAULT_MAX_CODE_LENGTH, own[context].length);
+		uint64_t ownBits = encodedBits(row, own[context].length) + 8 * codeLengthHeaderSize(own[context].length);
+		uint64_t sharedBits = encodedBits(row, sharedLengths);
+		hasOwn[context] = (ownBits < sharedBits);
+		if (hasOwn[context]) savings.push_back(std::make_pair(sharedBits - ownBits, context));
+		else anyShared = true;
+	}
+
+	//past the limit, the contexts that save least share, leaving room for the shared code
+	if (savings.size() > size_t(MAX_ORDER1_TABLES))
+	{
+		std::sort(savings.begin(), savings.end());
+		for (size_t i = 0; i + (MAX_ORDER1_TABLES - 1) < savings.size(); i++)
+		{
+			hasOwn[savings[i].second] = false;
+		}
+		anyShared = true;
+	}
+	else if (anyShared && savings.size() == size_t(MAX_ORDER1_TABLES))
+	{
+		std::sort(savings.begin(), savings.end());
+		hasOwn[savings[0].second] = false;
+	}
+
+	//second pass: the shared code only needs to suit the contexts left
+	map.tables.clear();
+	if (anyShared)
+	{
+		for (int ch = 0; ch < NUM_SYMBOLS; ch++)
+		{
+			shared[ch] = 0;
+		}
+		for (int context = 0; context < NUM_CONTEXTS; context++)
+		{
+			if (!map.used[context] || hasOwn[context]) continue;
+			for (int ch = 0; ch < NUM_SYMBOLS; ch++)
+			{
+				shared[ch] += rows[context * NUM_SYMBOLS + ch];
+			}
+		}
+		map.tables.push_back(CodeTable());
+		buildLimitedCodeLengths(shared, DEFAULT_MAX_CODE_LENGTH, map.tables.back().length);
+	}
+
+	uint64_t totalBits = 0;
+	for (int context = 0; context < NUM_CONTEXTS; context++)
+	{
+		map.table[context] = 0;
+		if (!map.used[context]) continue;
+		if (hasOwn[context])
+		{
+			map.table[context] = int(map.tables.size());
+			map.tables.push_back(own[context]);
+		}
+		totalBits += encodedBits(rows + context * NUM_SYMBOLS, map.tables[map.table[context]].length);
+	}
+
+	for (size_t t = 0; t < map.tables.size(); t++)
+	{
+		buildCanonicalCodeTable(map.tables[t].length, map.tables[t]);
+	}
+	return totalBits;
+}
+
+/*
+	Returns the number of bits a table number takes in the context map
+	for numTables tables
+*/
+static int tableIndexBits(int numTables)
+{
+	int bits = 0;
+	while ((1 << bits) < numTables) bits++;
+	return bits;
+}
+
+/*
+	Writes the context map and the code length header of every table,
+	as HuffmanOrder1.h lays them out
+*/
+static void writeContextMap(obstream& outfile, const ContextMap& map)
+{
+	int numTables = int(map.tables.size());
+	int indexBits = tableIndexBits(numTables);
+
+	bool wasBuffering = outfile.isBitBuffering();
+	outfile.setBitBuffering(true);
+	outfile.writeBits(numTables - 1, 8);
+	for (int context = 0; context < NUM_CONTEXTS; context++)
+	{
+		outfile.writeBits(map.used[context] ? 1 : 0, 1);
+	}
+	for (int context = 0; context < NUM_CONTEXTS; context++)
+	{
+		if (map.used[context] && indexBits > 0) outfile.writeBits(map.table[context], indexBits);
+	}
+	outfile.flushBits();
+	outfile.setBitBuffering(wasBuffering);
+
+	for (int t = 0; t < numTables; t++)
+	{
+		writeCodeLengthHeader(outfile, map.tables[t].length);
+	}
+}
+
+/* Function: compressOrder1
+ * Usage: compressOrder1(infile, outfile);
+ * --------------------------------------------------------
+ * Counts the bytes by context, chooses the tables, and then codes
+ * every byte with the table of the byte before it.
+ */
+void compressOrder1(ibstream& infile, obstream& outfile)
+{
+	std::vector<uint64_t> counts;
+	ContextMap map;
+	uint64_t rawBytes = countContexts(infile, counts, map.used);
+	uint64_t totalBits = chooseTables(counts, map);
+
+	MemoryCategoryScope scope(CODING_MEMORY);
+	ostringbstream header;
+	writeContextMap(header, map);
+	string headerBytes = header.str();
+
+	infile.rewind();
+	if (!isWorthCoding(rawBytes, headerBytes.size(), totalBits))
+	{
+		writeContainerVersion(outfile, STORED_CONTAINER, true);
+		writeStoredLength(outfile, rawBytes);
+		uint32_t checksum = 0;
+		copyStored(infile, outfile, rawBytes, &checksum);
+		writeUint32(outfile, checksum);
+		return;
+	}
+	writeContainerVersion(outfile, ORDER1_CONTAINER);
+	outfile.write(headerBytes.data(), headerBytes.size());
+
+	const CodeTable* codeFor[NUM_CONTEXTS];
+	for (int context = 0; context < NUM_CONTEXTS; context++)
+	{
+		codeFor[context] = &map.tables[map.table[context]];
+	}
+
+	bool wasBuffering = outfile.isBitBuffering();
+	outfile.setBitBuffering(true);
+	streambuf* source = infile.rdbuf();
+	std::vector<char> buffer(ORDER1_CHUNK_SIZE);
+	const CodeTable* code = codeFor[0];
+	while (true)
+	{
+		streamsize count = source->sgetn(&buffer[0], ORDER1_CHUNK_SIZE);
+		if (count <= 0) break;
+
+		for (streamsize i = 0; i < count; i++)
+		{
+			int ch = (unsigned char)buffer[i];
+			outfile.writeBits(code->bits[ch], code->length[ch]);
+			code = codeFor[ch];
+		}
+	}
+	outfile.writeBits(code->bits[PSEUDO_EOF], code->length[PSEUDO_EOF]);
+	outfile.flushBits();
+	outfile.setBitBuffering(wasBuffering);
+}
+
+/* Function: decodeOrder1Container
+ * Usage: decodeOrder1Container(infile, outfile);
+ * --------------------------------------------------------
+ * Reads the context map and tables, then decodes with one lookup
+ * per byte, the decoded byte picking the slot of the next lookup.
+ */
+void decodeOrder1Container(ibstream& infile, ostream& outfile)
+{
+	MemoryCategoryScope scope(CODING_MEMORY);
+	bool wasBuffering = infile.isBitBuffering();
+	infile.setBitBuffering(true);
+	int numTables = int(infile.readBits(8)) + 1;
+	if (numTables > MAX_ORDER1_TABLES) error("Order-1 container has too many code tables.");
+	int indexBits = tableIndexBits(numTables);
+	bool used[NUM_CONTEXTS];
+	for (int context = 0; context < NUM_CONTEXTS; context++)
+	{
+		used[context] = (infile.readBits(1) != 0);
+	}
+	int table[NUM_CONTEXTS] = { 0 };
+	for (int context = 0; context < NUM_CONTEXTS; context++)
+	{
+		if (used[context] && indexBits > 0) table[context] = int(infile.readBits(indexBits));
+		if (table[context] >= numTables) error("Context map is damaged.");
+	}
+	if (infile.fail()) error("Context map is cut off.");
+	infile.setBitBuffering(false);
+
+	//every table packed one after another, each as wide as its longest code
+	std::vector<uint16_t> packed;
+	std::vector<size_t> start(numTables);
+	std::vector<int> lookupBits(numTables);
+	for (int t = 0; t < numTables; t++)
+	{
+		uint8_t lengths[NUM_SYMBOLS];
+		readCodeLengthHeader(infile, lengths);
+		DecodeTable code;
+		buildCachedDecodeTable(lengths, code);
+		if (!code.subtables.empty()) error("Code table is too long for order-1 coding.");
+
+		start[t] = packed.size();
+		lookupBits[t] = code.lookupBits;
+		for (size_t i = 0; i < (size_t(1) << code.lookupBits); i++)
+		{
+			packed.push_back(uint16_t(code.entries[i].symbol | (code.entries[i].length << SYMBOL_BITS)));
+		}
+	}
+
+	ContextSlot slots[NUM_CONTEXTS];
+	for (int context = 0; context < NUM_CONTEXTS; context++)
+	{
+		slots[context].entries = &packed[start[table[context]]];
+		slots[context].mask = (uint32_t(1) << lookupBits[table[context]]) - 1;
+	}
+
+	infile.setBitBuffering(true);
+	OutputBuffer output(outfile);
+	const ContextSlot* slot = &slots[0];
+	while (true)
+	{
+		uint16_t entry = slot->entries[uint32_t(infile.peekBits(DEFAULT_DECODE_BITS)) & slot->mask];
+		infile.skipBits(entry >> SYMBOL_BITS);
+		if (infile.fail()) error("Encoded data ended before PSEUDO_EOF.");
+		int symbol = entry & SYMBOL_MASK;
+		if (symbol == PSEUDO_EOF) break;
+
+		output.put(char(symbol));
+		slot = &slots[symbol];
+	}
+	output.flush();
+	infile.setBitBuffering(wasBuffering);
+}
@@ -0,0 +1,68 @@
+/**********************************************************
+ * File: HuffmanOrder1.h
+ *
+ * Order-1 context coding.  In text and logs the byte before
+ * says a great deal about the next one - after 'q' comes 'u',
+ * after a space a capital or a common first letter - so a code
+ * chosen by the previous byte is much shorter than one code for
+ * the whole file.  Up to MAX_ORDER1_TABLES codes are kept, one
+ * per context, but a context with few bytes after it would cost
+ * more in its header than it saves, so such contexts share one
+ * common code, as do those that save the least when there would
+ * be more tables than that.
+ *
+ * An ORDER1_CONTAINER holds the magic and version, then a
+ * context map, packed least significant bit first:
+ *
+ *   8 bits    the number of code tables, less one
+ *   256 bits  for each context, whether it is ever used
+ *   n bits    for each used context, its table number, with n
+ *             just wide enough for the largest table number
+ *
+ * padded to a whole byte, then the code length header (see
+ * writeCodeLengthHeader) of each table, then the encoded bits
+ * ending in PSEUDO_EOF.  Coding starts in context 0, and every
+ * table has a code for PSEUDO_EOF.
+ *
+ * No code is longer than DEFAULT_MAX_CODE_LENGTH, so each table
+ * decodes in one lookup no wider than its own longest code, and
+ * the decoder moves from one context to the next by indexing an
+ * array with the byte it just decoded.  Decoder entries take 16
+ * bits, so even MAX_ORDER1_TABLES tables of the longest codes fit
+ * in 256 KB of second-level cache; text typically needs about 60
+ * tables, many of them narrower.
+ */
+
+#ifndef HuffmanOrder1_Included
+#define HuffmanOrder1_Included
+
+#include "HuffmanEncoding.h"
+
+/* Constant: MAX_ORDER1_TABLES
+ * The most code tables an ORDER1_CONTAINER may hold, the shared
+ * one included.  The decoder rejects a container with more, so
+ * that no file can make it build more than 256 KB of tables.
+ */
+const int MAX_ORDER1_TABLES = 64;
+
+/* Function: compressOrder1
+ * Usage: compressOrder1(infile, outfile);
+ * --------------------------------------------------------
+ * Compresses infile into outfile as an ORDER1_CONTAINER, or as a
+ * STORED_CONTAINER if coding would not shrink it.  Like compress,
+ * it reads infile twice, so infile must be rewindable.
+ * compress(infile, outfile, ORDER1_MODE) calls this.
+ */
+void compressOrder1(ibstream& infile, obstream& outfile);
+
+/* Function: decodeOrder1Container
+ * Usage: decodeOrder1Container(infile, outfile);
+ * --------------------------------------------------------
+ * Decodes an ORDER1_CONTAINER whose magic and version have
+ * already been read, writing the original data to outfile.
+ * Raises an error if the data is damaged.  decompress calls this
+ * for every ORDER1_CONTAINER.
+ */
+void decodeOrder1Container(ibstream& infile, ostream& outfile);
+
+#endif
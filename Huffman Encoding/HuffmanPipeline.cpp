@@ -0,0 +1,310 @@
+/**********************************************************
+ * File: HuffmanPipeline.cpp
+ *
+ * Implementation of the PipelinedCompression class and
+ * compressPipelined from HuffmanPipeline.h.
+ */
+
+#include "HuffmanPipeline.h"
+#include "MemoryDiagnostics.h"
+#include "error.h"
+
+/* Size of a block record before its data: type and two sizes. */
+static const int BLOCK_RECORD_BYTES = 1 + 4 + 4;
+
+/* Constructor: PipelinedCompression
+ * ----------------------------------------------------
+ * Sets up the ring of slots, then starts the reader, the encoders
+ * and the writer.  Every count is in place before the first thread
+ * starts, since the threads read them straight away.
+ */
+PipelinedCompression::PipelinedCompression(istream& infile, obstream& outfile, int blockSize,
+                                           int numThreads, int maxBlocks,
+                                           PipelineCallback callback, void* data)
+	: infile(infile), outfile(outfile), blockSize(blockSize), callback(callback),
+	  callbackData(data), joined(false), nextRead(0), nextEncode(0), nextWrite(0),
+	  inputDone(false), stagesLeft(0), hasFailed(false), readCount(0), writeCount(0) {
+	if (blockSize < 1 || blockSize > MAX_BLOCK_SIZE) error("Block size must be between 1 byte and 1 GiB.");
+	if (numThreads < 0) error("Number of threads cannot be negative.");
+	if (maxBlocks < 0) error("Number of blocks held cannot be negative.");
+	if (numThreads == 0) numThreads = hardwareThreads();
+	if (maxBlocks == 0) maxBlocks = 2 * numThreads;
+
+	Slot empty;
+	empty.state = FREE_SLOT;
+	empty.type = HUFFMAN_BLOCK;
+	slots.assign(maxBlocks, empty);
+
+	stagesLeft = numThreads + 2;
+	threads.push_back(fork(runReader, *this));
+	for (int i = 0; i < numThreads; i++) {
+		threads.push_back(fork(runEncoder, *this));
+	}
+	threads.push_back(fork(runWriter, *this));
+}
+
+/* Destructor: ~PipelinedCompression
+ * ----------------------------------------------------
+ * Joins the threads, which still point at this object.
+ */
+PipelinedCompression::~PipelinedCompression() {
+	joinAll();
+}
+
+/* Member function: wait
+ * ----------------------------------------------------
+ * Joins the threads and raises any error they left behind.
+ */
+void PipelinedCompression::wait() {
+	joinAll();
+	if (hasFailed) error(failure);
+}
+
+/* Member function: isDone
+ * ----------------------------------------------------
+ * Checks whether every stage has finished.
+ */
+bool PipelinedCompression::isDone() {
+	bool done = false;
+	synchronized (lock) {
+		done = (stagesLeft == 0);
+	}
+	return done;
+}
+
+/* Member function: failed
+ * ----------------------------------------------------
+ * Reads the failure flag under the lock.
+ */
+bool PipelinedCompression::failed() {
+	bool result = false;
+	synchronized (lock) {
+		result = hasFailed;
+	}
+	return result;
+}
+
+/* Member function: message
+ * ----------------------------------------------------
+ * Returns the first error raised by any stage, if any.
+ */
+string PipelinedCompression::message() {
+	string result;
+	synchronized (lock) {
+		result = failure;
+	}
+	return result;
+}
+
+/* Member function: bytesRead
+ * ----------------------------------------------------
+ * Reads the input count under the lock.
+ */
+uint64_t PipelinedCompression::bytesRead() {
+	uint64_t result = 0;
+	synchronized (lock) {
+		result = readCount;
+	}
+	return result;
+}
+
+/* Member function: bytesWritten
+ * ----------------------------------------------------
+ * Reads the output count under the lock.
+ */
+uint64_t PipelinedCompression::bytesWritten() {
+	uint64_t result = 0;
+	synchronized (lock) {
+		result = writeCount;
+	}
+	return result;
+}
+
+/* Member function: runReader
+ * ----------------------------------------------------
+ * Thread body: reads each block into the next slot once the writer
+ * has freed it.  Only the reader touches a slot between the writer
+ * freeing it and the reader handing it on, so the reading itself
+ * happens outside the lock.
+ */
+void PipelinedCompression::runReader(PipelinedCompression& pipeline) {
+	MemoryCategoryScope scope(BLOCK_MEMORY);
+	try {
+		while (true) {
+			Slot* slot = NULL;
+			synchronized (pipeline.lock) {
+				while (!pipeline.hasFailed &&
+				       pipeline.nextRead - pipeline.nextWrite >= pipeline.slots.size()) {
+					pipeline.lock.wait();
+				}
+				if (!pipeline.hasFailed) {
+					slot = &pipeline.slots[size_t(pipeline.nextRead % pipeline.slots.size())];
+				}
+			}
+			if (slot == NULL) break;
+
+			bool more = readBlock(pipeline.infile, pipeline.blockSize, slot->input);
+			synchronized (pipeline.lock) {
+				if (more) {
+					slot->state = READ_SLOT;
+					pipeline.nextRead++;
+					pipeline.readCount += slot->input.size();
+				} else {
+					pipeline.inputDone = true;
+				}
+				pipeline.lock.signal();
+			}
+			if (!more) break;
+		}
+	} catch (ErrorException& ex) {
+		pipeline.fail(ex.getMessage());
+	}
+	pipeline.finishStage();
+}
+
+/* Member function: runEncoder
+ * ----------------------------------------------------
+ * Thread body: takes the oldest block that has been read but not
+ * yet taken, encodes it outside the lock, and marks it encoded,
+ * until the input has ended and every block has been taken.
+ */
+void PipelinedCompression::runEncoder(PipelinedCompression& pipeline) {
+	MemoryCategoryScope scope(BLOCK_MEMORY);
+	try {
+		while (true) {
+			Slot* slot = NULL;
+			synchronized (pipeline.lock) {
+				while (!pipeline.hasFailed && !pipeline.inputDone &&
+				       pipeline.nextEncode == pipeline.nextRead) {
+					pipeline.lock.wait();
+				}
+				if (!pipeline.hasFailed && pipeline.nextEncode < pipeline.nextRead) {
+					slot = &pipeline.slots[size_t(pipeline.nextEncode % pipeline.slots.size())];
+					slot->state = ENCODING_SLOT;
+					pipeline.nextEncode++;
+				}
+			}
+			if (slot == NULL) break;
+
+			BlockType type = encodeBlock(HUFFMAN_BLOCK, slot->input, slot->output);
+			synchronized (pipeline.lock) {
+				slot->type = type;
+				slot->state = ENCODED_SLOT;
+				pipeline.lock.signal();
+			}
+		}
+	} catch (ErrorException& ex) {
+		pipeline.fail(ex.getMessage());
+	}
+	pipeline.finishStage();
+}
+
+/* Member function: runWriter
+ * ----------------------------------------------------
+ * Thread body: writes the container in input order, waiting for
+ * each block in turn to be encoded and freeing its slot once it is
+ * written, then finishes the container once the last block is out.
+ */
+void PipelinedCompression::runWriter(PipelinedCompression& pipeline) {
+	MemoryCategoryScope scope(BLOCK_MEMORY);
+	try {
+		std::vector<BlockIndexEntry> index;
+		writeContainerVersion(pipeline.outfile, BLOCK_CONTAINER);
+		synchronized (pipeline.lock) {
+			pipeline.writeCount = (sizeof CONTAINER_MAGIC - 1) + 1;
+		}
+
+		bool finished = false;
+		while (true) {
+			Slot* slot = NULL;
+			synchronized (pipeline.lock) {
+				while (!pipeline.hasFailed &&
+				       !(pipeline.inputDone && pipeline.nextWrite == pipeline.nextRead) &&
+				       !(pipeline.nextWrite < pipeline.nextRead &&
+				         pipeline.slots[size_t(pipeline.nextWrite % pipeline.slots.size())].state == ENCODED_SLOT)) {
+					pipeline.lock.wait();
+				}
+				if (!pipeline.hasFailed) {
+					if (pipeline.nextWrite == pipeline.nextRead) {
+						finished = true;
+					} else {
+						slot = &pipeline.slots[size_t(pipeline.nextWrite % pipeline.slots.size())];
+					}
+				}
+			}
+			if (slot == NULL) break;
+
+			writeBlockRecord(pipeline.outfile, slot->type, slot->input.size(), slot->output, index);
+			synchronized (pipeline.lock) {
+				pipeline.writeCount += BLOCK_RECORD_BYTES + slot->output.size();
+				slot->state = FREE_SLOT;
+				pipeline.nextWrite++;
+				pipeline.lock.signal();
+			}
+		}
+
+		if (finished) {
+			writeBlockIndex(pipeline.outfile, index);
+			pipeline.outfile.flush();
+			if (pipeline.outfile.fail()) error("Cannot finish writing the compressed data.");
+			synchronized (pipeline.lock) {
+				pipeline.writeCount += 1 + 8 * index.size() + 4;
+			}
+		}
+	} catch (ErrorException& ex) {
+		pipeline.fail(ex.getMessage());
+	}
+	pipeline.finishStage();
+}
+
+/* Member function: fail
+ * ----------------------------------------------------
+ * Keeps the first reason given and wakes every stage, so that they
+ * all see the failure and stop.
+ */
+void PipelinedCompression::fail(const string& why) {
+	synchronized (lock) {
+		if (!hasFailed) {
+			hasFailed = true;
+			failure = why;
+		}
+		lock.signal();
+	}
+}
+
+/* Member function: finishStage
+ * ----------------------------------------------------
+ * Counts one thread finished; the last one calls the callback.
+ */
+void PipelinedCompression::finishStage() {
+	bool last = false;
+	synchronized (lock) {
+		last = (--stagesLeft == 0);
+		lock.signal();
+	}
+	if (last && callback != NULL) callback(callbackData, *this);
+}
+
+/* Member function: joinAll
+ * ----------------------------------------------------
+ * Joins every thread, once.
+ */
+void PipelinedCompression::joinAll() {
+	if (joined) return;
+	for (size_t i = 0; i < threads.size(); i++) {
+		join(threads[i]);
+	}
+	joined = true;
+}
+
+/* Function: compressPipelined
+ * Usage: compressPipelined(infile, outfile, blockSize, numThreads, maxBlocks);
+ * --------------------------------------------------------
+ * Starts a pipeline and waits for it.
+ */
+void compressPipelined(istream& infile, obstream& outfile, int blockSize, int numThreads,
+                       int maxBlocks)
+{
+	PipelinedCompression compression(infile, outfile, blockSize, numThreads, maxBlocks);
+	compression.wait();
+}
@@ -0,0 +1,161 @@
+/**********************************************************
+ * File: HuffmanPipeline.h
+ *
+ * Pipelined compression of a single stream.  compressBlocks
+ * reads a batch of blocks, encodes the batch, writes it, and
+ * only then reads again, so the disk waits for the processors
+ * and the processors wait for the disk.  Here the three stages
+ * run on threads of their own and overlap:
+ *
+ *   reader    reads blocks of the input into free slots
+ *   encoders  count and encode the blocks that have been read
+ *             (see encodeBlock), several at once
+ *   writer    writes the encoded blocks out in input order and
+ *             frees their slots
+ *
+ * The slots are a fixed ring, so the reader stops when it gets
+ * a ring ahead of the writer, and memory stays bounded however
+ * large the input is.  The output is the same BLOCK_CONTAINER
+ * that compressBlocks writes.
+ */
+
+#ifndef HuffmanPipeline_Included
+#define HuffmanPipeline_Included
+
+#include "HuffmanBlocks.h"
+#include "thread.h"
+#include <string>
+#include <vector>
+using namespace std;
+
+class PipelinedCompression;
+
+/* Type: PipelineCallback
+ * A function called once a pipelined compression has finished,
+ * with the data given when it was started and the compression
+ * itself, whose failed and message tell how it went.  It runs on
+ * one of the pipeline's threads and must not call wait.
+ */
+typedef void (*PipelineCallback)(void* data, PipelinedCompression& compression);
+
+/* Class: PipelinedCompression
+ * One compression running in the background.  It starts as soon
+ * as it is made; wait blocks until it is done, the way a future
+ * would, and a callback can be given instead of, or as well as,
+ * waiting.  The streams belong to the pipeline until it is done.
+ */
+class PipelinedCompression {
+public:
+	/* Constructor: PipelinedCompression
+	 * Usage: PipelinedCompression compression(infile, outfile);
+	 *        PipelinedCompression compression(infile, outfile, blockSize, numThreads,
+	 *                                         maxBlocks, callback, data);
+	 * ----------------------------------------------------
+	 * Starts compressing infile into outfile in blocks of blockSize
+	 * bytes, encoding on numThreads threads besides the reader and
+	 * writer; zero means one per processor.  At most maxBlocks blocks
+	 * of input and output are held at once, zero meaning two for each
+	 * encoder.  callback, if not NULL, is called with data when the
+	 * compression has finished.
+	 */
+	PipelinedCompression(istream& infile, obstream& outfile,
+	                     int blockSize = DEFAULT_BLOCK_SIZE, int numThreads = 0,
+	                     int maxBlocks = 0, PipelineCallback callback = NULL,
+	                     void* data = NULL);
+
+	/* Destructor: ~PipelinedCompression
+	 * ----------------------------------------------------
+	 * Waits for the compression to finish, without raising its error.
+	 */
+	~PipelinedCompression();
+
+	/* Member function: wait
+	 * Usage: compression.wait();
+	 * ----------------------------------------------------
+	 * Blocks until the compression has finished, then raises its
+	 * error if it failed.  Later calls return at once, raising the
+	 * same error again.
+	 */
+	void wait();
+
+	/* Member function: isDone
+	 * Usage: if (compression.isDone()) ...
+	 * ----------------------------------------------------
+	 * Returns whether the compression has finished, without waiting.
+	 */
+	bool isDone();
+
+	/* Member function: failed
+	 * Usage: if (compression.failed()) ...
+	 * ----------------------------------------------------
+	 * Returns whether the compression has failed so far; message
+	 * tells why.
+	 */
+	bool failed();
+	string message();
+
+	/* Member function: bytesRead
+	 * Usage: uint64_t done = compression.bytesRead();
+	 * ----------------------------------------------------
+	 * Returns how many bytes of input have been read so far, and
+	 * bytesWritten how many bytes of output have been written.
+	 */
+	uint64_t bytesRead();
+	uint64_t bytesWritten();
+
+private:
+	/* Not copyable, since its threads point back at it. */
+	PipelinedCompression(const PipelinedCompression&);
+	PipelinedCompression& operator=(const PipelinedCompression&);
+
+	/* What a slot holds, in the order it holds them. */
+	enum SlotState { FREE_SLOT, READ_SLOT, ENCODING_SLOT, ENCODED_SLOT };
+
+	struct Slot {
+		SlotState state;
+		BlockType type;
+		string input;
+		string output;
+	};
+
+	static void runReader(PipelinedCompression& pipeline);
+	static void runEncoder(PipelinedCompression& pipeline);
+	static void runWriter(PipelinedCompression& pipeline);
+	void fail(const string& why);
+	void finishStage();
+	void joinAll();
+
+	istream& infile;
+	obstream& outfile;
+	int blockSize;
+	PipelineCallback callback;
+	void* callbackData;
+	vector<Thread> threads;
+	bool joined;
+
+	Lock lock;              /* guards everything below; signalled on every change */
+	vector<Slot> slots;     /* block n is in slot n % slots.size() */
+	uint64_t nextRead;      /* blocks read so far */
+	uint64_t nextEncode;    /* blocks handed to encoders so far */
+	uint64_t nextWrite;     /* blocks written so far */
+	bool inputDone;
+	int stagesLeft;         /* threads that have not yet finished */
+	bool hasFailed;
+	string failure;
+	uint64_t readCount;
+	uint64_t writeCount;
+};
+
+/* Function: compressPipelined
+ * Usage: compressPipelined(infile, outfile);
+ *        compressPipelined(infile, outfile, blockSize, numThreads, maxBlocks);
+ * --------------------------------------------------------
+ * Compresses infile into outfile as a PipelinedCompression would
+ * and waits for it, raising its error if it fails.  The result is
+ * the same as that of compressBlocks with the same block size.
+ */
+void compressPipelined(istream& infile, obstream& outfile,
+                       int blockSize = DEFAULT_BLOCK_SIZE, int numThreads = 0,
+                       int maxBlocks = 0);
+
+#endif
@@ -0,0 +1,322 @@
+/**********************************************************
+ * File: HuffmanPresets.cpp
+ *
+ * Implementation of the preset functions from HuffmanPresets.h.
+ */
+
+#include "HuffmanPresets.h"
+#include "HuffmanTables.h"
+#include "MemoryDiagnostics.h"
+#include "error.h"
+#include "strlib.h"
+#include <cstring>
+#include <algorithm>
+
+/* Constant: ENGLISH_TEXT_LENGTHS
+ * The code length of every ext_char in ENGLISH_TEXT_PRESET, sixteen
+ * byte values to a line and PSEUDO_EOF last.  They are the lengths
+ * buildLimitedCodeLengths gives with DEFAULT_MAX_CODE_LENGTH to the
+ * byte counts of test/encodeDecode/tomSawyer and poem together, with
+ * every byte value and PSEUDO_EOF counted at least once, so that
+ * anything can be coded.  Changing them changes the preset and
+ * breaks every message already written with it.
+ */
+static const uint8_t ENGLISH_TEXT_LENGTHS[NUM_SYMBOLS] = {
+	11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 6, 11, 11, 11, 11, 11,
+	11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11,
+	3, 9, 7, 11, 11, 11, 11, 7, 11, 11, 11, 11, 6, 8, 7, 11,
+	11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 9, 11, 11, 11, 10,
+	11, 9, 10, 11, 11, 11, 11, 11, 9, 8, 11, 11, 11, 11, 10, 10,
+	11, 11, 11, 9, 8, 11, 11, 10, 11, 11, 11, 11, 11, 11, 11, 11,
+	11, 4, 6, 6, 5, 4, 6, 6, 4, 5, 10, 7, 5, 6, 4, 4,
+	6, 11, 5, 5, 4, 6, 7, 6, 10, 6, 11, 11, 11, 11, 11, 11,
+	11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11,
+	11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11,
+	11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11,
+	11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11,
+	11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11,
+	11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11,
+	11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11,
+	11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11,
+	11
+};
+
+/* Type: PresetTraits
+ * What is known about each preset when the program is built: its
+ * code lengths and its longest code, which sizes the templated
+ * encoder and decoder loops below.
+ */
+template <int PRESET>
+struct PresetTraits;
+
+template <>
+struct PresetTraits<ENGLISH_TEXT_PRESET> {
+	enum { MAX_LENGTH = 11 };
+	static const uint8_t* lengths() { return ENGLISH_TEXT_LENGTHS; }
+};
+
+/*
+	Fills in dictionary from the code lengths of PRESET, with a primary
+	decode table exactly as wide as its longest code
+*/
+template <int PRESET>
+static void buildPreset(HuffmanDictionary& dictionary)
+{
+	MemoryCategoryScope scope(TABLE_MEMORY);
+	dictionary.id = PRESET;
+	memcpy(dictionary.codes.length, PresetTraits<PRESET>::lengths(), NUM_SYMBOLS);
+	buildCanonicalCodeTable(dictionary.codes.length, dictionary.codes);
+	buildDecodeTable(dictionary.codes, dictionary.decoder, PresetTraits<PRESET>::MAX_LENGTH);
+
+	dictionary.maxCodeLength = 0;
+	for (int ch = 0; ch < NUM_SYMBOLS; ch++)
+	{
+		dictionary.maxCodeLength = max(dictionary.maxCodeLength, int(dictionary.codes.length[ch]));
+	}
+}
+
+/* Type: PresetTables
+ * The tables of every preset.  They are built once, before main
+ * runs, and only read after that, so any thread can use them
+ * without locking.
+ */
+struct PresetTables {
+	HuffmanDictionary english;
+
+	PresetTables()
+	{
+		buildPreset<ENGLISH_TEXT_PRESET>(english);
+	}
+};
+
+static const PresetTables gPresetTables;
+
+/*
+	Encodes length bytes from data, followed by PSEUDO_EOF, into output
+	starting at index start, and returns the index just past the last
+	byte written.  Every code is at most MAX_LENGTH bits, so groups of
+	codes that fit above the bits left over from the last store are
+	gathered without checking, and the register is stored eight bytes
+	at a time.  output must have room for eight bytes past the end.
+*/
+template <int MAX_LENGTH>
+static size_t encodePresetBytes(const uint8_t* data, size_t length, const CodeTable& codes,
+                                std::vector<uint8_t>& output, size_t start)
+{
+	const int GROUP = 56 / MAX_LENGTH; //at most 7 bits are left after a store
+	uint8_t* out = &output[0];
+	size_t pos = start;
+	uint64_t bitBuffer = 0;
+	int bitCount = 0;
+
+	size_t i = 0;
+	for (; i + GROUP <= length; i += GROUP)
+	{
+		for (int k = 0; k < GROUP; k++)
+		{
+			bitBuffer |= codes.bits[data[i + k]] << bitCount;
+			bitCount += codes.length[data[i + k]];
+		}
+		for (int k = 0; k < 8; k++)
+		{
+			out[pos + k] = uint8_t(bitBuffer >> (8 * k));
+		}
+		pos += bitCount >> 3;
+		bitBuffer >>= bitCount & ~7;
+		bitCount &= 7;
+	}
+
+	for (; i <= length; i++)
+	{
+		ext_char ch = (i < length ? data[i] : PSEUDO_EOF);
+		bitBuffer |= codes.bits[ch] << bitCount;
+		bitCount += codes.length[ch];
+		for (int k = 0; k < 8; k++)
+		{
+			out[pos + k] = uint8_t(bitBuffer >> (8 * k));
+		}
+		pos += bitCount >> 3;
+		bitBuffer >>= bitCount & ~7;
+		bitCount &= 7;
+	}
+
+	//the last partial byte is padded with zeros
+	if (bitCount > 0) out[pos++] = uint8_t(bitBuffer);
+	return pos;
+}
+
+/*
+	Decodes the bits in length bytes from data with table, whose
+	primary lookup is LOOKUP_BITS wide and holds every code, until
+	PSEUDO_EOF, replacing the contents of output.  The register is
+	refilled seven bytes at a time, and then a whole group of codes is
+	decoded with one lookup each.
+*/
+template <int LOOKUP_BITS>
+static void decodePresetBytes(const uint8_t* data, size_t length, const DecodeTable& table,
+                              std::vector<uint8_t>& output)
+{
+	const int GROUP = 56 / LOOKUP_BITS;
+	const uint64_t MASK = (uint64_t(1) << LOOKUP_BITS) - 1;
+	const DecodeEntry* entries = &table.entries[0];
+
+	output.resize(length * 2 + 64); //a guess, grown as needed
+	size_t written = 0;
+	size_t pos = 0;
+	uint64_t bitBuffer = 0;
+	int bitCount = 0;
+	int padBits = 0; //zero bits added past the end of the data
+
+	while (true)
+	{
+		if (pos + 8 <= length)
+		{
+			bitBuffer |= loadLittleEndian64(data + pos) << bitCount;
+			pos += (63 - bitCount) >> 3;
+			bitCount |= 56;
+		}
+		else
+		{
+			while (bitCount <= 56)
+			{
+				uint64_t byte = 0;
+				if (pos < length) byte = data[pos];
+				else padBits += 8;
+				pos++;
+				bitBuffer |= byte << bitCount;
+				bitCount += 8;
+			}
+		}
+
+		if (written + GROUP > output.size()) output.resize(output.size() * 2);
+		for (int k = 0; k < GROUP; k++)
+		{
+			const DecodeEntry& entry = entries[bitBuffer & MASK];
+			bitBuffer >>= entry.length;
+			bitCount -= entry.length;
+			if (bitCount < padBits) error("Encoded data ended before PSEUDO_EOF.");
+			if (entry.symbol == PSEUDO_EOF) goto finished;
+			output[written++] = uint8_t(entry.symbol);
+		}
+	}
+
+finished:
+	output.resize(written);
+}
+
+/*
+	Reads the preset number of a PRESET_CONTAINER whose magic and
+	version have already been read, checking that it is a preset
+*/
+static PresetId readPresetId(istream& infile)
+{
+	int id = infile.get();
+	if (infile.fail()) error("Preset container is cut off.");
+	if (!isPreset(id)) error("Unknown preset " + integerToString(id) + ".");
+	return PresetId(id);
+}
+
+/* Function: isPreset
+ * Usage: if (isPreset(id)) ...
+ * --------------------------------------------------------
+ * Checks id against the list of presets.
+ */
+bool isPreset(int id)
+{
+	return id == ENGLISH_TEXT_PRESET;
+}
+
+/* Function: presetDictionary
+ * Usage: const HuffmanDictionary& code = presetDictionary(preset);
+ * --------------------------------------------------------
+ * Looks the preset up among the tables built at startup.
+ */
+const HuffmanDictionary& presetDictionary(PresetId preset)
+{
+	if (preset == ENGLISH_TEXT_PRESET) return gPresetTables.english;
+	error("Unknown preset " + integerToString(int(preset)) + ".");
+	return gPresetTables.english; //not reached
+}
+
+/* Function: compressWithPreset
+ * Usage: compressWithPreset(infile, outfile, preset);
+ * --------------------------------------------------------
+ * Writes the container header, then codes through the bit stream.
+ */
+void compressWithPreset(istream& infile, obstream& outfile, PresetId preset)
+{
+	MemoryCategoryScope scope(CODING_MEMORY);
+	const HuffmanDictionary& code = presetDictionary(preset);
+	writeContainerVersion(outfile, PRESET_CONTAINER);
+	outfile.put(char(preset));
+	encodeWithTable(infile, code.codes, outfile);
+}
+
+/* Function: compressWithPreset
+ * Usage: compressWithPreset(data, length, preset, output);
+ * --------------------------------------------------------
+ * output is sized for the longest codes and cut back after coding,
+ * which saves counting the bytes first.
+ */
+void compressWithPreset(const uint8_t* data, size_t length, PresetId preset,
+                        std::vector<uint8_t>& output)
+{
+	MemoryCategoryScope scope(CODING_MEMORY);
+	const HuffmanDictionary& code = presetDictionary(preset);
+	size_t magicBytes = sizeof CONTAINER_MAGIC - 1;
+	output.resize(PRESET_HEADER_BYTES + ((length + 1) * code.maxCodeLength + 7) / 8 + 8);
+	memcpy(&output[0], CONTAINER_MAGIC, magicBytes);
+	output[magicBytes] = uint8_t(PRESET_CONTAINER);
+	output[magicBytes + 1] = uint8_t(preset);
+
+	size_t end = 0;
+	switch (preset)
+	{
+	case ENGLISH_TEXT_PRESET:
+		end = encodePresetBytes<PresetTraits<ENGLISH_TEXT_PRESET>::MAX_LENGTH>(data, length, code.codes,
+		                                                                        output, PRESET_HEADER_BYTES);
+		break;
+	}
+	output.resize(end);
+}
+
+/* Function: decodePresetContainer
+ * Usage: decodePresetContainer(infile, outfile);
+ * --------------------------------------------------------
+ * Reads the preset number, then decodes through the bit stream.
+ */
+void decodePresetContainer(ibstream& infile, ostream& outfile)
+{
+	MemoryCategoryScope scope(CODING_MEMORY);
+	decodeSymbols(infile, presetDictionary(readPresetId(infile)).decoder, outfile);
+}
+
+/* Function: decompressWithPreset
+ * Usage: decompressWithPreset(data, length, output);
+ * --------------------------------------------------------
+ * Checks the fixed-size container header, then decodes straight
+ * from memory.
+ */
+void decompressWithPreset(const uint8_t* data, size_t length, std::vector<uint8_t>& output)
+{
+	MemoryCategoryScope scope(CODING_MEMORY);
+	size_t magicBytes = sizeof CONTAINER_MAGIC - 1;
+	if (length < size_t(PRESET_HEADER_BYTES) ||
+	    memcmp(data, CONTAINER_MAGIC, magicBytes) != 0 ||
+	    data[magicBytes] != PRESET_CONTAINER)
+	{
+		error("Not a preset compressed file.");
+	}
+	if (!isPreset(data[magicBytes + 1])) error("Unknown preset " + integerToString(data[magicBytes + 1]) + ".");
+
+	PresetId preset = PresetId(data[magicBytes + 1]);
+	const HuffmanDictionary& code = presetDictionary(preset);
+	switch (preset)
+	{
+	case ENGLISH_TEXT_PRESET:
+		decodePresetBytes<PresetTraits<ENGLISH_TEXT_PRESET>::MAX_LENGTH>(data + PRESET_HEADER_BYTES,
+		                                                                  length - PRESET_HEADER_BYTES,
+		                                                                  code.decoder, output);
+		break;
+	}
+}
@@ -0,0 +1,99 @@
+/**********************************************************
+ * File: HuffmanPresets.h
+ *
+ * Built-in codes for well-known kinds of data.  A preset is
+ * a code fixed when the program is built, so a message coded
+ * with it needs no code length header and no tree or code to
+ * be built on either side, and unlike a dictionary (see
+ * HuffmanDictionary.h) nothing has to be shipped alongside the
+ * messages: every copy of the program knows every preset.
+ *
+ * A message is a PRESET_CONTAINER: the container magic and
+ * version, the preset number in 1 byte, then the encoded bits
+ * ending in PSEUDO_EOF.
+ *
+ * Each preset's code lengths are a table in HuffmanPresets.cpp,
+ * and its longest code is a compile-time constant, so the
+ * encoder and decoder loops for each preset are instantiated
+ * from templates with their widths fixed: the decoder needs no
+ * second-level lookups, and both move a whole group of codes
+ * per step through a 64-bit register.
+ */
+
+#ifndef HuffmanPresets_Included
+#define HuffmanPresets_Included
+
+#include "HuffmanDictionary.h"
+#include <vector>
+
+/* Type: PresetId
+ * The built-in codes, by the number written into each message.
+ *
+ *   ENGLISH_TEXT_PRESET: English prose in ASCII, trained on the
+ *                        tomSawyer and poem samples.
+ */
+enum PresetId {
+	ENGLISH_TEXT_PRESET = 1
+};
+
+/* Constant: PRESET_HEADER_BYTES
+ * The size of the container header of every message: magic,
+ * version and preset number.
+ */
+const int PRESET_HEADER_BYTES = (sizeof CONTAINER_MAGIC - 1) + 1 + 1;
+
+/* Function: isPreset
+ * Usage: if (isPreset(id)) ...
+ * --------------------------------------------------------
+ * Returns whether id is the number of a built-in preset.
+ */
+bool isPreset(int id);
+
+/* Function: presetDictionary
+ * Usage: const HuffmanDictionary& code = presetDictionary(ENGLISH_TEXT_PRESET);
+ * --------------------------------------------------------
+ * Returns the code of the given preset as a dictionary whose id is
+ * the preset number.  Every byte value has a code.  Raises an error
+ * if there is no such preset.
+ */
+const HuffmanDictionary& presetDictionary(PresetId preset);
+
+/* Function: compressWithPreset
+ * Usage: compressWithPreset(infile, outfile, preset);
+ * --------------------------------------------------------
+ * Compresses infile, from its current position to its end, into
+ * outfile as a PRESET_CONTAINER coded with preset.
+ */
+void compressWithPreset(istream& infile, obstream& outfile, PresetId preset);
+
+/* Function: compressWithPreset
+ * Usage: compressWithPreset(data, length, preset, output);
+ * --------------------------------------------------------
+ * Compresses length bytes starting at data into output, which is
+ * replaced, giving the same bytes as the stream version through
+ * the preset's own encoding loop.
+ */
+void compressWithPreset(const uint8_t* data, size_t length, PresetId preset,
+                        std::vector<uint8_t>& output);
+
+/* Function: decodePresetContainer
+ * Usage: decodePresetContainer(infile, outfile);
+ * --------------------------------------------------------
+ * Decodes a PRESET_CONTAINER whose magic and version have already
+ * been read, writing the original data to outfile.  Raises an error
+ * if the preset is unknown or the data is damaged.  decompress
+ * calls this for every PRESET_CONTAINER.
+ */
+void decodePresetContainer(ibstream& infile, ostream& outfile);
+
+/* Function: decompressWithPreset
+ * Usage: decompressWithPreset(data, length, output);
+ * --------------------------------------------------------
+ * Decompresses the PRESET_CONTAINER held in length bytes starting
+ * at data into output, which is replaced, through the preset's own
+ * decoding loop.  Raises the same errors as decodePresetContainer,
+ * or an error if the data is not a PRESET_CONTAINER.
+ */
+void decompressWithPreset(const uint8_t* data, size_t length, std::vector<uint8_t>& output);
+
+#endif
@@ -0,0 +1,233 @@
+/**********************************************************
+ * File: HuffmanSeek.cpp
+ *
+ * Implementation of the seekable container functions from
+ * HuffmanSeek.h.
+ */
+
+#include "HuffmanSeek.h"
+#include "HuffmanBlocks.h"
+#include "HuffmanHistogram.h"
+#include "TableCache.h"
+#include "LittleEndian.h"
+#include "MemoryDiagnostics.h"
+#include "OutputBuffer.h"
+#include "error.h"
+#include <vector>
+
+/* Size of the checkpoint index trailer: interval, data size and
+ * number of checkpoints.
+ */
+static const int CHECKPOINT_TRAILER_BYTES = 4 + 8 + 4;
+
+/* Size of the chunks read while coding. */
+static const int SEEK_CHUNK_SIZE = 65536;
+
+/* Type: RangeBuffer
+ * A stream buffer that counts every byte written to it and passes
+ * on to another stream only those between two positions.
+ */
+class RangeBuffer : public streambuf {
+public:
+	RangeBuffer(ostream& target, uint64_t first, uint64_t end)
+		: target(target), first(first), end(end), position(0)
+	{
+		/* Empty */
+	}
+
+protected:
+	int_type overflow(int_type ch)
+	{
+		if (traits_type::eq_int_type(ch, traits_type::eof())) return traits_type::not_eof(ch);
+		char byte = traits_type::to_char_type(ch);
+		xsputn(&byte, 1);
+		return ch;
+	}
+
+	streamsize xsputn(const char* data, streamsize count)
+	{
+		uint64_t from = (position > first ? position : first);
+		uint64_t to = (position + count < end ? position + count : end);
+		if (from < to) target.write(data + size_t(from - position), streamsize(to - from));
+		position += count;
+		return count;
+	}
+
+private:
+	ostream& target;
+	uint64_t first;
+	uint64_t end;
+	uint64_t position;
+};
+
+/*
+	Decodes the range from a SEEKABLE_CONTAINER whose magic and version
+	have already been read: reads the code, finds the checkpoint at or
+	before offset in the index, and decodes from there until the range
+	is done
+*/
+static void decodeSeekableRange(ibstream& infile, ostream& outfile, uint64_t offset, uint64_t end)
+{
+	uint8_t lengths[NUM_SYMBOLS];
+	readCodeLengthHeader(infile, lengths);
+	streamoff bitsStart = streamoff(infile.tellg());
+	if (bitsStart < 0) error("Cannot seek in the compressed data.");
+
+	infile.seekg(-CHECKPOINT_TRAILER_BYTES, ios::end);
+	uint64_t interval = readUint32(infile, "Checkpoint index");
+	uint64_t rawSize = readUint64(infile, "Checkpoint index");
+	uint64_t numCheckpoints = readUint32(infile, "Checkpoint index");
+	if (interval == 0 || numCheckpoints != (rawSize == 0 ? 0 : (rawSize - 1) / interval))
+	{
+		error("Checkpoint index is damaged.");
+	}
+	if (end > rawSize) end = rawSize;
+	if (offset >= end) return;
+
+	uint64_t checkpoint = offset / interval;
+	uint64_t bitOffset = 0;
+	if (checkpoint > 0)
+	{
+		infile.seekg(-CHECKPOINT_TRAILER_BYTES - streamoff(8 * (numCheckpoints - checkpoint + 1)), ios::end);
+		bitOffset = readUint64(infile, "Checkpoint index");
+	}
+
+	DecodeTable table;
+	buildCachedDecodeTable(lengths, table);
+	const DecodeEntry* entries = &table.entries[0];
+	const int lookupBits = table.lookupBits;
+
+	infile.clear();
+	infile.seekg(bitsStart + streamoff(bitOffset / 8));
+	infile.setBitBuffering(true);
+	if (bitOffset % 8 != 0) infile.skipBits(int(bitOffset % 8));
+
+	//the bytes between the checkpoint and the range are decoded and dropped
+	uint64_t skip = offset - checkpoint * interval;
+	uint64_t total = skip + (end - offset);
+	OutputBuffer output(outfile);
+	for (uint64_t i = 0; i < total; i++)
+	{
+		const DecodeEntry* entry = &entries[uint32_t(infile.peekBits(lookupBits))];
+		while (entry->link != 0)
+		{
+			infile.skipBits(entry->length);
+			entry = &entries[table.subtables[entry->symbol] + uint32_t(infile.peekBits(entry->link))];
+		}
+		infile.skipBits(entry->length);
+
+		if (infile.fail() || entry->symbol == PSEUDO_EOF) error("Encoded data ended before the range.");
+		if (i < skip) continue;
+
+		output.put(char(entry->symbol));
+	}
+	output.flush();
+	infile.setBitBuffering(false);
+}
+
+/* Function: compressSeekable
+ * Usage: compressSeekable(infile, outfile, interval);
+ * --------------------------------------------------------
+ * Counts the bytes, builds the code, and then codes the bytes
+ * again, noting the number of bits written so far each time it
+ * reaches a checkpoint.
+ */
+void compressSeekable(ibstream& infile, obstream& outfile, int interval)
+{
+	MemoryCategoryScope scope(CODING_MEMORY);
+	if (interval < 1) error("Checkpoints must be at least one byte apart.");
+
+	uint64_t counts[NUM_BYTE_VALUES] = { 0 };
+	countBytes(infile, counts);
+	uint64_t weights[NUM_SYMBOLS] = { 0 };
+	uint64_t rawSize = 0;
+	for (int ch = 0; ch < NUM_BYTE_VALUES; ch++)
+	{
+		weights[ch] = counts[ch];
+		rawSize += counts[ch];
+	}
+	weights[PSEUDO_EOF] = 1;
+
+	/* The trailer counts checkpoints in 32 bits, so refuse before writing anything. */
+	if (rawSize != 0 && (rawSize - 1) / uint64_t(interval) > 0xFFFFFFFFu)
+	{
+		error("Too many checkpoints for the input; use a larger interval.");
+	}
+	CodeTable codes;
+	buildCachedCodeTable(weights, codes);
+
+	writeContainerVersion(outfile, SEEKABLE_CONTAINER);
+	writeCodeLengthHeader(outfile, codes.length);
+
+	infile.rewind();
+	bool wasBuffering = outfile.isBitBuffering();
+	outfile.setBitBuffering(true);
+	std::vector<uint64_t> checkpoints;
+	uint64_t bits = 0, position = 0;
+	int untilCheckpoint = interval;
+	std::vector<char> buffer(SEEK_CHUNK_SIZE);
+	while (true)
+	{
+		streamsize count = infile.rdbuf()->sgetn(&buffer[0], SEEK_CHUNK_SIZE);
+		if (count <= 0) break;
+
+		for (streamsize i = 0; i < count; i++)
+		{
+			if (untilCheckpoint == 0)
+			{
+				checkpoints.push_back(bits);
+				untilCheckpoint = interval;
+			}
+			untilCheckpoint--;
+
+			ext_char ch = (unsigned char)buffer[i];
+			outfile.writeBits(codes.bits[ch], codes.length[ch]);
+			bits += codes.length[ch];
+		}
+		position += uint64_t(count);
+	}
+	outfile.writeBits(codes.bits[PSEUDO_EOF], codes.length[PSEUDO_EOF]);
+	outfile.flushBits();
+	outfile.setBitBuffering(wasBuffering);
+
+	for (size_t i = 0; i < checkpoints.size(); i++)
+	{
+		writeUint64(outfile, checkpoints[i]);
+	}
+	writeUint32(outfile, uint32_t(interval));
+	writeUint64(outfile, position);
+	writeUint32(outfile, uint32_t(checkpoints.size()));
+}
+
+/* Function: decompressRange
+ * Usage: decompressRange(infile, outfile, offset, length);
+ * --------------------------------------------------------
+ * Seeks where the container allows it, and otherwise decodes the
+ * whole file through a buffer that keeps only the range.
+ */
+void decompressRange(ibstream& infile, ostream& outfile, uint64_t offset, uint64_t length)
+{
+	MemoryCategoryScope scope(CODING_MEMORY);
+	uint64_t end = (length > ~offset ? ~uint64_t(0) : offset + length);
+	streampos start = infile.tellg();
+	if (start == streampos(-1)) error("Cannot seek in the compressed data.");
+
+	bool checked = false; //the other containers go to decompress, which checks them
+	ContainerVersion version = readContainerVersion(infile, checked);
+	if (version == SEEKABLE_CONTAINER)
+	{
+		decodeSeekableRange(infile, outfile, offset, end);
+	}
+	else if (version == BLOCK_CONTAINER)
+	{
+		decodeBlockRange(infile, outfile, offset, end - offset);
+	}
+	else
+	{
+		infile.clear();
+		infile.seekg(start);
+		RangeBuffer range(outfile, offset, end);
+		ostream window(&range);
+		decompress(infile, window);
+	}
+}
@@ -0,0 +1,68 @@
+/**********************************************************
+ * File: HuffmanSeek.h
+ *
+ * Reading a window from the middle of a compressed file.  An
+ * ordinary compressed file can only be decoded from its first
+ * bit, since codes have no fixed size.  A SEEKABLE_CONTAINER
+ * adds checkpoints: every so many bytes of the original data,
+ * it records how many bits into the encoded data that byte's
+ * code starts, so a reader can seek to the checkpoint nearest
+ * a range and decode only from there.
+ *
+ * A SEEKABLE_CONTAINER holds the magic and version, a code
+ * length header (see writeCodeLengthHeader), and the encoded
+ * bits ending in PSEUDO_EOF, just as a CANONICAL_CONTAINER
+ * does, so decompress can read it from the start.  Then comes
+ * the checkpoint index:
+ *
+ *   8 bytes  bit offset of original byte k * interval, for
+ *            each k from 1 while that byte exists
+ *   4 bytes  the interval
+ *   8 bytes  the size of the original data
+ *   4 bytes  the number of checkpoints above
+ *
+ * Bit offsets count from the first bit after the header, and
+ * all numbers are stored least significant byte first.  The
+ * checkpoint of byte 0 is always at bit 0 and not stored.
+ */
+
+#ifndef HuffmanSeek_Included
+#define HuffmanSeek_Included
+
+#include "HuffmanEncoding.h"
+
+/* Constant: DEFAULT_CHECKPOINT_INTERVAL
+ * The number of original bytes between checkpoints unless told
+ * otherwise.  Each checkpoint costs 8 bytes of the file, and a
+ * range read decodes up to this many bytes before the range.
+ */
+const int DEFAULT_CHECKPOINT_INTERVAL = 1 << 16;
+
+/* Function: compressSeekable
+ * Usage: compressSeekable(infile, outfile);
+ *        compressSeekable(infile, outfile, interval);
+ * --------------------------------------------------------
+ * Compresses infile into outfile as a SEEKABLE_CONTAINER with a
+ * checkpoint every interval bytes.  Like compress, it reads infile
+ * twice, so infile must be rewindable.  Raises an error if interval
+ * is less than one, or so small for the input that there would be
+ * more than 2^32 - 1 checkpoints, before anything is written.
+ */
+void compressSeekable(ibstream& infile, obstream& outfile,
+                      int interval = DEFAULT_CHECKPOINT_INTERVAL);
+
+/* Function: decompressRange
+ * Usage: decompressRange(infile, outfile, offset, length);
+ * --------------------------------------------------------
+ * Writes to outfile the length bytes of original data starting
+ * at offset, cut short at the end of the data.  A
+ * SEEKABLE_CONTAINER is decoded from the last checkpoint at or
+ * before offset, and a BLOCK_CONTAINER from the first block that
+ * overlaps the range; both stop as soon as the range is done, and
+ * infile must be seekable.  Any other file is decoded from the
+ * start, keeping only the range.  infile must be at the start of
+ * the compressed file.
+ */
+void decompressRange(ibstream& infile, ostream& outfile, uint64_t offset, uint64_t length);
+
+#endif
@@ -0,0 +1,108 @@
+/**********************************************************
+ * File: HuffmanStats.cpp
+ *
+ * Implementation of the instrumentation from HuffmanStats.h.
+ */
+
+#include "HuffmanStats.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+/* Constructor: CodingStats
+ * ----------------------------------------------------
+ * Starts with every time and count at zero.
+ */
+CodingStats::CodingStats()
+	: bytesIn(0), bytesOut(0), headerBytes(0), symbolsCoded(0), maxCodeLength(0), treeNodes(0)
+{
+	for (int i = 0; i < NUM_CODING_PHASES; i++)
+	{
+		phaseSeconds[i] = 0;
+	}
+}
+
+/* Member function: totalSeconds
+ * ----------------------------------------------------
+ * Sums the phases.
+ */
+double CodingStats::totalSeconds() const
+{
+	double total = 0;
+	for (int i = 0; i < NUM_CODING_PHASES; i++)
+	{
+		total += phaseSeconds[i];
+	}
+	return total;
+}
+
+/* Function: phaseName
+ * Usage: cout << phaseName(HEADER_PHASE);
+ * --------------------------------------------------------
+ * Returns a short lower-case name for phase.
+ */
+const char* phaseName(CodingPhase phase)
+{
+	switch (phase)
+	{
+		case HISTOGRAM_PHASE: return "histogram";
+		case CODE_PHASE: return "code";
+		case HEADER_PHASE: return "header";
+		case CODING_PHASE: return "coding";
+		default: return "unknown";
+	}
+}
+
+/* Function: currentSeconds
+ * Usage: double start = currentSeconds();
+ * --------------------------------------------------------
+ * Returns a wall-clock time in seconds from a monotonic clock.
+ */
+double currentSeconds()
+{
+#ifdef _WIN32
+	LARGE_INTEGER frequency, now;
+	QueryPerformanceFrequency(&frequency);
+	QueryPerformanceCounter(&now);
+	return double(now.QuadPart) / double(frequency.QuadPart);
+#else
+	timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec + now.tv_nsec / 1e9;
+#endif
+}
+
+/* Function: endPhase
+ * Usage: endPhase(stats, CODE_PHASE, mark);
+ * --------------------------------------------------------
+ * Adds the time since mark to phase in stats and moves mark to
+ * now, unless stats is NULL.
+ */
+void endPhase(CodingStats* stats, CodingPhase phase, double& mark)
+{
+	if (stats == NULL) return;
+
+	double now = currentSeconds();
+	stats->phaseSeconds[phase] += now - mark;
+	mark = now;
+}
+
+/* Function: readPosition
+ * Function: writePosition
+ * Usage: streamoff start = readPosition(infile);
+ * --------------------------------------------------------
+ * Ask the stream buffer directly, which ignores the stream's end
+ * of file and failure flags.
+ */
+streamoff readPosition(istream& infile)
+{
+	return streamoff(infile.rdbuf()->pubseekoff(0, ios_base::cur, ios_base::in));
+}
+
+streamoff writePosition(ostream& outfile)
+{
+	return streamoff(outfile.rdbuf()->pubseekoff(0, ios_base::cur, ios_base::out));
+}
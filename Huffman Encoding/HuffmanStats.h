@@ -0,0 +1,99 @@
+/**********************************************************
+ * File: HuffmanStats.h
+ *
+ * Optional instrumentation for compress and decompress.  A
+ * caller that wants to know where the time goes passes a
+ * CodingStats, which is filled in with the time spent in each
+ * phase and a few counts.  Without one, nothing is measured.
+ */
+
+#ifndef HuffmanStats_Included
+#define HuffmanStats_Included
+
+#include "HuffmanTypes.h"
+#include <istream>
+#include <ostream>
+using namespace std;
+
+/* Type: CodingPhase
+ * The parts that compress and decompress spend their time in.
+ *
+ *   HISTOGRAM_PHASE: reading the input to count its bytes.
+ *   CODE_PHASE:      building the tree, code tables and decode
+ *                    tables.
+ *   HEADER_PHASE:    writing or reading the container header.
+ *   CODING_PHASE:    reading, coding and writing the data itself.
+ *
+ * Reading and writing happen inside the histogram and coding
+ * phases, so slow I/O shows up there.
+ */
+enum CodingPhase {
+	HISTOGRAM_PHASE,
+	CODE_PHASE,
+	HEADER_PHASE,
+	CODING_PHASE,
+	NUM_CODING_PHASES
+};
+
+/* Type: CodingStats
+ * What one call to compress or decompress did.  Byte counts come
+ * from stream positions, so they are zero for a stream that cannot
+ * report its position.  Containers that do not have a field, like
+ * the header of an adaptive file, leave it at zero.
+ */
+struct CodingStats {
+	double phaseSeconds[NUM_CODING_PHASES];  /* wall time of each phase */
+	uint64_t bytesIn;
+	uint64_t bytesOut;
+	uint64_t headerBytes;    /* magic, version and code lengths */
+	uint64_t symbolsCoded;   /* bytes coded, plus PSEUDO_EOF */
+	int maxCodeLength;
+	long treeNodes;          /* nodes in the encoding tree, if one was built */
+
+	CodingStats();
+
+	/* Member function: totalSeconds
+	 * Usage: double seconds = stats.totalSeconds();
+	 * ----------------------------------------------------
+	 * Returns the time spent in all phases together.
+	 */
+	double totalSeconds() const;
+};
+
+/* Function: phaseName
+ * Usage: cout << phaseName(HEADER_PHASE);
+ * --------------------------------------------------------
+ * Returns a short lower-case name for phase.
+ */
+const char* phaseName(CodingPhase phase);
+
+/* Function: currentSeconds
+ * Usage: double start = currentSeconds();
+ * --------------------------------------------------------
+ * Returns a wall-clock time in seconds, measured from some
+ * arbitrary point, from the most precise clock available.
+ */
+double currentSeconds();
+
+/* Function: endPhase
+ * Usage: endPhase(stats, CODE_PHASE, mark);
+ * --------------------------------------------------------
+ * Adds the time since mark to phase in stats and moves mark to
+ * now.  Does nothing if stats is NULL, so that callers can mark
+ * phases unconditionally.
+ */
+void endPhase(CodingStats* stats, CodingPhase phase, double& mark);
+
+/* Function: readPosition
+ * Function: writePosition
+ * Usage: streamoff start = readPosition(infile);
+ * --------------------------------------------------------
+ * Return the position of the next byte to be read from or written
+ * to a stream, or -1 if the stream cannot tell.  Unlike tellg and
+ * tellp, these still work once the end of the stream has been
+ * reached.
+ */
+streamoff readPosition(istream& infile);
+streamoff writePosition(ostream& outfile);
+
+#endif
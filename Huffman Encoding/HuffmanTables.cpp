@@ -0,0 +1,432 @@
+/**********************************************************
+ * File: HuffmanTables.cpp
+ *
+ * Implementation of the lookup tables from HuffmanTables.h.
+ */
+
+#include "HuffmanTables.h"
+#include "MemoryDiagnostics.h"
+#include "error.h"
+#include "strlib.h"
+#include <algorithm>
+
+/*
+	Records the code word of every leaf below node.  code holds the
+	depth bits already taken to reach node, first bit in the lowest
+	position.
+*/
+static void fillCodeTable(CodeTable& table, Node* node, uint64_t code, int depth)
+{
+	if (node->character != NOT_A_CHAR)
+	{
+		table.bits[node->character] = code;
+		table.length[node->character] = uint8_t(depth);
+		return;
+	}
+
+	if (depth == MAX_TABLE_CODE_LENGTH)
+	{
+		error("Encoding tree is too deep for a code table.");
+	}
+
+	fillCodeTable(table, node->zero, code, depth + 1);
+	fillCodeTable(table, node->one, code | (uint64_t(1) << depth), depth + 1);
+}
+
+/* Function: buildCodeTable
+ * Usage: buildCodeTable(encodingTree, table);
+ * --------------------------------------------------------
+ * Fills in table with the code word of every character in the
+ * given encoding tree.  Raises an error if the tree is deeper than
+ * MAX_TABLE_CODE_LENGTH.
+ */
+void buildCodeTable(Node* encodingTree, CodeTable& table)
+{
+	MemoryCategoryScope scope(TABLE_MEMORY);
+	for (int i = 0; i < NUM_SYMBOLS; i++)
+	{
+		table.bits[i] = 0;
+		table.length[i] = 0;
+	}
+
+	fillCodeTable(table, encodingTree, 0, 0);
+}
+
+/* Function: buildCanonicalCodeTable
+ * Usage: buildCanonicalCodeTable(lengths, table);
+ * --------------------------------------------------------
+ * Fills in table with the canonical code for the given code
+ * lengths, indexed by ext_char (zero for symbols without a
+ * code).  Raises an error if the lengths do not describe a
+ * complete prefix code.
+ */
+void buildCanonicalCodeTable(const uint8_t lengths[NUM_SYMBOLS], CodeTable& table)
+{
+	MemoryCategoryScope scope(TABLE_MEMORY);
+	if (!isCompleteCode(lengths)) error("Code lengths do not form a complete prefix code.");
+
+	//lengths may be table.length itself, so count before overwriting
+	int lengthCount[MAX_TABLE_CODE_LENGTH + 1] = { 0 };
+	uint8_t length[NUM_SYMBOLS];
+	for (int ch = 0; ch < NUM_SYMBOLS; ch++)
+	{
+		length[ch] = lengths[ch];
+		lengthCount[length[ch]]++;
+	}
+
+	/*
+		Canonical codes of one length are consecutive numbers, in
+		symbol order, continuing from where the previous length
+		stopped.  They are written most significant bit first, so
+		each one is reversed for the bit streams.
+	*/
+	uint64_t nextCode[MAX_TABLE_CODE_LENGTH + 1];
+	uint64_t code = 0;
+	lengthCount[0] = 0;
+	for (int len = 1; len <= MAX_TABLE_CODE_LENGTH; len++)
+	{
+		code = (code + lengthCount[len - 1]) << 1;
+		nextCode[len] = code;
+	}
+
+	for (int ch = 0; ch < NUM_SYMBOLS; ch++)
+	{
+		table.length[ch] = length[ch];
+		table.bits[ch] = 0;
+		if (length[ch] == 0) continue;
+
+		uint64_t canonical = nextCode[length[ch]]++;
+		for (int i = 0; i < length[ch]; i++)
+		{
+			table.bits[ch] |= ((canonical >> (length[ch] - 1 - i)) & 1) << i;
+		}
+	}
+}
+
+/* Function: isCompleteCode
+ * Usage: if (isCompleteCode(lengths)) { ... }
+ * --------------------------------------------------------
+ * Returns whether the given code lengths (zero meaning "no code")
+ * describe a complete prefix code: one where every sequence of
+ * bits starts with exactly one code word.  A single symbol with
+ * length zero also counts as complete.
+ */
+bool isCompleteCode(const uint8_t lengths[NUM_SYMBOLS])
+{
+	int lengthCount[MAX_TABLE_CODE_LENGTH + 1] = { 0 };
+	int numCodes = 0;
+	for (int ch = 0; ch < NUM_SYMBOLS; ch++)
+	{
+		if (lengths[ch] > MAX_TABLE_CODE_LENGTH) return false;
+		if (lengths[ch] != 0) numCodes++;
+		lengthCount[lengths[ch]]++;
+	}
+
+	if (numCodes == 0) return lengthCount[0] == NUM_SYMBOLS;
+
+	/*
+		Walk down the lengths counting how many code words are still
+		unused at each depth.  More unused words than symbols left
+		means the code can never be completed.
+	*/
+	uint64_t unused = 1;
+	int remaining = numCodes;
+	for (int len = 1; len <= MAX_TABLE_CODE_LENGTH; len++)
+	{
+		unused <<= 1;
+		if (uint64_t(lengthCount[len]) > unused) return false;
+		unused -= lengthCount[len];
+		remaining -= lengthCount[len];
+		if (unused > uint64_t(remaining)) return false;
+		if (remaining == 0) break;
+	}
+
+	return unused == 0;
+}
+
+/* Type: PackageItem
+ * An item in one package-merge list: either a single symbol, or a
+ * package of two items from the list before, with their combined
+ * weight.
+ */
+struct PackageItem {
+	uint64_t weight;
+	int symbol;
+	int first, second;
+};
+
+/*
+	Adds one to the length of every symbol in the item at index,
+	once for each time it appears in the item
+*/
+static void countPackage(const std::vector<PackageItem>& items, int index,
+                         uint8_t lengths[NUM_SYMBOLS])
+{
+	const PackageItem& item = items[index];
+	if (item.symbol != NOT_A_CHAR)
+	{
+		lengths[item.symbol]++;
+		return;
+	}
+
+	countPackage(items, item.first, lengths);
+	countPackage(items, item.second, lengths);
+}
+
+/* Function: encodedBits
+ * Usage: uint64_t bits = encodedBits(weights, lengths);
+ * --------------------------------------------------------
+ * Adds up weight times length over every symbol.
+ */
+uint64_t encodedBits(const uint64_t weights[NUM_SYMBOLS], const uint8_t lengths[NUM_SYMBOLS])
+{
+	uint64_t total = 0;
+	for (int ch = 0; ch < NUM_SYMBOLS; ch++)
+	{
+		total += weights[ch] * lengths[ch];
+	}
+	return total;
+}
+
+/* Function: buildLimitedCodeLengths
+ * Usage: buildLimitedCodeLengths(weights, maxLength, lengths);
+ * --------------------------------------------------------
+ * Fills in lengths with the code lengths, none longer than
+ * maxLength, that minimize the total encoded size for the given
+ * symbol weights.  Uses the package-merge algorithm.  Raises an
+ * error if the symbols cannot all be given codes of at most
+ * maxLength bits.
+ */
+void buildLimitedCodeLengths(const uint64_t weights[NUM_SYMBOLS], int maxLength,
+                             uint8_t lengths[NUM_SYMBOLS])
+{
+	MemoryCategoryScope scope(TREE_MEMORY);
+	if (maxLength < 1 || maxLength > MAX_TABLE_CODE_LENGTH)
+	{
+		error("Maximum code length must be between 1 and 64 bits.");
+	}
+
+	//every item lives here, lists refer to items by index
+	std::vector<PackageItem> items;
+	std::vector<int> leaves;
+	for (int ch = 0; ch < NUM_SYMBOLS; ch++)
+	{
+		lengths[ch] = 0;
+		if (weights[ch] == 0) continue;
+
+		PackageItem leaf;
+		leaf.weight = weights[ch];
+		leaf.symbol = ch;
+		leaf.first = leaf.second = -1;
+		items.push_back(leaf);
+	}
+
+	int numSymbols = int(items.size());
+	if (numSymbols <= 1) return; //a lone symbol needs no bits
+	if (maxLength < 64 && (uint64_t(1) << maxLength) < uint64_t(numSymbols))
+	{
+		error("Too many symbols for a maximum code length of " +
+		      integerToString(maxLength) + " bits.");
+	}
+
+	//insertion sort by weight, stable so equal weights keep symbol order
+	for (int i = 0; i < numSymbols; i++)
+	{
+		int j = int(leaves.size());
+		leaves.push_back(i);
+		while (j > 0 && items[leaves[j - 1]].weight > items[i].weight)
+		{
+			leaves[j] = leaves[j - 1];
+			j--;
+		}
+		leaves[j] = i;
+	}
+
+	/*
+		Start from the leaves, which are the coins of the deepest
+		level.  Each round pairs up the cheapest items into packages
+		and merges those with a fresh set of leaves, one level up.
+		After maxLength - 1 rounds, the cheapest 2n - 2 items hold
+		each symbol once for every bit of its code.
+	*/
+	std::vector<int> current = leaves;
+	for (int level = 1; level < maxLength; level++)
+	{
+		std::vector<int> packages;
+		for (size_t i = 0; i + 1 < current.size(); i += 2)
+		{
+			PackageItem package;
+			package.weight = items[current[i]].weight + items[current[i + 1]].weight;
+			package.symbol = NOT_A_CHAR;
+			package.first = current[i];
+			package.second = current[i + 1];
+			packages.push_back(int(items.size()));
+			items.push_back(package);
+		}
+
+		//merge, preferring leaves on ties
+		std::vector<int> merged;
+		size_t nextLeaf = 0, nextPackage = 0;
+		while (nextLeaf < leaves.size() || nextPackage < packages.size())
+		{
+			if (nextPackage == packages.size() ||
+			    (nextLeaf < leaves.size() &&
+			     items[leaves[nextLeaf]].weight <= items[packages[nextPackage]].weight))
+			{
+				merged.push_back(leaves[nextLeaf++]);
+			}
+			else
+			{
+				merged.push_back(packages[nextPackage++]);
+			}
+		}
+		current.swap(merged);
+	}
+
+	for (int i = 0; i < 2 * numSymbols - 2; i++)
+	{
+		countPackage(items, current[i], lengths);
+	}
+}
+
+/* Type: PendingCode
+ * A code word still to be entered into some level of a decode
+ * table, with the bits of the levels above already stripped.
+ */
+struct PendingCode {
+	uint64_t bits;
+	int length;
+	int symbol;
+};
+
+/*
+	Orders pending codes by their first tableBits bits, so codes
+	sharing a second-level table end up next to each other
+*/
+struct PrefixOrder {
+	uint64_t mask;
+	bool operator()(const PendingCode& one, const PendingCode& two) const
+	{
+		return (one.bits & mask) < (two.bits & mask);
+	}
+};
+
+/*
+	Fills the table level starting at base (1 << bits slots) with the
+	given codes.  Codes that fit are spread over every slot they are
+	a prefix of.  Longer codes are grouped by their first bits bits;
+	each group gets a second-level table, at most maxBits wide, that
+	is filled with the rest of the group's code words.
+*/
+static void fillDecodeLevel(DecodeTable& table, int maxBits, uint32_t base,
+                            int bits, std::vector<PendingCode>& codes)
+{
+	std::vector<PendingCode> longCodes;
+	for (size_t i = 0; i < codes.size(); i++)
+	{
+		const PendingCode& code = codes[i];
+		if (code.length > bits)
+		{
+			longCodes.push_back(code);
+			continue;
+		}
+
+		//every index whose low length bits equal the code decodes to it
+		for (uint32_t slot = uint32_t(code.bits); slot < (1u << bits); slot += (1u << code.length))
+		{
+			DecodeEntry& entry = table.entries[base + slot];
+			entry.symbol = uint16_t(code.symbol);
+			entry.length = uint8_t(code.length);
+			entry.link = 0;
+		}
+	}
+
+	PrefixOrder order;
+	order.mask = (uint64_t(1) << bits) - 1;
+	std::sort(longCodes.begin(), longCodes.end(), order);
+
+	size_t start = 0;
+	while (start < longCodes.size())
+	{
+		uint32_t prefix = uint32_t(longCodes[start].bits & order.mask);
+		size_t end = start;
+		int longest = 0;
+		std::vector<PendingCode> group;
+		while (end < longCodes.size() && uint32_t(longCodes[end].bits & order.mask) == prefix)
+		{
+			PendingCode rest = longCodes[end];
+			rest.bits >>= bits;
+			rest.length -= bits;
+			if (rest.length > longest) longest = rest.length;
+			group.push_back(rest);
+			end++;
+		}
+
+		int subBits = (longest < maxBits ? longest : maxBits);
+		uint32_t offset = uint32_t(table.entries.size());
+		table.entries.resize(offset + (1u << subBits));
+
+		DecodeEntry& entry = table.entries[base + prefix];
+		entry.symbol = uint16_t(table.subtables.size());
+		entry.length = uint8_t(bits);
+		entry.link = uint8_t(subBits);
+		table.subtables.push_back(offset);
+
+		fillDecodeLevel(table, maxBits, offset, subBits, group);
+		start = end;
+	}
+}
+
+/* Function: buildDecodeTable
+ * Usage: buildDecodeTable(codes, table);
+ * --------------------------------------------------------
+ * Fills in table so that it decodes the code words in the given
+ * code table.  The primary table peeks at most maxBits bits, and
+ * is narrower if no code is that long.  The code words must form
+ * a complete prefix code, as those from a tree or from
+ * buildCanonicalCodeTable do.
+ */
+void buildDecodeTable(const CodeTable& codes, DecodeTable& table, int maxBits)
+{
+	MemoryCategoryScope scope(TABLE_MEMORY);
+	if (maxBits < 1 || maxBits > MAX_DECODE_BITS)
+	{
+		error("Decode table width must be between 1 and 16 bits.");
+	}
+
+	std::vector<PendingCode> pending;
+	int longest = 0;
+	for (int ch = 0; ch < NUM_SYMBOLS; ch++)
+	{
+		if (codes.length[ch] == 0 && !(ch == PSEUDO_EOF && pending.empty())) continue;
+
+		PendingCode code;
+		code.bits = codes.bits[ch];
+		code.length = codes.length[ch];
+		code.symbol = ch;
+		if (code.length > longest) longest = code.length;
+		pending.push_back(code);
+	}
+
+	int bits = (longest < maxBits ? longest : maxBits);
+	table.lookupBits = bits;
+	table.entries.assign(size_t(1) << bits, DecodeEntry());
+	table.subtables.clear();
+
+	fillDecodeLevel(table, maxBits, 0, bits, pending);
+}
+
+/* Function: buildDecodeTable
+ * Usage: buildDecodeTable(encodingTree, table);
+ * --------------------------------------------------------
+ * Fills in table so that it decodes the codes described by the
+ * given encoding tree.  The primary table peeks at most maxBits
+ * bits, and is narrower if the tree is not that deep.
+ */
+void buildDecodeTable(Node* encodingTree, DecodeTable& table, int maxBits)
+{
+	MemoryCategoryScope scope(TABLE_MEMORY);
+	CodeTable codes;
+	buildCodeTable(encodingTree, codes);
+	buildDecodeTable(codes, table, maxBits);
+}
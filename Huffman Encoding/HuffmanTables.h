@@ -0,0 +1,158 @@
+/**********************************************************
+ * File: HuffmanTables.h
+ *
+ * Lookup tables derived from a Huffman encoding tree.  A
+ * code table gives the encoder each character's code word
+ * directly, and a decode table lets the decoder resolve a
+ * complete code word with a single array index instead of
+ * walking the tree one bit at a time.
+ */
+
+#ifndef HuffmanTables_Included
+#define HuffmanTables_Included
+
+#include "HuffmanTypes.h"
+#include <vector>
+
+/* Constant: NUM_SYMBOLS
+ * The number of distinct ext_chars that can appear in an encoding
+ * tree: the 256 byte values plus PSEUDO_EOF.
+ */
+const int NUM_SYMBOLS = 257;
+
+/* Constant: MAX_TABLE_CODE_LENGTH
+ * The longest code word a CodeTable can store.
+ */
+const int MAX_TABLE_CODE_LENGTH = 64;
+
+/* Constant: DEFAULT_DECODE_BITS
+ * The number of bits the decoder peeks at once.  Codes no longer
+ * than this are decoded with a single lookup; longer codes fall
+ * through to a small second-level table.
+ */
+const int DEFAULT_DECODE_BITS = 11;
+
+/* Constant: MAX_DECODE_BITS
+ * Upper bound on the lookup width of any one decode table level.
+ */
+const int MAX_DECODE_BITS = 16;
+
+/* Constant: NO_LENGTH_LIMIT
+ * Passed as a maximum code length to mean that codes may be as
+ * long as the Huffman algorithm makes them.
+ */
+const int NO_LENGTH_LIMIT = 0;
+
+/* Type: CodeTable
+ * The code word of every symbol, indexed by ext_char.  bits holds
+ * the code with its first bit in the lowest position, which is the
+ * order the bit streams write bits in, and length holds the number
+ * of bits.  Symbols not in the tree have length zero.
+ */
+struct CodeTable {
+	uint64_t bits[NUM_SYMBOLS];
+	uint8_t length[NUM_SYMBOLS];
+};
+
+/* Type: DecodeEntry
+ * One slot of a decode table.  If link is zero, the slot decodes
+ * to symbol and consumes length bits.  Otherwise the code is longer
+ * than this table level: length bits are consumed, and the next
+ * link bits index the second-level table numbered symbol.
+ */
+struct DecodeEntry {
+	uint16_t symbol;
+	uint8_t length;
+	uint8_t link;
+};
+
+/* Type: DecodeTable
+ * A multi-level decode table.  entries holds the primary table
+ * (1 << lookupBits slots) followed by every second-level table;
+ * subtables records where each second-level table begins.
+ *
+ * Bits are indexed in the order the bit streams store them, so the
+ * first bit of a code word is the least significant bit of the
+ * index.
+ */
+struct DecodeTable {
+	int lookupBits;
+	std::vector<DecodeEntry> entries;
+	std::vector<uint32_t> subtables;
+};
+
+/* Function: buildCodeTable
+ * Usage: buildCodeTable(encodingTree, table);
+ * --------------------------------------------------------
+ * Fills in table with the code word of every character in the
+ * given encoding tree.  Raises an error if the tree is deeper than
+ * MAX_TABLE_CODE_LENGTH.
+ */
+void buildCodeTable(Node* encodingTree, CodeTable& table);
+
+/* Function: buildCanonicalCodeTable
+ * Usage: buildCanonicalCodeTable(lengths, table);
+ * --------------------------------------------------------
+ * Fills in table with the canonical code for the given code
+ * lengths, indexed by ext_char (zero for symbols without a
+ * code).  Canonical codes are determined by their lengths alone,
+ * so a file header only needs to store the lengths.  Raises an
+ * error if the lengths do not describe a complete prefix code.
+ */
+void buildCanonicalCodeTable(const uint8_t lengths[NUM_SYMBOLS], CodeTable& table);
+
+/* Function: isCompleteCode
+ * Usage: if (isCompleteCode(lengths)) { ... }
+ * --------------------------------------------------------
+ * Returns whether the given code lengths (zero meaning "no code")
+ * describe a complete prefix code: one where every sequence of
+ * bits starts with exactly one code word.  A single symbol with
+ * length zero also counts as complete.
+ */
+bool isCompleteCode(const uint8_t lengths[NUM_SYMBOLS]);
+
+/* Function: encodedBits
+ * Usage: uint64_t bits = encodedBits(weights, lengths);
+ * --------------------------------------------------------
+ * Returns how many bits coding every symbol as often as weights
+ * says, with codes of the given lengths, takes.  This is the
+ * exact size of the encoded data when weights is its histogram.
+ */
+uint64_t encodedBits(const uint64_t weights[NUM_SYMBOLS], const uint8_t lengths[NUM_SYMBOLS]);
+
+/* Function: buildLimitedCodeLengths
+ * Usage: buildLimitedCodeLengths(weights, maxLength, lengths);
+ * --------------------------------------------------------
+ * Fills in lengths with the code lengths, none longer than
+ * maxLength, that minimize the total encoded size for the given
+ * symbol weights.  Symbols of weight zero get no code, and a lone
+ * symbol gets the empty code.  Uses the package-merge algorithm.
+ * Raises an error if the symbols cannot all be given codes of at
+ * most maxLength bits.
+ */
+void buildLimitedCodeLengths(const uint64_t weights[NUM_SYMBOLS], int maxLength,
+                             uint8_t lengths[NUM_SYMBOLS]);
+
+/* Function: buildDecodeTable
+ * Usage: buildDecodeTable(codes, table);
+ * --------------------------------------------------------
+ * Fills in table so that it decodes the code words in the given
+ * code table.  The primary table peeks at most maxBits bits, and
+ * is narrower if no code is that long.  The code words must form
+ * a complete prefix code, as those from a tree or from
+ * buildCanonicalCodeTable do.
+ */
+void buildDecodeTable(const CodeTable& codes, DecodeTable& table,
+                      int maxBits = DEFAULT_DECODE_BITS);
+
+/* Function: buildDecodeTable
+ * Usage: buildDecodeTable(encodingTree, table);
+ * --------------------------------------------------------
+ * Fills in table so that it decodes the codes described by the
+ * given encoding tree.  The primary table peeks at most maxBits
+ * bits, and is narrower if the tree is not that deep.
+ */
+void buildDecodeTable(Node* encodingTree, DecodeTable& table,
+                      int maxBits = DEFAULT_DECODE_BITS);
+
+#endif
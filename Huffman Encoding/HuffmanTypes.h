@@ -10,6 +10,20 @@
 
 #include <stddef.h>
 
+/* Fixed-width integer types used by the bit-level code.  Visual
+ * Studio 2008 does not ship <stdint.h>, so we provide the few
+ * typedefs we need ourselves on that compiler.
+ */
+#if defined(_MSC_VER) && _MSC_VER < 1600
+typedef unsigned __int8  uint8_t;
+typedef unsigned __int16 uint16_t;
+typedef unsigned __int32 uint32_t;
+typedef unsigned __int64 uint64_t;
+typedef __int64 int64_t;
+#else
+#include <stdint.h>
+#endif
+
 /* Type: ext_char
  * A type representing a character, a pseudo-eof, or nothing. */
 typedef int ext_char;
@@ -54,9 +68,10 @@ struct Node {
 	Node *one;
 	
 	/* The weight of this node, which is the combined weight of all
-	 * characters at or below this node.
+	 * characters at or below this node.  It is 64 bits wide so that
+	 * a character seen more than 2^31 times cannot overflow it.
 	 */
-	int weight;
+	uint64_t weight;
 	
 	/* The following code is used to instrument the Node type so that we can
 	 * check whether or not you are leaking memory.	 You don't need to worry
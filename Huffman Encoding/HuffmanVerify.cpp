@@ -0,0 +1,165 @@
+/**********************************************************
+ * File: HuffmanVerify.cpp
+ *
+ * Implementation of the checking functions from
+ * HuffmanVerify.h.
+ */
+
+#include "HuffmanVerify.h"
+#include "HuffmanStats.h"
+#include "MappedFile.h"
+#include "error.h"
+#include <cstring>
+#include <streambuf>
+
+/* The number of bytes findMismatch hands to memcmp at a time;
+ * only a block that differs is looked at byte by byte.
+ */
+static const size_t COMPARE_BLOCK_SIZE = 4096;
+
+/* Type: CompareBuffer
+ * A stream buffer that keeps nothing written to it, but compares
+ * each write with the same stretch of an expected copy and notes
+ * where they first differ.
+ */
+class CompareBuffer : public streambuf {
+public:
+	CompareBuffer(const unsigned char* expected, size_t length)
+		: expected(expected), length(length), position(0), differs(false), mismatch(0)
+	{
+		/* Empty */
+	}
+
+	/* Returns whether everything written so far matches. */
+	bool matchesSoFar() const
+	{
+		return !differs;
+	}
+
+	/* Returns the offset of the first difference, once there is one. */
+	uint64_t firstMismatch() const
+	{
+		return mismatch;
+	}
+
+	/* Returns the number of bytes written. */
+	uint64_t written() const
+	{
+		return position;
+	}
+
+protected:
+	int_type overflow(int_type ch)
+	{
+		if (traits_type::eq_int_type(ch, traits_type::eof())) return traits_type::not_eof(ch);
+		char byte = traits_type::to_char_type(ch);
+		xsputn(&byte, 1);
+		return ch;
+	}
+
+	streamsize xsputn(const char* data, streamsize count)
+	{
+		if (!differs)
+		{
+			size_t left = (position < length ? size_t(length - position) : 0);
+			size_t compared = (size_t(count) < left ? size_t(count) : left);
+			size_t offset = findMismatch(expected + position, (const unsigned char*)data, compared);
+			if (offset < compared || compared < size_t(count))
+			{
+				differs = true;
+				mismatch = position + offset;
+			}
+		}
+		position += uint64_t(count);
+		return count;
+	}
+
+private:
+	const unsigned char* expected;
+	uint64_t length;
+	uint64_t position;
+	bool differs;
+	uint64_t mismatch;
+};
+
+/* Function: findMismatch
+ * Usage: size_t offset = findMismatch(one, two, length);
+ * --------------------------------------------------------
+ * memcmp runs a block at a time, far faster than a loop over bytes,
+ * and says only whether the block differs; the byte loop is left
+ * for the one block that does.
+ */
+size_t findMismatch(const unsigned char* one, const unsigned char* two, size_t length)
+{
+	size_t start = 0;
+	while (start < length)
+	{
+		size_t count = (length - start < COMPARE_BLOCK_SIZE ? length - start : COMPARE_BLOCK_SIZE);
+		if (memcmp(one + start, two + start, count) != 0)
+		{
+			while (one[start] == two[start]) start++;
+			return start;
+		}
+		start += count;
+	}
+	return length;
+}
+
+/* Function: verifyArchive
+ * Usage: VerifyResult result = verifyArchive(compressed, original, length);
+ * --------------------------------------------------------
+ * Decompresses into a CompareBuffer, so every block the decoder
+ * writes is compared and dropped at once.
+ */
+VerifyResult verifyArchive(ibstream& compressed, const unsigned char* original, size_t length)
+{
+	VerifyResult result;
+	result.bytesIn = length;
+	result.bytesOut = 0;
+	result.compressSeconds = 0;
+
+	streamoff start = readPosition(compressed);
+	CompareBuffer comparison(original, length);
+	ostream decoded(&comparison);
+	double mark = currentSeconds();
+	try
+	{
+		decompress(compressed, decoded);
+	}
+	catch (ErrorException& ex)
+	{
+		result.message = ex.getMessage();
+	}
+	result.decompressSeconds = currentSeconds() - mark;
+	if (start >= 0) result.bytesOut = uint64_t(readPosition(compressed) - start);
+
+	//a decode that stops short differs at the first byte it left out
+	result.matches = result.message.empty() && comparison.matchesSoFar() && comparison.written() == length;
+	result.mismatchOffset = (comparison.matchesSoFar() ? comparison.written() : comparison.firstMismatch());
+	if (result.message.empty() && !result.matches)
+	{
+		result.message = "Decompressed data differs from the original.";
+	}
+	return result;
+}
+
+/* Function: verifyRoundTrip
+ * Usage: VerifyResult result = verifyRoundTrip(filename, mode);
+ * --------------------------------------------------------
+ * Maps the file, compresses it into a string, and checks that.
+ */
+VerifyResult verifyRoundTrip(const string& filename, CompressionMode mode)
+{
+	imapbstream original(filename);
+	if (!original.is_open()) error("Cannot open file " + filename + " for reading.");
+
+	ostringbstream compressed;
+	double mark = currentSeconds();
+	compress(original, compressed, mode);
+	double compressSeconds = currentSeconds() - mark;
+
+	istringbstream archive(compressed.str());
+	VerifyResult result = verifyArchive(archive, original.data(), original.length());
+	result.compressSeconds = compressSeconds;
+	return result;
+}
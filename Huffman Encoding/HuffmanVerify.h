@@ -0,0 +1,65 @@
+/**********************************************************
+ * File: HuffmanVerify.h
+ *
+ * Checking that a compressed file gives back its original.
+ * The decoded bytes are compared with the original as they
+ * come out of the decoder, a large block at a time, so nothing
+ * is written to disk and the decoded file is never held whole;
+ * the original is read through a memory mapping, so it is not
+ * copied either.  Checking therefore costs about as much as
+ * decompressing alone.
+ */
+
+#ifndef HuffmanVerify_Included
+#define HuffmanVerify_Included
+
+#include "HuffmanEncoding.h"
+#include <string>
+using namespace std;
+
+/* Type: VerifyResult
+ * What one check found.  mismatchOffset is the first byte at which
+ * the decoded data and the original differ, including the first
+ * byte that one has and the other does not; it is meaningless when
+ * they match.  A compressed file too damaged to decode also does
+ * not match, and message says why.  compressSeconds is zero when
+ * nothing was compressed.
+ */
+struct VerifyResult {
+	bool matches;
+	uint64_t bytesIn;        /* size of the original */
+	uint64_t bytesOut;       /* size of the compressed file */
+	uint64_t mismatchOffset;
+	string message;
+	double compressSeconds;
+	double decompressSeconds;
+};
+
+/* Function: findMismatch
+ * Usage: size_t offset = findMismatch(one, two, length);
+ * --------------------------------------------------------
+ * Returns the offset of the first byte at which the length bytes at
+ * one and at two differ, or length if they are the same.
+ */
+size_t findMismatch(const unsigned char* one, const unsigned char* two, size_t length);
+
+/* Function: verifyArchive
+ * Usage: VerifyResult result = verifyArchive(compressed, original, length);
+ * --------------------------------------------------------
+ * Decompresses compressed, from its current position, and compares
+ * what comes out with the length bytes at original.
+ */
+VerifyResult verifyArchive(ibstream& compressed, const unsigned char* original, size_t length);
+
+/* Function: verifyRoundTrip
+ * Usage: VerifyResult result = verifyRoundTrip(filename);
+ *        VerifyResult result = verifyRoundTrip(filename, mode);
+ * --------------------------------------------------------
+ * Compresses the named file in the given mode into memory, then
+ * checks the result with verifyArchive, timing both directions.
+ * The file is memory-mapped, and the compressed data is the only
+ * copy made.  Raises an error if the file cannot be opened.
+ */
+VerifyResult verifyRoundTrip(const string& filename, CompressionMode mode = STATIC_MODE);
+
+#endif
@@ -0,0 +1,76 @@
+/**********************************************************
+ * File: LittleEndian.cpp
+ *
+ * Implementation of the functions from LittleEndian.h.
+ */
+
+#include "LittleEndian.h"
+#include "error.h"
+#include <string>
+
+/*
+	Writes the low bytes bytes of value, least significant first
+*/
+static void writeLittleEndian(ostream& outfile, uint64_t value, int bytes)
+{
+	for (int i = 0; i < bytes; i++)
+	{
+		outfile.put(char(value & 0xFF));
+		value >>= 8;
+	}
+}
+
+/*
+	Reads bytes bytes written by writeLittleEndian, raising an error
+	naming what if the stream ends first
+*/
+static uint64_t readLittleEndian(istream& infile, int bytes, const char* what)
+{
+	uint64_t value = 0;
+	for (int i = 0; i < bytes; i++)
+	{
+		value |= uint64_t((unsigned char)infile.get()) << (8 * i);
+	}
+	if (infile.fail()) error(string(what) + " is cut off.");
+	return value;
+}
+
+/* Function: writeUint32
+ * Usage: writeUint32(outfile, value);
+ * --------------------------------------------------------
+ * Writes the four low bytes.
+ */
+void writeUint32(ostream& outfile, uint32_t value)
+{
+	writeLittleEndian(outfile, value, 4);
+}
+
+/* Function: writeUint64
+ * Usage: writeUint64(outfile, value);
+ * --------------------------------------------------------
+ * Writes all eight bytes.
+ */
+void writeUint64(ostream& outfile, uint64_t value)
+{
+	writeLittleEndian(outfile, value, 8);
+}
+
+/* Function: readUint32
+ * Usage: uint32_t value = readUint32(infile, what);
+ * --------------------------------------------------------
+ * Reads four bytes.
+ */
+uint32_t readUint32(istream& infile, const char* what)
+{
+	return uint32_t(readLittleEndian(infile, 4, what));
+}
+
+/* Function: readUint64
+ * Usage: uint64_t value = readUint64(infile, what);
+ * --------------------------------------------------------
+ * Reads eight bytes.
+ */
+uint64_t readUint64(istream& infile, const char* what)
+{
+	return readLittleEndian(infile, 8, what);
+}
@@ -0,0 +1,48 @@
+/**********************************************************
+ * File: LittleEndian.h
+ *
+ * Whole numbers in a fixed number of bytes, least significant
+ * byte first, as every container stores its sizes, counts and
+ * checksums.  The bytes are written and read one at a time, so
+ * the layout is the same on every processor.
+ */
+
+#ifndef LittleEndian_Included
+#define LittleEndian_Included
+
+#include "HuffmanTypes.h"
+#include <istream>
+#include <ostream>
+using namespace std;
+
+/* Function: writeUint32
+ * Usage: writeUint32(outfile, value);
+ * --------------------------------------------------------
+ * Writes value to outfile as four bytes, least significant first.
+ */
+void writeUint32(ostream& outfile, uint32_t value);
+
+/* Function: writeUint64
+ * Usage: writeUint64(outfile, value);
+ * --------------------------------------------------------
+ * Writes value to outfile as eight bytes, least significant first.
+ */
+void writeUint64(ostream& outfile, uint64_t value);
+
+/* Function: readUint32
+ * Usage: uint32_t value = readUint32(infile, "Block container");
+ * --------------------------------------------------------
+ * Reads four bytes written by writeUint32.  If the stream ends
+ * first, raises an error saying that what is cut off.
+ */
+uint32_t readUint32(istream& infile, const char* what);
+
+/* Function: readUint64
+ * Usage: uint64_t value = readUint64(infile, "Checkpoint index");
+ * --------------------------------------------------------
+ * Reads eight bytes written by writeUint64, raising the same
+ * error as readUint32 if the stream ends first.
+ */
+uint64_t readUint64(istream& infile, const char* what);
+
+#endif
@@ -0,0 +1,468 @@
+/**********************************************************
+ * File: MappedFile.cpp
+ *
+ * Implementation of the memory-mapped streams from
+ * MappedFile.h, for Windows and for POSIX systems.
+ */
+
+#include "MappedFile.h"
+#include "strlib.h"
+#include <iostream>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+/* The smallest output mapping; mapping nothing is not allowed. */
+static const size_t MIN_MAP_CAPACITY = 4096;
+
+/* The largest mapping size_t can describe. */
+static const size_t MAX_MAP_SIZE = size_t(-1);
+
+/* Function grownCapacity
+ * ----------------------------------
+ * Returns how large an output mapping of mappedSize bytes grows to
+ * hold position bytes: doubling from at least MIN_MAP_CAPACITY, or
+ * just position once doubling would not fit in a size_t.
+ */
+static size_t grownCapacity(size_t mappedSize, size_t position) {
+	size_t capacity = (mappedSize < MIN_MAP_CAPACITY ? MIN_MAP_CAPACITY : mappedSize);
+	while (capacity < position) {
+		if (capacity > MAX_MAP_SIZE / 2) return position;
+		capacity *= 2;
+	}
+	return capacity;
+}
+
+/* Constructor mapbuf::mapbuf
+ * ----------------------------------
+ * Starts with nothing mapped.
+ */
+mapbuf::mapbuf() : base(NULL), mappedSize(0), fileSize(0), writing(false), opened(false) {
+#ifdef _WIN32
+	fileHandle = INVALID_HANDLE_VALUE;
+	mappingHandle = NULL;
+#else
+	fd = -1;
+#endif
+}
+
+/* Destructor mapbuf::~mapbuf
+ * ----------------------------------
+ * Closes the file if it is still open.
+ */
+mapbuf::~mapbuf() {
+	if (opened) close();
+}
+
+/* Member function mapbuf::openForReading
+ * ----------------------------------
+ * Opens the file and maps all of it.  An empty file is open but has
+ * nothing mapped.  A file too large for size_t to span, which on a
+ * 32-bit build is any file of 4 GiB or more, is not opened, rather
+ * than mapped only in part.
+ */
+bool mapbuf::openForReading(const char* filename) {
+	if (opened) return false;
+#ifdef _WIN32
+	fileHandle = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL,
+	                         OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (fileHandle == INVALID_HANDLE_VALUE) return false;
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(fileHandle, &size)) {
+		CloseHandle(fileHandle);
+		fileHandle = INVALID_HANDLE_VALUE;
+		return false;
+	}
+	if (ULONGLONG(size.QuadPart) > ULONGLONG(MAX_MAP_SIZE)) {
+		CloseHandle(fileHandle);
+		fileHandle = INVALID_HANDLE_VALUE;
+		return false;
+	}
+	fileSize = size_t(size.QuadPart);
+#else
+	fd = ::open(filename, O_RDONLY);
+	if (fd < 0) return false;
+	struct stat info;
+	if (fstat(fd, &info) != 0) {
+		::close(fd);
+		fd = -1;
+		return false;
+	}
+	if ((unsigned long long)info.st_size > (unsigned long long)MAX_MAP_SIZE) {
+		::close(fd);
+		fd = -1;
+		return false;
+	}
+	fileSize = size_t(info.st_size);
+#endif
+	writing = false;
+	opened = true;
+	if (fileSize > 0 && !map(fileSize)) {
+		close();
+		return false;
+	}
+	setg(base, base, base + fileSize);
+	return true;
+}
+
+/* Member function mapbuf::openForWriting
+ * ----------------------------------
+ * Creates or empties the file, then grows it to capacity bytes and
+ * maps them.
+ */
+bool mapbuf::openForWriting(const char* filename, size_t capacity) {
+	if (opened) return false;
+#ifdef _WIN32
+	fileHandle = CreateFileA(filename, GENERIC_READ | GENERIC_WRITE, 0, NULL,
+	                         CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (fileHandle == INVALID_HANDLE_VALUE) return false;
+#else
+	fd = ::open(filename, O_RDWR | O_CREAT | O_TRUNC, 0666);
+	if (fd < 0) return false;
+#endif
+	writing = true;
+	opened = true;
+	fileSize = 0;
+	if (!map(capacity < MIN_MAP_CAPACITY ? MIN_MAP_CAPACITY : capacity)) {
+		close();
+		return false;
+	}
+	setPutPosition(0);
+	return true;
+}
+
+/* Member function mapbuf::close
+ * ----------------------------------
+ * Unmaps the file and, for output, cuts it back to the bytes written
+ * before closing it.
+ */
+bool mapbuf::close() {
+	if (!opened) return false;
+	size_t written = length();
+	unmap();
+	setg(NULL, NULL, NULL);
+	setp(NULL, NULL);
+
+	bool ok = true;
+#ifdef _WIN32
+	if (writing) {
+		LARGE_INTEGER size;
+		size.QuadPart = LONGLONG(written);
+		ok = SetFilePointerEx(fileHandle, size, NULL, FILE_BEGIN) && SetEndOfFile(fileHandle);
+	}
+	if (!CloseHandle(fileHandle)) ok = false;
+	fileHandle = INVALID_HANDLE_VALUE;
+#else
+	if (writing && ftruncate(fd, off_t(written)) != 0) ok = false;
+	if (::close(fd) != 0) ok = false;
+	fd = -1;
+#endif
+	opened = false;
+	writing = false;
+	fileSize = 0;
+	return ok;
+}
+
+/* Member function mapbuf::is_open
+ * ----------------------------------
+ * Returns whether a file is open.
+ */
+bool mapbuf::is_open() const {
+	return opened;
+}
+
+/* Member function mapbuf::data
+ * ----------------------------------
+ * Returns the start of the mapping, which is NULL for an empty input.
+ */
+const char* mapbuf::data() const {
+	return base;
+}
+
+/* Member function mapbuf::length
+ * ----------------------------------
+ * For output, the end is wherever the furthest write reached.
+ */
+size_t mapbuf::length() const {
+	if (writing) {
+		size_t current = size_t(pptr() - pbase());
+		return (current > fileSize ? current : fileSize);
+	}
+	return fileSize;
+}
+
+/* Member function mapbuf::overflow
+ * ----------------------------------
+ * Called when the output mapping is full: doubles it, then stores ch.
+ * Once a remap has failed there is no mapping to grow, and every
+ * later write fails too.
+ */
+mapbuf::int_type mapbuf::overflow(int_type ch) {
+	if (!writing || base == NULL) return traits_type::eof();
+
+	size_t position = size_t(pptr() - pbase());
+	if (position > fileSize) fileSize = position;
+	if (position == MAX_MAP_SIZE) return traits_type::eof();
+	size_t capacity = grownCapacity(mappedSize, position + 1);
+	unmap();
+	if (!map(capacity)) {
+		setp(NULL, NULL);
+		return traits_type::eof();
+	}
+	setPutPosition(position);
+
+	if (!traits_type::eq_int_type(ch, traits_type::eof())) {
+		*pptr() = traits_type::to_char_type(ch);
+		pbump(1);
+	}
+	return traits_type::not_eof(ch);
+}
+
+/* Member function mapbuf::seekoff
+ * ----------------------------------
+ * Moves the read position within the input, or the write position
+ * within the output, growing the output mapping if needed.  Output
+ * that has lost its mapping to a failed remap cannot seek.
+ */
+mapbuf::pos_type mapbuf::seekoff(off_type off, ios_base::seekdir way, ios_base::openmode which) {
+	const pos_type failed = pos_type(off_type(-1));
+	if (!opened) return failed;
+
+	if (writing && (which & ios_base::out)) {
+		if (base == NULL) return failed;
+		size_t current = size_t(pptr() - pbase());
+		if (current > fileSize) fileSize = current;
+
+		off_type from = (way == ios_base::beg ? 0 : way == ios_base::cur ? off_type(current) : off_type(fileSize));
+		if (from + off < 0 || (unsigned long long)(from + off) > (unsigned long long)MAX_MAP_SIZE) return failed;
+		size_t position = size_t(from + off);
+		if (position > mappedSize) {
+			size_t capacity = grownCapacity(mappedSize, position);
+			unmap();
+			if (!map(capacity)) {
+				setp(NULL, NULL);
+				return failed;
+			}
+		}
+		setPutPosition(position);
+		return pos_type(off_type(position));
+	}
+
+	if (!writing && (which & ios_base::in)) {
+		size_t current = size_t(gptr() - eback());
+		off_type from = (way == ios_base::beg ? 0 : way == ios_base::cur ? off_type(current) : off_type(fileSize));
+		if (from + off < 0 || from + off > off_type(fileSize)) return failed;
+		setg(base, base + (from + off), base + fileSize);
+		return pos_type(from + off);
+	}
+
+	return failed;
+}
+
+/* Member function mapbuf::seekpos
+ * ----------------------------------
+ * Same as seekoff from the beginning.
+ */
+mapbuf::pos_type mapbuf::seekpos(pos_type pos, ios_base::openmode which) {
+	return seekoff(off_type(pos), ios_base::beg, which);
+}
+
+/* Member function mapbuf::map
+ * ----------------------------------
+ * Maps the first size bytes of the open file, read-only for input.
+ * For output the file is first made size bytes long.
+ */
+bool mapbuf::map(size_t size) {
+#ifdef _WIN32
+	LARGE_INTEGER length;
+	length.QuadPart = LONGLONG(size);
+	mappingHandle = CreateFileMappingA(fileHandle, NULL, writing ? PAGE_READWRITE : PAGE_READONLY,
+	                                   length.HighPart, length.LowPart, NULL);
+	if (mappingHandle == NULL) return false;
+	base = (char*)MapViewOfFile(mappingHandle, writing ? FILE_MAP_WRITE : FILE_MAP_READ, 0, 0, size);
+	if (base == NULL) {
+		CloseHandle(mappingHandle);
+		mappingHandle = NULL;
+		return false;
+	}
+#else
+	if (writing && ftruncate(fd, off_t(size)) != 0) return false;
+	void* start = mmap(NULL, size, writing ? PROT_READ | PROT_WRITE : PROT_READ,
+	                   writing ? MAP_SHARED : MAP_PRIVATE, fd, 0);
+	if (start == MAP_FAILED) return false;
+	base = (char*)start;
+#endif
+	mappedSize = size;
+	return true;
+}
+
+/* Member function mapbuf::unmap
+ * ----------------------------------
+ * Releases the current mapping, if there is one.
+ */
+void mapbuf::unmap() {
+	if (base == NULL) return;
+#ifdef _WIN32
+	UnmapViewOfFile(base);
+	CloseHandle(mappingHandle);
+	mappingHandle = NULL;
+#else
+	munmap(base, mappedSize);
+#endif
+	base = NULL;
+	mappedSize = 0;
+}
+
+/* Member function mapbuf::setPutPosition
+ * ----------------------------------
+ * Points the put area at the whole mapping with the next write at
+ * position.  pbump only takes an int, so large moves are split up.
+ */
+void mapbuf::setPutPosition(size_t position) {
+	setp(base, base + mappedSize);
+	const size_t step = 1 << 30;
+	while (position > step) {
+		pbump(int(step));
+		position -= step;
+	}
+	pbump(int(position));
+}
+
+/* Constructor imapbstream::imapbstream
+ * -------------------------------------------
+ * Wires up the stream class so that it knows to read data
+ * from a mapping.
+ */
+imapbstream::imapbstream() {
+	init(&mb);
+}
+
+/* Constructor imapbstream::imapbstream
+ * -------------------------------------------
+ * Wires up the stream class so that it knows to read data
+ * from a mapping, then maps the given file.
+ */
+imapbstream::imapbstream(const char* filename) {
+	init(&mb);
+	open(filename);
+}
+imapbstream::imapbstream(string filename) {
+	init(&mb);
+	open(filename);
+}
+
+/* Member function imapbstream::open
+ * -------------------------------------------
+ * Attempts to map the specified file, failing if unable
+ * to do so.
+ */
+void imapbstream::open(const char* filename) {
+	if (!mb.openForReading(filename))
+		setstate(ios::failbit);
+}
+void imapbstream::open(string filename) {
+	open(filename.c_str());
+}
+
+/* Member function imapbstream::is_open
+ * -------------------------------------------
+ * Determines whether a file is mapped.
+ */
+bool imapbstream::is_open() {
+	return mb.is_open();
+}
+
+/* Member function imapbstream::close
+ * -------------------------------------------
+ * Unmaps the file, if one is mapped.
+ */
+void imapbstream::close() {
+	if (!mb.close())
+		setstate(ios::failbit);
+}
+
+/* Member function imapbstream::data
+ * -------------------------------------------
+ * Returns the mapped bytes of the file.
+ */
+const unsigned char* imapbstream::data() {
+	return (const unsigned char*)mb.data();
+}
+
+/* Member function imapbstream::length
+ * -------------------------------------------
+ * Returns the number of mapped bytes.
+ */
+size_t imapbstream::length() {
+	return mb.length();
+}
+
+/* Constructor omapbstream::omapbstream
+ * -------------------------------------------
+ * Wires up the stream class so that it knows to write data
+ * to a mapping.
+ */
+omapbstream::omapbstream() {
+	init(&mb);
+}
+
+/* Constructor omapbstream::omapbstream
+ * -------------------------------------------
+ * Wires up the stream class so that it knows to write data
+ * to a mapping, then opens the given file.
+ */
+omapbstream::omapbstream(const char* filename, size_t capacity) {
+	init(&mb);
+	open(filename, capacity);
+}
+omapbstream::omapbstream(string filename, size_t capacity) {
+	init(&mb);
+	open(filename, capacity);
+}
+
+/* Member function omapbstream::open
+ * -------------------------------------------
+ * Attempts to create and map the specified file, failing if
+ * unable to do so.  Source files are refused, as by ofbstream.
+ */
+void omapbstream::open(const char* filename, size_t capacity) {
+	if (endsWith(filename, ".cpp") || endsWith(filename, ".h") ||
+			endsWith(filename, ".hh") || endsWith(filename, ".cc")) {
+		cerr << "It is potentially extremely dangerous to write to file "
+				 << filename << ", because that might be your own source code.	"
+				 << "We're explicitly disallowing this operation.	 Please choose a "
+				 << "different filename." << endl;
+		setstate(ios::failbit);
+
+	} else {
+		if (!mb.openForWriting(filename, capacity))
+			setstate(ios::failbit);
+	}
+}
+void omapbstream::open(string filename, size_t capacity) {
+	open(filename.c_str(), capacity);
+}
+
+/* Member function omapbstream::is_open
+ * -------------------------------------------
+ * Determines whether a file is mapped.
+ */
+bool omapbstream::is_open() {
+	return mb.is_open();
+}
+
+/* Member function omapbstream::close
+ * -------------------------------------------
+ * Flushes any buffered bits, then finishes and unmaps the file.
+ */
+void omapbstream::close() {
+	flushBits();
+	if (!mb.close())
+		setstate(ios::failbit);
+}
@@ -0,0 +1,256 @@
+/**********************************************************
+ * File: MappedFile.h
+ *
+ * Bit streams over memory-mapped files.  imapbstream and
+ * omapbstream work like ifbstream and ofbstream, but the file
+ * is mapped into memory, so reading and writing go straight
+ * to the mapped pages instead of being copied through a
+ * filebuf.  The mapped input is also available as a plain
+ * pointer, for code that wants to work on the bytes directly.
+ */
+
+#ifndef MappedFile_Included
+#define MappedFile_Included
+
+#include "bstream.h"
+#include <streambuf>
+#include <string>
+using namespace std;
+
+/* Constant: DEFAULT_MAP_CAPACITY
+ * How many bytes an output mapping starts out with unless told
+ * otherwise.  The mapping grows when it fills up.
+ */
+const size_t DEFAULT_MAP_CAPACITY = 1 << 20;
+
+/*
+ * Class: mapbuf
+ * ---------------
+ * A stream buffer over a memory-mapped file.  For reading, the whole
+ * file is mapped read-only.  For writing, the file is made as large
+ * as the requested capacity and mapped; the mapping doubles whenever
+ * it fills up, and the file is cut back to the bytes written when it
+ * is closed.
+ */
+class mapbuf: public streambuf {
+public:
+	mapbuf();
+	~mapbuf();
+
+	/*
+	 * Member function: openForReading
+	 * Usage: if (mb.openForReading("file")) { ... }
+	 * ---------------------------------------------
+	 * Maps the given file for reading.  Returns whether it worked,
+	 * which it does not for a file larger than size_t can span.
+	 */
+	bool openForReading(const char* filename);
+
+	/*
+	 * Member function: openForWriting
+	 * Usage: if (mb.openForWriting("file", capacity)) { ... }
+	 * -------------------------------------------------------
+	 * Creates or empties the given file and maps capacity bytes of
+	 * it for writing.  Returns whether it worked.
+	 */
+	bool openForWriting(const char* filename, size_t capacity);
+
+	/*
+	 * Member function: close
+	 * Usage: if (mb.close()) { ... }
+	 * ------------------------------
+	 * Unmaps the file, first cutting an output file back to what was
+	 * written.  Returns false if nothing was open or the file could
+	 * not be finished properly.
+	 */
+	bool close();
+
+	/*
+	 * Member function: is_open
+	 * Usage: if (mb.is_open()) { ... }
+	 * --------------------------------
+	 * Returns whether a file is mapped.
+	 */
+	bool is_open() const;
+
+	/*
+	 * Member function: data
+	 * Usage: const char* bytes = mb.data();
+	 * -------------------------------------
+	 * Returns the start of the mapping.
+	 */
+	const char* data() const;
+
+	/*
+	 * Member function: length
+	 * Usage: size_t n = mb.length();
+	 * ------------------------------
+	 * Returns the size of an input file, or the number of bytes
+	 * written so far to an output file.
+	 */
+	size_t length() const;
+
+protected:
+	int_type overflow(int_type ch);
+	pos_type seekoff(off_type off, ios_base::seekdir way, ios_base::openmode which);
+	pos_type seekpos(pos_type pos, ios_base::openmode which);
+
+private:
+	bool map(size_t size);
+	void unmap();
+	void setPutPosition(size_t position);
+
+	/* Not copyable, since it owns the mapping. */
+	mapbuf(const mapbuf&);
+	mapbuf& operator=(const mapbuf&);
+
+	char* base;
+	size_t mappedSize;
+	size_t fileSize;     /* input size, or the most ever written */
+	bool writing;
+	bool opened;
+#ifdef _WIN32
+	void* fileHandle;
+	void* mappingHandle;
+#else
+	int fd;
+#endif
+};
+
+/*
+ * Class: imapbstream
+ * ---------------
+ * A class for reading files in all of the usual ways, plus bit-by-bit,
+ * through a read-only memory mapping.  You can treat this class like an
+ * ifbstream.
+ */
+class imapbstream: public ibstream {
+public:
+	/*
+	 * Constructor: imapbstream();
+	 * Usage: imapbstream imb;
+	 * -------------------------
+	 * Constructs a new imapbstream not attached to any file.
+	 */
+	imapbstream();
+
+	/*
+	 * Constructor: imapbstream(const char* filename);
+	 * Constructor: imapbstream(string filename);
+	 * Usage: imapbstream imb("filename");
+	 * -------------------------
+	 * Constructs a new imapbstream that maps the specified file, if
+	 * it exists.	 If not, the stream enters an error state.
+	 */
+	imapbstream(const char* filename);
+	imapbstream(string filename);
+
+	/*
+	 * Member function: open(const char* filename);
+	 * Member function: open(string filename);
+	 * Usage: imb.open("my-file.txt");
+	 * -------------------------
+	 * Maps the specified file for reading.	If an error occurs, the
+	 * stream enters a failure state.
+	 */
+	void open(const char* filename);
+	void open(string filename);
+
+	/*
+	 * Member function: is_open();
+	 * Usage: if (imb.is_open()) { ... }
+	 * --------------------------
+	 * Returns whether or not this imapbstream has a file mapped.
+	 */
+	bool is_open();
+
+	/*
+	 * Member function: close();
+	 * Usage: imb.close();
+	 * --------------------------
+	 * Unmaps the file.  If the stream is not open, puts the stream
+	 * into a fail state.
+	 */
+	void close();
+
+	/*
+	 * Member function: data();
+	 * Member function: length();
+	 * Usage: countBytes(imb.data(), imb.length(), counts);
+	 * --------------------------
+	 * Return the mapped bytes of the whole file and how many there
+	 * are, independent of the read position.
+	 */
+	const unsigned char* data();
+	size_t length();
+
+private:
+	/* The mapping that does the reading. */
+	mapbuf mb;
+};
+
+/*
+ * Class: omapbstream
+ * ---------------
+ * A class for writing files in all of the usual ways, plus bit-by-bit,
+ * into a memory mapping.  You can treat this class like an ofbstream;
+ * as with ofbstream, source files cannot be opened for writing.
+ */
+class omapbstream: public obstream {
+public:
+	/*
+	 * Constructor: omapbstream();
+	 * Usage: omapbstream omb;
+	 * -------------------------
+	 * Constructs a new omapbstream not attached to any file.
+	 */
+	omapbstream();
+
+	/*
+	 * Constructor: omapbstream(const char* filename);
+	 * Constructor: omapbstream(string filename);
+	 * Usage: omapbstream omb("filename", expectedSize);
+	 * -------------------------
+	 * Constructs a new omapbstream that writes the specified file.
+	 * Read the documentation on "open" for more details.
+	 */
+	omapbstream(const char* filename, size_t capacity = DEFAULT_MAP_CAPACITY);
+	omapbstream(string filename, size_t capacity = DEFAULT_MAP_CAPACITY);
+
+	/*
+	 * Member function: open(const char* filename);
+	 * Member function: open(string filename);
+	 * Usage: omb.open("my-file.txt", expectedSize);
+	 * -------------------------
+	 * Opens the specified file for writing, mapping capacity bytes
+	 * to start with; an accurate guess at the final size avoids any
+	 * remapping.  If an error occurs, the stream enters a failure
+	 * state.
+	 */
+	void open(const char* filename, size_t capacity = DEFAULT_MAP_CAPACITY);
+	void open(string filename, size_t capacity = DEFAULT_MAP_CAPACITY);
+
+	/*
+	 * Member function: is_open();
+	 * Usage: if (omb.is_open()) { ... }
+	 * --------------------------
+	 * Returns whether or not this omapbstream has a file mapped.
+	 */
+	bool is_open();
+
+	/*
+	 * Member function: close();
+	 * Usage: omb.close();
+	 * --------------------------
+	 * Flushes any buffered bits, cuts the file back to the bytes
+	 * written, and unmaps it.  If the stream is not open, puts the
+	 * stream into a fail state.
+	 */
+	void close();
+
+private:
+	/* The mapping that does the writing. */
+	mapbuf mb;
+};
+
+#endif
@@ -6,10 +6,208 @@
 
 #include "MemoryDiagnostics.h"
 #include "HuffmanTypes.h"
+#include <cstdlib>
+#include <new>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#pragma intrinsic(_InterlockedCompareExchange64)
+#define THREAD_LOCAL __declspec(thread)
+#else
+#define THREAD_LOCAL __thread
+#endif
+
+/* Exception specifications for the replaced operators.  C++11 drops
+ * dynamic ones, and C++17 rejects them, so a new may throw anything
+ * and a delete is noexcept there; Visual C++ never checked them.
+ */
+#if __cplusplus >= 201103L || defined(_MSC_VER)
+#define THROWS_BAD_ALLOC
+#else
+#define THROWS_BAD_ALLOC throw(std::bad_alloc)
+#endif
+#if __cplusplus >= 201103L
+#define THROWS_NOTHING noexcept
+#else
+#define THROWS_NOTHING throw()
+#endif
+
+/* Type: Counters
+ * The shared form of MemoryUsage, updated only atomically.
+ */
+struct Counters {
+	volatile int64_t allocations;
+	volatile int64_t frees;
+	volatile int64_t bytesAllocated;
+	volatile int64_t liveBytes;
+	volatile int64_t peakBytes;
+};
+
+/* Type: BlockHeader
+ * Stored just in front of every block from operator new, so that
+ * operator delete knows what it is freeing.  BLOCK_HEADER_SIZE keeps
+ * the block itself as well aligned as malloc's.
+ */
+struct BlockHeader {
+	size_t size;
+	int category;
+};
+const size_t BLOCK_HEADER_SIZE = 16;
 
 /* Global variables (ewww!) tracking total allocations. */
-static long gTotalAllocs = 0;
-static long gTotalFrees = 0;
+static volatile int64_t gTotalAllocs = 0;
+static volatile int64_t gTotalFrees = 0;
+
+/* Counters for every category and for the whole program. */
+static Counters gCategoryCounters[NUM_MEMORY_CATEGORIES];
+static Counters gTotalCounters;
+
+/* The calling thread's category and counters. */
+static THREAD_LOCAL int tCurrentCategory = OTHER_MEMORY;
+static THREAD_LOCAL MemoryUsage tThreadUsage;
+
+/* Function: atomicAdd
+ * --------------------------------------------------------
+ * Adds delta to target as one indivisible step and returns the new
+ * value.  Adding zero reads target safely.
+ */
+static int64_t atomicAdd(volatile int64_t* target, int64_t delta) {
+#ifdef _MSC_VER
+	int64_t old;
+	do {
+		old = *target;
+	} while (_InterlockedCompareExchange64(target, old + delta, old) != old);
+	return old + delta;
+#else
+	return __sync_add_and_fetch(target, delta);
+#endif
+}
+
+/* Function: atomicMax
+ * --------------------------------------------------------
+ * Raises target to value if it is lower, as one indivisible step.
+ */
+static void atomicMax(volatile int64_t* target, int64_t value) {
+	while (true) {
+		int64_t old = atomicAdd(target, 0);
+		if (old >= value) return;
+#ifdef _MSC_VER
+		if (_InterlockedCompareExchange64(target, value, old) == old) return;
+#else
+		if (__sync_val_compare_and_swap(target, old, value) == old) return;
+#endif
+	}
+}
+
+#ifdef TRACK_HEAP_MEMORY
+
+/* Function: countBlock
+ * --------------------------------------------------------
+ * Records a block of size bytes being allocated (sign 1) or freed
+ * (sign -1) under category.
+ */
+static void countBlock(Counters& counters, int64_t size, int sign) {
+	atomicAdd(sign > 0 ? &counters.allocations : &counters.frees, 1);
+	if (sign > 0) atomicAdd(&counters.bytesAllocated, size);
+	int64_t live = atomicAdd(&counters.liveBytes, sign * size);
+	if (sign > 0) atomicMax(&counters.peakBytes, live);
+}
+
+static void countBlock(int category, int64_t size, int sign) {
+	countBlock(gCategoryCounters[category], size, sign);
+	countBlock(gTotalCounters, size, sign);
+
+	MemoryUsage& usage = tThreadUsage;
+	if (sign > 0) {
+		usage.allocations++;
+		usage.bytesAllocated += size;
+	} else {
+		usage.frees++;
+	}
+	usage.liveBytes += sign * size;
+	if (usage.liveBytes > usage.peakBytes) usage.peakBytes = usage.liveBytes;
+}
+
+#endif
+
+/* Function: snapshot
+ * --------------------------------------------------------
+ * Reads shared counters into a MemoryUsage.
+ */
+static MemoryUsage snapshot(Counters& counters) {
+	MemoryUsage usage;
+	usage.allocations = atomicAdd(&counters.allocations, 0);
+	usage.frees = atomicAdd(&counters.frees, 0);
+	usage.bytesAllocated = atomicAdd(&counters.bytesAllocated, 0);
+	usage.liveBytes = atomicAdd(&counters.liveBytes, 0);
+	usage.peakBytes = atomicAdd(&counters.peakBytes, 0);
+	return usage;
+}
+
+#ifdef TRACK_HEAP_MEMORY
+
+/* Global operators new and delete
+ * Usage: Implicit
+ * --------------------------------------------------------
+ * Every allocation in the program comes through here.  The
+ * block is allocated with room for a BlockHeader in front, and
+ * counted under the calling thread's category.  The array and
+ * nothrow forms all go through the plain ones.
+ */
+void* operator new(size_t bytesNeeded) THROWS_BAD_ALLOC {
+	void* block;
+	while ((block = malloc(bytesNeeded + BLOCK_HEADER_SIZE)) == NULL) {
+		std::new_handler handler = std::set_new_handler(NULL);
+		std::set_new_handler(handler);
+		if (handler == NULL) throw std::bad_alloc();
+		handler();
+	}
+
+	BlockHeader* header = static_cast<BlockHeader*>(block);
+	header->size = bytesNeeded;
+	header->category = tCurrentCategory;
+	countBlock(header->category, int64_t(bytesNeeded), 1);
+	return static_cast<char*>(block) + BLOCK_HEADER_SIZE;
+}
+
+void operator delete(void* toDelete) THROWS_NOTHING {
+	if (toDelete == NULL) return;
+
+	void* block = static_cast<char*>(toDelete) - BLOCK_HEADER_SIZE;
+	BlockHeader* header = static_cast<BlockHeader*>(block);
+	countBlock(header->category, int64_t(header->size), -1);
+	free(block);
+}
+
+void* operator new[](size_t bytesNeeded) THROWS_BAD_ALLOC {
+	return operator new(bytesNeeded);
+}
+
+void operator delete[](void* toDelete) THROWS_NOTHING {
+	operator delete(toDelete);
+}
+
+void* operator new(size_t bytesNeeded, const std::nothrow_t&) THROWS_NOTHING {
+	try {
+		return operator new(bytesNeeded);
+	} catch (std::bad_alloc&) {
+		return NULL;
+	}
+}
+
+void operator delete(void* toDelete, const std::nothrow_t&) THROWS_NOTHING {
+	operator delete(toDelete);
+}
+
+void* operator new[](size_t bytesNeeded, const std::nothrow_t&) THROWS_NOTHING {
+	return operator new(bytesNeeded, std::nothrow);
+}
+
+void operator delete[](void* toDelete, const std::nothrow_t&) THROWS_NOTHING {
+	operator delete(toDelete);
+}
+
+#endif
 
 /* Operators new and delete
  * Usage: Implicit
@@ -19,11 +217,11 @@ static long gTotalFrees = 0;
  * deallocations.
  */
 void* Node::operator new (size_t bytesNeeded) {
-	++gTotalAllocs;
+	atomicAdd(&gTotalAllocs, 1);
 	return ::operator new(bytesNeeded);
 }
 void	Node::operator delete(void* toDelete) {
-	++gTotalFrees;
+	atomicAdd(&gTotalFrees, 1);
 	return ::operator delete(toDelete);
 }
 
@@ -35,7 +233,7 @@ void	Node::operator delete(void* toDelete) {
  * throughout the program.
  */
 long numAllocations() {
-	return gTotalAllocs;
+	return long(atomicAdd(&gTotalAllocs, 0));
 }
 
 /* Function: numDeallocations
@@ -45,6 +243,117 @@ long numAllocations() {
  * throughout the program.
  */
 long numDeallocations() {
-	return gTotalFrees;
+	return long(atomicAdd(&gTotalFrees, 0));
+}
+
+/* Function: recordNodeAllocations
+ * Usage: recordNodeAllocations(count);
+ * --------------------------------------------------------
+ * Counts count Nodes as allocated without going through
+ * operator new.
+ */
+void recordNodeAllocations(long count) {
+	atomicAdd(&gTotalAllocs, count);
 }
 
+/* Function: recordNodeDeallocations
+ * Usage: recordNodeDeallocations(count);
+ * --------------------------------------------------------
+ * Counts count Nodes as deallocated without going through
+ * operator delete.
+ */
+void recordNodeDeallocations(long count) {
+	atomicAdd(&gTotalFrees, count);
+}
+
+/* Function: isTrackingHeapMemory
+ * Usage: if (isTrackingHeapMemory()) ...
+ * --------------------------------------------------------
+ * Returns whether the operators above were built in.
+ */
+bool isTrackingHeapMemory() {
+#ifdef TRACK_HEAP_MEMORY
+	return true;
+#else
+	return false;
+#endif
+}
+
+/* Function: memoryUsage
+ * Usage: MemoryUsage usage = memoryUsage(TREE_MEMORY);
+ * --------------------------------------------------------
+ * Returns the counters for one category across all threads.
+ */
+MemoryUsage memoryUsage(MemoryCategory category) {
+	return snapshot(gCategoryCounters[category]);
+}
+
+/* Function: totalMemoryUsage
+ * Usage: MemoryUsage usage = totalMemoryUsage();
+ * --------------------------------------------------------
+ * Returns the counters for every allocation in the program.
+ */
+MemoryUsage totalMemoryUsage() {
+	return snapshot(gTotalCounters);
+}
+
+/* Function: threadMemoryUsage
+ * Usage: MemoryUsage usage = threadMemoryUsage();
+ * --------------------------------------------------------
+ * Returns the counters of the calling thread.
+ */
+MemoryUsage threadMemoryUsage() {
+	return tThreadUsage;
+}
+
+/* Function: resetPeakMemory
+ * Usage: resetPeakMemory();
+ * --------------------------------------------------------
+ * Lowers every peak to the current liveBytes.  Another thread
+ * allocating at the same moment may leave a peak a little high,
+ * never too low.
+ */
+void resetPeakMemory() {
+	for (int i = 0; i <= NUM_MEMORY_CATEGORIES; i++) {
+		Counters& counters = (i < NUM_MEMORY_CATEGORIES ? gCategoryCounters[i] : gTotalCounters);
+		int64_t old = atomicAdd(&counters.peakBytes, 0);
+		atomicAdd(&counters.peakBytes, -old);
+		atomicMax(&counters.peakBytes, atomicAdd(&counters.liveBytes, 0));
+	}
+	tThreadUsage.peakBytes = tThreadUsage.liveBytes;
+}
+
+/* Function: memoryCategoryName
+ * Usage: cout << memoryCategoryName(TREE_MEMORY);
+ * --------------------------------------------------------
+ * Returns a short lower-case name for category.
+ */
+const char* memoryCategoryName(MemoryCategory category) {
+	switch (category) {
+		case OTHER_MEMORY: return "other";
+		case FREQUENCY_MEMORY: return "frequency";
+		case TREE_MEMORY: return "tree";
+		case TABLE_MEMORY: return "table";
+		case HEADER_MEMORY: return "header";
+		case CODING_MEMORY: return "coding";
+		case BLOCK_MEMORY: return "block";
+		default: return "unknown";
+	}
+}
+
+/* Constructor: MemoryCategoryScope
+ * ----------------------------------------------------
+ * Switches the calling thread to category, remembering the old one.
+ */
+MemoryCategoryScope::MemoryCategoryScope(MemoryCategory category)
+	: previous(MemoryCategory(tCurrentCategory)) {
+	tCurrentCategory = category;
+}
+
+/* Destructor: ~MemoryCategoryScope
+ * ----------------------------------------------------
+ * Switches back to the category from before.
+ */
+MemoryCategoryScope::~MemoryCategoryScope() {
+	tCurrentCategory = previous;
+}
@@ -4,10 +4,26 @@
  * Code to allow for memory diagnostics.  These functions
  * allow us to count how many Nodes you have allocated and
  * deallocated.
+ *
+ * Beyond Nodes, every allocation the program makes through
+ * operator new is counted, with its size, under the memory
+ * category of the code that made it.  The codec marks its
+ * phases with MemoryCategoryScope, so the Maps, strings and
+ * Vectors it uses are charged to the phase they belong to.
+ * All counters are updated atomically and may be read while
+ * other threads allocate.
+ *
+ * Counting beyond Nodes replaces the global operator new and
+ * delete, which puts a header on every block the program
+ * allocates.  That is only done in a program built with
+ * TRACK_HEAP_MEMORY defined, as the test harness is; elsewhere
+ * the heap counters stay at zero and only Nodes are counted.
  */
 #ifndef MemoryDiagnostics_Included
 #define MemoryDiagnostics_Included
 
+#include "HuffmanTypes.h"
+
 /* Function: numAllocations
  * Usage: long x = numAllocations();
  * --------------------------------------------------------
@@ -24,4 +40,129 @@ long numAllocations();
  */
 long numDeallocations();
 
+/* Function: recordNodeAllocations
+ * Usage: recordNodeAllocations(count);
+ * --------------------------------------------------------
+ * Counts count Nodes as allocated without going through
+ * operator new.  Used by NodeArena.
+ */
+void recordNodeAllocations(long count);
+
+/* Function: recordNodeDeallocations
+ * Usage: recordNodeDeallocations(count);
+ * --------------------------------------------------------
+ * Counts count Nodes as deallocated without going through
+ * operator delete.  Used by NodeArena.
+ */
+void recordNodeDeallocations(long count);
+
+/* Type: MemoryCategory
+ * What an allocation was made for, by the kind of code that made it.
+ *
+ *   OTHER_MEMORY:     anything outside a marked part of the codec.
+ *   FREQUENCY_MEMORY: counting characters, including the frequency
+ *                     table itself.
+ *   TREE_MEMORY:      building encoding trees or code lengths.
+ *   TABLE_MEMORY:     code and decode tables.
+ *   HEADER_MEMORY:    writing and reading file headers.
+ *   CODING_MEMORY:    encoding and decoding the data.
+ *   BLOCK_MEMORY:     block buffers of the block container.
+ */
+enum MemoryCategory {
+	OTHER_MEMORY,
+	FREQUENCY_MEMORY,
+	TREE_MEMORY,
+	TABLE_MEMORY,
+	HEADER_MEMORY,
+	CODING_MEMORY,
+	BLOCK_MEMORY,
+	NUM_MEMORY_CATEGORIES
+};
+
+/* Type: MemoryUsage
+ * Counters for a set of allocations.  liveBytes is what has been
+ * allocated and not yet freed, and peakBytes the most liveBytes has
+ * been since the program started or resetPeakMemory was called.
+ * Sizes are those requested from operator new.
+ */
+struct MemoryUsage {
+	int64_t allocations;
+	int64_t frees;
+	int64_t bytesAllocated;
+	int64_t liveBytes;
+	int64_t peakBytes;
+};
+
+/* Function: isTrackingHeapMemory
+ * Usage: if (isTrackingHeapMemory()) ...
+ * --------------------------------------------------------
+ * Returns whether the program was built with TRACK_HEAP_MEMORY,
+ * without which the counters below are always zero.
+ */
+bool isTrackingHeapMemory();
+
+/* Function: memoryUsage
+ * Usage: MemoryUsage usage = memoryUsage(TREE_MEMORY);
+ * --------------------------------------------------------
+ * Returns the counters for one category across all threads.  A
+ * block is charged to the category it was allocated under, even if
+ * it is freed under another.
+ */
+MemoryUsage memoryUsage(MemoryCategory category);
+
+/* Function: totalMemoryUsage
+ * Usage: MemoryUsage usage = totalMemoryUsage();
+ * --------------------------------------------------------
+ * Returns the counters for every allocation in the program.  The
+ * peak is that of the total, which may be less than the sum of the
+ * category peaks.
+ */
+MemoryUsage totalMemoryUsage();
+
+/* Function: threadMemoryUsage
+ * Usage: MemoryUsage usage = threadMemoryUsage();
+ * --------------------------------------------------------
+ * Returns the counters for the allocations and frees made by the
+ * calling thread, which is what a per-worker quota needs.  A block
+ * freed by a different thread than the one that allocated it lowers
+ * the freeing thread's liveBytes, which can then be negative.
+ */
+MemoryUsage threadMemoryUsage();
+
+/* Function: resetPeakMemory
+ * Usage: resetPeakMemory();
+ * --------------------------------------------------------
+ * Lowers every peak, including the calling thread's, to the
+ * current liveBytes, so that the peak of a single job can be
+ * measured.
+ */
+void resetPeakMemory();
+
+/* Function: memoryCategoryName
+ * Usage: cout << memoryCategoryName(TREE_MEMORY);
+ * --------------------------------------------------------
+ * Returns a short lower-case name for category.
+ */
+const char* memoryCategoryName(MemoryCategory category);
+
+/* Class: MemoryCategoryScope
+ * Charges the calling thread's allocations to a category for as long
+ * as the object exists, then goes back to the category from before.
+ * Scopes nest; the innermost one wins.
+ *
+ *     MemoryCategoryScope scope(TREE_MEMORY);
+ */
+class MemoryCategoryScope {
+public:
+	explicit MemoryCategoryScope(MemoryCategory category);
+	~MemoryCategoryScope();
+
+private:
+	MemoryCategory previous;
+
+	/* Not copyable, since it restores the category once. */
+	MemoryCategoryScope(const MemoryCategoryScope&);
+	MemoryCategoryScope& operator=(const MemoryCategoryScope&);
+};
+
 #endif
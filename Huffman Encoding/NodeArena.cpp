@@ -0,0 +1,62 @@
+/**********************************************************
+ * File: NodeArena.cpp
+ *
+ * Implementation of the NodeArena class from NodeArena.h.
+ */
+
+#include "NodeArena.h"
+#include "MemoryDiagnostics.h"
+#include "error.h"
+
+/* Constructor: NodeArena
+ * ----------------------------------------------------
+ * Creates an arena with every Node free.
+ */
+NodeArena::NodeArena() : used(0) {
+	/* Empty */
+}
+
+/* Destructor: ~NodeArena
+ * ----------------------------------------------------
+ * Releases any Nodes still handed out.
+ */
+NodeArena::~NodeArena() {
+	reset();
+}
+
+/* Member function: allocate
+ * ----------------------------------------------------
+ * Returns the next free Node, counting it as an allocation.
+ */
+Node* NodeArena::allocate() {
+	if (used == ARENA_CAPACITY) error("Node arena is full.");
+	recordNodeAllocations(1);
+	return &nodes[used++];
+}
+
+/* Member function: reset
+ * ----------------------------------------------------
+ * Marks every Node free again and counts them all as freed.
+ */
+void NodeArena::reset() {
+	recordNodeDeallocations(used);
+	used = 0;
+}
+
+/* Member function: releaseAfter
+ * ----------------------------------------------------
+ * Marks the Nodes past mark free again and counts them as freed.
+ */
+void NodeArena::releaseAfter(int mark) {
+	if (mark < 0 || mark > used) error("Node arena mark is out of range.");
+	recordNodeDeallocations(used - mark);
+	used = mark;
+}
+
+/* Member function: size
+ * ----------------------------------------------------
+ * Returns the number of Nodes in use.
+ */
+int NodeArena::size() const {
+	return used;
+}
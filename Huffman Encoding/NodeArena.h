@@ -0,0 +1,77 @@
+/**********************************************************
+ * File: NodeArena.h
+ *
+ * A fixed block of Nodes for building encoding trees without
+ * a heap allocation per node.  Every tree over the 257
+ * ext_chars fits in one arena, and all of its nodes are
+ * released at once by resetting the arena.
+ */
+
+#ifndef NodeArena_Included
+#define NodeArena_Included
+
+#include "HuffmanTypes.h"
+#include "HuffmanTables.h"
+
+/* Constant: ARENA_CAPACITY
+ * The number of Nodes in an arena: enough for a complete tree
+ * over every ext_char.
+ */
+const int ARENA_CAPACITY = 2 * NUM_SYMBOLS;
+
+/* Class: NodeArena
+ * Hands out Nodes from a contiguous block.  Nodes from an arena
+ * must not be passed to freeTree or deleted; they stay valid
+ * until the arena is reset or destroyed.  Allocations and
+ * releases are still reported to numAllocations and
+ * numDeallocations.  An arena must only be used by one thread at
+ * a time.
+ */
+class NodeArena {
+public:
+	NodeArena();
+	~NodeArena();
+
+	/* Member function: allocate
+	 * Usage: Node* node = arena.allocate();
+	 * ----------------------------------------------------
+	 * Returns an uninitialized Node from the arena.  Raises an
+	 * error if all ARENA_CAPACITY nodes are in use.
+	 */
+	Node* allocate();
+
+	/* Member function: reset
+	 * Usage: arena.reset();
+	 * ----------------------------------------------------
+	 * Releases every Node handed out so far in constant time.
+	 */
+	void reset();
+
+	/* Member function: releaseAfter
+	 * Usage: int mark = arena.size();
+	 *        ...
+	 *        arena.releaseAfter(mark);
+	 * ----------------------------------------------------
+	 * Releases only the Nodes handed out since size() was mark,
+	 * leaving those from before, and any trees they make up, as
+	 * they were.
+	 */
+	void releaseAfter(int mark);
+
+	/* Member function: size
+	 * Usage: int used = arena.size();
+	 * ----------------------------------------------------
+	 * Returns the number of Nodes handed out since the last reset.
+	 */
+	int size() const;
+
+private:
+	/* Not copyable, since trees point into the block. */
+	NodeArena(const NodeArena&);
+	NodeArena& operator=(const NodeArena&);
+
+	Node nodes[ARENA_CAPACITY];
+	int used;
+};
+
+#endif
@@ -0,0 +1,28 @@
+/**********************************************************
+ * File: OutputBuffer.cpp
+ *
+ * Implementation of the OutputBuffer class from OutputBuffer.h.
+ */
+
+#include "OutputBuffer.h"
+#include "HuffmanChecksum.h"
+
+/* Constructor: OutputBuffer
+ * ----------------------------------------------------
+ * Leaves the bytes uninitialised, since only those put are read.
+ */
+OutputBuffer::OutputBuffer(ostream& target, uint32_t* checksum)
+	: target(target), checksum(checksum), used(0) {
+	/* Empty */
+}
+
+/* Member function: flush
+ * ----------------------------------------------------
+ * One write for everything held, checksummed first.
+ */
+void OutputBuffer::flush() {
+	if (used == 0) return;
+	if (checksum != NULL) *checksum = updateCrc32c(*checksum, (const unsigned char*)bytes, used);
+	target.write(bytes, streamsize(used));
+	used = 0;
+}
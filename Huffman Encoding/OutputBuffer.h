@@ -0,0 +1,87 @@
+/**********************************************************
+ * File: OutputBuffer.h
+ *
+ * A bounded buffer in front of an output stream.  Every
+ * ostream::put goes through a sentry and the stream buffer's
+ * virtual functions, which once the decoders find a symbol in
+ * a handful of instructions costs more than finding it did.
+ * The decoders put each byte into an OutputBuffer instead,
+ * which hands them to the stream with one write per chunk.
+ * A buffer can also keep the CRC-32C of everything it writes
+ * (see HuffmanChecksum.h), taken from each chunk as it goes
+ * out, while it is still in cache.
+ *
+ * The bytes are kept in the buffer object itself and never
+ * cleared, so a decoder that keeps its buffer on the stack
+ * allocates nothing for it.  A decoder flushes the buffer once
+ * it has decoded everything; when an error is raised instead,
+ * the bytes still held are dropped rather than written out
+ * while the stack unwinds.
+ */
+
+#ifndef OutputBuffer_Included
+#define OutputBuffer_Included
+
+#include "HuffmanTypes.h"
+#include <ostream>
+using namespace std;
+
+/* Constant: OUTPUT_BUFFER_SIZE
+ * The number of bytes an OutputBuffer holds before writing them
+ * out, which is all the memory it ever uses.
+ */
+const int OUTPUT_BUFFER_SIZE = 1 << 16;
+
+/* Class: OutputBuffer
+ * Collects bytes for one output stream and writes them out in
+ * chunks of OUTPUT_BUFFER_SIZE, and whatever is left when flushed.
+ * Bytes reach the stream in the order they were put.
+ */
+class OutputBuffer {
+public:
+	/* Constructor: OutputBuffer
+	 * Usage: OutputBuffer output(outfile);
+	 *        OutputBuffer output(outfile, &crc);
+	 * ----------------------------------------------------
+	 * Creates an empty buffer in front of target.  If checksum is
+	 * given, every byte written out is added to the CRC-32C it
+	 * points to, which the caller starts at 0.
+	 */
+	explicit OutputBuffer(ostream& target, uint32_t* checksum = NULL);
+
+	/* Member function: put
+	 * Usage: output.put(ch);
+	 * ----------------------------------------------------
+	 * Adds one byte, writing the buffer out first if it is full.
+	 */
+	void put(char ch);
+
+	/* Member function: flush
+	 * Usage: output.flush();
+	 * ----------------------------------------------------
+	 * Writes out the bytes held so far, leaving the buffer empty.
+	 * Bytes not flushed by the time the buffer is destroyed are
+	 * never written.
+	 */
+	void flush();
+
+private:
+	/* Not copyable, since both copies would write the same bytes. */
+	OutputBuffer(const OutputBuffer&);
+	OutputBuffer& operator=(const OutputBuffer&);
+
+	ostream& target;
+	uint32_t* checksum;
+	char bytes[OUTPUT_BUFFER_SIZE];
+	size_t used;
+};
+
+/*
+ * put is called once per decoded symbol, so it is defined inline.
+ */
+inline void OutputBuffer::put(char ch) {
+	if (used == size_t(OUTPUT_BUFFER_SIZE)) flush();
+	bytes[used++] = ch;
+}
+
+#endif
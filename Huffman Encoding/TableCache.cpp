@@ -0,0 +1,281 @@
+/**********************************************************
+ * File: TableCache.cpp
+ *
+ * Implementation of the TableCache class and the cached
+ * table builders from TableCache.h.
+ */
+
+#include "TableCache.h"
+#include "HuffmanEncoding.h"
+#include "MemoryDiagnostics.h"
+#include <cmath>
+
+/* Constant: NODE_OVERHEAD
+ * A guess at what the list and map spend on each entry besides the
+ * entry itself and its keys.
+ */
+static const size_t NODE_OVERHEAD = 64;
+
+/* The cache installed by setTableCache. */
+static TableCache* gTableCache = NULL;
+
+/* Returns the key of the code table for weights: a tag, then one
+ * byte per ext_char that is zero if it does not appear and otherwise
+ * one more than how many FINGERPRINT_STEPS its share of the total
+ * lies below one.
+ */
+static string fingerprintKey(const uint64_t weights[NUM_SYMBOLS]) {
+	double total = 0;
+	for (int ch = 0; ch < NUM_SYMBOLS; ch++) {
+		total += double(weights[ch]);
+	}
+
+	string key(1 + NUM_SYMBOLS, '\0');
+	key[0] = 'F';
+	for (int ch = 0; ch < NUM_SYMBOLS; ch++) {
+		if (weights[ch] == 0) continue;
+		double steps = floor(FINGERPRINT_STEPS * log(total / double(weights[ch])) / log(2.0));
+		key[1 + ch] = char(1 + (steps < 254 ? int(steps) : 254));
+	}
+	return key;
+}
+
+/* Returns the key of the decode table for lengths: a tag, then the
+ * lengths themselves.
+ */
+static string lengthsKey(const uint8_t lengths[NUM_SYMBOLS]) {
+	return string("L") + string((const char*)lengths, NUM_SYMBOLS);
+}
+
+/* Returns the key of the state machine for codes: a tag, then the
+ * lengths, then the code word of each character that has one.
+ */
+static string codesKey(const CodeTable& codes) {
+	string key = string("M") + string((const char*)codes.length, NUM_SYMBOLS);
+	for (int ch = 0; ch < NUM_SYMBOLS; ch++) {
+		if (codes.length[ch] == 0) continue;
+		for (int i = 0; i < 8; i++) key += char(codes.bits[ch] >> (8 * i));
+	}
+	return key;
+}
+
+/* Constructor: TableCache
+ * ----------------------------------------------------
+ * Starts out empty with every counter at zero.
+ */
+TableCache::TableCache(size_t capacityBytes) : capacity(capacityBytes) {
+	counts.hits = counts.misses = counts.evictions = counts.entries = 0;
+	counts.bytes = 0;
+}
+
+/* Member function: findCodes
+ * ----------------------------------------------------
+ * Looks up the fingerprint of weights.
+ */
+bool TableCache::findCodes(const uint64_t weights[NUM_SYMBOLS], CodeTable& codes) {
+	Entry entry;
+	if (!find(fingerprintKey(weights), entry)) return false;
+	codes = entry.codes;
+	return true;
+}
+
+/* Member function: addCodes
+ * ----------------------------------------------------
+ * Stores codes under the fingerprint of weights.
+ */
+void TableCache::addCodes(const uint64_t weights[NUM_SYMBOLS], const CodeTable& codes) {
+	Entry entry;
+	entry.key = fingerprintKey(weights);
+	entry.codes = codes;
+	add(entry);
+}
+
+/* Member function: findDecodeTable
+ * ----------------------------------------------------
+ * Looks up the exact lengths.
+ */
+bool TableCache::findDecodeTable(const uint8_t lengths[NUM_SYMBOLS], DecodeTable& table) {
+	Entry entry;
+	if (!find(lengthsKey(lengths), entry)) return false;
+	table = entry.table;
+	return true;
+}
+
+/* Member function: addDecodeTable
+ * ----------------------------------------------------
+ * Stores table under the exact lengths.
+ */
+void TableCache::addDecodeTable(const uint8_t lengths[NUM_SYMBOLS], const DecodeTable& table) {
+	Entry entry;
+	entry.key = lengthsKey(lengths);
+	entry.table = table;
+	add(entry);
+}
+
+/* Member function: findFsmDecoder
+ * ----------------------------------------------------
+ * Looks up the exact code words.
+ */
+bool TableCache::findFsmDecoder(const CodeTable& codes, FsmDecoder& machine) {
+	Entry entry;
+	if (!find(codesKey(codes), entry)) return false;
+	machine = entry.machine;
+	return true;
+}
+
+/* Member function: addFsmDecoder
+ * ----------------------------------------------------
+ * Stores machine under the exact code words.
+ */
+void TableCache::addFsmDecoder(const CodeTable& codes, const FsmDecoder& machine) {
+	Entry entry;
+	entry.key = codesKey(codes);
+	entry.machine = machine;
+	add(entry);
+}
+
+/* Member function: stats
+ * ----------------------------------------------------
+ * Copies the counters under the lock.
+ */
+TableCacheStats TableCache::stats() {
+	TableCacheStats result;
+	synchronized (lock) {
+		result = counts;
+	}
+	return result;
+}
+
+/* Member function: clear
+ * ----------------------------------------------------
+ * Empties the list and index and zeroes the counters.
+ */
+void TableCache::clear() {
+	synchronized (lock) {
+		MemoryCategoryScope scope(TABLE_MEMORY);
+		entries.clear();
+		index.clear();
+		counts.hits = counts.misses = counts.evictions = counts.entries = 0;
+		counts.bytes = 0;
+	}
+}
+
+/* Member function: find
+ * ----------------------------------------------------
+ * Copies out the entry for key, if there is one, and moves it to
+ * the front of the list, counting a hit or a miss.
+ */
+bool TableCache::find(const string& key, Entry& result) {
+	bool found = false;
+	synchronized (lock) {
+		map<string, EntryIterator>::iterator place = index.find(key);
+		if (place == index.end()) {
+			counts.misses++;
+		} else {
+			entries.splice(entries.begin(), entries, place->second);
+			result = *place->second;
+			counts.hits++;
+			found = true;
+		}
+	}
+	return found;
+}
+
+/* Member function: add
+ * ----------------------------------------------------
+ * Puts entry at the front of the list, replacing any entry with the
+ * same key, then drops entries from the back until the cache fits
+ * its capacity again.  An entry larger than the whole capacity is
+ * not kept at all.
+ */
+void TableCache::add(Entry& entry) {
+	entry.bytes = sizeof(Entry) + 2 * entry.key.size() + NODE_OVERHEAD +
+	              entry.table.entries.size() * sizeof(DecodeEntry) +
+	              entry.table.subtables.size() * sizeof(uint32_t) +
+	              entry.machine.memoryBytes();
+
+	synchronized (lock) {
+		MemoryCategoryScope scope(TABLE_MEMORY);
+		map<string, EntryIterator>::iterator place = index.find(entry.key);
+		if (place != index.end()) {
+			counts.bytes -= place->second->bytes;
+			counts.entries--;
+			entries.erase(place->second);
+			index.erase(place);
+		}
+
+		entries.push_front(entry);
+		index[entry.key] = entries.begin();
+		counts.bytes += entry.bytes;
+		counts.entries++;
+
+		while (counts.bytes > capacity && !entries.empty()) {
+			Entry& oldest = entries.back();
+			counts.bytes -= oldest.bytes;
+			counts.entries--;
+			counts.evictions++;
+			index.erase(oldest.key);
+			entries.pop_back();
+		}
+	}
+}
+
+/* Function: setTableCache
+ * Usage: setTableCache(&cache);
+ * --------------------------------------------------------
+ * Installs cache, or none.
+ */
+void setTableCache(TableCache* cache) {
+	gTableCache = cache;
+}
+
+/* Function: getTableCache
+ * Usage: TableCache* cache = getTableCache();
+ * --------------------------------------------------------
+ * Returns the installed cache.
+ */
+TableCache* getTableCache() {
+	return gTableCache;
+}
+
+/* Function: buildCachedCodeTable
+ * Usage: buildCachedCodeTable(weights, codes);
+ * --------------------------------------------------------
+ * Works the code out only when the cache does not have it.
+ */
+void buildCachedCodeTable(const uint64_t weights[NUM_SYMBOLS], CodeTable& codes) {
+	TableCache* cache = getTableCache();
+	if (cache != NULL && cache->findCodes(weights, codes)) return;
+
+	buildLimitedCodeLengths(weights, DEFAULT_MAX_CODE_LENGTH, codes.length);
+	buildCanonicalCodeTable(codes.length, codes);
+	if (cache != NULL) cache->addCodes(weights, codes);
+}
+
+/* Function: buildCachedDecodeTable
+ * Usage: buildCachedDecodeTable(lengths, table);
+ * --------------------------------------------------------
+ * Builds the tables only when the cache does not have them.
+ */
+void buildCachedDecodeTable(const uint8_t lengths[NUM_SYMBOLS], DecodeTable& table) {
+	TableCache* cache = getTableCache();
+	if (cache != NULL && cache->findDecodeTable(lengths, table)) return;
+
+	CodeTable codes;
+	buildCanonicalCodeTable(lengths, codes);
+	buildDecodeTable(codes, table);
+	if (cache != NULL) cache->addDecodeTable(lengths, table);
+}
+
+/* Function: buildCachedFsmDecoder
+ * Usage: buildCachedFsmDecoder(codes, machine);
+ * --------------------------------------------------------
+ * Builds the machine only when the cache does not have it.
+ */
+void buildCachedFsmDecoder(const CodeTable& codes, FsmDecoder& machine) {
+	TableCache* cache = getTableCache();
+	if (cache != NULL && cache->findFsmDecoder(codes, machine)) return;
+
+	machine = FsmDecoder(codes);
+	if (cache != NULL) cache->addFsmDecoder(codes, machine);
+}
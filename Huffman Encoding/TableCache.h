@@ -0,0 +1,210 @@
+/**********************************************************
+ * File: TableCache.h
+ *
+ * A cache of code tables and decode tables, for programs that
+ * compress and decompress many similar inputs.  Inputs with
+ * the same shape would otherwise have the same code worked
+ * out, and the same tables built, over and over.
+ *
+ * Code tables are found by a fingerprint of the frequencies:
+ * which characters appear, and roughly how often compared to
+ * the whole input.  Inputs with the same fingerprint share a
+ * code, which fits each of them nearly as well as its own:
+ * every character's share of the input is within a fraction
+ * of a bit of what the code was built for.  Decode tables
+ * are found by the exact code lengths they decode, and state
+ * machines (see HuffmanFsm.h) by the exact code words.
+ *
+ * Once a cache is installed with setTableCache, compress,
+ * decompress, the buffer functions and the block functions
+ * all use it.  Without one, nothing is cached and compress
+ * always uses each input's own code.
+ */
+
+#ifndef TableCache_Included
+#define TableCache_Included
+
+#include "HuffmanTypes.h"
+#include "HuffmanTables.h"
+#include "HuffmanFsm.h"
+#include "thread.h"
+#include <list>
+#include <map>
+#include <string>
+using namespace std;
+
+/* Constant: DEFAULT_TABLE_CACHE_BYTES
+ * How much memory a cache may hold unless told otherwise.
+ */
+const size_t DEFAULT_TABLE_CACHE_BYTES = 1 << 20;
+
+/* Constant: FINGERPRINT_STEPS
+ * How finely a fingerprint records a character's frequency: the
+ * number of steps per halving of its share of the input.
+ */
+const int FINGERPRINT_STEPS = 4;
+
+/* Type: TableCacheStats
+ * What a cache has done since it was made or cleared.  A lookup
+ * that finds a table is a hit, one that does not is a miss, and an
+ * eviction is a table dropped to stay within the capacity.
+ */
+struct TableCacheStats {
+	long hits;
+	long misses;
+	long evictions;
+	long entries;
+	size_t bytes;
+};
+
+/* Class: TableCache
+ * A least recently used cache of tables, bounded in bytes.  One
+ * cache may be used by any number of threads at the same time;
+ * tables are copied in and out under a lock, so callers never share
+ * a table with the cache.
+ */
+class TableCache {
+public:
+	/* Constructor: TableCache
+	 * Usage: TableCache cache;
+	 *        TableCache cache(capacityBytes);
+	 * ----------------------------------------------------
+	 * Creates an empty cache holding at most capacityBytes of tables
+	 * and bookkeeping.
+	 */
+	TableCache(size_t capacityBytes = DEFAULT_TABLE_CACHE_BYTES);
+
+	/* Member function: findCodes
+	 * Usage: if (cache.findCodes(weights, codes)) { ... }
+	 * ----------------------------------------------------
+	 * Looks for a code table stored for frequencies with the same
+	 * fingerprint as weights, indexed by ext_char.  If there is one,
+	 * copies it into codes and returns true.
+	 */
+	bool findCodes(const uint64_t weights[NUM_SYMBOLS], CodeTable& codes);
+
+	/* Member function: addCodes
+	 * Usage: cache.addCodes(weights, codes);
+	 * ----------------------------------------------------
+	 * Stores a copy of codes, which must give a code of at most
+	 * DEFAULT_MAX_CODE_LENGTH bits to every character of nonzero
+	 * weight, for the fingerprint of weights.
+	 */
+	void addCodes(const uint64_t weights[NUM_SYMBOLS], const CodeTable& codes);
+
+	/* Member function: findDecodeTable
+	 * Usage: if (cache.findDecodeTable(lengths, table)) { ... }
+	 * ----------------------------------------------------
+	 * Looks for a decode table stored for exactly these code
+	 * lengths.  If there is one, copies it into table and returns
+	 * true.
+	 */
+	bool findDecodeTable(const uint8_t lengths[NUM_SYMBOLS], DecodeTable& table);
+
+	/* Member function: addDecodeTable
+	 * Usage: cache.addDecodeTable(lengths, table);
+	 * ----------------------------------------------------
+	 * Stores a copy of table, which decodes the canonical code for
+	 * lengths.
+	 */
+	void addDecodeTable(const uint8_t lengths[NUM_SYMBOLS], const DecodeTable& table);
+
+	/* Member function: findFsmDecoder
+	 * Usage: if (cache.findFsmDecoder(codes, machine)) { ... }
+	 * ----------------------------------------------------
+	 * Looks for a state machine stored for exactly the code words
+	 * and lengths of codes.  If there is one, copies it into machine
+	 * and returns true.
+	 */
+	bool findFsmDecoder(const CodeTable& codes, FsmDecoder& machine);
+
+	/* Member function: addFsmDecoder
+	 * Usage: cache.addFsmDecoder(codes, machine);
+	 * ----------------------------------------------------
+	 * Stores a copy of machine, which decodes codes with the default
+	 * memory limit.
+	 */
+	void addFsmDecoder(const CodeTable& codes, const FsmDecoder& machine);
+
+	/* Member function: stats
+	 * Usage: TableCacheStats counts = cache.stats();
+	 * ----------------------------------------------------
+	 * Returns the counters and the current size of the cache.
+	 */
+	TableCacheStats stats();
+
+	/* Member function: clear
+	 * Usage: cache.clear();
+	 * ----------------------------------------------------
+	 * Drops every table and sets the counters back to zero.
+	 */
+	void clear();
+
+private:
+	/* Not copyable, since it owns a lock. */
+	TableCache(const TableCache&);
+	TableCache& operator=(const TableCache&);
+
+	struct Entry {
+		string key;
+		CodeTable codes;     /* for fingerprint keys */
+		DecodeTable table;   /* for code length keys */
+		FsmDecoder machine;  /* for code word keys */
+		size_t bytes;
+	};
+	typedef list<Entry>::iterator EntryIterator;
+
+	bool find(const string& key, Entry& result);
+	void add(Entry& entry);
+
+	size_t capacity;
+	list<Entry> entries;   /* most recently used first */
+	map<string, EntryIterator> index;
+	TableCacheStats counts;
+	Lock lock;
+};
+
+/* Function: setTableCache
+ * Usage: setTableCache(&cache);
+ * --------------------------------------------------------
+ * Installs the cache used from now on by every compress and
+ * decompress function, or none if cache is NULL, which is the
+ * default.  The cache must outlive its use.  Set it before
+ * starting threads that code.
+ */
+void setTableCache(TableCache* cache);
+
+/* Function: getTableCache
+ * Usage: TableCache* cache = getTableCache();
+ * --------------------------------------------------------
+ * Returns the cache installed by setTableCache, or NULL.
+ */
+TableCache* getTableCache();
+
+/* Function: buildCachedCodeTable
+ * Usage: buildCachedCodeTable(weights, codes);
+ * --------------------------------------------------------
+ * Fills in codes with the canonical code for the best code
+ * lengths of at most DEFAULT_MAX_CODE_LENGTH bits for weights, as
+ * buildLimitedCodeLengths and buildCanonicalCodeTable do, or from
+ * the installed cache if it has a code for the same fingerprint.
+ */
+void buildCachedCodeTable(const uint64_t weights[NUM_SYMBOLS], CodeTable& codes);
+
+/* Function: buildCachedDecodeTable
+ * Usage: buildCachedDecodeTable(lengths, table);
+ * --------------------------------------------------------
+ * Fills in table so that it decodes the canonical code for the
+ * given lengths, or copies it from the installed cache.
+ */
+void buildCachedDecodeTable(const uint8_t lengths[NUM_SYMBOLS], DecodeTable& table);
+
+/* Function: buildCachedFsmDecoder
+ * Usage: buildCachedFsmDecoder(codes, machine);
+ * --------------------------------------------------------
+ * Replaces machine with the state machine for codes, with the
+ * default memory limit, or copies it from the installed cache.
+ */
+void buildCachedFsmDecoder(const CodeTable& codes, FsmDecoder& machine);
+
+#endif
@@ -0,0 +1,269 @@
+/**********************************************************
+ * File: WorkPool.cpp
+ *
+ * Implementation of the WorkPool class from WorkPool.h.
+ */
+
+#include "WorkPool.h"
+#include "HuffmanBlocks.h"
+#include "error.h"
+
+#ifdef _MSC_VER
+#define THREAD_LOCAL __declspec(thread)
+#else
+#define THREAD_LOCAL __thread
+#endif
+
+/* The pool whose task the current thread is running, if any, and
+ * the index of the thread in that pool.
+ */
+static THREAD_LOCAL WorkPool* tCurrentPool = NULL;
+static THREAD_LOCAL int tCurrentIndex = 0;
+
+/* Constructor: WorkPool
+ * ----------------------------------------------------
+ * Makes one empty queue per thread.
+ */
+WorkPool::WorkPool(int numThreads)
+	: running(false), stopping(false), pending(0), queued(0), stolen(0), nextQueue(0), failed(false) {
+	if (numThreads < 0) error("Number of threads cannot be negative.");
+	if (numThreads == 0) numThreads = hardwareThreads();
+	for (int i = 0; i < numThreads; i++) {
+		Worker* worker = new Worker;
+		worker->pool = this;
+		worker->index = i;
+		workers.push_back(worker);
+	}
+}
+
+/* Destructor: ~WorkPool
+ * ----------------------------------------------------
+ * Wakes the waiting threads to tell them to end, joins them, and
+ * frees the queues.
+ */
+WorkPool::~WorkPool() {
+	synchronized (stateLock) {
+		stopping = true;
+		stateLock.signal();
+	}
+	for (size_t i = 1; i < threads.size(); i++) {
+		join(threads[i]);
+	}
+	for (size_t i = 0; i < workers.size(); i++) {
+		delete workers[i];
+	}
+}
+
+/* Member function: submit
+ * ----------------------------------------------------
+ * Counts the task as pending before it can be taken, so that no
+ * thread sees the pool as finished while it is being queued, and
+ * wakes the idle threads once it is on a queue.
+ */
+void WorkPool::submit(void (*fn)(void* data), void* data) {
+	Task task;
+	task.fn = fn;
+	task.data = data;
+
+	int index = 0;
+	synchronized (stateLock) {
+		pending++;
+		if (tCurrentPool == this) {
+			index = tCurrentIndex;
+		} else {
+			index = nextQueue;
+			nextQueue = (nextQueue + 1) % int(workers.size());
+		}
+	}
+
+	Worker* worker = workers[index];
+	synchronized (worker->lock) {
+		worker->tasks.push_back(task);
+	}
+	synchronized (stateLock) {
+		queued++;
+		stateLock.signal();
+	}
+}
+
+/* Member function: run
+ * ----------------------------------------------------
+ * Starts every thread but the first on the first call, lets them
+ * take tasks, and works as the first thread until nothing is
+ * pending.  The other threads go back to waiting by themselves.
+ */
+void WorkPool::run() {
+	if (threads.empty()) {
+		threads.resize(workers.size());
+		for (size_t i = 1; i < workers.size(); i++) {
+			threads[i] = fork(runWorker, *workers[i]);
+		}
+	}
+
+	synchronized (stateLock) {
+		running = true;
+		stateLock.signal();
+	}
+	WorkPool* outerPool = tCurrentPool;
+	int outerIndex = tCurrentIndex;
+	tCurrentPool = this;
+	tCurrentIndex = 0;
+	runTasks();
+	tCurrentPool = outerPool;
+	tCurrentIndex = outerIndex;
+
+	bool wasFailed = false;
+	string firstMessage;
+	synchronized (stateLock) {
+		running = false;
+		wasFailed = failed;
+		firstMessage = message;
+		failed = false;
+		message.clear();
+	}
+	if (wasFailed) error(firstMessage);
+}
+
+/* Member function: numThreads
+ * ----------------------------------------------------
+ * Returns the number of queues.
+ */
+int WorkPool::numThreads() const {
+	return int(workers.size());
+}
+
+/* Member function: steals
+ * ----------------------------------------------------
+ * Returns the steal count.
+ */
+long WorkPool::steals() {
+	long result = 0;
+	synchronized (stateLock) {
+		result = stolen;
+	}
+	return result;
+}
+
+/* Member function: isRunningTask
+ * ----------------------------------------------------
+ * Checks the pool the thread is marked as working for.
+ */
+bool WorkPool::isRunningTask() {
+	return tCurrentPool != NULL;
+}
+
+/* Member function: runWorker
+ * ----------------------------------------------------
+ * Thread body of every thread but the first: waits on the state
+ * lock until a run is under way and a task is queued, takes it if
+ * no other thread has, and goes back to waiting, until the pool
+ * is destroyed.  queued is checked under the lock that signals
+ * it, so no wakeup is missed, and it may briefly fall below zero
+ * when a task is taken before submit counts it.
+ */
+void WorkPool::runWorker(Worker& worker) {
+	WorkPool* pool = worker.pool;
+	tCurrentPool = pool;
+	tCurrentIndex = worker.index;
+
+	while (true) {
+		bool stop = false;
+		synchronized (pool->stateLock) {
+			while (!pool->stopping && (!pool->running || pool->queued <= 0)) {
+				pool->stateLock.wait();
+			}
+			stop = pool->stopping;
+		}
+		if (stop) break;
+
+		Task task;
+		if (pool->takeTask(worker.index, task)) pool->runTask(task);
+	}
+}
+
+/* Member function: runTasks
+ * ----------------------------------------------------
+ * Runs tasks on the calling thread, as the first thread, until
+ * nothing is pending anywhere.  When it finds no task while others
+ * are still running, it waits on the state lock, since those tasks
+ * may yet submit more; it is woken when a task is queued or the
+ * last one finishes.
+ */
+void WorkPool::runTasks() {
+	while (true) {
+		Task task;
+		if (takeTask(0, task)) {
+			runTask(task);
+			continue;
+		}
+
+		bool finished = false;
+		synchronized (stateLock) {
+			while (queued <= 0 && pending > 0) {
+				stateLock.wait();
+			}
+			finished = (pending == 0);
+		}
+		if (finished) break;
+	}
+}
+
+/* Member function: takeTask
+ * ----------------------------------------------------
+ * Takes the newest task of queue index, or failing that the oldest
+ * task of the next queue that has one.  Returns whether it found a
+ * task.
+ */
+bool WorkPool::takeTask(int index, Task& task) {
+	int count = int(workers.size());
+	for (int i = 0; i < count; i++) {
+		Worker* victim = workers[(index + i) % count];
+		bool found = false;
+		synchronized (victim->lock) {
+			if (!victim->tasks.empty()) {
+				if (i == 0) {
+					task = victim->tasks.back();
+					victim->tasks.pop_back();
+				} else {
+					task = victim->tasks.front();
+					victim->tasks.pop_front();
+				}
+				found = true;
+			}
+		}
+
+		if (found) {
+			synchronized (stateLock) {
+				queued--;
+				if (i != 0) stolen++;
+			}
+			return true;
+		}
+	}
+	return false;
+}
+
+/* Member function: runTask
+ * ----------------------------------------------------
+ * Runs one task, keeping the first error raised by any task, and
+ * counts it finished, waking the idle threads if it was the last.
+ */
+void WorkPool::runTask(Task& task) {
+	string taskMessage;
+	bool taskFailed = false;
+	try {
+		task.fn(task.data);
+	} catch (ErrorException& ex) {
+		taskFailed = true;
+		taskMessage = ex.getMessage();
+	}
+
+	synchronized (stateLock) {
+		if (taskFailed && !failed) {
+			failed = true;
+			message = taskMessage;
+		}
+		pending--;
+		if (pending == 0) stateLock.signal();
+	}
+}
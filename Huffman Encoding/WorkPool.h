@@ -0,0 +1,123 @@
+/**********************************************************
+ * File: WorkPool.h
+ *
+ * A work-stealing thread pool.  Every thread has its own
+ * queue of tasks.  A thread runs the newest task of its own
+ * queue first, which keeps a task's subtasks on the thread
+ * that made them, and when its queue is empty it steals the
+ * oldest task of another thread's queue, which tends to be
+ * the largest piece of work left there.  Threads therefore
+ * stay busy whether the work comes as a few large tasks that
+ * split themselves up or as many small ones.
+ *
+ * The pool is built on the fork, join and Lock of thread.h.
+ */
+
+#ifndef WorkPool_Included
+#define WorkPool_Included
+
+#include "thread.h"
+#include <deque>
+#include <string>
+#include <vector>
+using namespace std;
+
+/* Class: WorkPool
+ * Runs tasks on a fixed number of threads, the calling thread
+ * being one of them.  Tasks are submitted, then run() runs them
+ * all, and any tasks they submit in turn, before returning.  The
+ * other threads are started by the first run and wait for the next
+ * one in between, so a pool that is kept and run many times starts
+ * its threads only once.
+ */
+class WorkPool {
+public:
+	/* Constructor: WorkPool
+	 * Usage: WorkPool pool;
+	 *        WorkPool pool(numThreads);
+	 * ----------------------------------------------------
+	 * Creates a pool of numThreads threads; zero means one per
+	 * processor.  No threads are started until run is called.
+	 */
+	WorkPool(int numThreads = 0);
+	~WorkPool();
+
+	/* Member function: submit
+	 * Usage: pool.submit(fn, data);
+	 * ----------------------------------------------------
+	 * Adds a task that calls fn(data).  From inside a running task,
+	 * the new task goes on the queue of the thread running it; from
+	 * outside, tasks are dealt out to the queues in turn.  data must
+	 * stay valid until run returns.
+	 */
+	void submit(void (*fn)(void* data), void* data);
+
+	/* Member function: run
+	 * Usage: pool.run();
+	 * ----------------------------------------------------
+	 * Runs every task until none are left, then returns.  A task that
+	 * raises an error does not stop the others; once they have all
+	 * finished, the first error is raised again here.
+	 */
+	void run();
+
+	/* Member function: numThreads
+	 * Usage: int threads = pool.numThreads();
+	 * ----------------------------------------------------
+	 * Returns how many threads the pool runs tasks on.
+	 */
+	int numThreads() const;
+
+	/* Member function: steals
+	 * Usage: long stolen = pool.steals();
+	 * ----------------------------------------------------
+	 * Returns how many tasks have been taken from another thread's
+	 * queue so far.
+	 */
+	long steals();
+
+	/* Member function: isRunningTask
+	 * Usage: if (WorkPool::isRunningTask()) ...
+	 * ----------------------------------------------------
+	 * Returns whether the calling thread is running a task of any
+	 * pool, where starting a pool of its own would only add threads
+	 * to a machine that is already busy.
+	 */
+	static bool isRunningTask();
+
+private:
+	/* Not copyable, since it owns locks and its threads point back. */
+	WorkPool(const WorkPool&);
+	WorkPool& operator=(const WorkPool&);
+
+	struct Task {
+		void (*fn)(void* data);
+		void* data;
+	};
+
+	struct Worker {
+		WorkPool* pool;
+		int index;
+		deque<Task> tasks;   /* newest at the back */
+		Lock lock;
+	};
+
+	static void runWorker(Worker& worker);
+	void runTasks();
+	bool takeTask(int index, Task& task);
+	void runTask(Task& task);
+
+	vector<Worker*> workers;
+	vector<Thread> threads;   /* started by the first run */
+	Lock stateLock;       /* guards everything below */
+	bool running;         /* run has been called and not returned */
+	bool stopping;        /* the threads are to end */
+	long pending;         /* tasks submitted but not yet finished */
+	long queued;          /* tasks on the queues, not yet taken */
+	long stolen;
+	int nextQueue;
+	bool failed;
+	string message;
+};
+
+#endif
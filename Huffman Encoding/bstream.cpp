@@ -27,8 +27,12 @@ inline void SetNthBit(int n, int & inByte) { inByte |= (1 << n); }
  * "pos" is the bit position within curByte that is next to read
  * We set initial state for lastTell and curByte to 0, then pos is
  * set at 8 so that next readBit will trigger a fresh read.
+ * Bit buffering starts off, with an empty bit register ("bitBuffer",
+ * holding "bitCount" bits of which the top "padBits" are zero padding
+ * added after the stream ran out).
  */
-ibstream::ibstream() : istream(NULL), lastTell(0), curByte(0), pos(NUM_BITS_IN_BYTE) {}
+ibstream::ibstream() : istream(NULL), lastTell(0), curByte(0), pos(NUM_BITS_IN_BYTE),
+		buffering(false), bitBuffer(0), bitCount(0), padBits(0) {}
 
 /* Member function ibstream::readBit
  * ---------------------------------
@@ -38,6 +42,14 @@ ibstream::ibstream() : istream(NULL), lastTell(0), curByte(0), pos(NUM_BITS_IN_B
  * If read byte from file at EOF, return EOF.
  */
 int ibstream::readBit() {
+	if (buffering) {
+		if (bitCount - padBits <= 0) refillBits(1);
+		if (bitCount - padBits <= 0) return EOF;
+		int result = int(bitBuffer & 1);
+		bitBuffer >>= 1;
+		bitCount--;
+		return result;
+	}
 	if (!is_open()) error("Cannot read a bit from a stream that is not open.");
 	
 	// if just finished bits from curByte or if data read from stream after last readBit()
@@ -52,15 +64,104 @@ int ibstream::readBit() {
 	return result;
 }
 
+/* Member function ibstream::setBitBuffering
+ * -----------------------------------------
+ * Switching buffering off gives back every whole byte still in the
+ * register.  They were the last bytes read, so they can usually be put
+ * back one at a time; if the stream buffer refuses, we seek back over
+ * the rest instead.
+ */
+void ibstream::setBitBuffering(bool enabled) {
+	if (enabled == buffering) return;
+	if (enabled && !is_open()) error("Cannot buffer bits for a stream which is not open.");
+
+	if (!enabled) {
+		for (int unused = (bitCount - padBits) / NUM_BITS_IN_BYTE; unused > 0; unused--) {
+			if (rdbuf()->sungetc() == EOF) {
+				seekg(-unused, ios::cur);
+				break;
+			}
+		}
+	}
+	buffering = enabled;
+	bitBuffer = 0;
+	bitCount = 0;
+	padBits = 0;
+	pos = NUM_BITS_IN_BYTE;
+}
+
+/* Member function ibstream::isBitBuffering
+ * ----------------------------------------
+ * Reports the buffering flag.
+ */
+bool ibstream::isBitBuffering() {
+	return buffering;
+}
+
+/* Member function ibstream::refillBits
+ * ------------------------------------
+ * Slow path of peekBits and skipBits.  Tops the register up with as many
+ * whole bytes as fit, fetched from the stream buffer in one call.  Once
+ * the stream is exhausted, zero bytes are added instead and counted in
+ * padBits.
+ */
+void ibstream::refillBits(int nbits) {
+	if (!buffering) error("peekBits and skipBits require bit buffering to be on.");
+	if (nbits < 0 || nbits > MAX_PEEK_BITS) error("Can only peek or skip up to 57 bits at once.");
+
+	int room = (64 - bitCount) / NUM_BITS_IN_BYTE;
+	if (padBits == 0 && room > 0) {
+		unsigned char bytes[8];
+		streamsize got = rdbuf()->sgetn((char*) bytes, room);
+		for (streamsize i = 0; i < got; i++) {
+			bitBuffer |= uint64_t(bytes[i]) << bitCount;
+			bitCount += NUM_BITS_IN_BYTE;
+		}
+		if (got == room) return;
+	}
+	while (bitCount < nbits) {
+		bitCount += NUM_BITS_IN_BYTE;
+		padBits += NUM_BITS_IN_BYTE;
+	}
+}
+
+/* Member function ibstream::readBits
+ * ----------------------------------
+ * Peeks and skips when buffering; otherwise collects readBit results and
+ * flags the stream once they run out.
+ */
+uint64_t ibstream::readBits(int nbits) {
+	if (buffering) {
+		uint64_t result = peekBits(nbits);
+		skipBits(nbits);
+		return result;
+	}
+	if (nbits < 0 || nbits > MAX_PEEK_BITS) error("Can only read up to 57 bits at once.");
+
+	uint64_t result = 0;
+	for (int i = 0; i < nbits; i++) {
+		int bit = readBit();
+		if (bit == EOF) {
+			setstate(ios::failbit | ios::eofbit);
+			break;
+		}
+		result |= uint64_t(bit) << i;
+	}
+	return result;
+}
+
 /* Member function ibstream::rewind
  * ---------------------------------
  * Simply seeks back to beginning of file, so reading begins again
- * from start.
+ * from start.  Anything in the bit buffer is thrown away.
  */
 void ibstream::rewind() {
 	if (!is_open()) error("Cannot rewind stream which is not open.");
 	clear();
 	seekg(0, ios::beg);
+	bitBuffer = 0;
+	bitCount = 0;
+	padBits = 0;
 }
 
 /* Member function ibstream::size
@@ -69,14 +170,14 @@ void ibstream::rewind() {
  * In order to not disrupt reading, we also record cur streampos and
  * re-seek to there before returning.
  */
-long ibstream::size() {
+int64_t ibstream::size() {
 	if (!is_open()) error("Cannot get size of stream which is not open.");
 	clear();					// clear any error state
 	streampos cur = tellg();	// save current streampos
 	seekg(0, ios::end);			// seek to end
 	streampos end = tellg();	// get offset
 	seekg(cur);					// seek back to original pos
-	return long(end);
+	return int64_t(streamoff(end));
 }
 
 /* Member function ibstream::is_open
@@ -97,8 +198,11 @@ bool ibstream::is_open() {
  * "pos" is the bit position within curByte that is next to write
  * We set initial state for lastTell and curByte to 0, then pos is
  * set at 8 so that next writeBit will start a new byte.
+ * Bit buffering starts off, with an empty bit register ("bitBuffer",
+ * holding "bitCount" bits) and no bytes staged for the stream.
  */
-obstream::obstream() : ostream(NULL), lastTell(0), curByte(0), pos(NUM_BITS_IN_BYTE) {}
+obstream::obstream() : ostream(NULL), lastTell(0), curByte(0), pos(NUM_BITS_IN_BYTE),
+		buffering(false), bitBuffer(0), bitCount(0), numStaged(0) {}
 
 /* Member function obstream::writeBit
  * ----------------------------------
@@ -112,6 +216,10 @@ obstream::obstream() : ostream(NULL), lastTell(0), curByte(0), pos(NUM_BITS_IN_B
  */
 void obstream::writeBit(int bit) {
 	if (bit != 0 && bit != 1) error("writeBit expects argument which can be only 0 or 1.");
+	if (buffering) {
+		writeBits(bit, 1);
+		return;
+	}
 	if (!is_open()) error("Cannot writeBit to stream which is not open.");
 	
 		// if just filled curByte or if data written to stream after last writeBit()
@@ -133,20 +241,137 @@ void obstream::writeBit(int bit) {
 }
 
 
+/* Member function obstream::writeBits
+ * -----------------------------------
+ * Without buffering this is just a loop over writeBit.  With buffering,
+ * the bits are or-ed into bitBuffer above the bits already there.  The
+ * register never holds more than 31 bits between calls, so up to 32 new
+ * bits always fit; longer codes are added in two halves.  Every time the
+ * register reaches 32 bits, four whole bytes move to the staging area,
+ * which goes to the stream buffer in one call once it fills up.
+ */
+void obstream::writeBits(uint64_t code, int nbits) {
+	if (nbits < 0 || nbits > 64) error("writeBits expects between 0 and 64 bits.");
+	if (!buffering) {
+		for (int i = 0; i < nbits; i++)
+			writeBit(int((code >> i) & 1));
+		return;
+	}
+
+	if (nbits > 32) {
+		writeBits(code & 0xFFFFFFFFu, 32);
+		code >>= 32;
+		nbits -= 32;
+	}
+	code &= (uint64_t(1) << nbits) - 1;
+
+	bitBuffer |= code << bitCount;
+	bitCount += nbits;
+	if (bitCount >= 32) {
+		uint32_t word = uint32_t(bitBuffer);
+		staged[numStaged++] = char(word);
+		staged[numStaged++] = char(word >> 8);
+		staged[numStaged++] = char(word >> 16);
+		staged[numStaged++] = char(word >> 24);
+		bitBuffer >>= 32;
+		bitCount -= 32;
+		if (numStaged == sizeof staged) drainBits();
+	}
+}
+
+/* Member function obstream::setBitBuffering
+ * -----------------------------------------
+ * Switching buffering off flushes first so that no bits are lost.
+ * Switching it on starts a fresh byte, just as writeBit does after
+ * other output.
+ */
+void obstream::setBitBuffering(bool enabled) {
+	if (enabled == buffering) return;
+	if (enabled && !is_open()) error("Cannot buffer bits for a stream which is not open.");
+	flushBits();
+	buffering = enabled;
+	pos = NUM_BITS_IN_BYTE;
+}
+
+/* Member function obstream::isBitBuffering
+ * ----------------------------------------
+ * Reports the buffering flag.
+ */
+bool obstream::isBitBuffering() {
+	return buffering;
+}
+
+/* Member function obstream::flushBits
+ * -----------------------------------
+ * Moves every bit in the register into the staging area, padding the
+ * last byte with zeros, and writes the staging area to the stream.
+ */
+void obstream::flushBits() {
+	if (!buffering) return;
+	while (bitCount > 0) {
+		staged[numStaged++] = char(bitBuffer);
+		bitBuffer >>= NUM_BITS_IN_BYTE;
+		bitCount -= NUM_BITS_IN_BYTE;
+		if (numStaged == sizeof staged) drainBits();
+	}
+	bitBuffer = 0;
+	bitCount = 0;
+	drainBits();
+}
+
+/* Member function obstream::drainBits
+ * -----------------------------------
+ * Hands the staged bytes to the stream buffer in a single call, putting
+ * the stream into a bad state if they could not all be written.
+ */
+void obstream::drainBits() {
+	if (numStaged == 0) return;
+	if (rdbuf() == NULL || rdbuf()->sputn(staged, numStaged) != numStaged)
+		setstate(ios::badbit);
+	numStaged = 0;
+}
+
+/* Member function obstream::pendingBits
+ * -------------------------------------
+ * Copies the staged bytes, then the register contents rounded up to a
+ * whole number of bytes.
+ */
+string obstream::pendingBits() {
+	string result(staged, numStaged);
+	uint64_t bits = bitBuffer;
+	for (int count = bitCount; count > 0; count -= NUM_BITS_IN_BYTE) {
+		result += char(bits);
+		bits >>= NUM_BITS_IN_BYTE;
+	}
+	return result;
+}
+
 /* Member function obstream::size
  * ------------------------------
  * Seek to file end and use tell to retrieve position.
  * In order to not disrupt writing, we also record cur streampos and
- * re-seek to there before returning.
+ * re-seek to there before returning.  Bits still in the bit buffer are
+ * written out as far as whole bytes go and the rest are counted as one
+ * partial byte, like writeBit would have left it.
  */
-long obstream::size() {
+int64_t obstream::size() {
 	if (!is_open()) error("Cannot get size of stream which is not open.");
+	int64_t pending = 0;
+	if (buffering) {
+		while (bitCount >= NUM_BITS_IN_BYTE) {
+			staged[numStaged++] = char(bitBuffer);
+			bitBuffer >>= NUM_BITS_IN_BYTE;
+			bitCount -= NUM_BITS_IN_BYTE;
+		}
+		drainBits();
+		if (bitCount > 0) pending = 1;
+	}
 	clear();					// clear any error state
 	streampos cur = tellp();	// save current streampos
 	seekp(0, ios::end);			// seek to end
 	streampos end = tellp();	// get offset
 	seekp(cur);					// seek back to original pos
-	return long(end);
+	return int64_t(streamoff(end)) + pending;
 }
 
 /* Member function obstream::is_open
@@ -273,6 +498,69 @@ bool ofbstream::is_open() {
  * Closes the given file.
  */
 void ofbstream::close() {
+	flushBits();
+	if (!fb.close())
+		setstate(ios::failbit);
+}
+
+/* Constructor fbstream::fbstream
+ * -------------------------------------------
+ * Wires up the stream class so that it knows to read and
+ * write data on disk.
+ */
+fbstream::fbstream() : iostream(NULL) {
+	init(&fb);
+}
+
+/* Constructor fbstream::fbstream
+ * -------------------------------------------
+ * Wires up the stream class so that it knows to read and
+ * write data on disk, then opens the given file.
+ */
+fbstream::fbstream(const char* filename) : iostream(NULL) {
+	init(&fb);
+	open(filename);
+}
+fbstream::fbstream(string filename) : iostream(NULL) {
+	init(&fb);
+	open(filename);
+}
+
+/* Member function fbstream::open
+ * -------------------------------------------
+ * Attempts to open the specified file in place, failing if
+ * unable to do so.  Asking for both reading and writing is
+ * what keeps the file from being emptied.
+ */
+void fbstream::open(const char* filename) {
+	if (endsWith(filename, ".cpp") || endsWith(filename, ".h") ||
+			endsWith(filename, ".hh") || endsWith(filename, ".cc")) {
+		cerr << "It is potentially extremely dangerous to write to file "
+				 << filename << ", because that might be your own source code.	"
+				 << "We're explicitly disallowing this operation.	 Please choose a "
+				 << "different filename." << endl;
+		setstate(ios::failbit);
+	} else if (!fb.open(filename, ios::in | ios::out | ios::binary)) {
+		setstate(ios::failbit);
+	}
+}
+void fbstream::open(string filename) {
+	open(filename.c_str());
+}
+
+/* Member function fbstream::is_open
+ * -------------------------------------------
+ * Determines whether the file stream is open.
+ */
+bool fbstream::is_open() {
+	return fb.is_open();
+}
+
+/* Member function fbstream::close
+ * -------------------------------------------
+ * Closes the given file.
+ */
+void fbstream::close() {
 	if (!fb.close())
 		setstate(ios::failbit);
 }
@@ -306,8 +594,9 @@ ostringbstream::ostringbstream() {
 
 /* Member function ostringbstream::str
  * -------------------------------------------
- * Retrives the underlying string data.
+ * Retrives the underlying string data, plus whatever the bit buffer
+ * still holds.
  */
 string ostringbstream::str() {
-	return sb.str();
+	return sb.str() + pendingBits();
 }
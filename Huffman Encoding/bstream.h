@@ -9,10 +9,15 @@
  * The idea is that you can substitute an ibstream in place of an
  * istream and use the same operations (get, fail, >>, etc.) 
  * along with added member functions of readBit, rewind, and size.
+ * An ibstream can also read ahead into a 64-bit bit buffer, which
+ * allows peeking at and skipping several bits at once; see
+ * setBitBuffering.
  *
  * Similarly, the obstream can be used in place of ofstream, and has
  * same operations (put, fail, <<, etc.) along with additional
- * member functions writebit and size.
+ * member functions writebit and size.  An obstream can also collect
+ * bits in a 64-bit buffer and hand them to the underlying stream a
+ * block at a time; see setBitBuffering.
  *
  * There are two subclasses of ibstream: ifbstream and istringbstream,
  * which are similar to the ifstream and istringstream classes.	 The
@@ -27,6 +32,7 @@
 #include <ostream>
 #include <fstream>
 #include <sstream>
+#include "HuffmanTypes.h"
 using namespace std;
 
 /*
@@ -40,6 +46,13 @@ using namespace std;
  * You will probably not create instances of this class directly.	 Instead, you
  * will create ifbstreams or istringbstreams to read from files or string buffers.
  */
+/*
+ * Constant: MAX_PEEK_BITS
+ * -----------------------
+ * The most bits that peekBits, skipBits and readBits handle in one call.
+ */
+const int MAX_PEEK_BITS = 57;
+
 class ibstream: public istream {
 public:
 	/*
@@ -60,6 +73,64 @@ public:
 	 * Raises an error if this ibstream has not been properly opened.
 	 */
 	int readBit();
+
+	/*
+	 * Member function: setBitBuffering
+	 * Usage: in.setBitBuffering(true);
+	 * --------------------------------
+	 * Turns bit buffering on or off.  By default it is off, and readBit
+	 * fetches one byte at a time, so readBit and >> can be mixed freely.
+	 * With buffering on, the stream reads several bytes at a time into a
+	 * 64-bit bit buffer, and peekBits and skipBits become available.
+	 * While buffering is on, the underlying stream runs up to eight bytes
+	 * ahead of the bits consumed; do not use >> or get until buffering
+	 * is turned off again.  Turning it off drops the rest of the current
+	 * byte and hands the bytes read ahead back to the stream, so that
+	 * the next byte read is the one after the last bit consumed.
+	 * Raises an error if this ibstream has not been properly opened.
+	 */
+	void setBitBuffering(bool enabled);
+
+	/*
+	 * Member function: isBitBuffering
+	 * Usage: if (in.isBitBuffering()) { ... }
+	 * ---------------------------------------
+	 * Returns whether bit buffering is turned on.
+	 */
+	bool isBitBuffering();
+
+	/*
+	 * Member function: peekBits
+	 * Usage: uint64_t bits = in.peekBits(11);
+	 * ---------------------------------------
+	 * Returns the next nbits bits (at most MAX_PEEK_BITS) without
+	 * consuming them.  The first bit is in the lowest position, just as
+	 * if each had been read by readBit in turn.  Past the end of the
+	 * stream, the missing bits read as zero.  Raises an error if bit
+	 * buffering is off.
+	 */
+	uint64_t peekBits(int nbits);
+
+	/*
+	 * Member function: skipBits
+	 * Usage: in.skipBits(length);
+	 * ---------------------------
+	 * Consumes the next nbits bits (at most MAX_PEEK_BITS).  Skipping
+	 * past the end of the stream puts it into a fail state.  Raises an
+	 * error if bit buffering is off.
+	 */
+	void skipBits(int nbits);
+
+	/*
+	 * Member function: readBits
+	 * Usage: uint64_t bits = in.readBits(nbits);
+	 * ------------------------------------------
+	 * Reads and consumes the next nbits bits (at most MAX_PEEK_BITS),
+	 * first bit lowest.  Without bit buffering this is a loop over
+	 * readBit.  Reading past the end of the stream returns zero for the
+	 * missing bits and puts the stream into a fail state.
+	 */
+	uint64_t readBits(int nbits);
 	
 	/*
 	 * Member function: rewind
@@ -67,7 +138,7 @@ public:
 	 * -------------------
 	 * Rewinds the ibstream back to the beginning so that subsequent reads
 	 * start again from the beginning.	Raises an error if this ibstream 
-	 * has not been properly opened.
+	 * has not been properly opened.  Empties the bit buffer, if any.
 	 */
 	void rewind();
 	
@@ -75,10 +146,11 @@ public:
 	 * Member function: size
 	 * Usage: sz = in.size();
 	 * ----------------------
-	 * Returns the size in bytes of the data attached to this stream.
+	 * Returns the size in bytes of the data attached to this stream,
+	 * as 64 bits so that files past 2 GB report their true size.
 	 * Raises an error if this ibstream has not been properly opened.
 	 */
-	long size();
+	int64_t size();
 	
 	/*
 	 * Member function: is_open()
@@ -93,6 +165,13 @@ public:
 private:
 	int pos, curByte;
 	streampos lastTell;
+
+	/* State for bit buffering. */
+	void refillBits(int nbits);
+	bool buffering;
+	uint64_t bitBuffer;
+	int bitCount;
+	int padBits;
 };
 
 
@@ -126,15 +205,60 @@ public:
 	 * Raises an error if this ibstream has not been properly opened.
 	 */
 	void writeBit(int bit);
+
+	/*
+	 * Member function: writeBits
+	 * Usage: out.writeBits(code, length);
+	 * -----------------------------------
+	 * Writes the low nbits bits of code (0 to 64 of them), lowest bit
+	 * first, exactly as if each had been passed to writeBit in turn.
+	 * Raises an error if nbits is out of range.
+	 */
+	void writeBits(uint64_t code, int nbits);
+
+	/*
+	 * Member function: setBitBuffering
+	 * Usage: out.setBitBuffering(true);
+	 * ---------------------------------
+	 * Turns bit buffering on or off.  By default it is off, and every
+	 * bit is written to the stream as soon as writeBit is called, so
+	 * writeBit and << can be mixed freely.  With buffering on, bits
+	 * are collected in a 64-bit register and handed to the stream a
+	 * block of bytes at a time, which is much faster, but they only
+	 * reach the stream when flushBits is called.  Call flushBits
+	 * before using << or put on a buffering stream.  Turning buffering
+	 * off flushes any pending bits.
+	 */
+	void setBitBuffering(bool enabled);
+
+	/*
+	 * Member function: isBitBuffering
+	 * Usage: if (out.isBitBuffering()) { ... }
+	 * ----------------------------------------
+	 * Returns whether bit buffering is turned on.
+	 */
+	bool isBitBuffering();
+
+	/*
+	 * Member function: flushBits
+	 * Usage: out.flushBits();
+	 * -----------------------
+	 * Writes all buffered bits to the stream, padding the final partial
+	 * byte with zero bits.  The next bit written starts a new byte.
+	 * Does nothing if bit buffering is off.
+	 */
+	void flushBits();
 	
 	/*
 	 * Member function: size
 	 * Usage: sz = in.size();
 	 * ----------------------
 	 * Returns the size in bytes of the file attached to this stream.
+	 * Bits still held by the bit buffer count toward the size, which
+	 * is 64 bits wide like ibstream::size.
 	 * Raises an error if this obstream has not been properly opened.
 	 */
-	long size();
+	int64_t size();
 	
 	/*
 	 * Member function: is_open()
@@ -145,10 +269,28 @@ public:
 	 * returns true.
 	 */
 	virtual bool is_open();
+
+protected:
+	/*
+	 * Member function: pendingBits
+	 * Usage: string tail = pendingBits();
+	 * -----------------------------------
+	 * Returns the bytes that flushBits would write right now, without
+	 * writing them.
+	 */
+	string pendingBits();
 	
 private:
 	int pos, curByte;
 	streampos lastTell;
+
+	/* State for bit buffering. */
+	void drainBits();
+	bool buffering;
+	uint64_t bitBuffer;
+	int bitCount;
+	char staged[512];
+	int numStaged;
 };
 
 /*
@@ -277,6 +419,73 @@ public:
 	 * Member function: close();
 	 * Usage: ifb.close();
 	 * --------------------------
+	 * Flushes any buffered bits, then closes the currently-opened file,
+	 * if the stream is open.	 If the stream is not open, puts the
+	 * stream into a fail state.
+	 */
+	void close();
+
+private:
+	/* The actual file buffer which does reading and writing. */
+	filebuf fb;
+};
+
+/*
+ * Class: fbstream
+ * ---------------
+ * A class for updating a file that already exists, reading it and
+ * writing it in place.  Unlike an ofbstream, opening the file does
+ * not empty it, and unlike an fstream opened for appending, writes
+ * go wherever the stream is positioned.  There is no bit-level
+ * support.  As with ofbstream, source files cannot be opened.
+ */
+
+class fbstream: public iostream {
+public:
+	/*
+	 * Constructor: fbstream();
+	 * Usage: fbstream fb;
+	 * -------------------------
+	 * Constructs a new fbstream not attached to any file.	You can
+	 * open a file using the .open() member functions.
+	 */
+	fbstream();
+
+	/*
+	 * Constructor: fbstream(const char* filename);
+	 * Constructor: fbstream(string filename);
+	 * Usage: fbstream fb("filename");
+	 * -------------------------
+	 * Constructs a new fbstream that updates the specified file, if
+	 * it exists.	 If not, the stream enters an error state.
+	 */
+	fbstream(const char* filename);
+	fbstream(string filename);
+
+	/*
+	 * Member function: open(const char* filename);
+	 * Member function: open(string filename);
+	 * Usage: fb.open("my-file.txt");
+	 * -------------------------
+	 * Opens the specified file for reading and writing.	If it does
+	 * not exist or cannot be written, the stream enters a failure
+	 * state, which can be detected by calling fb.fail().
+	 */
+	void open(const char* filename);
+	void open(string filename);
+
+	/*
+	 * Member function: is_open();
+	 * Usage: if (fb.is_open()) { ... }
+	 * --------------------------
+	 * Returns whether or not this fbstream is connected to a file.
+	 */
+	bool is_open();
+
+	/*
+	 * Member function: close();
+	 * Usage: fb.close();
+	 * --------------------------
 	 * Closes the currently-opened file, if the stream is open.	 If the
 	 * stream is not open, puts the stream into a fail state.
 	 */
@@ -338,7 +547,8 @@ public:
 	/* Member function: string str();
 	 * Usage: cout << osb.str() << endl;
 	 * ----------------------------
-	 * Retrieves the underlying string of the istringbstream.
+	 * Retrieves the underlying string of the istringbstream, including
+	 * any bits still held by the bit buffer.
 	 */
 	string str();
 	
@@ -347,4 +557,21 @@ private:
 	stringbuf sb;
 };
 
+/*
+ * The bit-buffered read operations are called once per code word by the
+ * decoders, so the common case where the buffer already holds enough
+ * bits is defined inline here.
+ */
+inline uint64_t ibstream::peekBits(int nbits) {
+	if (bitCount < nbits) refillBits(nbits);
+	return bitBuffer & ((uint64_t(1) << nbits) - 1);
+}
+
+inline void ibstream::skipBits(int nbits) {
+	if (bitCount < nbits) refillBits(nbits);
+	bitBuffer >>= nbits;
+	bitCount -= nbits;
+	if (bitCount < padBits) setstate(ios::failbit | ios::eofbit);
+}
+
 #endif